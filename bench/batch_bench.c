@@ -0,0 +1,120 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+#include "bench.h"
+
+#define LANES   256
+#define CYCLES  1000000         // per lane
+#define STAGGER 1009            // cycles lane i runs ahead in the staggered runs
+
+static uint8_t image[0x10000];
+static uint8_t (*memory)[0x10000];
+static struct cpu cpus[LANES];
+static uint64_t instructions;
+
+// Every lane starts on the functional test. Staggered lanes are first run
+// apart so that no two are at the same point in it.
+static void setup(int stagger) {
+    for (size_t i = 0; i < LANES; i++) {
+        memcpy(memory[i], image, sizeof(image));
+        cpu_init(&cpus[i], BENCH_START);
+
+        if (stagger) {
+            struct bus bus = bench_flat_bus(memory[i]);
+            cpu_run_fast(&cpus[i], &bus, i * STAGGER);
+        }
+    }
+}
+
+static void bench_loops(const char *name, int fast, int stagger) {
+    setup(stagger);
+
+    uint64_t cycles = 0;
+    instructions = 0;
+
+    double start = bench_now();
+    for (size_t i = 0; i < LANES; i++) {
+        struct bus bus = bench_flat_bus(memory[i]);
+        uint64_t ran = 0;
+
+        while (ran < CYCLES) {
+            if (fast) {
+                ran += cpu_step_fast(&cpus[i], &bus);
+            } else {
+                do {
+                    cpu_tick(&cpus[i], &bus);
+                    ran++;
+                } while (cpus[i].cycle != 0);
+            }
+            instructions++;
+        }
+
+        cycles += ran;
+    }
+    double seconds = bench_now() - start;
+
+    bench_report(name, instructions, cycles, seconds);
+}
+
+// Runs after bench_loops() with the same stagger, and checks that every lane
+// ends where the loops left it.
+static void bench_batch(const char *name, int stagger) {
+    struct cpu expected[LANES];
+    memcpy(expected, cpus, sizeof(cpus));
+
+    setup(stagger);
+
+    struct batch *batch = batch_create(LANES);
+    if (batch == NULL) {
+        printf("ERROR: batch_create failed\n");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < LANES; i++) {
+        batch_write(batch, i, 0x0000, memory[i], sizeof(image));
+        batch_set(batch, i, &cpus[i]);
+    }
+
+    double start = bench_now();
+    uint64_t cycles = batch_run(batch, CYCLES);
+    double seconds = bench_now() - start;
+
+    for (size_t i = 0; i < LANES; i++) {
+        struct cpu lane;
+        batch_get(batch, i, &lane);
+
+        if (lane.pc != expected[i].pc) {
+            printf("ERROR: lane %zu stopped at 0x%04X, expected 0x%04X\n", i, lane.pc, expected[i].pc);
+            batch_destroy(batch);
+            return;
+        }
+    }
+
+    batch_destroy(batch);
+
+    bench_report(name, instructions, cycles, seconds);
+}
+
+int main(void) {
+    printf("[%s, %d lanes]\n", BENCH_CONFIG, LANES);
+
+    memory = malloc(LANES * sizeof(*memory));
+    if (memory == NULL) {
+        printf("ERROR: out of memory\n");
+        return 1;
+    }
+
+    bench_load(image);
+
+    bench_loops("cpu_step x N", 0, 0);
+    bench_loops("cpu_step_fast x N", 1, 0);
+    bench_batch("batch_run (lockstep)", 0);
+
+    bench_loops("cpu_step_fast x N", 1, 1);
+    bench_batch("batch_run (staggered)", 1);
+
+    free(memory);
+
+    return 0;
+}
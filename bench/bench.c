@@ -0,0 +1,53 @@
+#include <stdlib.h>
+#include <time.h>
+
+#include "bench.h"
+
+static uint8_t peek(void *inst, uint16_t addr) {
+    uint8_t *mem = (uint8_t *)inst;
+
+    return mem[addr];
+}
+
+static void poke(void *inst, uint16_t addr, uint8_t data) {
+    uint8_t *mem = (uint8_t *)inst;
+
+    mem[addr] = data;
+}
+
+void bench_load(uint8_t *memory) {
+    FILE *bin = fopen(BENCH_IMAGE, "r");
+    if (bin == NULL) {
+        printf("ERROR: unable to open %s\n", BENCH_IMAGE);
+        exit(1);
+    }
+
+    size_t bytes_read = fread(memory, 1, 0x10000, bin);
+    fclose(bin);
+
+    if (bytes_read != 0x10000) {
+        printf("ERROR: %s is not 0x10000 bytes\n", BENCH_IMAGE);
+        exit(1);
+    }
+}
+
+struct bus bench_flat_bus(uint8_t *memory) {
+    struct bus bus = {
+        .inst = memory,
+        .peek = peek,
+        .poke = poke
+    };
+
+    return bus;
+}
+
+double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void bench_report(const char *name, uint64_t instructions, uint64_t cycles, double seconds) {
+    printf("%-24s %8.2f MIPS %9.2f MHz %8.3f s\n",
+        name, instructions / seconds / 1e6, cycles / seconds / 1e6, seconds);
+}
@@ -0,0 +1,47 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "bus.h"
+#include "cpu.h"
+
+// Workload for all benchmarks: Klaus Dormann's functional test, run from
+// 0x0400 until it traps at BENCH_DONE_PC. Without decimal mode the 2A03
+// fails the decimal tests at the very end and traps there instead.
+#define BENCH_IMAGE   "./test/6502_functional_test/6502_functional_test.bin"
+#define BENCH_START   0x0400
+
+#ifdef CPU_2A03
+#define BENCH_DONE_PC 0x3477
+#else
+#define BENCH_DONE_PC 0x3469
+#endif
+
+// Build options that change the core, printed ahead of each run
+#if defined(CPU_2A03)
+#define BENCH_CPU "2A03"
+#elif defined(CPU_65C02)
+#define BENCH_CPU "65C02"
+#else
+#define BENCH_CPU "6502"
+#endif
+
+#ifdef CPU_LAZY_FLAGS
+#define BENCH_CONFIG BENCH_CPU ", lazy flags"
+#else
+#define BENCH_CONFIG BENCH_CPU ", eager flags"
+#endif
+
+// Loads the 64K test image into memory, exits on failure.
+void bench_load(uint8_t *memory);
+
+// A bus over a flat 64K array.
+struct bus bench_flat_bus(uint8_t *memory);
+
+double bench_now(void);
+
+void bench_report(const char *name, uint64_t instructions, uint64_t cycles, double seconds);
+
+#endif
@@ -0,0 +1,108 @@
+#include "bench.h"
+
+#define IO_PAGE 0xC000          // a page of device registers the workload never touches
+
+static uint8_t memory[0x10000];
+static uint8_t io[0x100];
+
+// filled in by the first cpu_step_fast() run
+static uint64_t total_instructions;
+static uint64_t total_cycles;
+
+// A callback that decodes the address the way a machine with I/O would
+static uint8_t ranged_peek(void *inst, uint16_t addr) {
+    if (addr >= IO_PAGE && addr < IO_PAGE + 0x100) {
+        return io[addr & 0xFF];
+    }
+
+    return ((uint8_t *)inst)[addr];
+}
+
+static void ranged_poke(void *inst, uint16_t addr, uint8_t data) {
+    if (addr >= IO_PAGE && addr < IO_PAGE + 0x100) {
+        io[addr & 0xFF] = data;
+        return;
+    }
+
+    ((uint8_t *)inst)[addr] = data;
+}
+
+static struct bus make_bus(int kind) {
+    struct bus bus = bench_flat_bus(memory);
+
+    if (kind > 0) {
+        bus.peek = ranged_peek;
+        bus.poke = ranged_poke;
+    }
+
+    if (kind > 1) {
+        bus_map(&bus, 0x0000, 0x10000, memory);
+        bus_unmap(&bus, IO_PAGE, 0x100);
+    }
+
+    return bus;
+}
+
+static const char *names[] = { "flat", "ranged", "pages" };
+
+static void bench_step_fast(int kind) {
+    bench_load(memory);
+    struct bus bus = make_bus(kind);
+
+    struct cpu cpu;
+    cpu_init(&cpu, BENCH_START);
+
+    uint64_t instructions = 0;
+    uint64_t cycles = 0;
+    uint16_t prev_pc;
+
+    double start = bench_now();
+    do {
+        prev_pc = cpu.pc;
+        cycles += cpu_step_fast(&cpu, &bus);
+        instructions++;
+    } while (prev_pc != cpu.pc);
+    double seconds = bench_now() - start;
+
+    char name[32];
+    snprintf(name, sizeof(name), "step_fast (%s)", names[kind]);
+    bench_report(name, instructions, cycles, seconds);
+
+    total_instructions = instructions;
+    total_cycles = cycles;
+}
+
+static void bench_run_fast(int kind) {
+    bench_load(memory);
+    struct bus bus = make_bus(kind);
+
+    struct cpu cpu;
+    cpu_init(&cpu, BENCH_START);
+
+    double start = bench_now();
+    uint64_t cycles = cpu_run_fast(&cpu, &bus, total_cycles);
+    double seconds = bench_now() - start;
+
+    if (cpu.pc != BENCH_DONE_PC) {
+        printf("ERROR: cpu_run_fast stopped at 0x%04X\n", cpu.pc);
+        return;
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "run_fast (%s)", names[kind]);
+    bench_report(name, total_instructions, cycles, seconds);
+}
+
+int main(void) {
+    printf("[%s]\n", BENCH_CONFIG);
+
+    for (int kind = 0; kind < 3; kind++) {
+        bench_step_fast(kind);
+    }
+
+    for (int kind = 0; kind < 3; kind++) {
+        bench_run_fast(kind);
+    }
+
+    return 0;
+}
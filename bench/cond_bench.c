@@ -0,0 +1,114 @@
+#include "bench.h"
+#include "cond.h"
+
+#define BREAKPOINTS 1000
+
+static uint8_t memory[0x10000];
+
+// instructions the functional test executes, by address
+static uint8_t executed[0x10000];
+
+// filled in by count_instructions()
+static uint64_t total_instructions;
+
+static void count_instructions(void) {
+    bench_load(memory);
+    struct bus bus = bench_flat_bus(memory);
+
+    struct cpu cpu;
+    cpu_init(&cpu, BENCH_START);
+
+    uint16_t prev_pc;
+    do {
+        prev_pc = cpu.pc;
+        executed[cpu.pc] = 1;
+        cpu_step_fast(&cpu, &bus);
+        total_instructions++;
+    } while (prev_pc != cpu.pc);
+}
+
+// Never true, so the test runs to the end: A is never both, and no byte is
+// above 255
+static const char *conditions[] = {
+    "A == $FF && mem[$D012] > 255",
+    "mem[$0200 + X] > 255 || hits < 0",
+    "(A ^ X) == $100 && C",
+};
+
+// Spreads the breakpoints evenly over the executed addresses
+static void add_breakpoints(struct cond_set *set) {
+    int n = 0;
+    for (int addr = 0; addr < 0x10000; addr++) {
+        n += executed[addr];
+    }
+
+    int step = n > BREAKPOINTS ? n / BREAKPOINTS : 1;
+    int added = 0;
+    int seen = 0;
+
+    for (int addr = 0; addr < 0x10000 && added < BREAKPOINTS; addr++) {
+        if (!executed[addr] || seen++ % step != 0) {
+            continue;
+        }
+
+        if (cond_set_add(set, WATCH_EXEC, addr, conditions[added % 3], NULL, 0) != 0) {
+            printf("ERROR: condition doesn't compile\n");
+            return;
+        }
+        added++;
+    }
+}
+
+// Runs the functional test with no watch, an armed watch with nothing set,
+// or BREAKPOINTS conditional breakpoints. Returns the seconds taken.
+static double bench_run(const char *name, int watched, int breakpoints) {
+    bench_load(memory);
+    struct bus bus = bench_flat_bus(memory);
+
+    static struct cpu_watch watch;
+    cpu_watch_init(&watch);
+
+    struct cond_set *set = cond_set_create(&watch);
+    if (breakpoints) {
+        add_breakpoints(set);
+    }
+
+    struct cpu cpu;
+    cpu_init(&cpu, BENCH_START);
+    cpu.watch = watched ? &watch : NULL;
+
+    double start = bench_now();
+    struct cpu_result result = cpu_run(&cpu, &bus, UINT64_MAX);
+    double seconds = bench_now() - start;
+
+    uint64_t evals = cond_set_evals(set);
+    cond_set_destroy(set);
+
+    if (result.reason != CPU_STOP_TRAP || cpu.pc != BENCH_DONE_PC) {
+        printf("ERROR: cpu_run stopped (%d) at 0x%04X\n", result.reason, cpu.pc);
+        return seconds;
+    }
+
+    bench_report(name, total_instructions, result.cycles, seconds);
+
+    if (breakpoints) {
+        printf("    %llu conditions evaluated, %.1f%% of instructions\n",
+            (unsigned long long)evals, 100.0 * evals / total_instructions);
+    }
+
+    return seconds;
+}
+
+int main(void) {
+    printf("Conditional breakpoints (%s)\n", BENCH_CONFIG);
+
+    count_instructions();
+
+    bench_run("cpu_run", 0, 0);
+    double armed = bench_run("cpu_run (watch armed)", 1, 0);
+    double conditional = bench_run("cpu_run (conditions)", 1, 1);
+
+    printf("    %.1f%% slower than with the watch armed\n", 100.0 * (conditional - armed) / armed);
+
+    return 0;
+}
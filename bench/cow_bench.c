@@ -0,0 +1,61 @@
+#include "bench.h"
+#include "cow.h"
+
+#define BOOT     10000000   // cycles into the functional test to fork at
+#define CHILDREN 1000
+#define RUNS     20000
+#define RUN      2000       // cycles each child runs before its reset
+
+static uint8_t memory[0x10000];
+
+int main(void) {
+    printf("Copy-on-write forks (%s)\n", BENCH_CONFIG);
+
+    bench_load(memory);
+    struct bus bus = bench_flat_bus(memory);
+    bus_map(&bus, 0x0000, 0x10000, memory);
+
+    struct cpu cpu;
+    cpu_init(&cpu, BENCH_START);
+    cpu_run(&cpu, &bus, BOOT);
+
+    struct cow_base *base = cow_base_new(&cpu, &bus);
+    if (base == NULL) {
+        printf("ERROR: unable to fork\n");
+        return 1;
+    }
+
+    static struct cow_child *children[CHILDREN];
+    double start = bench_now();
+    for (int i = 0; i < CHILDREN; i++) {
+        children[i] = cow_child_new(base);
+    }
+    double seconds = bench_now() - start;
+    printf("cow_child_new            %8.2f us per child\n", seconds / CHILDREN * 1e6);
+
+    // each child runs a little way on from the fork and is reset, round robin
+    unsigned dirty = 0;
+    double resetting = 0;
+
+    start = bench_now();
+    for (int i = 0; i < RUNS; i++) {
+        struct cow_child *child = children[i % CHILDREN];
+        cpu_run(&child->cpu, &child->bus, RUN);
+        dirty += child->dirty_n;
+
+        double reset_start = bench_now();
+        cow_child_reset(child);
+        resetting += bench_now() - reset_start;
+    }
+    seconds = bench_now() - start;
+
+    printf("cow_child_reset          %8.2f us per reset, %.1f pages written\n",
+        resetting / RUNS * 1e6, (double)dirty / RUNS);
+    printf("run and reset            %8.0f per second (%d cycles each)\n", RUNS / seconds, RUN);
+
+    for (int i = 0; i < CHILDREN; i++) {
+        cow_child_free(children[i]);
+    }
+    cow_base_free(base);
+    return 0;
+}
@@ -0,0 +1,250 @@
+#include <string.h>
+
+#include "bench.h"
+#include "dcache.h"
+#include "jit.h"
+
+static uint8_t memory[0x10000];
+
+// filled in by bench_step_fast() for the runs that can't count instructions
+static uint64_t total_instructions;
+static uint64_t total_cycles;
+
+static void bench_step(void) {
+    bench_load(memory);
+    struct bus bus = bench_flat_bus(memory);
+
+    struct cpu cpu;
+    cpu_init(&cpu, BENCH_START);
+
+    uint64_t instructions = 0;
+    uint64_t cycles = 0;
+    uint16_t prev_pc;
+
+    double start = bench_now();
+    do {
+        prev_pc = cpu.pc;
+        do {
+            cpu_tick(&cpu, &bus);
+            cycles++;
+        } while (cpu.cycle != 0);
+        instructions++;
+    } while (prev_pc != cpu.pc);
+    double seconds = bench_now() - start;
+
+    bench_report("cpu_tick (table)", instructions, cycles, seconds);
+}
+
+static void bench_step_fast(void) {
+    bench_load(memory);
+    struct bus bus = bench_flat_bus(memory);
+
+    struct cpu cpu;
+    cpu_init(&cpu, BENCH_START);
+
+    uint64_t instructions = 0;
+    uint64_t cycles = 0;
+    uint16_t prev_pc;
+
+    double start = bench_now();
+    do {
+        prev_pc = cpu.pc;
+        cycles += cpu_step_fast(&cpu, &bus);
+        instructions++;
+    } while (prev_pc != cpu.pc);
+    double seconds = bench_now() - start;
+
+    bench_report("cpu_step_fast (switch)", instructions, cycles, seconds);
+
+    total_instructions = instructions;
+    total_cycles = cycles;
+}
+
+static void bench_run_fast(void) {
+    bench_load(memory);
+    struct bus bus = bench_flat_bus(memory);
+
+    struct cpu cpu;
+    cpu_init(&cpu, BENCH_START);
+
+    double start = bench_now();
+    uint64_t cycles = cpu_run_fast(&cpu, &bus, total_cycles);
+    double seconds = bench_now() - start;
+
+    if (cpu.pc != BENCH_DONE_PC) {
+        printf("ERROR: cpu_run_fast stopped at 0x%04X\n", cpu.pc);
+        return;
+    }
+
+    bench_report("cpu_run_fast (threaded)", total_instructions, cycles, seconds);
+}
+
+// Finds the trap itself rather than being told how long to run
+static void bench_run(void) {
+    bench_load(memory);
+    struct bus bus = bench_flat_bus(memory);
+
+    struct cpu cpu;
+    cpu_init(&cpu, BENCH_START);
+
+    double start = bench_now();
+    struct cpu_result result = cpu_run(&cpu, &bus, UINT64_MAX);
+    double seconds = bench_now() - start;
+
+    if (result.reason != CPU_STOP_TRAP || cpu.pc != BENCH_DONE_PC) {
+        printf("ERROR: cpu_run stopped (%d) at 0x%04X\n", result.reason, cpu.pc);
+        return;
+    }
+
+    bench_report("cpu_run (switch)", total_instructions, result.cycles, seconds);
+}
+
+// cpu_run() with a breakpoint and watchpoints the workload never hits
+static void bench_run_watched(void) {
+    bench_load(memory);
+    struct bus bus = bench_flat_bus(memory);
+
+    static struct cpu_watch watch;
+    cpu_watch_init(&watch);
+    cpu_watch_set(&watch, WATCH_EXEC | WATCH_READ | WATCH_WRITE, 0xFF00, 0x10, 1);
+
+    struct cpu cpu;
+    cpu_init(&cpu, BENCH_START);
+    cpu.watch = &watch;
+
+    double start = bench_now();
+    struct cpu_result result = cpu_run(&cpu, &bus, UINT64_MAX);
+    double seconds = bench_now() - start;
+
+    if (result.reason != CPU_STOP_TRAP || cpu.pc != BENCH_DONE_PC) {
+        printf("ERROR: cpu_run stopped (%d) at 0x%04X\n", result.reason, cpu.pc);
+        return;
+    }
+
+    bench_report("cpu_run (watch armed)", total_instructions, result.cycles, seconds);
+}
+
+static void bench_dcache(void) {
+    bench_load(memory);
+    struct bus bus = bench_flat_bus(memory);
+
+    struct cpu cpu;
+    cpu_init(&cpu, BENCH_START);
+
+    struct dcache *dcache = dcache_create();
+
+    double start = bench_now();
+    uint64_t cycles = dcache_run(dcache, &cpu, &bus, total_cycles);
+    double seconds = bench_now() - start;
+
+    dcache_destroy(dcache);
+
+    if (cpu.pc != BENCH_DONE_PC) {
+        printf("ERROR: dcache_run stopped at 0x%04X\n", cpu.pc);
+        return;
+    }
+
+    bench_report("dcache_run", total_instructions, cycles, seconds);
+}
+
+static void bench_jit(const char *name, int mapped) {
+    bench_load(memory);
+    struct bus bus = bench_flat_bus(memory);
+
+    struct cpu cpu;
+    cpu_init(&cpu, BENCH_START);
+
+    if (mapped) {
+        bus_map(&bus, 0x0000, 0x10000, memory);
+    }
+
+    struct jit *jit = jit_create();
+
+    double start = bench_now();
+    uint64_t cycles = jit_run(jit, &cpu, &bus, total_cycles);
+    double seconds = bench_now() - start;
+
+    jit_destroy(jit);
+
+    if (cpu.pc != BENCH_DONE_PC) {
+        printf("ERROR: jit_run stopped at 0x%04X\n", cpu.pc);
+        return;
+    }
+
+    bench_report(name, total_instructions, cycles, seconds);
+}
+
+// A loop run with the IRQ line held but masked, which the engines should
+// run as fast as with no line held: LDX #0, INX, STX $10, BNE back to the
+// INX and JMP back to the LDX, from $0200
+static const uint8_t masked_loop[] = {
+    0xA2, 0x00, 0xE8, 0x86, 0x10, 0xD0, 0xFB, 0x4C, 0x00, 0x02,
+};
+
+#define MASKED_CYCLES 20000000
+
+enum engine { RUN_FAST, DCACHE, JIT };
+
+static void bench_masked(const char *name, enum engine engine) {
+    memset(memory, 0, sizeof(memory));
+    memcpy(&memory[0x0200], masked_loop, sizeof(masked_loop));
+    struct bus bus = bench_flat_bus(memory);
+
+    struct cpu cpu;
+    cpu_init(&cpu, 0x0200);
+    cpu_set_p(&cpu, P_I);
+    cpu_assert(&cpu, INTR_IRQ);
+
+    // the instructions in the cycles the engines are given
+    struct cpu count = cpu;
+    uint64_t instructions = 0;
+    for (uint64_t cycles = 0; cycles < MASKED_CYCLES; instructions++) {
+        cycles += cpu_step_fast(&count, &bus);
+    }
+
+    struct dcache *dcache = dcache_create();
+    struct jit *jit = jit_create();
+    uint64_t cycles = 0;
+
+    double start = bench_now();
+    switch (engine) {
+    case RUN_FAST:
+        cycles = cpu_run_fast(&cpu, &bus, MASKED_CYCLES);
+        break;
+    case DCACHE:
+        cycles = dcache_run(dcache, &cpu, &bus, MASKED_CYCLES);
+        break;
+    case JIT:
+        cycles = jit_run(jit, &cpu, &bus, MASKED_CYCLES);
+        break;
+    }
+    double seconds = bench_now() - start;
+
+    dcache_destroy(dcache);
+    jit_destroy(jit);
+
+    if (cpu.pc > 0x0207 || cpu.sp != 0xFF) {
+        printf("ERROR: %s took the IRQ\n", name);
+        return;
+    }
+
+    bench_report(name, instructions, cycles, seconds);
+}
+
+int main(void) {
+    printf("[%s]\n", BENCH_CONFIG);
+
+    bench_step();
+    bench_step_fast();
+    bench_run_fast();
+    bench_run();
+    bench_run_watched();
+    bench_dcache();
+    bench_jit("jit_run (bus)", 0);
+    bench_jit("jit_run (mapped)", 1);
+    bench_masked("cpu_run_fast (IRQ masked)", RUN_FAST);
+    bench_masked("dcache_run (IRQ masked)", DCACHE);
+    bench_masked("jit_run (IRQ masked)", JIT);
+
+    return 0;
+}
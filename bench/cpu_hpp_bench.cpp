@@ -0,0 +1,147 @@
+extern "C" {
+#include "bench.h"
+}
+
+#include "cpu.hpp"
+
+static uint8_t memory[0x10000];
+
+// filled in by the first cpu_step_fast() run
+static uint64_t total_instructions;
+static uint64_t total_cycles;
+
+// The simplest bus policy: a flat 64K array
+struct Flat {
+    uint8_t *m;
+
+    uint8_t peek(uint16_t addr) {
+        return m[addr];
+    }
+
+    void poke(uint16_t addr, uint8_t data) {
+        m[addr] = data;
+    }
+};
+
+static struct bus make_bus(int pages) {
+    struct bus bus = bench_flat_bus(memory);
+
+    if (pages) {
+        bus_map(&bus, 0x0000, 0x10000, memory);
+    }
+
+    return bus;
+}
+
+static const char *names[] = { "flat", "pages" };
+
+static void bench_c_step(int pages) {
+    bench_load(memory);
+    struct bus bus = make_bus(pages);
+
+    struct cpu cpu;
+    cpu_init(&cpu, BENCH_START);
+
+    uint64_t instructions = 0;
+    uint64_t cycles = 0;
+    uint16_t prev_pc;
+
+    double start = bench_now();
+    do {
+        prev_pc = cpu.pc;
+        cycles += cpu_step_fast(&cpu, &bus);
+        instructions++;
+    } while (prev_pc != cpu.pc);
+    double seconds = bench_now() - start;
+
+    char name[32];
+    snprintf(name, sizeof(name), "C step_fast (%s)", names[pages]);
+    bench_report(name, instructions, cycles, seconds);
+
+    total_instructions = instructions;
+    total_cycles = cycles;
+}
+
+static void bench_c_run(int pages) {
+    bench_load(memory);
+    struct bus bus = make_bus(pages);
+
+    struct cpu cpu;
+    cpu_init(&cpu, BENCH_START);
+
+    double start = bench_now();
+    uint64_t cycles = cpu_run_fast(&cpu, &bus, total_cycles);
+    double seconds = bench_now() - start;
+
+    if (cpu.pc != BENCH_DONE_PC) {
+        printf("ERROR: cpu_run_fast stopped at 0x%04X\n", cpu.pc);
+        return;
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "C run_fast (%s)", names[pages]);
+    bench_report(name, total_instructions, cycles, seconds);
+}
+
+template <class Bus>
+static void bench_step(const char *name, Bus &bus) {
+    bench_load(memory);
+
+    mos6502::Cpu<Bus> cpu(bus, BENCH_START);
+
+    uint64_t instructions = 0;
+    uint64_t cycles = 0;
+    uint16_t prev_pc;
+
+    double start = bench_now();
+    do {
+        prev_pc = cpu.regs.pc;
+        cycles += cpu.step();
+        instructions++;
+    } while (prev_pc != cpu.regs.pc);
+    double seconds = bench_now() - start;
+
+    bench_report(name, instructions, cycles, seconds);
+}
+
+template <class Bus>
+static void bench_run(const char *name, Bus &bus) {
+    bench_load(memory);
+
+    mos6502::Cpu<Bus> cpu(bus, BENCH_START);
+
+    double start = bench_now();
+    uint64_t cycles = cpu.run(total_cycles);
+    double seconds = bench_now() - start;
+
+    if (cpu.regs.pc != BENCH_DONE_PC) {
+        printf("ERROR: %s stopped at 0x%04X\n", name, cpu.regs.pc);
+        return;
+    }
+
+    bench_report(name, total_instructions, cycles, seconds);
+}
+
+int main(void) {
+    printf("[%s]\n", BENCH_CONFIG);
+
+    Flat flat = { memory };
+    struct bus c_flat = make_bus(0);
+    struct bus c_pages = make_bus(1);
+    mos6502::CBus cbus_flat(&c_flat);
+    mos6502::CBus cbus_pages(&c_pages);
+
+    bench_c_step(0);
+    bench_c_step(1);
+    bench_step("Cpu<CBus> step (flat)", cbus_flat);
+    bench_step("Cpu<CBus> step (pages)", cbus_pages);
+    bench_step("Cpu<Flat> step", flat);
+
+    bench_c_run(0);
+    bench_c_run(1);
+    bench_run("Cpu<CBus> run (flat)", cbus_flat);
+    bench_run("Cpu<CBus> run (pages)", cbus_pages);
+    bench_run("Cpu<Flat> run", flat);
+
+    return 0;
+}
@@ -0,0 +1,49 @@
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "farm.h"
+
+#define JOBS   1024
+#define CYCLES 1000000          // per job
+
+static uint8_t image[0x10000];
+static struct farm_job jobs[JOBS];
+
+// Every job runs the functional test from a different point, so that jobs
+// take different paths through it.
+static void bench_farm(unsigned threads, int pin) {
+    for (size_t i = 0; i < JOBS; i++) {
+        jobs[i] = (struct farm_job){ .image = image, .cycles = CYCLES + i % 64 * 1000 };
+        cpu_init(&jobs[i].cpu, BENCH_START);
+    }
+
+    struct farm_options options = { .threads = threads, .pin = pin };
+    struct farm_stats stats;
+
+    if (farm_run(jobs, JOBS, &options, &stats) != 0) {
+        printf("ERROR: farm_run failed\n");
+        exit(1);
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "farm_run x%u%s", stats.threads, pin ? " pinned" : "");
+    bench_report(name, stats.instructions, stats.cycles, stats.seconds);
+}
+
+int main(void) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned cores = online > 0 ? online : 1;
+
+    printf("[%s, %d jobs, %u cores]\n", BENCH_CONFIG, JOBS, cores);
+
+    bench_load(image);
+
+    for (unsigned threads = 1; threads < cores; threads *= 2) {
+        bench_farm(threads, 0);
+    }
+    bench_farm(cores, 0);
+    bench_farm(cores, 1);
+
+    return 0;
+}
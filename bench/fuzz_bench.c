@@ -0,0 +1,79 @@
+#include "bench.h"
+#include "cow.h"
+#include "fuzz.h"
+
+#define BOOT  10000000  // cycles into the functional test to fork at
+#define LONG  20000000  // cycles for the coverage overhead
+#define RUNS  100000
+
+static uint8_t memory[0x10000];
+
+// Runs from the fork for `cycles` each time, with fuzz_run() and with
+// cpu_run() on a bare child, and prints both rates
+static void execs(struct fuzz *fuzz, struct cow_child *child, uint64_t cycles) {
+    fuzz->config.max_cycles = cycles;
+
+    double start = bench_now();
+    for (int i = 0; i < RUNS; i++) {
+        fuzz_run(fuzz, NULL, 0);
+    }
+    double seconds = bench_now() - start;
+
+    start = bench_now();
+    for (int i = 0; i < RUNS; i++) {
+        cow_child_reset(child);
+        cpu_run(&child->cpu, &child->bus, cycles);
+    }
+    double bare = bench_now() - start;
+
+    printf("fuzz_run, %5llu cycles   %8.0f per second (cow reset and cpu_run: %.0f)\n",
+        (unsigned long long)cycles, RUNS / seconds, RUNS / bare);
+}
+
+int main(void) {
+    printf("Coverage-guided fuzzing (%s)\n", BENCH_CONFIG);
+
+    bench_load(memory);
+    struct bus bus = bench_flat_bus(memory);
+    bus_map(&bus, 0x0000, 0x10000, memory);
+
+    struct cpu cpu;
+    cpu_init(&cpu, BENCH_START);
+    cpu_run(&cpu, &bus, BOOT);
+
+    struct fuzz_config config = { .max_cycles = LONG };
+    struct fuzz *fuzz = fuzz_new(&cpu, &bus, &config);
+    struct cow_base *base = cow_base_new(&cpu, &bus);
+    struct cow_child *child = base != NULL ? cow_child_new(base) : NULL;
+    if (fuzz == NULL || child == NULL) {
+        printf("ERROR: unable to fork\n");
+        return 1;
+    }
+
+    // the cost of the edge map over a long run
+    double start = bench_now();
+    fuzz_run(fuzz, NULL, 0);
+    double seconds = bench_now() - start;
+
+    cow_child_reset(child);
+    start = bench_now();
+    struct cpu_result result = cpu_run(&child->cpu, &child->bus, LONG);
+    double bare = bench_now() - start;
+
+    printf("fuzz_run                 %8.2f MHz, %.2fx the time of cpu_run (%.2f MHz)\n",
+        fuzz->cycles / seconds / 1e6, seconds / bare, result.cycles / bare / 1e6);
+
+    int edges = 0;
+    for (int i = 0; i < FUZZ_MAP; i++) {
+        edges += fuzz->map[i] != 0;
+    }
+    printf("edges                    %8d\n", edges);
+
+    execs(fuzz, child, 500);
+    execs(fuzz, child, 5000);
+
+    cow_child_free(child);
+    cow_base_free(base);
+    fuzz_free(fuzz);
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include <string.h>
+
+#include "bench.h"
+#include "mapper.h"
+
+// CPU cycles in an NES scanline, rounded up
+#define SCANLINE 114
+
+static uint8_t memory[0x10000];
+
+// two copies of the top 16K for a window to switch between
+static uint8_t banks[2 * 0x4000];
+
+// filled in by count_instructions()
+static uint64_t total_instructions;
+static uint64_t total_cycles;
+
+static void count_instructions(void) {
+    bench_load(memory);
+    struct bus bus = bench_flat_bus(memory);
+
+    struct cpu cpu;
+    cpu_init(&cpu, BENCH_START);
+
+    uint16_t prev_pc;
+    do {
+        prev_pc = cpu.pc;
+        total_cycles += cpu_step_fast(&cpu, &bus);
+        total_instructions++;
+    } while (prev_pc != cpu.pc);
+}
+
+static uint8_t flat_peek(void *inst, uint16_t addr) {
+    return ((uint8_t *)inst)[addr];
+}
+
+static void flat_poke(void *inst, uint16_t addr, uint8_t data) {
+    ((uint8_t *)inst)[addr] = data;
+}
+
+// Runs the functional test a scanline at a time, swapping the bank at
+// 0xC000 after each one if `swap` is set
+static void bench_scanlines(int swap) {
+    bench_load(memory);
+    memcpy(banks, memory + 0xC000, 0x4000);
+    memcpy(banks + 0x4000, memory + 0xC000, 0x4000);
+
+    struct mapper mapper;
+    mapper_init(&mapper, memory, flat_peek, flat_poke);
+    bus_map(&mapper.bus, 0x0000, 0xC000, memory);
+    int window = mapper_window(&mapper, 0xC000, 0x4000, banks, 2, 0);
+
+    struct cpu cpu;
+    cpu_init(&cpu, BENCH_START);
+
+    uint64_t cycles = 0;
+    uint64_t lines = 0;
+
+    double start = bench_now();
+    while (cycles < total_cycles) {
+        cycles += cpu_run_fast(&cpu, &mapper.bus, SCANLINE);
+        lines++;
+
+        if (swap) {
+            mapper_select(&mapper, window, lines);
+        }
+    }
+    double seconds = bench_now() - start;
+
+    if (cpu.pc != BENCH_DONE_PC) {
+        printf("ERROR: stopped at 0x%04X\n", cpu.pc);
+        return;
+    }
+
+    bench_report(swap ? "swap every scanline" : "no swaps", total_instructions, cycles, seconds);
+    printf("    %llu scanlines, %.1f ns each\n", (unsigned long long)lines, seconds * 1e9 / lines);
+}
+
+int main(void) {
+    printf("[%s]\n", BENCH_CONFIG);
+
+    count_instructions();
+    bench_scanlines(0);
+    bench_scanlines(1);
+
+    return 0;
+}
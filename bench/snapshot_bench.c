@@ -0,0 +1,96 @@
+#include "bench.h"
+#include "snapshot.h"
+
+// A snapshot every NTSC NES frame, with ten seconds' worth kept if the
+// budget allows
+#define FRAME    29781
+#define CAPACITY 600
+#define BUDGET   (16 << 20)
+
+static uint8_t memory[0x10000];
+static struct snapshot snapshot;
+
+// Snapshots only see mapped pages
+static struct bus mapped_bus(void) {
+    bench_load(memory);
+    struct bus bus = bench_flat_bus(memory);
+    bus_map(&bus, 0x0000, 0x10000, memory);
+    return bus;
+}
+
+static void bench_save(void) {
+    struct bus bus = mapped_bus();
+
+    struct cpu cpu;
+    cpu_init(&cpu, BENCH_START);
+
+    double start = bench_now();
+    for (int i = 0; i < 10000; i++) {
+        snapshot_save(&snapshot, &cpu, &bus);
+    }
+    double save = (bench_now() - start) / 10000;
+
+    start = bench_now();
+    for (int i = 0; i < 10000; i++) {
+        snapshot_restore(&snapshot, &cpu, &bus);
+    }
+    double restore = (bench_now() - start) / 10000;
+
+    printf("snapshot_save            %8.2f us\n", save * 1e6);
+    printf("snapshot_restore         %8.2f us\n", restore * 1e6);
+}
+
+static void bench_ring(void) {
+    struct bus bus = mapped_bus();
+
+    struct cpu cpu;
+    cpu_init(&cpu, BENCH_START);
+
+    struct snapshot_ring *ring = snapshot_ring_new(BUDGET, CAPACITY);
+    if (ring == NULL) {
+        printf("ERROR: unable to create the ring\n");
+        return;
+    }
+
+    // the whole functional test, one frame at a time
+    double pushing = 0;
+    uint64_t frames = 0;
+    uint16_t prev_pc;
+
+    do {
+        double start = bench_now();
+        snapshot_ring_push(ring, &cpu, &bus, frames);
+        pushing += bench_now() - start;
+        frames++;
+
+        prev_pc = cpu.pc;
+        cpu_run(&cpu, &bus, FRAME);
+    } while (prev_pc != cpu.pc);
+
+    unsigned count = snapshot_ring_count(ring);
+    printf("snapshot_ring_push       %8.2f us per frame, %llu frames, %u kept\n",
+        pushing / frames * 1e6, (unsigned long long)frames, count);
+
+    // a frame back, half the ring back and then to the oldest
+    const char *names[] = { "1 frame", "half the ring", "the rest" };
+
+    for (int i = 0; i < 3; i++) {
+        unsigned n = snapshot_ring_count(ring);
+        unsigned back = i == 0 ? 1 : i == 1 ? n / 2 : n - 1;
+
+        double start = bench_now();
+        snapshot_ring_rewind(ring, back, &cpu, &bus);
+        double seconds = bench_now() - start;
+        printf("snapshot_ring_rewind     %8.2f us (%s, %u frames)\n", seconds * 1e6, names[i], back);
+    }
+
+    snapshot_ring_free(ring);
+}
+
+int main(void) {
+    printf("Snapshots (%s)\n", BENCH_CONFIG);
+
+    bench_save();
+    bench_ring();
+    return 0;
+}
@@ -0,0 +1,118 @@
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "trace.h"
+
+#define TRACE_PATH "/tmp/trace_bench.trace"
+
+static uint8_t memory[0x10000];
+
+// filled in by count_instructions()
+static uint64_t total_instructions;
+static uint64_t total_cycles;
+
+static void count_instructions(void) {
+    bench_load(memory);
+    struct bus bus = bench_flat_bus(memory);
+
+    struct cpu cpu;
+    cpu_init(&cpu, BENCH_START);
+
+    uint16_t prev_pc;
+    do {
+        prev_pc = cpu.pc;
+        total_cycles += cpu_step_fast(&cpu, &bus);
+        total_instructions++;
+    } while (prev_pc != cpu.pc);
+}
+
+static double bench_run(void) {
+    bench_load(memory);
+    struct bus bus = bench_flat_bus(memory);
+
+    struct cpu cpu;
+    cpu_init(&cpu, BENCH_START);
+
+    double start = bench_now();
+    struct cpu_result result = cpu_run(&cpu, &bus, UINT64_MAX);
+    double seconds = bench_now() - start;
+
+    bench_report("cpu_run", total_instructions, result.cycles, seconds);
+    return seconds;
+}
+
+// Includes writing out the end of the trace
+static double bench_trace(void) {
+    bench_load(memory);
+    struct bus bus = bench_flat_bus(memory);
+
+    struct cpu cpu;
+    cpu_init(&cpu, BENCH_START);
+
+    double start = bench_now();
+    struct trace *trace = trace_open(TRACE_PATH);
+    if (trace == NULL) {
+        printf("ERROR: unable to create %s\n", TRACE_PATH);
+        return 0;
+    }
+
+    uint64_t cycles = trace_run(trace, &cpu, &bus, total_cycles);
+    int closed = trace_close(trace);
+    double seconds = bench_now() - start;
+
+    if (closed != 0 || cpu.pc != BENCH_DONE_PC) {
+        printf("ERROR: trace_run stopped at 0x%04X\n", cpu.pc);
+        return seconds;
+    }
+
+    struct stat st;
+    stat(TRACE_PATH, &st);
+
+    bench_report("trace_run (to disk)", total_instructions, cycles, seconds);
+    printf("    %.1f MB, %.2f bytes per instruction\n", st.st_size / 1e6, (double)st.st_size / total_instructions);
+    return seconds;
+}
+
+// Reads the whole trace back
+static void bench_read(void) {
+    struct trace_reader *reader = trace_reader_open(TRACE_PATH);
+    if (reader == NULL) {
+        printf("ERROR: unable to read %s\n", TRACE_PATH);
+        return;
+    }
+
+    struct trace_record record;
+    uint64_t records = 0;
+    uint64_t cycles = 0;
+
+    double start = bench_now();
+    while (trace_read(reader, &record) == 1) {
+        records++;
+        cycles += record.cycles;
+    }
+    double seconds = bench_now() - start;
+
+    trace_reader_close(reader);
+
+    if (records != total_instructions) {
+        printf("ERROR: read %llu records\n", (unsigned long long)records);
+        return;
+    }
+
+    bench_report("trace_read", records, cycles, seconds);
+}
+
+int main(void) {
+    printf("Tracing (%s)\n", BENCH_CONFIG);
+
+    count_instructions();
+
+    double plain = bench_run();
+    double traced = bench_trace();
+    printf("    %.2fx the time of cpu_run\n", traced / plain);
+    bench_read();
+
+    unlink(TRACE_PATH);
+    return 0;
+}
@@ -0,0 +1,112 @@
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "tracedb.h"
+
+#define TRACE_PATH "/tmp/tracedb_bench.trace"
+#define DB_PATH    "/tmp/tracedb_bench.db"
+
+#define QUERIES 100000
+#define STATES  1000
+
+static uint8_t memory[0x10000];
+static uint8_t rebuilt[0x10000];
+
+// Traces the whole functional test
+static int record(void) {
+    bench_load(memory);
+    struct bus bus = bench_flat_bus(memory);
+
+    struct cpu cpu;
+    cpu_init(&cpu, BENCH_START);
+
+    struct trace *trace = trace_open(TRACE_PATH);
+    if (trace == NULL) {
+        printf("ERROR: unable to create %s\n", TRACE_PATH);
+        return -1;
+    }
+
+    uint16_t prev_pc;
+    do {
+        prev_pc = cpu.pc;
+        trace_run(trace, &cpu, &bus, 1);
+    } while (prev_pc != cpu.pc);
+
+    return trace_close(trace);
+}
+
+static double per_query(double seconds, int n) {
+    return seconds / n * 1e6;
+}
+
+int main(void) {
+    printf("Trace database (%s)\n", BENCH_CONFIG);
+
+    if (record() != 0) {
+        return 1;
+    }
+
+    double start = bench_now();
+    if (tracedb_build(TRACE_PATH, DB_PATH) != 0) {
+        printf("ERROR: unable to build %s\n", DB_PATH);
+        unlink(TRACE_PATH);
+        return 1;
+    }
+    double seconds = bench_now() - start;
+
+    struct tracedb *db = tracedb_open(DB_PATH, TRACE_PATH);
+    if (db == NULL) {
+        printf("ERROR: unable to open %s\n", DB_PATH);
+        return 1;
+    }
+
+    struct stat st;
+    stat(DB_PATH, &st);
+
+    uint64_t records = tracedb_records(db);
+    uint64_t cycles = tracedb_cycles(db);
+    bench_report("tracedb_build", records, cycles, seconds);
+    printf("    %.1f MB for %llu records\n", st.st_size / 1e6, (unsigned long long)records);
+
+    // at random cycles, over the zero page and stack where most writes land
+    srand(1);
+    uint64_t found = 0;
+    start = bench_now();
+    for (int i = 0; i < QUERIES; i++) {
+        struct tracedb_access access;
+        uint64_t cycle = (uint64_t)rand() * rand() % cycles;
+        found += tracedb_last_write(db, rand() & 0x1FF, cycle, &access);
+    }
+    seconds = bench_now() - start;
+    printf("tracedb_last_write       %8.2f us per query, %llu found\n", per_query(seconds, QUERIES),
+        (unsigned long long)found);
+
+    uint64_t accesses = 0;
+    start = bench_now();
+    for (int i = 0; i < QUERIES; i++) {
+        uint64_t cycle = (uint64_t)rand() * rand() % cycles;
+        accesses += tracedb_accesses(db, 0x0100, 0x01FF, cycle, cycle + 10000, TRACEDB_READS | TRACEDB_WRITES, NULL, NULL);
+    }
+    seconds = bench_now() - start;
+    printf("tracedb_accesses         %8.2f us per query, %.1f accesses each (stack, 10000 cycles)\n",
+        per_query(seconds, QUERIES), (double)accesses / QUERIES);
+
+    start = bench_now();
+    for (int i = 0; i < STATES; i++) {
+        struct cpu cpu;
+        uint64_t cycle = (uint64_t)rand() * rand() % cycles;
+        if (tracedb_state(db, cycle, &cpu, rebuilt, NULL) != 1) {
+            printf("ERROR: no state at cycle %llu\n", (unsigned long long)cycle);
+            break;
+        }
+    }
+    seconds = bench_now() - start;
+    printf("tracedb_state            %8.2f us per query\n", per_query(seconds, STATES));
+
+    tracedb_close(db);
+    unlink(DB_PATH);
+    unlink(TRACE_PATH);
+    return 0;
+}
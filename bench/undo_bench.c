@@ -0,0 +1,83 @@
+#include "bench.h"
+#include "undo.h"
+
+#define BUDGET (64 << 20)
+
+static uint8_t memory[0x10000];
+
+// Journaling only sees mapped pages
+static struct bus mapped_bus(void) {
+    bench_load(memory);
+    struct bus bus = bench_flat_bus(memory);
+    bus_map(&bus, 0x0000, 0x10000, memory);
+    return bus;
+}
+
+static double bench_run(uint64_t *instructions) {
+    struct bus bus = mapped_bus();
+
+    struct cpu cpu;
+    cpu_init(&cpu, BENCH_START);
+
+    // counted first, untimed
+    uint16_t prev_pc;
+    do {
+        prev_pc = cpu.pc;
+        cpu_step_fast(&cpu, &bus);
+        (*instructions)++;
+    } while (prev_pc != cpu.pc);
+
+    bus = mapped_bus();
+    cpu_init(&cpu, BENCH_START);
+
+    double start = bench_now();
+    struct cpu_result result = cpu_run(&cpu, &bus, UINT64_MAX);
+    double seconds = bench_now() - start;
+
+    bench_report("cpu_run (mapped)", *instructions, result.cycles, seconds);
+    return seconds;
+}
+
+static void bench_undo(uint64_t instructions, double plain) {
+    struct bus bus = mapped_bus();
+
+    struct cpu cpu;
+    cpu_init(&cpu, BENCH_START);
+
+    struct undo *undo = undo_new(BUDGET);
+    if (undo == NULL) {
+        printf("ERROR: unable to create the journal\n");
+        return;
+    }
+
+    double start = bench_now();
+    struct cpu_result result = undo_run(undo, &cpu, &bus, UINT64_MAX);
+    double seconds = bench_now() - start;
+
+    if (result.reason != CPU_STOP_TRAP || cpu.pc != BENCH_DONE_PC) {
+        printf("ERROR: undo_run stopped at 0x%04X\n", cpu.pc);
+        undo_free(undo);
+        return;
+    }
+
+    bench_report("undo_run", instructions, result.cycles, seconds);
+    printf("    %.2fx the time of cpu_run, %zu instructions kept in %d MB\n",
+        seconds / plain, undo_depth(undo), BUDGET >> 20);
+
+    size_t depth = undo_depth(undo);
+    start = bench_now();
+    result = undo_run_back(undo, &cpu, &bus, UINT64_MAX);
+    seconds = bench_now() - start;
+
+    bench_report("undo_run_back", depth, result.cycles, seconds);
+    undo_free(undo);
+}
+
+int main(void) {
+    printf("Undo journal (%s)\n", BENCH_CONFIG);
+
+    uint64_t instructions = 0;
+    double plain = bench_run(&instructions);
+    bench_undo(instructions, plain);
+    return 0;
+}
@@ -4,53 +4,30 @@
 
 #include "bus.h"
 #include "cpu.h"
+#include "loader.h"
 
 const char * banner =
 "#################\n"
 "#     COMPY     #\n"
 "#################\n\n";
 
-static struct memory {
-    uint8_t ram[0x8000];
-    uint8_t rom[0x8000];
-} memory;
+static uint8_t ram[0x8000];
 
+// RAM and ROM are mapped, so these only see writes to ROM
 static uint8_t peek(void *inst, uint16_t addr) {
-    struct memory *mem = (struct memory *)inst;
-
-    if (addr < 0x8000) {
-        return mem->ram[addr];
-    } else {
-        return mem->rom[addr - 0x8000];
-    }
+    (void)inst;
+    (void)addr;
+    return 0;
 }
 
 static void poke(void *inst, uint16_t addr, uint8_t data) {
-    struct memory *mem = (struct memory *)inst;
-
-    if (addr < 0x8000) {
-        mem->ram[addr] = data;
-    }
-}
-
-static size_t load(FILE *bin) {
-    uint8_t binbuf[0x10000];
-
-    size_t bytes_read = fread(binbuf, 1, 0x10000, bin);
-
-    if (bytes_read < 0x8000) {
-        memcpy(memory.ram, binbuf, bytes_read);
-        return bytes_read;
-    }
-
-    memcpy(memory.ram, binbuf, 0x8000);
-    memcpy(memory.rom, binbuf + 0x8000, bytes_read - 0x8000);
-    return bytes_read;
+    (void)inst;
+    (void)addr;
+    (void)data;
 }
 
 int main(int argc, char *argv[]) {
     struct bus bus = {
-        .inst = &memory,
         .peek = peek,
         .poke = poke
     };
@@ -60,35 +37,32 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    FILE *bin = fopen(argv[1], "r");
-    if (bin == NULL) {
+    struct image image;
+    if (image_open(&image, argv[1], IMAGE_RAW) != 0) {
         printf("ERROR: unable to open %s\n", argv[1]);
         return 1;
     }
 
-    size_t bytes_read = load(bin);
-    fclose(bin);
-
-    if (bytes_read != 0x10000) {
+    if (image.segments[0].size != 0x10000) {
         printf("ERROR: program file is not 0x10000 bytes\n");
         return 1;
     }
 
-    uint16_t pc_start = bus_peek(&bus, 0xFFFD);
-    pc_start = pc_start << 8 | bus_peek(&bus, 0xFFFC);
+    // ROM comes straight from the file; RAM starts as a copy of it
+    image_map(&image, &bus);
+    memcpy(ram, image.segments[0].data, sizeof(ram));
+    bus_map(&bus, 0x0000, sizeof(ram), ram);
 
     struct cpu cpu;
-    cpu_init(&cpu, pc_start);
+    cpu_init(&cpu, image.reset);
 
     printf(banner);
 
-    uint16_t prev_pc;
-    do {
-        prev_pc = cpu.pc;
-        cpu_step(&cpu, &bus);
-    } while (prev_pc != cpu.pc);
+    // the program ends in a jump to itself
+    cpu_run(&cpu, &bus, UINT64_MAX);
 
-    printf("Result of computation is: %d\n", memory.ram[0]);
+    printf("Result of computation is: %d\n", ram[0]);
 
+    image_close(&image);
     return 0;
 }
@@ -0,0 +1,223 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch_step.h"
+
+//
+// Lanes on their own
+//
+
+// A lane's memory as a bus, every `stride` bytes from `base`
+struct lane {
+    uint8_t *base;
+    size_t stride;
+};
+
+static uint8_t peek(void *inst, uint16_t addr) {
+    struct lane *lane = inst;
+    return lane->base[addr * lane->stride];
+}
+
+static void poke(void *inst, uint16_t addr, uint8_t data) {
+    struct lane *lane = inst;
+    lane->base[addr * lane->stride] = data;
+}
+
+// Runs a lane by itself for up to a slice, stopping early where another lane
+// is parked so that the two can go on together.
+static void run_lane(struct batch *b, size_t i) {
+    struct cpu cpu;
+    struct lane lane = { b->ram + i, b->n };
+    struct bus bus = { .inst = &lane, .peek = peek, .poke = poke };
+    uint64_t stop = b->cycles[i] + BATCH_SLICE;
+
+    if (stop > b->stop[i]) {
+        stop = b->stop[i];
+    }
+
+    batch_get(b, i, &cpu);
+    do {
+        b->cycles[i] += cpu_step_fast(&cpu, &bus);
+    } while (b->cycles[i] < stop && !(b->parked[cpu.pc >> 3] & 1 << (cpu.pc & 7)));
+    batch_set(b, i, &cpu);
+
+    b->live[i] = b->cycles[i] < b->stop[i] ? 0xFF : 0x00;
+}
+
+// Marks or clears the PCs of the waiting lanes outside the group
+static void park(struct batch *b, int on) {
+    for (size_t i = 0; i < b->lanes; i++) {
+        if (b->mask[i] || !b->live[i]) {
+            continue;
+        }
+
+        if (on) {
+            b->parked[b->pc[i] >> 3] |= 1 << (b->pc[i] & 7);
+        } else {
+            b->parked[b->pc[i] >> 3] = 0;
+        }
+    }
+}
+
+void batch_list(struct batch *b) {
+    size_t n = 0;
+
+    for (size_t i = 0; i < b->lanes; i++) {
+        if (b->mask[i]) {
+            b->group[n++] = i;
+        }
+    }
+}
+
+void batch_scalar(struct batch *b) {
+    batch_list(b);
+    park(b, 1);
+    for (size_t k = 0; k < b->group_n; k++) {
+        run_lane(b, b->group[k]);
+    }
+    park(b, 0);
+}
+
+//
+// Public functions
+//
+
+static void *alloc(size_t n, size_t size) {
+    size_t bytes = (n * size + BATCH_ALIGN - 1) / BATCH_ALIGN * BATCH_ALIGN;
+    void *p = aligned_alloc(BATCH_ALIGN, bytes);
+
+    if (p != NULL) {
+        memset(p, 0, bytes);
+    }
+
+    return p;
+}
+
+struct batch *batch_create(size_t lanes) {
+    struct batch *b = calloc(1, sizeof(struct batch));
+    if (b == NULL) {
+        return NULL;
+    }
+
+    b->lanes = lanes;
+    b->n = (lanes + BATCH_ALIGN - 1) / BATCH_ALIGN * BATCH_ALIGN;
+    b->ram = alloc(b->n, 0x10000);
+    b->pc = alloc(b->n, sizeof(uint16_t));
+    b->sp = alloc(b->n, 1);
+    b->p = alloc(b->n, 1);
+    b->a = alloc(b->n, 1);
+    b->x = alloc(b->n, 1);
+    b->y = alloc(b->n, 1);
+    b->cycles = alloc(b->n, sizeof(uint64_t));
+    b->stop = alloc(b->n, sizeof(uint64_t));
+    b->live = alloc(b->n, 1);
+    b->group = alloc(b->n, sizeof(uint32_t));
+    b->mask = alloc(b->n, 1);
+    b->val = alloc(b->n, 1);
+    b->take = alloc(b->n, 1);
+    b->extra = alloc(b->n, 1);
+    b->ea = alloc(b->n, sizeof(uint16_t));
+    b->target = alloc(b->n, sizeof(uint16_t));
+    b->parked = alloc(0x10000 / 8, 1);
+
+    if (b->ram == NULL || b->pc == NULL || b->sp == NULL || b->p == NULL
+        || b->a == NULL || b->x == NULL || b->y == NULL || b->cycles == NULL
+        || b->stop == NULL || b->live == NULL || b->group == NULL || b->mask == NULL
+        || b->val == NULL || b->take == NULL || b->extra == NULL || b->ea == NULL
+        || b->target == NULL || b->parked == NULL) {
+        batch_destroy(b);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < lanes; i++) {
+        struct cpu cpu;
+        cpu_init(&cpu, 0);
+        batch_set(b, i, &cpu);
+    }
+
+    return b;
+}
+
+void batch_destroy(struct batch *b) {
+    if (b == NULL) {
+        return;
+    }
+
+    free(b->ram);
+    free(b->pc);
+    free(b->sp);
+    free(b->p);
+    free(b->a);
+    free(b->x);
+    free(b->y);
+    free(b->cycles);
+    free(b->stop);
+    free(b->live);
+    free(b->group);
+    free(b->mask);
+    free(b->val);
+    free(b->take);
+    free(b->extra);
+    free(b->ea);
+    free(b->target);
+    free(b->parked);
+    free(b);
+}
+
+size_t batch_lanes(const struct batch *b) {
+    return b->lanes;
+}
+
+void batch_read(const struct batch *b, size_t lane, uint16_t addr, uint8_t *data, size_t size) {
+    for (size_t k = 0; k < size; k++) {
+        data[k] = b->ram[(size_t)(uint16_t)(addr + k) * b->n + lane];
+    }
+}
+
+void batch_write(struct batch *b, size_t lane, uint16_t addr, const uint8_t *data, size_t size) {
+    for (size_t k = 0; k < size; k++) {
+        b->ram[(size_t)(uint16_t)(addr + k) * b->n + lane] = data[k];
+    }
+}
+
+void batch_get(const struct batch *b, size_t lane, struct cpu *cpu) {
+    cpu_init(cpu, b->pc[lane]);
+    cpu->sp = b->sp[lane];
+    cpu->a = b->a[lane];
+    cpu->x = b->x[lane];
+    cpu->y = b->y[lane];
+    cpu_set_p(cpu, b->p[lane]);
+}
+
+void batch_set(struct batch *b, size_t lane, const struct cpu *cpu) {
+    b->pc[lane] = cpu->pc;
+    b->sp[lane] = cpu->sp;
+    b->p[lane] = cpu_get_p(cpu);
+    b->a[lane] = cpu->a;
+    b->x[lane] = cpu->x;
+    b->y[lane] = cpu->y;
+}
+
+uint64_t batch_cycles(const struct batch *b, size_t lane) {
+    return b->cycles[lane];
+}
+
+uint64_t batch_run(struct batch *b, uint64_t cycles) {
+    uint64_t ran = 0;
+
+    for (size_t i = 0; i < b->lanes; i++) {
+        b->stop[i] = b->cycles[i] + cycles;
+        b->live[i] = cycles > 0 ? 0xFF : 0x00;
+        ran -= b->cycles[i];
+    }
+
+    int (*step)(struct batch *) = __builtin_cpu_supports("avx2") ? batch_step_avx2 : batch_step_sse2;
+    while (step(b)) {
+    }
+
+    for (size_t i = 0; i < b->lanes; i++) {
+        ran += b->cycles[i];
+    }
+
+    return ran;
+}
@@ -0,0 +1,45 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpu.h"
+
+// Runs many independent CPUs (lanes) side by side. Registers are kept as
+// structure-of-arrays, one array per register, and so is memory: every lane
+// has its own flat 64K, interleaved so that the lanes' copies of an address
+// sit side by side. Each step takes the lane that is furthest behind and
+// executes its instruction for every lane at the same PC and opcode at once,
+// with the register and flag work done a vector of lanes at a time (32 with
+// AVX2 when the host has it, 16 with SSE2 otherwise). Lanes that have
+// diverged from most of the others are split off and run alone for a short
+// slice, stopping early where another lane waits so they can rejoin it.
+//
+// Lanes see exactly what cpu_step_fast() would over a flat bus: the same
+// registers, memory and cycle counts.
+
+struct batch;
+
+struct batch *batch_create(size_t lanes);
+void batch_destroy(struct batch *batch);
+
+size_t batch_lanes(const struct batch *batch);
+
+// Copies to and from a lane's memory, which starts zeroed. Addresses wrap.
+void batch_read(const struct batch *batch, size_t lane, uint16_t addr, uint8_t *data, size_t size);
+void batch_write(struct batch *batch, size_t lane, uint16_t addr, const uint8_t *data, size_t size);
+
+// Copies a lane's registers to and from a cpu, which must be between
+// instructions with no reset pending.
+void batch_get(const struct batch *batch, size_t lane, struct cpu *cpu);
+void batch_set(struct batch *batch, size_t lane, const struct cpu *cpu);
+
+// Cycles the lane has run since it was created.
+uint64_t batch_cycles(const struct batch *batch, size_t lane);
+
+// Runs every lane until it has run at least `cycles` more and returns the
+// total number of cycles run across all lanes.
+uint64_t batch_run(struct batch *batch, uint64_t cycles);
+
+#endif
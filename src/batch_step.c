@@ -0,0 +1,762 @@
+#include "batch_step.h"
+
+// Built once per vector width: BATCH_VEC lanes to a vector, 16 for SSE2 and
+// 32 for AVX2. The function it defines is named for the width.
+#ifndef BATCH_VEC
+#define BATCH_VEC 16
+#endif
+
+#if BATCH_VEC == 32
+#define batch_step batch_step_avx2
+#define batch_count batch_count_avx2
+#else
+#define batch_step batch_step_sse2
+#define batch_count batch_count_sse2
+#endif
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+#define ACTION_RD  (1 << 0)
+#define ACTION_WR  (1 << 1)
+#define ACTION_RMW (ACTION_RD | ACTION_WR)
+
+#define HALF (BATCH_VEC / 2)
+
+// A vector of lanes' bytes, half of one, and half as many lanes' addresses.
+// Every vector is exactly one register wide: GCC splits wider ones up, but
+// does their comparisons a lane at a time.
+typedef uint8_t vec __attribute__((vector_size(BATCH_VEC), may_alias));
+typedef uint8_t hvec __attribute__((vector_size(HALF), may_alias));
+typedef int8_t shvec __attribute__((vector_size(HALF), may_alias));
+typedef uint16_t vec16 __attribute__((vector_size(BATCH_VEC), may_alias));
+typedef int16_t svec16 __attribute__((vector_size(BATCH_VEC), may_alias));
+
+typedef void (*kernel)(struct batch *b);
+
+// Loops over the lanes a vector at a time. V(arr) is the current vector of
+// a byte array and BLEND() keeps `old` outside the group.
+#define LANES for (size_t at = 0; at < b->n; at += BATCH_VEC)
+#define V(arr) (*(vec *)((arr) + at))
+#define BLEND(old, new) (((new) & V(b->mask)) | ((old) & ~V(b->mask)))
+
+// The same for 16-bit arrays, with H(arr) the matching bytes
+#define HALVES for (size_t at = 0; at < b->n; at += HALF)
+#define W(arr) (*(vec16 *)((arr) + at))
+#define H(arr) (*(hvec *)((arr) + at))
+#define WIDEN(v) __builtin_convertvector((v), vec16)
+#define WMASK ((vec16)__builtin_convertvector(*(shvec *)(b->mask + at), svec16))
+#define WBLEND(old, new) (((new) & WMASK) | ((old) & ~WMASK))
+
+// The lanes' bytes at a memory address
+#define ROW(addr) (b->ram + (size_t)(uint16_t)(addr) * b->n)
+
+// Lanes in the group, one at a time, once listed
+#define GROUP for (size_t k = 0, i; k < b->group_n && (i = b->group[k], 1); k++)
+
+// Macros rather than functions, which would pass vectors by value
+#define SET_NZ(p, r) (((p) & (uint8_t)~(P_N | P_Z)) | ((r) & P_N) | ((vec)((r) == 0) & P_Z))
+
+//
+// Action kernels
+//
+
+static ALWAYS_INLINE void load(struct batch *b, uint8_t *reg) {
+    LANES {
+        V(reg) = BLEND(V(reg), V(b->val));
+        V(b->p) = BLEND(V(b->p), SET_NZ(V(b->p), V(b->val)));
+    }
+}
+
+static ALWAYS_INLINE void store(struct batch *b, const uint8_t *reg) {
+    LANES {
+        V(b->val) = V(reg);
+    }
+}
+
+static ALWAYS_INLINE void compare(struct batch *b, const uint8_t *reg) {
+    LANES {
+        vec r = V(reg) - V(b->val);
+        vec p = (V(b->p) & (uint8_t)~P_C) | ((vec)(V(reg) >= V(b->val)) & P_C);
+        V(b->p) = BLEND(V(b->p), SET_NZ(p, r));
+    }
+}
+
+static ALWAYS_INLINE void step_reg(struct batch *b, uint8_t *reg, uint8_t delta) {
+    LANES {
+        vec r = V(reg) + delta;
+        V(reg) = BLEND(V(reg), r);
+        V(b->p) = BLEND(V(b->p), SET_NZ(V(b->p), r));
+    }
+}
+
+static ALWAYS_INLINE void transfer(struct batch *b, const uint8_t *from, uint8_t *to) {
+    LANES {
+        V(to) = BLEND(V(to), V(from));
+        V(b->p) = BLEND(V(b->p), SET_NZ(V(b->p), V(from)));
+    }
+}
+
+static ALWAYS_INLINE void set_flag(struct batch *b, uint8_t flag, int on) {
+    LANES {
+        vec p = on ? V(b->p) | flag : V(b->p) & (uint8_t)~flag;
+        V(b->p) = BLEND(V(b->p), p);
+    }
+}
+
+static ALWAYS_INLINE void branch(struct batch *b, uint8_t flag, int on) {
+    LANES {
+        vec set = (vec)((V(b->p) & flag) != 0);
+        V(b->take) = on ? set : ~set;
+    }
+}
+
+static ALWAYS_INLINE void add(struct batch *b, int subtract) {
+    LANES {
+        vec a = V(b->a);
+        vec v = subtract ? ~V(b->val) : V(b->val);
+        vec r = a + v + (V(b->p) & P_C);
+        vec c = ((a & v) | ((a | v) & ~r)) >> 7;
+        vec o = (~(a ^ v) & (a ^ r) & 0x80) >> 1;
+        vec p = (V(b->p) & (uint8_t)~(P_V | P_C)) | o | c;
+        V(b->a) = BLEND(a, r);
+        V(b->p) = BLEND(V(b->p), SET_NZ(p, r));
+    }
+}
+
+static ALWAYS_INLINE void logic(struct batch *b, int op) {
+    LANES {
+        vec r = op == 0 ? V(b->a) | V(b->val) : op == 1 ? V(b->a) & V(b->val) : V(b->a) ^ V(b->val);
+        V(b->a) = BLEND(V(b->a), r);
+        V(b->p) = BLEND(V(b->p), SET_NZ(V(b->p), r));
+    }
+}
+
+// Shifts and read-modify-writes work on val
+static ALWAYS_INLINE void modify(struct batch *b, int op) {
+    LANES {
+        vec v = V(b->val);
+        vec c = V(b->p) & P_C;
+        vec r;
+
+        switch (op) {
+        case 0: r = v << 1; c = v >> 7; break;                  // asl
+        case 1: r = v >> 1; c = v & 1; break;                   // lsr
+        case 2: r = (v << 1) | c; c = v >> 7; break;            // rol
+        case 3: r = (v >> 1) | (c << 7); c = v & 1; break;      // ror
+        case 4: r = v + 1; break;                               // inc
+        default: r = v - 1; break;                              // dec
+        }
+
+        vec p = (V(b->p) & (uint8_t)~P_C) | c;
+        V(b->val) = r;
+        V(b->p) = BLEND(V(b->p), SET_NZ(p, r));
+    }
+}
+
+static void ora(struct batch *b) { logic(b, 0); }
+static void and(struct batch *b) { logic(b, 1); }
+static void eor(struct batch *b) { logic(b, 2); }
+static void adc(struct batch *b) { add(b, 0); }
+static void sbc(struct batch *b) { add(b, 1); }
+static void cmp(struct batch *b) { compare(b, b->a); }
+static void cpx(struct batch *b) { compare(b, b->x); }
+static void cpy(struct batch *b) { compare(b, b->y); }
+static void asl(struct batch *b) { modify(b, 0); }
+static void lsr(struct batch *b) { modify(b, 1); }
+static void rol(struct batch *b) { modify(b, 2); }
+static void ror(struct batch *b) { modify(b, 3); }
+static void inc(struct batch *b) { modify(b, 4); }
+static void dec(struct batch *b) { modify(b, 5); }
+static void inx(struct batch *b) { step_reg(b, b->x, 1); }
+static void iny(struct batch *b) { step_reg(b, b->y, 1); }
+static void dex(struct batch *b) { step_reg(b, b->x, 0xFF); }
+static void dey(struct batch *b) { step_reg(b, b->y, 0xFF); }
+static void sta(struct batch *b) { store(b, b->a); }
+static void stx(struct batch *b) { store(b, b->x); }
+static void sty(struct batch *b) { store(b, b->y); }
+static void lda(struct batch *b) { load(b, b->a); }
+static void ldx(struct batch *b) { load(b, b->x); }
+static void ldy(struct batch *b) { load(b, b->y); }
+static void tax(struct batch *b) { transfer(b, b->a, b->x); }
+static void tay(struct batch *b) { transfer(b, b->a, b->y); }
+static void txa(struct batch *b) { transfer(b, b->x, b->a); }
+static void tya(struct batch *b) { transfer(b, b->y, b->a); }
+static void tsx(struct batch *b) { transfer(b, b->sp, b->x); }
+static void bpl(struct batch *b) { branch(b, P_N, 0); }
+static void bmi(struct batch *b) { branch(b, P_N, 1); }
+static void bne(struct batch *b) { branch(b, P_Z, 0); }
+static void beq(struct batch *b) { branch(b, P_Z, 1); }
+static void bcc(struct batch *b) { branch(b, P_C, 0); }
+static void bcs(struct batch *b) { branch(b, P_C, 1); }
+static void bvc(struct batch *b) { branch(b, P_V, 0); }
+static void bvs(struct batch *b) { branch(b, P_V, 1); }
+static void sec(struct batch *b) { set_flag(b, P_C, 1); }
+static void sed(struct batch *b) { set_flag(b, P_D, 1); }
+static void sei(struct batch *b) { set_flag(b, P_I, 1); }
+static void clc(struct batch *b) { set_flag(b, P_C, 0); }
+static void cld(struct batch *b) { set_flag(b, P_D, 0); }
+static void cli(struct batch *b) { set_flag(b, P_I, 0); }
+static void clv(struct batch *b) { set_flag(b, P_V, 0); }
+
+static void txs(struct batch *b) {
+    LANES {
+        V(b->sp) = BLEND(V(b->sp), V(b->x));
+    }
+}
+
+static void bit(struct batch *b) {
+    LANES {
+        vec v = V(b->val);
+        vec p = (V(b->p) & (uint8_t)~(P_N | P_V | P_Z)) | (v & (P_N | P_V));
+        p |= (vec)((V(b->a) & v) == 0) & P_Z;
+        V(b->p) = BLEND(V(b->p), p);
+    }
+}
+
+static void nop(struct batch *b) {
+    (void)b;
+}
+
+#ifdef CPU_65C02
+
+static void stz(struct batch *b) {
+    LANES {
+        V(b->val) = (vec){ 0 };
+    }
+}
+
+// TSB and TRB set Z from A and the old value
+static ALWAYS_INLINE void test_bits(struct batch *b, int set) {
+    LANES {
+        vec v = V(b->val);
+        vec p = (V(b->p) & (uint8_t)~P_Z) | ((vec)((V(b->a) & v) == 0) & P_Z);
+        V(b->val) = set ? v | V(b->a) : v & ~V(b->a);
+        V(b->p) = BLEND(V(b->p), p);
+    }
+}
+
+static void tsb(struct batch *b) { test_bits(b, 1); }
+static void trb(struct batch *b) { test_bits(b, 0); }
+
+static void bit_imm(struct batch *b) {
+    LANES {
+        vec p = (V(b->p) & (uint8_t)~P_Z) | ((vec)((V(b->a) & V(b->val)) == 0) & P_Z);
+        V(b->p) = BLEND(V(b->p), p);
+    }
+}
+
+static void bra(struct batch *b) {
+    LANES {
+        V(b->take) = (vec){ 0 } + 0xFF;
+    }
+}
+
+#endif
+
+
+//
+// Memory and bookkeeping
+//
+
+static ALWAYS_INLINE uint8_t mem(const struct batch *b, size_t i, uint16_t addr) {
+    return ROW(addr)[i];
+}
+
+// Nonzero when every lane in the group has the same ea, which is how lanes
+// in lockstep usually access memory. Their bytes are then side by side.
+static int uniform(struct batch *b) {
+    uint16_t ea = b->ea[b->lead];
+    vec16 diff = { 0 };
+
+    HALVES {
+        diff |= (W(b->ea) ^ ea) & WMASK;
+    }
+
+    for (int k = 0; k < HALF; k++) {
+        if (diff[k]) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Reads val from ea
+static void read(struct batch *b) {
+    if (uniform(b)) {
+        const uint8_t *row = ROW(b->ea[b->lead]);
+        LANES {
+            V(b->val) = V(row);
+        }
+        return;
+    }
+
+    batch_list(b);
+    GROUP {
+        b->val[i] = mem(b, i, b->ea[i]);
+    }
+}
+
+// Writes val to ea
+static void write(struct batch *b) {
+    if (uniform(b)) {
+        uint8_t *row = ROW(b->ea[b->lead]);
+        LANES {
+            V(row) = BLEND(V(row), V(b->val));
+        }
+        return;
+    }
+
+    batch_list(b);
+    GROUP {
+        ROW(b->ea[i])[i] = b->val[i];
+    }
+}
+
+static void push(struct batch *b) {
+    HALVES {
+        W(b->ea) = WIDEN(H(b->sp)) | 0x0100;
+    }
+    LANES {
+        V(b->sp) = BLEND(V(b->sp), V(b->sp) - 1);
+    }
+    write(b);
+}
+
+static void pop(struct batch *b) {
+    LANES {
+        V(b->sp) = BLEND(V(b->sp), V(b->sp) + 1);
+    }
+    HALVES {
+        W(b->ea) = WIDEN(H(b->sp)) | 0x0100;
+    }
+    read(b);
+}
+
+// The lanes' two operand bytes as addresses, inside HALVES
+#define OPERAND16 (WIDEN(H(ROW(b->group_pc + 1))) | WIDEN(H(ROW(b->group_pc + 2))) << 8)
+
+// Moves the group on to `target`, or past the instruction, and counts its
+// base cycles plus `extra`
+static ALWAYS_INLINE void finish(struct batch *b, int jump, int extra) {
+    const struct cpu_op *op = &cpu_ops[b->group_opc];
+    uint16_t next = b->group_pc + op->length;
+
+    HALVES {
+        vec16 pc = (vec16){ 0 } + next;
+
+        if (jump) {
+            pc = W(b->target);
+        }
+
+        W(b->pc) = WBLEND(W(b->pc), pc);
+    }
+
+    for (size_t i = 0; i < b->lanes; i++) {
+        b->cycles[i] += b->mask[i] & (op->cycles + (extra ? b->extra[i] : 0));
+        b->live[i] = b->cycles[i] < b->stop[i] ? 0xFF : 0x00;
+    }
+}
+
+// Reads or writes memory at ea around the action, as `act_type` says
+static ALWAYS_INLINE void access(struct batch *b, kernel act, uint8_t act_type, int extra) {
+    if (act_type & ACTION_RD) {
+        read(b);
+    }
+
+    act(b);
+
+    if (act_type & ACTION_WR) {
+        write(b);
+    }
+
+    finish(b, 0, extra);
+}
+
+//
+// Address mode procedures
+//
+
+static ALWAYS_INLINE void brk(struct batch *b, kernel act, uint8_t act_type) {
+    (void)act;
+    (void)act_type;
+    batch_scalar(b);
+}
+
+static ALWAYS_INLINE void rti(struct batch *b, kernel act, uint8_t act_type) {
+    (void)act;
+    (void)act_type;
+    batch_scalar(b);
+}
+
+static ALWAYS_INLINE void jmp_ind(struct batch *b, kernel act, uint8_t act_type) {
+    (void)act;
+    (void)act_type;
+    batch_scalar(b);
+}
+
+static ALWAYS_INLINE void illegal(struct batch *b, kernel act, uint8_t act_type) {
+    (void)act;
+    (void)act_type;
+    batch_scalar(b);
+}
+
+static ALWAYS_INLINE void php(struct batch *b, kernel act, uint8_t act_type) {
+    (void)act;
+    (void)act_type;
+    LANES {
+        V(b->val) = V(b->p) | P_B | P_5;
+    }
+    push(b);
+    finish(b, 0, 0);
+}
+
+static ALWAYS_INLINE void plp(struct batch *b, kernel act, uint8_t act_type) {
+    (void)act;
+    (void)act_type;
+    pop(b);
+    LANES {
+        V(b->p) = BLEND(V(b->p), V(b->val) & (uint8_t)~(P_B | P_5));
+    }
+    finish(b, 0, 0);
+}
+
+static ALWAYS_INLINE void pha(struct batch *b, kernel act, uint8_t act_type) {
+    (void)act;
+    (void)act_type;
+    LANES {
+        V(b->val) = V(b->a);
+    }
+    push(b);
+    finish(b, 0, 0);
+}
+
+static ALWAYS_INLINE void pla(struct batch *b, kernel act, uint8_t act_type) {
+    (void)act;
+    (void)act_type;
+    pop(b);
+    lda(b);
+    finish(b, 0, 0);
+}
+
+#ifdef CPU_65C02
+
+static ALWAYS_INLINE void jmp_iax(struct batch *b, kernel act, uint8_t act_type) {
+    (void)act;
+    (void)act_type;
+    batch_scalar(b);
+}
+
+// PHX, PHY, PLX and PLY store from or load into the register through the
+// action, as in cpu.c
+static ALWAYS_INLINE void phr(struct batch *b, kernel act, uint8_t act_type) {
+    (void)act_type;
+    act(b);
+    push(b);
+    finish(b, 0, 0);
+}
+
+static ALWAYS_INLINE void plr(struct batch *b, kernel act, uint8_t act_type) {
+    (void)act_type;
+    pop(b);
+    act(b);
+    finish(b, 0, 0);
+}
+
+static ALWAYS_INLINE void nop1(struct batch *b, kernel act, uint8_t act_type) {
+    (void)act;
+    (void)act_type;
+    finish(b, 0, 0);
+}
+
+#endif
+
+static ALWAYS_INLINE void jsr(struct batch *b, kernel act, uint8_t act_type) {
+    (void)act;
+    (void)act_type;
+    uint16_t ret = b->group_pc + 2;
+
+    HALVES {
+        W(b->target) = OPERAND16;
+    }
+    LANES {
+        V(b->val) = (vec){ 0 } + (uint8_t)(ret >> 8);
+    }
+    push(b);
+    LANES {
+        V(b->val) = (vec){ 0 } + (uint8_t)ret;
+    }
+    push(b);
+    finish(b, 1, 0);
+}
+
+static ALWAYS_INLINE void rts(struct batch *b, kernel act, uint8_t act_type) {
+    (void)act;
+    (void)act_type;
+    pop(b);
+    HALVES {
+        W(b->target) = WIDEN(H(b->val));
+    }
+    pop(b);
+    HALVES {
+        W(b->target) = (W(b->target) | WIDEN(H(b->val)) << 8) + 1;
+    }
+    finish(b, 1, 0);
+}
+
+static ALWAYS_INLINE void jmp_abl(struct batch *b, kernel act, uint8_t act_type) {
+    (void)act;
+    (void)act_type;
+    HALVES {
+        W(b->target) = OPERAND16;
+    }
+    finish(b, 1, 0);
+}
+
+static ALWAYS_INLINE void imm(struct batch *b, kernel act, uint8_t act_type) {
+    (void)act_type;
+    const uint8_t *row = ROW(b->group_pc + 1);
+    LANES {
+        V(b->val) = V(row);
+    }
+    act(b);
+    finish(b, 0, 0);
+}
+
+static ALWAYS_INLINE void imp(struct batch *b, kernel act, uint8_t act_type) {
+    (void)act_type;
+    act(b);
+    finish(b, 0, 0);
+}
+
+static ALWAYS_INLINE void acc(struct batch *b, kernel act, uint8_t act_type) {
+    (void)act_type;
+    LANES {
+        V(b->val) = V(b->a);
+    }
+    act(b);
+    LANES {
+        V(b->a) = BLEND(V(b->a), V(b->val));
+    }
+    finish(b, 0, 0);
+}
+
+static ALWAYS_INLINE void zp_indexed(struct batch *b, const uint8_t *index, kernel act, uint8_t act_type) {
+    const uint8_t *row = ROW(b->group_pc + 1);
+    HALVES {
+        hvec zp = H(row);
+
+        if (index != NULL) {
+            zp += H(index);
+        }
+
+        W(b->ea) = WIDEN(zp);
+    }
+    access(b, act, act_type, 0);
+}
+
+static ALWAYS_INLINE void zpg(struct batch *b, kernel act, uint8_t act_type) {
+    zp_indexed(b, NULL, act, act_type);
+}
+
+static ALWAYS_INLINE void zpx(struct batch *b, kernel act, uint8_t act_type) {
+    zp_indexed(b, b->x, act, act_type);
+}
+
+static ALWAYS_INLINE void zpy(struct batch *b, kernel act, uint8_t act_type) {
+    zp_indexed(b, b->y, act, act_type);
+}
+
+// Absolute and (zp),Y reads take a cycle more when the index crosses a page,
+// as do the 65C02's abs,X shifts
+static ALWAYS_INLINE void abs_indexed(struct batch *b, const uint8_t *index, kernel act, uint8_t act_type, int cross) {
+    HALVES {
+        W(b->ea) = OPERAND16;
+    }
+
+    if (index != NULL) {
+        const uint8_t *row = ROW(b->group_pc + 1);
+        HALVES {
+            W(b->ea) += WIDEN(H(index));
+        }
+        LANES {
+            V(b->extra) = (vec)(V(row) + V(index) < V(row)) & 1;
+        }
+    }
+
+    access(b, act, act_type, cross);
+}
+
+static ALWAYS_INLINE void abl(struct batch *b, kernel act, uint8_t act_type) {
+    abs_indexed(b, NULL, act, act_type, 0);
+}
+
+static ALWAYS_INLINE void abx(struct batch *b, kernel act, uint8_t act_type) {
+    abs_indexed(b, b->x, act, act_type, act_type == ACTION_RD);
+}
+
+static ALWAYS_INLINE void aby(struct batch *b, kernel act, uint8_t act_type) {
+    abs_indexed(b, b->y, act, act_type, act_type == ACTION_RD);
+}
+
+// The pointers for (zp,X) and (zp),Y are fetched a lane at a time
+static ALWAYS_INLINE void idx(struct batch *b, kernel act, uint8_t act_type) {
+    batch_list(b);
+    GROUP {
+        uint8_t zp = mem(b, i, b->group_pc + 1) + b->x[i];
+        b->ea[i] = mem(b, i, zp) | mem(b, i, (uint8_t)(zp + 1)) << 8;
+    }
+    access(b, act, act_type, 0);
+}
+
+static ALWAYS_INLINE void idy(struct batch *b, kernel act, uint8_t act_type) {
+    batch_list(b);
+    GROUP {
+        uint8_t zp = mem(b, i, b->group_pc + 1);
+        uint8_t lo = mem(b, i, zp);
+        b->ea[i] = (lo | mem(b, i, (uint8_t)(zp + 1)) << 8) + b->y[i];
+        b->extra[i] = lo + b->y[i] > 0xFF;
+    }
+    access(b, act, act_type, act_type == ACTION_RD);
+}
+
+#ifdef CPU_65C02
+
+static ALWAYS_INLINE void abx_shift(struct batch *b, kernel act, uint8_t act_type) {
+    abs_indexed(b, b->x, act, act_type, 1);
+}
+
+static ALWAYS_INLINE void zpi(struct batch *b, kernel act, uint8_t act_type) {
+    batch_list(b);
+    GROUP {
+        uint8_t zp = mem(b, i, b->group_pc + 1);
+        b->ea[i] = mem(b, i, zp) | mem(b, i, (uint8_t)(zp + 1)) << 8;
+    }
+    access(b, act, act_type, 0);
+}
+
+#endif
+
+// Taken branches take a cycle more, and another if they cross a page
+static ALWAYS_INLINE void rel(struct batch *b, kernel act, uint8_t act_type) {
+    (void)act_type;
+    const uint8_t *row = ROW(b->group_pc + 1);
+    uint16_t next = b->group_pc + 2;
+
+    act(b);
+
+    HALVES {
+        vec16 take = (vec16)__builtin_convertvector(*(shvec *)(b->take + at), svec16);
+        vec16 target = (vec16)__builtin_convertvector(*(shvec *)(row + at), svec16) + next;
+        vec16 cross = (vec16)((target ^ next) > 0xFF);
+
+        W(b->target) = (target & take) | (next & ~take);
+        H(b->extra) = __builtin_convertvector(take & 1, hvec) + __builtin_convertvector(take & cross & 1, hvec);
+    }
+    finish(b, 1, 1);
+}
+
+//
+// Scheduling
+//
+
+size_t batch_count(const uint8_t *mask, size_t n) {
+    size_t total = 0;
+
+    // a byte per lane of a vector, emptied before the bytes can wrap
+    for (size_t start = 0; start < n; start += 255 * BATCH_VEC) {
+        size_t end = start + 255 * BATCH_VEC < n ? start + 255 * BATCH_VEC : n;
+        vec count = { 0 };
+
+        for (size_t at = start; at < end; at += BATCH_VEC) {
+            count += V(mask) & 1;
+        }
+
+        for (int k = 0; k < BATCH_VEC; k++) {
+            total += count[k];
+        }
+    }
+
+    return total;
+}
+
+// Picks the lane furthest behind to lead, so the others can catch up to it,
+// and collects the waiting lanes at the same PC and opcode. Returns 0 when
+// every lane is done.
+static int gather(struct batch *b) {
+    size_t lead = b->lanes;
+    uint64_t least = UINT64_MAX;
+
+    for (size_t i = 0; i < b->lanes; i++) {
+        if (b->live[i] && b->cycles[i] < least) {
+            least = b->cycles[i];
+            lead = i;
+        }
+    }
+
+    if (lead == b->lanes) {
+        return 0;
+    }
+
+    uint16_t pc = b->pc[lead];
+    uint8_t opc = mem(b, lead, pc);
+    const uint8_t *row = ROW(pc);
+
+    HALVES {
+        vec16 same = (vec16)(W(b->pc) == pc);
+        H(b->mask) = __builtin_convertvector(same, hvec) & H(b->live) & (hvec)(H(row) == opc);
+    }
+
+    b->lead = lead;
+    b->group_pc = pc;
+    b->group_opc = opc;
+    b->group_n = batch_count(b->mask, b->n);
+
+    return 1;
+}
+
+// ADC and SBC in decimal mode, which the 2A03 doesn't have
+static int decimal(struct batch *b) {
+#ifdef CPU_2A03
+    (void)b;
+    return 0;
+#else
+    uint8_t opc = b->group_opc;
+
+    if ((opc & 0x60) != 0x60 || ((opc & 0x03) != 0x01 && (opc & 0x1F) != 0x12)) {
+        return 0;
+    }
+
+    vec d = { 0 };
+    LANES {
+        d |= V(b->p) & V(b->mask);
+    }
+
+    for (int k = 0; k < BATCH_VEC; k++) {
+        if (d[k] & P_D) {
+            return 1;
+        }
+    }
+
+    return 0;
+#endif
+}
+
+int batch_step(struct batch *b) {
+    if (!gather(b)) {
+        return 0;
+    }
+
+    if (b->group_n * BATCH_SCALAR_RATIO < b->n || decimal(b)) {
+        batch_scalar(b);
+        return 1;
+    }
+
+    switch (b->group_opc) {
+#define OP(opc, p, a, t) case opc: p(b, a, t); break;
+#include "opcodes.def"
+#undef OP
+    }
+
+    return 1;
+}
@@ -0,0 +1,60 @@
+#ifndef __BATCH_STEP_H__
+#define __BATCH_STEP_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "batch.h"
+
+// Internals shared by batch.c and the vector kernels in batch_step.c.
+
+#define BATCH_ALIGN 32          // lanes are padded to whole AVX2 vectors
+#define BATCH_SCALAR_RATIO 2    // groups under half the lanes run one lane at a time
+#define BATCH_SLICE 1024        // most cycles a lane runs for when it runs alone
+
+struct batch {
+    size_t lanes;
+    size_t n;                   // lanes rounded up to BATCH_ALIGN
+    uint8_t *ram;               // byte addr of lane i at ram[addr * n + i]
+
+    uint16_t *pc;
+    uint8_t *sp;
+    uint8_t *p;
+    uint8_t *a;
+    uint8_t *x;
+    uint8_t *y;
+    uint64_t *cycles;
+    uint64_t *stop;
+    uint8_t *live;              // 0xFF while cycles < stop
+
+    // the group being stepped
+    size_t lead;
+    uint16_t group_pc;
+    uint8_t group_opc;
+    size_t group_n;
+    uint32_t *group;            // its lanes, once listed
+    uint8_t *mask;              // 0xFF for its lanes, 0x00 for the rest
+    uint8_t *val;               // operand or result
+    uint8_t *take;              // 0xFF where a branch is taken
+    uint8_t *extra;             // cycles past the base count
+    uint16_t *ea;
+    uint16_t *target;           // where jumps and branches go
+    uint8_t *parked;            // bitmap of PCs where other lanes wait
+};
+
+// Fills in group[] from mask.
+void batch_list(struct batch *b);
+
+// Runs the group's lanes one at a time, each for up to BATCH_SLICE cycles.
+void batch_scalar(struct batch *b);
+
+// Picks the next group and steps it through an instruction, returning 0 once
+// every lane is done. batch_step.c is built once per vector width.
+int batch_step_sse2(struct batch *b);
+int batch_step_avx2(struct batch *b);
+
+// Counts the 0xFF bytes of a mask of n lanes, n a multiple of BATCH_ALIGN.
+size_t batch_count_sse2(const uint8_t *mask, size_t n);
+size_t batch_count_avx2(const uint8_t *mask, size_t n);
+
+#endif
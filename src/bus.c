@@ -2,10 +2,42 @@
 
 #include "bus.h"
 
-uint8_t bus_peek(const struct bus *bus, uint16_t addr) {
-    return bus->peek(bus->inst, addr);
+extern BUS_INLINE uint8_t bus_peek(const struct bus *bus, uint16_t addr);
+extern BUS_INLINE void bus_poke(const struct bus *bus, uint16_t addr, uint8_t data);
+extern BUS_INLINE const uint8_t *bus_memory(const struct bus *bus, int page);
+
+void bus_map(struct bus *bus, uint16_t addr, uint32_t size, uint8_t *host) {
+    for (uint32_t offset = 0; offset < size; offset += 0x100) {
+        unsigned page = (addr + offset) >> 8 & 0xFF;
+        bus->read[page] = host + offset;
+        bus->write[page] = host + offset;
+        bus->ram[page] = 0;
+    }
+}
+
+void bus_map_rom(struct bus *bus, uint16_t addr, uint32_t size, const uint8_t *host) {
+    for (uint32_t offset = 0; offset < size; offset += 0x100) {
+        unsigned page = (addr + offset) >> 8 & 0xFF;
+        bus->read[page] = host + offset;
+        bus->write[page] = NULL;
+        bus->ram[page] = 0;
+    }
+}
+
+void bus_map_watched(struct bus *bus, uint16_t addr, uint32_t size, uint8_t *host) {
+    for (uint32_t offset = 0; offset < size; offset += 0x100) {
+        unsigned page = (addr + offset) >> 8 & 0xFF;
+        bus->read[page] = host + offset;
+        bus->write[page] = NULL;
+        bus->ram[page] = 1;
+    }
 }
 
-void bus_poke(const struct bus *bus, uint16_t addr, uint8_t data) {
-    bus->poke(bus->inst, addr, data);
+void bus_unmap(struct bus *bus, uint16_t addr, uint32_t size) {
+    for (uint32_t offset = 0; offset < size; offset += 0x100) {
+        unsigned page = (addr + offset) >> 8 & 0xFF;
+        bus->read[page] = NULL;
+        bus->write[page] = NULL;
+        bus->ram[page] = 0;
+    }
 }
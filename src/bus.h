@@ -1,16 +1,72 @@
 #ifndef __BUS_H__
 #define __BUS_H__
 
+#include <stddef.h>
 #include <stdint.h>
 
+#define BUS_PAGES 256           // 256-byte pages in the address space
+
+// Each page is either served straight from host memory or goes to the peek
+// and poke callbacks. read[] and write[] are indexed by addr >> 8 and hold
+// the host memory for that page, or NULL to use the callbacks, so a bus set
+// up with only the callbacks behaves as before. Pages may share host memory
+// for mirrors, and a page mapped only in read[] is ROM whose writes still
+// reach poke. A device that watches writes to RAM maps it only in read[] too
+// and sets its ram[] flag, so tools that copy memory know poke writes it.
 struct bus {
     void *inst;
     uint8_t (*peek)(void *inst, uint16_t addr);
     void (*poke)(void *inst, uint16_t addr, uint8_t data);
+
+    const uint8_t *read[BUS_PAGES];
+    uint8_t *write[BUS_PAGES];
+    uint8_t ram[BUS_PAGES];     // a page only in read[] is RAM
 };
 
+// Maps [addr, addr + size) to `host` for reading and writing. addr and size
+// must be multiples of 256.
+void bus_map(struct bus *bus, uint16_t addr, uint32_t size, uint8_t *host);
+
+// Maps [addr, addr + size) to `host` for reading only.
+void bus_map_rom(struct bus *bus, uint16_t addr, uint32_t size, const uint8_t *host);
+
+// Maps [addr, addr + size) to `host` for reading only, as RAM that poke
+// writes.
+void bus_map_watched(struct bus *bus, uint16_t addr, uint32_t size, uint8_t *host);
+
+// Sends [addr, addr + size) back to the callbacks.
+void bus_unmap(struct bus *bus, uint16_t addr, uint32_t size);
+
+// Defined inline so the CPU can call straight into the bus implementation,
+// and forced inline since GCC otherwise calls them once they check the page.
+// bus.c provides the external definitions.
+#define BUS_INLINE inline __attribute__((always_inline))
+
+BUS_INLINE uint8_t bus_peek(const struct bus *bus, uint16_t addr) {
+    const uint8_t *page = bus->read[addr >> 8];
+
+    if (page != NULL) {
+        return page[addr & 0xFF];
+    }
+
+    return bus->peek(bus->inst, addr);
+}
+
+BUS_INLINE void bus_poke(const struct bus *bus, uint16_t addr, uint8_t data) {
+    uint8_t *page = bus->write[addr >> 8];
+
+    if (page != NULL) {
+        page[addr & 0xFF] = data;
+        return;
+    }
+
+    bus->poke(bus->inst, addr, data);
+}
 
-uint8_t bus_peek(const struct bus *bus, uint16_t addr);
-void bus_poke(const struct bus *bus, uint16_t addr, uint8_t data);
+// The memory a page's mirrors share: what it writes to if it is mapped for
+// writing, else what it reads, or NULL if it is unmapped
+BUS_INLINE const uint8_t *bus_memory(const struct bus *bus, int page) {
+    return bus->write[page] != NULL ? bus->write[page] : bus->read[page];
+}
 
 #endif
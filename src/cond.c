@@ -0,0 +1,669 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "cond.h"
+
+#define COND_STACK 32           // deepest expression stack a condition may use
+
+// Bytecode. PUSH takes a 4-byte operand, FLAG a 1-byte mask and the jumps a
+// 2-byte target; JZ and JNZ jump keeping the top of the stack if it is zero
+// or nonzero, and otherwise pop it.
+enum {
+    OP_END,
+    OP_PUSH,
+    OP_A,
+    OP_X,
+    OP_Y,
+    OP_SP,
+    OP_PC,
+    OP_P,
+    OP_FLAG,
+    OP_HITS,
+    OP_DATA,
+    OP_MEM,
+    OP_NEG,
+    OP_NOT,
+    OP_INV,
+    OP_BOOL,
+    OP_MUL,
+    OP_DIV,
+    OP_MOD,
+    OP_ADD,
+    OP_SUB,
+    OP_SHL,
+    OP_SHR,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE,
+    OP_EQ,
+    OP_NE,
+    OP_AND,
+    OP_XOR,
+    OP_OR,
+    OP_JZ,
+    OP_JNZ,
+};
+
+struct cond {
+    size_t size;
+    uint8_t code[];
+};
+
+//
+// Compiler
+//
+
+struct parser {
+    const char *at;
+    uint8_t *code;
+    size_t size;
+    size_t cap;
+    int depth;
+    int failed;
+    char *error;
+    size_t error_size;
+};
+
+static void fail(struct parser *p, const char *message) {
+    if (p->failed) {
+        return;
+    }
+
+    p->failed = 1;
+    if (p->error != NULL && p->error_size > 0) {
+        if (*p->at) {
+            snprintf(p->error, p->error_size, "%s at \"%.16s\"", message, p->at);
+        } else {
+            snprintf(p->error, p->error_size, "%s at end", message);
+        }
+    }
+}
+
+static void emit(struct parser *p, uint8_t byte) {
+    if (p->size == p->cap) {
+        size_t cap = p->cap ? p->cap * 2 : 64;
+        uint8_t *code = realloc(p->code, cap);
+
+        if (code == NULL) {
+            fail(p, "out of memory");
+            return;
+        }
+
+        p->code = code;
+        p->cap = cap;
+    }
+
+    p->code[p->size++] = byte;
+}
+
+// Accounts for an op that leaves `change` more values on the stack
+static void push(struct parser *p, int change) {
+    p->depth += change;
+
+    if (p->depth > COND_STACK) {
+        fail(p, "expression too deep");
+    }
+}
+
+static void skip_space(struct parser *p) {
+    while (isspace((unsigned char)*p->at)) {
+        p->at++;
+    }
+}
+
+static int accept(struct parser *p, const char *token) {
+    skip_space(p);
+
+    size_t n = strlen(token);
+    if (strncmp(p->at, token, n) != 0) {
+        return 0;
+    }
+
+    p->at += n;
+    return 1;
+}
+
+static int digit_value(char c, int base) {
+    int value;
+
+    if (c >= '0' && c <= '9') {
+        value = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        value = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        value = c - 'A' + 10;
+    } else {
+        return -1;
+    }
+
+    return value < base ? value : -1;
+}
+
+static void number(struct parser *p) {
+    int base = 10;
+
+    if (*p->at == '$') {
+        base = 16;
+        p->at++;
+    } else if (*p->at == '%') {
+        base = 2;
+        p->at++;
+    } else if (p->at[0] == '0' && (p->at[1] == 'x' || p->at[1] == 'X')) {
+        base = 16;
+        p->at += 2;
+    }
+
+    if (digit_value(*p->at, base) < 0) {
+        fail(p, "expected a number");
+        return;
+    }
+
+    uint32_t value = 0;
+    int digit;
+    while ((digit = digit_value(*p->at, base)) >= 0) {
+        value = value * base + digit;
+        p->at++;
+    }
+
+    emit(p, OP_PUSH);
+    for (int i = 0; i < 4; i++) {
+        emit(p, value >> (8 * i));
+    }
+    push(p, 1);
+}
+
+static const struct {
+    const char *name;
+    uint8_t op;
+    uint8_t flag;
+} names[] = {
+    { "a", OP_A, 0 },
+    { "x", OP_X, 0 },
+    { "y", OP_Y, 0 },
+    { "sp", OP_SP, 0 },
+    { "pc", OP_PC, 0 },
+    { "p", OP_P, 0 },
+    { "n", OP_FLAG, P_N },
+    { "v", OP_FLAG, P_V },
+    { "d", OP_FLAG, P_D },
+    { "i", OP_FLAG, P_I },
+    { "z", OP_FLAG, P_Z },
+    { "c", OP_FLAG, P_C },
+    { "hits", OP_HITS, 0 },
+    { "data", OP_DATA, 0 },
+};
+
+static void expression(struct parser *p, int min_level);
+
+static void primary(struct parser *p) {
+    skip_space(p);
+
+    if (accept(p, "(")) {
+        expression(p, 0);
+        if (!accept(p, ")")) {
+            fail(p, "expected )");
+        }
+        return;
+    }
+
+    if (isdigit((unsigned char)*p->at) || *p->at == '$' || *p->at == '%') {
+        number(p);
+        return;
+    }
+
+    const char *start = p->at;
+    while (isalpha((unsigned char)*p->at)) {
+        p->at++;
+    }
+
+    size_t n = p->at - start;
+    if (n == 0) {
+        fail(p, "expected a value");
+        return;
+    }
+
+    if (n == 3 && strncasecmp(start, "mem", 3) == 0) {
+        if (!accept(p, "[")) {
+            fail(p, "expected [");
+            return;
+        }
+
+        expression(p, 0);
+        if (!accept(p, "]")) {
+            fail(p, "expected ]");
+        }
+
+        emit(p, OP_MEM);
+        return;
+    }
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strlen(names[i].name) == n && strncasecmp(start, names[i].name, n) == 0) {
+            emit(p, names[i].op);
+            if (names[i].op == OP_FLAG) {
+                emit(p, names[i].flag);
+            }
+            push(p, 1);
+            return;
+        }
+    }
+
+    p->at = start;
+    fail(p, "unknown name");
+}
+
+static void unary(struct parser *p) {
+    uint8_t op;
+
+    if (accept(p, "!")) {
+        op = OP_NOT;
+    } else if (accept(p, "~")) {
+        op = OP_INV;
+    } else if (accept(p, "-")) {
+        op = OP_NEG;
+    } else {
+        primary(p);
+        return;
+    }
+
+    unary(p);
+    emit(p, op);
+}
+
+// Binary operators by level, loosest first. Longer tokens come before their
+// prefixes, and a token in `unless` after one means it isn't that operator.
+static const struct {
+    const char *token;
+    const char *unless;
+    int level;
+    uint8_t op;
+} binary[] = {
+    { "||", NULL, 0, OP_JNZ },
+    { "&&", NULL, 1, OP_JZ },
+    { "|", "|", 2, OP_OR },
+    { "^", NULL, 3, OP_XOR },
+    { "&", "&", 4, OP_AND },
+    { "==", NULL, 5, OP_EQ },
+    { "!=", NULL, 5, OP_NE },
+    { "<<", NULL, 7, OP_SHL },
+    { ">>", NULL, 7, OP_SHR },
+    { "<=", NULL, 6, OP_LE },
+    { ">=", NULL, 6, OP_GE },
+    { "<", NULL, 6, OP_LT },
+    { ">", NULL, 6, OP_GT },
+    { "+", NULL, 8, OP_ADD },
+    { "-", NULL, 8, OP_SUB },
+    { "*", NULL, 9, OP_MUL },
+    { "/", NULL, 9, OP_DIV },
+    { "%", NULL, 9, OP_MOD },
+};
+
+// The binary operator at the cursor, or -1
+static int binary_at(struct parser *p) {
+    skip_space(p);
+
+    for (size_t i = 0; i < sizeof(binary) / sizeof(binary[0]); i++) {
+        size_t n = strlen(binary[i].token);
+
+        if (strncmp(p->at, binary[i].token, n) != 0) {
+            continue;
+        }
+
+        if (binary[i].unless != NULL && strncmp(p->at + n, binary[i].unless, strlen(binary[i].unless)) == 0) {
+            continue;
+        }
+
+        return i;
+    }
+
+    return -1;
+}
+
+static void expression(struct parser *p, int min_level) {
+    unary(p);
+
+    int i;
+    while (!p->failed && (i = binary_at(p)) >= 0 && binary[i].level >= min_level) {
+        p->at += strlen(binary[i].token);
+
+        if (binary[i].op == OP_JZ || binary[i].op == OP_JNZ) {
+            // short-circuit: the jump skips the right side with the left's value
+            emit(p, binary[i].op);
+            size_t target = p->size;
+            emit(p, 0);
+            emit(p, 0);
+            push(p, -1);
+
+            expression(p, binary[i].level + 1);
+
+            if (p->code != NULL && target + 1 < p->cap) {
+                p->code[target] = p->size & 0xFF;
+                p->code[target + 1] = p->size >> 8;
+            }
+
+            emit(p, OP_BOOL);
+            continue;
+        }
+
+        expression(p, binary[i].level + 1);
+        emit(p, binary[i].op);
+        push(p, -1);
+    }
+}
+
+struct cond *cond_compile(const char *text, char *error, size_t error_size) {
+    struct parser p = { .at = text, .error = error, .error_size = error_size };
+
+    expression(&p, 0);
+
+    skip_space(&p);
+    if (*p.at) {
+        fail(&p, "unexpected text");
+    }
+
+    emit(&p, OP_END);
+
+    if (p.size > 0xFFFF) {
+        fail(&p, "expression too long");
+    }
+
+    if (p.failed) {
+        free(p.code);
+        return NULL;
+    }
+
+    struct cond *cond = malloc(sizeof(*cond) + p.size);
+    if (cond != NULL) {
+        cond->size = p.size;
+        memcpy(cond->code, p.code, p.size);
+    }
+
+    free(p.code);
+    return cond;
+}
+
+void cond_free(struct cond *cond) {
+    free(cond);
+}
+
+//
+// Evaluation
+//
+
+int32_t cond_eval(const struct cond *cond, const struct cpu *cpu, const struct bus *bus, uint32_t hits, uint8_t data) {
+    int32_t stack[COND_STACK];
+    int32_t *top = stack - 1;
+    const uint8_t *code = cond->code;
+    const uint8_t *ip = code;
+
+#define BINARY(expr) \
+    do { \
+        int32_t r = *top--; \
+        int32_t l = *top; \
+        *top = (expr); \
+    } while (0)
+
+    for (;;) {
+        switch (*ip++) {
+        case OP_END:
+            return *top;
+        case OP_PUSH:
+            *++top = (int32_t)((uint32_t)ip[0] | (uint32_t)ip[1] << 8 | (uint32_t)ip[2] << 16 | (uint32_t)ip[3] << 24);
+            ip += 4;
+            break;
+        case OP_A:
+            *++top = cpu->a;
+            break;
+        case OP_X:
+            *++top = cpu->x;
+            break;
+        case OP_Y:
+            *++top = cpu->y;
+            break;
+        case OP_SP:
+            *++top = cpu->sp;
+            break;
+        case OP_PC:
+            *++top = cpu->pc;
+            break;
+        case OP_P:
+            *++top = cpu_get_p(cpu);
+            break;
+        case OP_FLAG:
+            *++top = (cpu_get_p(cpu) & *ip++) != 0;
+            break;
+        case OP_HITS:
+            *++top = hits;
+            break;
+        case OP_DATA:
+            *++top = data;
+            break;
+        case OP_MEM:
+            *top = bus_peek(bus, *top);
+            break;
+        case OP_NEG:
+            *top = -(uint32_t)*top;
+            break;
+        case OP_NOT:
+            *top = !*top;
+            break;
+        case OP_INV:
+            *top = ~*top;
+            break;
+        case OP_BOOL:
+            *top = *top != 0;
+            break;
+        case OP_MUL:
+            BINARY((int32_t)((uint32_t)l * (uint32_t)r));
+            break;
+        case OP_DIV:
+            BINARY(r == 0 || (l == INT32_MIN && r == -1) ? 0 : l / r);
+            break;
+        case OP_MOD:
+            BINARY(r == 0 || (l == INT32_MIN && r == -1) ? 0 : l % r);
+            break;
+        case OP_ADD:
+            BINARY((int32_t)((uint32_t)l + (uint32_t)r));
+            break;
+        case OP_SUB:
+            BINARY((int32_t)((uint32_t)l - (uint32_t)r));
+            break;
+        case OP_SHL:
+            BINARY((int32_t)((uint32_t)l << (r & 31)));
+            break;
+        case OP_SHR:
+            BINARY(l >> (r & 31));
+            break;
+        case OP_LT:
+            BINARY(l < r);
+            break;
+        case OP_LE:
+            BINARY(l <= r);
+            break;
+        case OP_GT:
+            BINARY(l > r);
+            break;
+        case OP_GE:
+            BINARY(l >= r);
+            break;
+        case OP_EQ:
+            BINARY(l == r);
+            break;
+        case OP_NE:
+            BINARY(l != r);
+            break;
+        case OP_AND:
+            BINARY(l & r);
+            break;
+        case OP_XOR:
+            BINARY(l ^ r);
+            break;
+        case OP_OR:
+            BINARY(l | r);
+            break;
+        case OP_JZ:
+            if (*top == 0) {
+                ip = code + (ip[0] | ip[1] << 8);
+            } else {
+                top--;
+                ip += 2;
+            }
+            break;
+        case OP_JNZ:
+            if (*top != 0) {
+                ip = code + (ip[0] | ip[1] << 8);
+            } else {
+                top--;
+                ip += 2;
+            }
+            break;
+        }
+    }
+
+#undef BINARY
+}
+
+//
+// Sets
+//
+
+struct cond_entry {
+    struct cond *cond;          // NULL to always stop
+    uint32_t hits;
+    int used;
+};
+
+struct cond_set {
+    struct cpu_watch *watch;
+    struct cond_entry *pages[3][256];   // by kind, then addr >> 8
+    uint64_t evals;
+};
+
+static int kind_index(int kind) {
+    return kind == WATCH_EXEC ? 0 : kind == WATCH_READ ? 1 : 2;
+}
+
+static int reason_index(int reason) {
+    return reason == CPU_STOP_BREAK ? 0 : reason == CPU_STOP_READ ? 1 : 2;
+}
+
+static struct cond_entry *entry_at(const struct cond_set *set, int index, uint16_t addr) {
+    struct cond_entry *page = set->pages[index][addr >> 8];
+
+    return page != NULL ? &page[addr & 0xFF] : NULL;
+}
+
+static int cond_set_filter(void *ctx, struct cpu *cpu, const struct bus *bus, int reason, uint16_t addr, uint8_t data) {
+    struct cond_set *set = ctx;
+    struct cond_entry *entry = entry_at(set, reason_index(reason), addr);
+
+    // a bit set without a condition
+    if (entry == NULL || !entry->used) {
+        return 1;
+    }
+
+    entry->hits++;
+
+    if (entry->cond == NULL) {
+        return 1;
+    }
+
+    set->evals++;
+    return cond_eval(entry->cond, cpu, bus, entry->hits, data) != 0;
+}
+
+struct cond_set *cond_set_create(struct cpu_watch *watch) {
+    struct cond_set *set = calloc(1, sizeof(*set));
+    if (set == NULL) {
+        return NULL;
+    }
+
+    set->watch = watch;
+    watch->filter = cond_set_filter;
+    watch->filter_ctx = set;
+    return set;
+}
+
+void cond_set_destroy(struct cond_set *set) {
+    if (set->watch->filter_ctx == set) {
+        set->watch->filter = NULL;
+        set->watch->filter_ctx = NULL;
+    }
+
+    for (int index = 0; index < 3; index++) {
+        for (int page = 0; page < 256; page++) {
+            struct cond_entry *entries = set->pages[index][page];
+
+            if (entries == NULL) {
+                continue;
+            }
+
+            for (int i = 0; i < 256; i++) {
+                cond_free(entries[i].cond);
+            }
+
+            free(entries);
+        }
+    }
+
+    free(set);
+}
+
+int cond_set_add(struct cond_set *set, int kind, uint16_t addr, const char *text, char *error, size_t error_size) {
+    struct cond *cond = NULL;
+
+    if (text != NULL && *text) {
+        cond = cond_compile(text, error, error_size);
+        if (cond == NULL) {
+            return -1;
+        }
+    }
+
+    int index = kind_index(kind);
+    struct cond_entry **page = &set->pages[index][addr >> 8];
+
+    if (*page == NULL) {
+        *page = calloc(256, sizeof(**page));
+        if (*page == NULL) {
+            cond_free(cond);
+            if (error != NULL && error_size > 0) {
+                snprintf(error, error_size, "out of memory");
+            }
+            return -1;
+        }
+    }
+
+    struct cond_entry *entry = &(*page)[addr & 0xFF];
+    cond_free(entry->cond);
+    entry->cond = cond;
+    entry->hits = 0;
+    entry->used = 1;
+
+    cpu_watch_set(set->watch, kind, addr, 1, 1);
+    return 0;
+}
+
+void cond_set_remove(struct cond_set *set, int kind, uint16_t addr) {
+    struct cond_entry *entry = entry_at(set, kind_index(kind), addr);
+
+    if (entry != NULL) {
+        cond_free(entry->cond);
+        memset(entry, 0, sizeof(*entry));
+    }
+
+    cpu_watch_set(set->watch, kind, addr, 1, 0);
+}
+
+uint32_t cond_set_hits(const struct cond_set *set, int kind, uint16_t addr) {
+    const struct cond_entry *entry = entry_at(set, kind_index(kind), addr);
+
+    return entry != NULL ? entry->hits : 0;
+}
+
+uint64_t cond_set_evals(const struct cond_set *set) {
+    return set->evals;
+}
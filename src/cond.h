@@ -0,0 +1,62 @@
+#ifndef __COND_H__
+#define __COND_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bus.h"
+#include "cpu.h"
+
+// Conditions for breakpoints and watchpoints. An expression such as
+//
+//     A == $FF && mem[$D012] > 100
+//     hits >= 10 && !C
+//
+// is compiled once into bytecode for a small stack machine, and a cond_set
+// runs it as the filter of a struct cpu_watch, so it is only evaluated when
+// the CPU reaches an address whose bit is set.
+//
+// Values are 32-bit signed integers. Operands are numbers (100, $FF, 0xFF,
+// %1010), the registers A, X, Y, SP, PC and P, the flags N, V, D, I, Z and
+// C (0 or 1), mem[addr], which reads through the bus, `hits`, the number of
+// times the address has been reached including this one, and `data`, the
+// byte read or written by a watchpoint. Operators, loosest first, are ||,
+// &&, |, ^, &, == and !=, < <= > >=, << >>, + -, * / %, and the unary
+// ! ~ -, with parentheses. Names are case-insensitive.
+
+struct cond;
+
+// Compiles `text`. Returns NULL on a syntax error and describes it in
+// `error`, which may be NULL.
+struct cond *cond_compile(const char *text, char *error, size_t error_size);
+
+void cond_free(struct cond *cond);
+
+// Evaluates a compiled condition. mem[] reads go through `bus`.
+int32_t cond_eval(const struct cond *cond, const struct cpu *cpu, const struct bus *bus, uint32_t hits, uint8_t data);
+
+// Conditional breakpoints and watchpoints on a watch. Each address of each
+// kind has at most one condition, and a counter of its hits.
+struct cond_set;
+
+// Creates a set and installs it as the watch's filter. Bits set on the
+// watch without a condition still stop the CPU every time.
+struct cond_set *cond_set_create(struct cpu_watch *watch);
+
+// Frees the set and removes it from the watch. Its bits stay set.
+void cond_set_destroy(struct cond_set *set);
+
+// Sets the watch bit for `kind` (WATCH_EXEC, WATCH_READ or WATCH_WRITE) at
+// addr and makes `text` its condition, replacing any other. NULL or ""
+// always stops. Returns 0, or -1 with `error` filled in.
+int cond_set_add(struct cond_set *set, int kind, uint16_t addr, const char *text, char *error, size_t error_size);
+
+// Clears the bit and the condition.
+void cond_set_remove(struct cond_set *set, int kind, uint16_t addr);
+
+// Hits counted at an address so far, and the number of conditions
+// evaluated across the set.
+uint32_t cond_set_hits(const struct cond_set *set, int kind, uint16_t addr);
+uint64_t cond_set_evals(const struct cond_set *set);
+
+#endif
@@ -0,0 +1,156 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "cow.h"
+
+struct cow_base {
+    struct cpu cpu;
+    struct bus bus;             // the parent's, for devices
+    uint8_t cow[BUS_PAGES];     // the page was mapped, for reading or writing
+    uint8_t first[BUS_PAGES];   // the first page mirroring the same memory
+    uint8_t next[BUS_PAGES];    // the next page mirroring it, in a ring
+    uint8_t own[BUS_PAGES];     // a child's copy is read as well as written
+    uint8_t ram[BUS_PAGES];     // a child may write the page
+    const uint8_t *read[BUS_PAGES]; // where a child reads until it writes
+    uint8_t pages[BUS_PAGES][256];
+};
+
+struct cow_base *cow_base_new(const struct cpu *cpu, const struct bus *bus) {
+    struct cow_base *base = malloc(sizeof(*base));
+    if (base == NULL) {
+        return NULL;
+    }
+
+    base->cpu = *cpu;
+    base->bus = *bus;
+
+    for (int page = 0; page < BUS_PAGES; page++) {
+        const uint8_t *mem = bus_memory(bus, page);
+
+        base->cow[page] = mem != NULL;
+        base->ram[page] = bus->write[page] != NULL || bus->ram[page];
+        base->first[page] = page;
+        base->next[page] = page;
+        base->read[page] = NULL;
+
+        if (!base->cow[page]) {
+            continue;
+        }
+
+        // join the ring of an earlier page over the same memory
+        for (int other = 0; other < page; other++) {
+            if (base->cow[other] && bus_memory(bus, other) == mem) {
+                int first = base->first[other];
+                base->first[page] = first;
+                base->next[page] = base->next[first];
+                base->next[first] = page;
+                break;
+            }
+        }
+
+        memcpy(base->pages[page], mem, 256);
+
+        // ROM over RAM goes on reading the ROM
+        base->own[page] = bus->read[page] == mem;
+        base->read[page] = base->own[page] ? base->pages[base->first[page]] : bus->read[page];
+    }
+
+    return base;
+}
+
+void cow_base_free(struct cow_base *base) {
+    free(base);
+}
+
+// Pages that aren't copy-on-write go to the parent's callbacks
+static uint8_t child_peek(void *inst, uint16_t addr) {
+    const struct bus *parent = &((struct cow_child *)inst)->base->bus;
+    return parent->peek(parent->inst, addr);
+}
+
+// The first write to a page copies it for the child and all its mirrors.
+// Writes to ROM go nowhere.
+static void child_poke(void *inst, uint16_t addr, uint8_t data) {
+    struct cow_child *child = inst;
+    const struct cow_base *base = child->base;
+    int page = addr >> 8;
+
+    if (!base->cow[page]) {
+        base->bus.poke(base->bus.inst, addr, data);
+        return;
+    }
+
+    if (!base->ram[page]) {
+        return;
+    }
+
+    int first = base->first[page];
+    uint8_t *copy = child->pages[first];
+    memcpy(copy, base->pages[first], 256);
+
+    int mirror = first;
+    do {
+        if (base->own[mirror]) {
+            child->bus.read[mirror] = copy;
+        }
+        child->bus.write[mirror] = copy;
+        mirror = base->next[mirror];
+    } while (mirror != first);
+
+    child->dirty[child->dirty_n++] = first;
+    copy[addr & 0xFF] = data;
+}
+
+struct cow_child *cow_child_new(const struct cow_base *base) {
+    struct cow_child *child = malloc(sizeof(*child));
+    if (child == NULL) {
+        return NULL;
+    }
+
+    child->pages = malloc(BUS_PAGES * 256);
+    if (child->pages == NULL) {
+        free(child);
+        return NULL;
+    }
+
+    child->base = base;
+    child->cpu = base->cpu;
+    child->bus = (struct bus){ .inst = child, .peek = child_peek, .poke = child_poke };
+
+    for (int page = 0; page < BUS_PAGES; page++) {
+        child->bus.read[page] = base->read[page];
+    }
+
+    child->dirty_n = 0;
+    return child;
+}
+
+void cow_child_free(struct cow_child *child) {
+    free(child->pages);
+    free(child);
+}
+
+void cow_child_reset(struct cow_child *child) {
+    const struct cow_base *base = child->base;
+
+    for (unsigned i = 0; i < child->dirty_n; i++) {
+        int first = child->dirty[i];
+        int mirror = first;
+
+        do {
+            child->bus.read[mirror] = base->read[mirror];
+            child->bus.write[mirror] = NULL;
+            mirror = base->next[mirror];
+        } while (mirror != first);
+    }
+    child->dirty_n = 0;
+
+    // the host's settings stay
+    struct cpu_idle *idle = child->cpu.idle;
+    struct cpu_watch *watch = child->cpu.watch;
+
+    child->cpu = base->cpu;
+    child->cpu.idle = idle;
+    child->cpu.watch = watch;
+    child->cpu.halt = 0;
+}
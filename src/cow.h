@@ -0,0 +1,56 @@
+#ifndef __COW_H__
+#define __COW_H__
+
+#include <stdint.h>
+
+#include "bus.h"
+#include "cpu.h"
+
+// Copy-on-write forks of a machine. A base freezes a copy of the CPU and
+// of every page the parent's bus maps, for reading or writing. Children
+// start out reading the base's pages and get their own copy of a page the
+// first time they write it, so a child costs nothing until it runs and
+// resetting one to the base only touches the pages it wrote. Pages that
+// mirror each other in the parent stay mirrored in each child, and a page
+// that reads ROM over RAM, as mapper.h's C64 does, goes on reading the ROM
+// while its writes go to the child's copy of the RAM.
+//
+// Mapped pages never reach the parent's callbacks from a child. Writes to
+// a page mapped only for reading land in the child's own copy of it if the
+// bus marks it as RAM, as mapper.h's C64 does its zero page, and are dropped
+// if it is ROM, mapper registers included. Bank switching is the parent's,
+// so a child keeps the banks it was forked with. Unmapped pages
+// go to the parent's callbacks: devices aren't forked, so a child's writes
+// to them reach the parent's devices. Children keep their own idle and watch
+// across resets.
+
+struct cow_base;
+
+struct cow_child {
+    struct cpu cpu;
+    struct bus bus;             // run the child on this
+
+    // internal
+    const struct cow_base *base;
+    uint8_t (*pages)[256];      // its copies, by the first page of each mirror
+    uint8_t dirty[BUS_PAGES];   // the pages it has copied
+    unsigned dirty_n;
+};
+
+// Freezes the parent as it is now; the parent may go on running. Returns
+// NULL on failure.
+struct cow_base *cow_base_new(const struct cpu *cpu, const struct bus *bus);
+
+// Frees the base, after every child made from it
+void cow_base_free(struct cow_base *base);
+
+// Makes a child of the base. Returns NULL on failure.
+struct cow_child *cow_child_new(const struct cow_base *base);
+
+void cow_child_free(struct cow_child *child);
+
+// Puts the child back to the base, in time that grows with the pages it
+// has written since it was made or last reset.
+void cow_child_reset(struct cow_child *child);
+
+#endif
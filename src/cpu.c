@@ -1,83 +1,104 @@
 #include <string.h>
+#include <time.h>
 #include "cpu.h"
 
-typedef void (*action)(struct cpu *cpu);
+extern inline uint8_t cpu_get_p(const struct cpu *cpu);
+extern inline void cpu_set_p(struct cpu *cpu, uint8_t p);
 
-typedef int (*procedure)(struct cpu *cpu, const struct bus *bus);
+#define CPU_TEMPLATE
+#define CPU_BUS const struct bus *
+#include "cpu_exec.h"
 
-#define ACTION_RD  (1 << 0)
-#define ACTION_WR  (1 << 1)
-#define ACTION_RMW (ACTION_RD | ACTION_WR)
+typedef int (*procedure)(struct cpu *cpu, const struct bus *bus);
 
 struct instruction {
     procedure proc;
-    action act;
-    uint8_t act_type;
 };
 
 static const struct instruction instructions[];
 
-static void set_z(struct cpu *cpu, uint8_t data) {
-    cpu->p &= ~P_Z;
-    cpu->p |= data ? 0 : P_Z;
-}
-
-static void set_n(struct cpu *cpu, uint8_t data) {
-    cpu->p &= ~P_N;
-    cpu->p |= data & 0x80 ? P_N : 0;
-}
-
-static void set_v(struct cpu *cpu, uint8_t in1, uint8_t in2, uint8_t out) {
-    /*
-    int u_over = (in1 & 0x80) && (in2 & 0x80) && !(out & 0x80);
-    int s_over = !(in1 & 0x80) && !(in2 & 0x80) && (out & 0x80);
-
-    cpu->p &= ~P_V;
-    cpu->p |= u_over || s_over ? P_V : 0;
-    */
-    cpu->p &= ~P_V;
-    cpu->p |= (in1 ^ out) & (in2 ^ out) & 0x80 ? P_V : 0;
-}
-
-static void push_stack(struct cpu *cpu, const struct bus *bus, uint8_t data) {
-    bus_poke(bus, 0x0100 | cpu->sp, data);
-    cpu->sp--;
-}
-
-static uint8_t pop_stack(struct cpu *cpu, const struct bus *bus) {
-    cpu->sp++;
-    return bus_peek(bus, 0x0100 | cpu->sp);
-}
-
-static uint8_t curr_stack(struct cpu *cpu, const struct bus *bus) {
-    return bus_peek(bus, 0x0100 | cpu->sp);
-}
-
-// only handles 3 digit BCD numbers
-// assumes bcd number is valid
-static uint16_t bcd2bin(uint16_t value) {
-    uint16_t result = (value / 0x100) * 100;
-    result += ((value & 0xFF) / 0x10) * 10;
-    result += value & 0x0F;
-    return result;
+// The decimal-mode tables cpu_exec.h describes
+#ifndef CPU_2A03
+
+uint16_t cpu_adc_decimal[2][256][256];
+uint16_t cpu_sbc_decimal[2][256][256];
+
+__attribute__((constructor))
+static void init_decimal(void) {
+    for (int c = 0; c < 2; c++) {
+        for (int a = 0; a < 256; a++) {
+            for (int b = 0; b < 256; b++) {
+                uint8_t flags = 0;
+                int bin = a + b + c;
+
+                int al = (a & 0x0F) + (b & 0x0F) + c;
+                if (al >= 0x0A) {
+                    al = ((al + 0x06) & 0x0F) + 0x10;
+                }
+
+                int sum = (a & 0xF0) + (b & 0xF0) + al;
+                int signed_sum = (int8_t)(a & 0xF0) + (int8_t)(b & 0xF0) + al;
+
+                flags |= sum & 0x80 ? P_N : 0;
+                flags |= signed_sum < -128 || signed_sum > 127 ? P_V : 0;
+                flags |= bin & 0xFF ? 0 : P_Z;
+
+                if (sum >= 0xA0) {
+                    sum += 0x60;
+                }
+
+                flags |= sum >= 0x100 ? P_C : 0;
+                cpu_adc_decimal[c][a][b] = (sum & 0xFF) | flags << 8;
+
+                flags = 0;
+                bin = a - b - !c;
+
+                al = (a & 0x0F) - (b & 0x0F) - !c;
+
+#ifdef CPU_65C02
+                // the 65C02 adjusts the whole binary difference instead
+                int diff = bin < 0 ? bin - 0x60 : bin;
+                if (al < 0) {
+                    diff -= 0x06;
+                }
+#else
+                if (al < 0) {
+                    al = ((al - 0x06) & 0x0F) - 0x10;
+                }
+
+                int diff = (a & 0xF0) - (b & 0xF0) + al;
+                if (diff < 0) {
+                    diff -= 0x60;
+                }
+#endif
+
+                flags |= bin & 0x80 ? P_N : 0;
+                flags |= (a ^ b) & (a ^ bin) & 0x80 ? P_V : 0;
+                flags |= bin & 0xFF ? 0 : P_Z;
+                flags |= bin >= 0 ? P_C : 0;
+                cpu_sbc_decimal[c][a][b] = (diff & 0xFF) | flags << 8;
+            }
+        }
+    }
 }
 
-// only handles 3 digit BCD numbers
-static uint16_t bin2bcd(uint16_t value) {
-    uint16_t result = (value / 100) << 8;
-    result |= ((value % 100) / 10) << 4;
-    result += value % 10;
-    return result;
-}
+#endif
 
 //
 // Explicit procedures
 //
 
-static int brk(struct cpu *cpu, const struct bus *bus) {
+// Also runs NMI and IRQ entries, which read the PC twice without moving past
+// it and push P without B
+static ALWAYS_INLINE int brk(struct cpu *cpu, const struct bus *bus, action act, uint8_t act_type) {
+    (void)act;
+    (void)act_type;
+    int entry = cpu->intr & INTR_ENTRY;
+
     switch (cpu->cycle) {
     case 1:
-        bus_peek(bus, cpu->pc++);
+        bus_peek(bus, cpu->pc);
+        cpu->pc += !entry;
         return 0;
     case 2:
         push_stack(cpu, bus, (cpu->pc >> 8) & 0xFF);
@@ -86,15 +107,17 @@ static int brk(struct cpu *cpu, const struct bus *bus) {
         push_stack(cpu, bus, cpu->pc & 0xFF);
         return 0;
     case 4:
-        push_stack(cpu, bus, cpu->p | P_B | P_5);
+        push_stack(cpu, bus, cpu_get_p(cpu) | (entry ? 0 : P_B) | P_5);
         return 0;
     case 5:
-        cpu->opr1 = bus_peek(bus, 0xFFFE);
+        cpu->ea = vector(cpu);
+        cpu->opr1 = bus_peek(bus, cpu->ea);
         return 0;
     case 6:
-        cpu->pc = bus_peek(bus, 0xFFFF);
+        cpu->pc = bus_peek(bus, cpu->ea + 1);
         cpu->pc = (cpu->pc << 8) | cpu->opr1;
-        cpu->p |= P_I;
+        cpu->p = (cpu->p | P_I) & ~P_ENTRY_CLEAR;
+        cpu->intr = (cpu->intr & ~INTR_ENTRY) | INTR_SKIP;
         return 1;
     default:
         return 1;
@@ -124,7 +147,7 @@ static int rst(struct cpu *cpu, const struct bus *bus) {
         case 6:
             cpu->pc = bus_peek(bus, 0xFFFD);
             cpu->pc = (cpu->pc << 8) | cpu->opr1;
-            cpu->p |= P_I;
+            cpu->p = (cpu->p | P_I) & ~P_ENTRY_CLEAR;
             cpu->intr &= ~INTR_RESET;
             return 1;
         default:
@@ -132,7 +155,9 @@ static int rst(struct cpu *cpu, const struct bus *bus) {
     }
 }
 
-static int rti(struct cpu *cpu, const struct bus *bus) {
+static ALWAYS_INLINE int rti(struct cpu *cpu, const struct bus *bus, action act, uint8_t act_type) {
+    (void)act;
+    (void)act_type;
     switch (cpu->cycle) {
     case 1:
         bus_peek(bus, cpu->pc);
@@ -141,8 +166,7 @@ static int rti(struct cpu *cpu, const struct bus *bus) {
         curr_stack(cpu, bus);
         return 0;
     case 3:
-        cpu->p = pop_stack(cpu, bus);
-        cpu->p &= ~(P_B | P_5);
+        cpu_set_p(cpu, pop_stack(cpu, bus) & ~(P_B | P_5));
         return 0;
     case 4:
         cpu->opr1 = pop_stack(cpu, bus);
@@ -156,20 +180,24 @@ static int rti(struct cpu *cpu, const struct bus *bus) {
     }
 }
 
-static int php(struct cpu *cpu, const struct bus *bus) {
+static ALWAYS_INLINE int php(struct cpu *cpu, const struct bus *bus, action act, uint8_t act_type) {
+    (void)act;
+    (void)act_type;
     switch (cpu->cycle) {
     case 1:
         bus_peek(bus, cpu->pc);
         return 0;
     case 2:
-        push_stack(cpu, bus, cpu->p | P_B | P_5);
+        push_stack(cpu, bus, cpu_get_p(cpu) | P_B | P_5);
         return 1;
     default:
         return 1;
     }
 }
 
-static int plp(struct cpu *cpu, const struct bus *bus) {
+static ALWAYS_INLINE int plp(struct cpu *cpu, const struct bus *bus, action act, uint8_t act_type) {
+    (void)act;
+    (void)act_type;
     switch (cpu->cycle) {
     case 1:
         bus_peek(bus, cpu->pc);
@@ -178,15 +206,17 @@ static int plp(struct cpu *cpu, const struct bus *bus) {
         curr_stack(cpu, bus);
         return 0;
     case 3:
-        cpu->p = pop_stack(cpu, bus);
-        cpu->p &= ~(P_B | P_5);
+        cpu->last_i = cpu->p & P_I;
+        cpu_set_p(cpu, pop_stack(cpu, bus) & ~(P_B | P_5));
         return 1;
     default:
         return 1;
     }
 }
 
-static int pha(struct cpu *cpu, const struct bus *bus) {
+static ALWAYS_INLINE int pha(struct cpu *cpu, const struct bus *bus, action act, uint8_t act_type) {
+    (void)act;
+    (void)act_type;
     switch (cpu->cycle) {
     case 1:
         bus_peek(bus, cpu->pc);
@@ -199,7 +229,9 @@ static int pha(struct cpu *cpu, const struct bus *bus) {
     }
 }
 
-static int pla(struct cpu *cpu, const struct bus *bus) {
+static ALWAYS_INLINE int pla(struct cpu *cpu, const struct bus *bus, action act, uint8_t act_type) {
+    (void)act;
+    (void)act_type;
     switch (cpu->cycle) {
     case 1:
         bus_peek(bus, cpu->pc);
@@ -217,7 +249,9 @@ static int pla(struct cpu *cpu, const struct bus *bus) {
     }
 }
 
-static int jsr(struct cpu *cpu, const struct bus *bus) {
+static ALWAYS_INLINE int jsr(struct cpu *cpu, const struct bus *bus, action act, uint8_t act_type) {
+    (void)act;
+    (void)act_type;
     switch (cpu->cycle) {
     case 1:
         cpu->opr2 = bus_peek(bus, cpu->pc++);
@@ -240,7 +274,9 @@ static int jsr(struct cpu *cpu, const struct bus *bus) {
     }
 }
 
-static int rts(struct cpu *cpu, const struct bus *bus) {
+static ALWAYS_INLINE int rts(struct cpu *cpu, const struct bus *bus, action act, uint8_t act_type) {
+    (void)act;
+    (void)act_type;
     switch (cpu->cycle) {
     case 1:
         bus_peek(bus, cpu->pc);
@@ -264,7 +300,9 @@ static int rts(struct cpu *cpu, const struct bus *bus) {
     }
 }
 
-static int jmp_abl(struct cpu *cpu, const struct bus *bus) {
+static ALWAYS_INLINE int jmp_abl(struct cpu *cpu, const struct bus *bus, action act, uint8_t act_type) {
+    (void)act;
+    (void)act_type;
     switch (cpu->cycle) {
     case 1:
         cpu->opr1 = bus_peek(bus, cpu->pc++);
@@ -278,7 +316,9 @@ static int jmp_abl(struct cpu *cpu, const struct bus *bus) {
     }
 }
 
-static int jmp_ind(struct cpu *cpu, const struct bus *bus) {
+static ALWAYS_INLINE int jmp_ind(struct cpu *cpu, const struct bus *bus, action act, uint8_t act_type) {
+    (void)act;
+    (void)act_type;
     switch (cpu->cycle) {
     case 1:
         cpu->opr1 = bus_peek(bus, cpu->pc++);
@@ -287,12 +327,24 @@ static int jmp_ind(struct cpu *cpu, const struct bus *bus) {
         cpu->ea = bus_peek(bus, cpu->pc++);
         cpu->ea = (cpu->ea << 8) | cpu->opr1;
         return 0;
+#ifdef CPU_65C02
+    // the 65C02 spends a cycle to carry into the pointer's high byte
+    case 3:
+        bus_peek(bus, cpu->pc - 1);
+        return 0;
+    case 4:
+        cpu->opr2 = bus_peek(bus, cpu->ea);
+        cpu->ea++;
+        return 0;
+    case 5:
+#else
     case 3:
         cpu->opr2 = bus_peek(bus, cpu->ea);
         cpu->ea &= 0xFF00;
         cpu->ea |= (cpu->opr1 + 1) & 0x00FF;
         return 0;
     case 4:
+#endif
         cpu->pc = bus_peek(bus, cpu->ea);
         cpu->pc = (cpu->pc << 8) | cpu->opr2;
         return 1;
@@ -301,387 +353,147 @@ static int jmp_ind(struct cpu *cpu, const struct bus *bus) {
     }
 }
 
-static int illegal(struct cpu *cpu, const struct bus *bus) {
-    (void)cpu;
-    (void)bus;
-    return 1;
-}
-
-//
-// Actions
-//
-
-static void ora(struct cpu *cpu) {
-    cpu->a |= cpu->opr1;
-    set_z(cpu, cpu->a);
-    set_n(cpu, cpu->a);
-}
-
-static void and(struct cpu *cpu) {
-    cpu->a &= cpu->opr1;
-    set_z(cpu, cpu->a);
-    set_n(cpu, cpu->a);
-}
-
-static void eor(struct cpu *cpu) {
-    cpu->a ^= cpu->opr1;
-    set_z(cpu, cpu->a);
-    set_n(cpu, cpu->a);
-}
+#ifdef CPU_65C02
 
-// TODO handle V flag?
-static void adc_bcd(struct cpu *cpu) {
-    uint16_t result = bcd2bin(cpu->a) + bcd2bin(cpu->opr1);
-    result += cpu->p & P_C ? 1 : 0;
-    result = bin2bcd(result);
-
-    cpu->p &= ~P_C;
-    cpu->p |= result & 0x0100 ? P_C : 0;
-
-    cpu->a = result & 0x00FF;
-
-    set_z(cpu, cpu->a);
-    set_n(cpu, cpu->a);
-}
-
-static void adc(struct cpu *cpu) {
-    if (cpu->p & P_D) {
-        adc_bcd(cpu);
-        return;
+// JMP (abs,X)
+static ALWAYS_INLINE int jmp_iax(struct cpu *cpu, const struct bus *bus, action act, uint8_t act_type) {
+    (void)act;
+    (void)act_type;
+    switch (cpu->cycle) {
+    case 1:
+        cpu->opr1 = bus_peek(bus, cpu->pc++);
+        return 0;
+    case 2:
+        cpu->ea = bus_peek(bus, cpu->pc++);
+        cpu->ea = (cpu->ea << 8) | cpu->opr1;
+        return 0;
+    case 3:
+        bus_peek(bus, cpu->pc - 1);
+        cpu->ea += cpu->x;
+        return 0;
+    case 4:
+        cpu->opr2 = bus_peek(bus, cpu->ea);
+        cpu->ea++;
+        return 0;
+    case 5:
+        cpu->pc = bus_peek(bus, cpu->ea);
+        cpu->pc = (cpu->pc << 8) | cpu->opr2;
+        return 1;
+    default:
+        return 1;
     }
-
-    uint16_t result = cpu->a + cpu->opr1 + (cpu->p & P_C ? 1 : 0);
-
-    cpu->p &= ~P_C;
-    cpu->p |= result & 0x0100 ? P_C : 0;
-
-    set_v(cpu, cpu->a, cpu->opr1, result & 0x00FF);
-
-    cpu->a = result & 0x00FF;
-
-    set_z(cpu, cpu->a);
-    set_n(cpu, cpu->a);
 }
 
-// TODO handle V flag?
-static void sbc_bcd(struct cpu *cpu) {
-    uint16_t result;
-    uint16_t abin = bcd2bin(cpu->a);
-    uint16_t opr1bin = bcd2bin(cpu->opr1) + (cpu->p & P_C ? 0 : 1);
-
-    if (abin >= opr1bin) {
-        result = abin - opr1bin;
-        result = bin2bcd(result);
-        cpu->p |= P_C;
-    } else {
-        result = 100 - opr1bin + abin;
-        result = bin2bcd(result);
-        cpu->p &= ~P_C;
+// PHX and PHY push what the action stores, and PLX and PLY pull what it
+// loads
+static ALWAYS_INLINE int phr(struct cpu *cpu, const struct bus *bus, action act, uint8_t act_type) {
+    (void)act_type;
+    switch (cpu->cycle) {
+    case 1:
+        bus_peek(bus, cpu->pc);
+        return 0;
+    case 2:
+        act(cpu);
+        push_stack(cpu, bus, cpu->opr1);
+        return 1;
+    default:
+        return 1;
     }
-
-    cpu->a = result & 0x00FF;
-
-    set_z(cpu, cpu->a);
-    set_n(cpu, cpu->a);
 }
 
-static void sbc(struct cpu *cpu) {
-    if (cpu->p & P_D) {
-        sbc_bcd(cpu);
-        return;
+static ALWAYS_INLINE int plr(struct cpu *cpu, const struct bus *bus, action act, uint8_t act_type) {
+    (void)act_type;
+    switch (cpu->cycle) {
+    case 1:
+        bus_peek(bus, cpu->pc);
+        return 0;
+    case 2:
+        curr_stack(cpu, bus);
+        return 0;
+    case 3:
+        cpu->opr1 = pop_stack(cpu, bus);
+        act(cpu);
+        return 1;
+    default:
+        return 1;
     }
-
-    cpu->opr1 = ~cpu->opr1;
-    adc(cpu);
-}
-
-static void cmp(struct cpu *cpu) {
-    uint8_t result = cpu->a - cpu->opr1;
-
-    cpu->p &= ~P_C;
-    cpu->p |= cpu->a >= cpu->opr1 ? P_C : 0;
-
-    set_z(cpu, result);
-    set_n(cpu, result);
-}
-
-static void cpx(struct cpu *cpu) {
-    uint8_t result = cpu->x - cpu->opr1;
-
-    cpu->p &= ~P_C;
-    cpu->p |= cpu->x >= cpu->opr1 ? P_C : 0;
-
-    set_z(cpu, result);
-    set_n(cpu, result);
-}
-
-static void cpy(struct cpu *cpu) {
-    uint8_t result = cpu->y - cpu->opr1;
-
-    cpu->p &= ~P_C;
-    cpu->p |= cpu->y >= cpu->opr1 ? P_C : 0;
-
-    set_z(cpu, result);
-    set_n(cpu, result);
 }
 
-static void dec(struct cpu *cpu) {
-    cpu->opr1--;
-    set_z(cpu, cpu->opr1);
-    set_n(cpu, cpu->opr1);
-}
-
-static void dex(struct cpu *cpu) {
-    cpu->x--;
-    set_z(cpu, cpu->x);
-    set_n(cpu, cpu->x);
-}
-
-static void dey(struct cpu *cpu) {
-    cpu->y--;
-    set_z(cpu, cpu->y);
-    set_n(cpu, cpu->y);
-}
-
-static void inc(struct cpu *cpu) {
-    cpu->opr1++;
-    set_z(cpu, cpu->opr1);
-    set_n(cpu, cpu->opr1);
-}
-
-static void inx(struct cpu *cpu) {
-    cpu->x++;
-    set_z(cpu, cpu->x);
-    set_n(cpu, cpu->x);
-}
-
-static void iny(struct cpu *cpu) {
-    cpu->y++;
-    set_z(cpu, cpu->y);
-    set_n(cpu, cpu->y);
-}
-
-static void asl(struct cpu *cpu) {
-    cpu->p &= ~P_C;
-    cpu->p |= cpu->opr1 & 0x80 ? P_C : 0;
-
-    cpu->opr1 <<= 1;
-    set_z(cpu, cpu->opr1);
-    set_n(cpu, cpu->opr1);
-}
-
-static void lsr(struct cpu *cpu) {
-    cpu->p &= ~(P_C | P_N);
-    cpu->p |= cpu->opr1 & 0x01 ? P_C : 0;
-
-    cpu->opr1 >>= 1;
-    set_z(cpu, cpu->opr1);
-
-}
-
-static void rol(struct cpu *cpu) {
-    uint8_t c = cpu->p & P_C;
-    cpu->p &= ~P_C;
-    cpu->p |= cpu->opr1 & 0x80 ? P_C : 0;
-
-    cpu->opr1 <<= 1;
-    cpu->opr1 |= c ? 0x01 : 0;
-    set_z(cpu, cpu->opr1);
-    set_n(cpu, cpu->opr1);
-}
-
-static void ror(struct cpu *cpu) {
-    uint8_t c = cpu->p & P_C;
-    cpu->p &= ~P_C;
-    cpu->p |= cpu->opr1 & 0x01 ? P_C : 0;
-
-    cpu->opr1 >>= 1;
-    cpu->opr1 |= c ? 0x80 : 0;
-    set_z(cpu, cpu->opr1);
-    set_n(cpu, cpu->opr1);
-}
-
-static void sta(struct cpu *cpu) {
-    cpu->opr1 = cpu->a;
-}
-
-static void stx(struct cpu *cpu) {
-    cpu->opr1 = cpu->x;
-}
-
-static void sty(struct cpu *cpu) {
-    cpu->opr1 = cpu->y;
-}
-
-static void tax(struct cpu *cpu) {
-    cpu->x = cpu->a;
-    set_z(cpu, cpu->a);
-    set_n(cpu, cpu->a);
-}
-
-static void tay(struct cpu *cpu) {
-    cpu->y = cpu->a;
-    set_z(cpu, cpu->a);
-    set_n(cpu, cpu->a);
-}
-
-static void txa(struct cpu *cpu) {
-    cpu->a = cpu->x;
-    set_z(cpu, cpu->a);
-    set_n(cpu, cpu->a);
-}
-
-static void tya(struct cpu *cpu) {
-    cpu->a = cpu->y;
-    set_z(cpu, cpu->a);
-    set_n(cpu, cpu->a);
-}
-
-static void tsx(struct cpu *cpu) {
-    cpu->x = cpu->sp;
-    set_z(cpu, cpu->x);
-    set_n(cpu, cpu->x);
-}
-
-static void txs(struct cpu *cpu) {
-    cpu->sp = cpu->x;
-}
-
-static void lda(struct cpu *cpu) {
-    cpu->a = cpu->opr1;
-    set_z(cpu, cpu->opr1);
-    set_n(cpu, cpu->opr1);
-}
-
-static void ldx(struct cpu *cpu) {
-    cpu->x = cpu->opr1;
-    set_z(cpu, cpu->opr1);
-    set_n(cpu, cpu->opr1);
-}
-
-static void ldy(struct cpu *cpu) {
-    cpu->y = cpu->opr1;
-    set_z(cpu, cpu->opr1);
-    set_n(cpu, cpu->opr1);
-}
-
-static void bpl(struct cpu *cpu) {
-    cpu->opr1 = !(cpu->p & P_N);
-}
-
-static void bmi(struct cpu *cpu) {
-    cpu->opr1 = cpu->p & P_N;
-}
-
-static void bne(struct cpu *cpu) {
-    cpu->opr1 = !(cpu->p & P_Z);
-}
-
-static void beq(struct cpu *cpu) {
-    cpu->opr1 = cpu->p & P_Z;
-}
-
-static void bcc(struct cpu *cpu) {
-    cpu->opr1 = !(cpu->p & P_C);
-}
-
-static void bcs(struct cpu *cpu) {
-    cpu->opr1 = cpu->p & P_C;
-}
-
-static void bvc(struct cpu *cpu) {
-    cpu->opr1 = !(cpu->p & P_V);
-}
-
-static void bvs(struct cpu *cpu) {
-    cpu->opr1 = cpu->p & P_V;
-}
-
-static void sec(struct cpu *cpu) {
-    cpu->p |= P_C;
-}
-
-static void sed(struct cpu *cpu) {
-    cpu->p |= P_D;
-}
-
-static void sei(struct cpu *cpu) {
-    cpu->p |= P_I;
-}
-
-static void clc(struct cpu *cpu) {
-    cpu->p &= ~P_C;
-}
-
-static void cld(struct cpu *cpu) {
-    cpu->p &= ~P_D;
-}
-
-static void cli(struct cpu *cpu) {
-    cpu->p &= ~P_I;
-}
-
-static void clv(struct cpu *cpu) {
-    cpu->p &= ~P_V;
+// The undefined opcodes that end with their fetch. cpu_tick() never gets
+// here.
+static ALWAYS_INLINE int nop1(struct cpu *cpu, const struct bus *bus, action act, uint8_t act_type) {
+    (void)cpu;
+    (void)bus;
+    (void)act;
+    (void)act_type;
+    return 1;
 }
 
-static void bit(struct cpu *cpu) {
-    cpu->p &= ~(P_V | P_N | P_Z);
-    cpu->p |= cpu->opr1 & (P_V | P_N);
-    cpu->p |= cpu->opr1 & cpu->a ? 0 : P_Z;
-}
+#endif
 
-static void nop(struct cpu *cpu) {
+static ALWAYS_INLINE int illegal(struct cpu *cpu, const struct bus *bus, action act, uint8_t act_type) {
+    (void)act;
+    (void)act_type;
     (void)cpu;
+    (void)bus;
+    return 1;
 }
 
+
 //
 // Address mode procedures
 //
+// Procedures advance an instruction by one cycle. They take the action and
+// action type as arguments and are instantiated once per opcode (tick_*) in
+// the instruction table.
+//
 
-static int imm(struct cpu *cpu, const struct bus *bus) {
+static ALWAYS_INLINE int imm(struct cpu *cpu, const struct bus *bus, action act, uint8_t act_type) {
+    (void)act_type;
     cpu->opr1 = bus_peek(bus, cpu->pc++);
-    instructions[cpu->opc].act(cpu);
+    act(cpu);
     return 1;
 }
 
-static int imp(struct cpu *cpu, const struct bus *bus) {
+static ALWAYS_INLINE int imp(struct cpu *cpu, const struct bus *bus, action act, uint8_t act_type) {
+    (void)act_type;
     bus_peek(bus, cpu->pc);
-    instructions[cpu->opc].act(cpu);
+    act(cpu);
     return 1;
 }
 
-static int acc(struct cpu *cpu, const struct bus *bus) {
+static ALWAYS_INLINE int acc(struct cpu *cpu, const struct bus *bus, action act, uint8_t act_type) {
+    (void)act_type;
     bus_peek(bus, cpu->pc);
     cpu->opr1 = cpu->a;
-    instructions[cpu->opc].act(cpu);
+    act(cpu);
     cpu->a = cpu->opr1;
     return 1;
 }
 
-static int zpg(struct cpu *cpu, const struct bus *bus) {
+static ALWAYS_INLINE int zpg(struct cpu *cpu, const struct bus *bus, action act, uint8_t act_type) {
     switch (cpu->cycle) {
     case 1:
         cpu->ea = bus_peek(bus, cpu->pc++);
         return 0;
     case 2:
-        if (instructions[cpu->opc].act_type == ACTION_WR) {
-            instructions[cpu->opc].act(cpu);
+        if (act_type == ACTION_WR) {
+            act(cpu);
             bus_poke(bus, cpu->ea, cpu->opr1);
             return 1;
         }
 
         cpu->opr1 = bus_peek(bus, cpu->ea);
 
-        if (instructions[cpu->opc].act_type == ACTION_RD) {
-            instructions[cpu->opc].act(cpu);
+        if (act_type == ACTION_RD) {
+            act(cpu);
             return 1;
         }
 
         return 0;
     case 3:
-        bus_poke(bus, cpu->ea, cpu->opr1);
-        instructions[cpu->opc].act(cpu);
+        modify(bus, cpu->ea, cpu->opr1);
+        act(cpu);
         return 0;
     case 4:
         bus_poke(bus, cpu->ea, cpu->opr1);
@@ -692,7 +504,7 @@ static int zpg(struct cpu *cpu, const struct bus *bus) {
     }
 }
 
-static int zpx(struct cpu *cpu, const struct bus *bus) {
+static ALWAYS_INLINE int zpx(struct cpu *cpu, const struct bus *bus, action act, uint8_t act_type) {
     switch (cpu->cycle) {
     case 1:
         cpu->ea = bus_peek(bus, cpu->pc++);
@@ -702,23 +514,23 @@ static int zpx(struct cpu *cpu, const struct bus *bus) {
         cpu->ea = (cpu->ea + cpu->x) & 0x00FF;
         return 0;
     case 3:
-        if (instructions[cpu->opc].act_type == ACTION_WR) {
-            instructions[cpu->opc].act(cpu);
+        if (act_type == ACTION_WR) {
+            act(cpu);
             bus_poke(bus, cpu->ea, cpu->opr1);
             return 1;
         }
 
         cpu->opr1 = bus_peek(bus, cpu->ea);
 
-        if (instructions[cpu->opc].act_type == ACTION_RD) {
-            instructions[cpu->opc].act(cpu);
+        if (act_type == ACTION_RD) {
+            act(cpu);
             return 1;
         }
 
         return 0;
     case 4:
-        bus_poke(bus, cpu->ea, cpu->opr1);
-        instructions[cpu->opc].act(cpu);
+        modify(bus, cpu->ea, cpu->opr1);
+        act(cpu);
         return 0;
     case 5:
         bus_poke(bus, cpu->ea, cpu->opr1);
@@ -729,7 +541,7 @@ static int zpx(struct cpu *cpu, const struct bus *bus) {
 }
 
 // TODO I think I can remove the RMW steps
-static int zpy(struct cpu *cpu, const struct bus *bus) {
+static ALWAYS_INLINE int zpy(struct cpu *cpu, const struct bus *bus, action act, uint8_t act_type) {
     switch (cpu->cycle) {
     case 1:
         cpu->ea = bus_peek(bus, cpu->pc++);
@@ -739,23 +551,23 @@ static int zpy(struct cpu *cpu, const struct bus *bus) {
         cpu->ea = (cpu->ea + cpu->y) & 0x00FF;
         return 0;
     case 3:
-        if (instructions[cpu->opc].act_type == ACTION_WR) {
-            instructions[cpu->opc].act(cpu);
+        if (act_type == ACTION_WR) {
+            act(cpu);
             bus_poke(bus, cpu->ea, cpu->opr1);
             return 1;
         }
 
         cpu->opr1 = bus_peek(bus, cpu->ea);
 
-        if (instructions[cpu->opc].act_type == ACTION_RD) {
-            instructions[cpu->opc].act(cpu);
+        if (act_type == ACTION_RD) {
+            act(cpu);
             return 1;
         }
 
         return 0;
     case 4:
-        bus_poke(bus, cpu->ea, cpu->opr1);
-        instructions[cpu->opc].act(cpu);
+        modify(bus, cpu->ea, cpu->opr1);
+        act(cpu);
         return 0;
     case 5:
         bus_poke(bus, cpu->ea, cpu->opr1);
@@ -765,7 +577,7 @@ static int zpy(struct cpu *cpu, const struct bus *bus) {
     }
 }
 
-static int abl(struct cpu *cpu, const struct bus *bus) {
+static ALWAYS_INLINE int abl(struct cpu *cpu, const struct bus *bus, action act, uint8_t act_type) {
     switch (cpu->cycle) {
     case 1:
         cpu->opr1 = bus_peek(bus, cpu->pc++);
@@ -777,23 +589,23 @@ static int abl(struct cpu *cpu, const struct bus *bus) {
         cpu->ea = cpu->opr2;
         cpu->ea = (cpu->ea << 8) | cpu->opr1;
 
-        if (instructions[cpu->opc].act_type == ACTION_WR) {
-            instructions[cpu->opc].act(cpu);
+        if (act_type == ACTION_WR) {
+            act(cpu);
             bus_poke(bus, cpu->ea, cpu->opr1);
             return 1;
         }
 
         cpu->opr1 = bus_peek(bus, cpu->ea);
 
-        if (instructions[cpu->opc].act_type == ACTION_RD) {
-            instructions[cpu->opc].act(cpu);
+        if (act_type == ACTION_RD) {
+            act(cpu);
             return 1;
         }
 
         return 0;
     case 4:
-        bus_poke(bus, cpu->ea, cpu->opr1);
-        instructions[cpu->opc].act(cpu);
+        modify(bus, cpu->ea, cpu->opr1);
+        act(cpu);
         return 0;
     case 5:
         bus_poke(bus, cpu->ea, cpu->opr1);
@@ -803,7 +615,7 @@ static int abl(struct cpu *cpu, const struct bus *bus) {
     }
 }
 
-static int abx(struct cpu *cpu, const struct bus *bus) {
+static ALWAYS_INLINE int abx(struct cpu *cpu, const struct bus *bus, action act, uint8_t act_type) {
     switch (cpu->cycle) {
     case 1:
         cpu->opr2 = bus_peek(bus, cpu->pc++);
@@ -815,9 +627,9 @@ static int abx(struct cpu *cpu, const struct bus *bus) {
     case 3:
         cpu->opr1 = bus_peek(bus, cpu->ea);
 
-        if (instructions[cpu->opc].act_type == ACTION_RD
+        if (act_type == ACTION_RD
             && (uint16_t)cpu->opr2 + cpu->x <= 0xFF) {
-            instructions[cpu->opc].act(cpu);
+            act(cpu);
             return 1;
         }
 
@@ -825,23 +637,23 @@ static int abx(struct cpu *cpu, const struct bus *bus) {
         cpu->ea += cpu->opr2 + cpu->x;
         return 0;
     case 4:
-        if (instructions[cpu->opc].act_type == ACTION_WR) {
-            instructions[cpu->opc].act(cpu);
+        if (act_type == ACTION_WR) {
+            act(cpu);
             bus_poke(bus, cpu->ea, cpu->opr1);
             return 1;
         }
 
         cpu->opr1 = bus_peek(bus, cpu->ea);
 
-        if (instructions[cpu->opc].act_type == ACTION_RD) {
-            instructions[cpu->opc].act(cpu);
+        if (act_type == ACTION_RD) {
+            act(cpu);
             return 1;
         }
 
         return 0;
     case 5:
-        bus_poke(bus, cpu->ea, cpu->opr1);
-        instructions[cpu->opc].act(cpu);
+        modify(bus, cpu->ea, cpu->opr1);
+        act(cpu);
         return 0;
     case 6:
 
@@ -852,7 +664,7 @@ static int abx(struct cpu *cpu, const struct bus *bus) {
     }
 }
 
-static int aby(struct cpu *cpu, const struct bus *bus) {
+static ALWAYS_INLINE int aby(struct cpu *cpu, const struct bus *bus, action act, uint8_t act_type) {
     switch (cpu->cycle) {
     case 1:
         cpu->opr2 = bus_peek(bus, cpu->pc++);
@@ -864,9 +676,9 @@ static int aby(struct cpu *cpu, const struct bus *bus) {
     case 3:
         cpu->opr1 = bus_peek(bus, cpu->ea);
 
-        if (instructions[cpu->opc].act_type == ACTION_RD
+        if (act_type == ACTION_RD
             && (uint16_t)cpu->opr2 + cpu->y <= 0xFF) {
-            instructions[cpu->opc].act(cpu);
+            act(cpu);
             return 1;
         }
 
@@ -874,11 +686,11 @@ static int aby(struct cpu *cpu, const struct bus *bus) {
         cpu->ea += cpu->opr2 + cpu->y;
         return 0;
     case 4:
-        if (instructions[cpu->opc].act_type == ACTION_RD) {
+        if (act_type == ACTION_RD) {
             cpu->opr1 = bus_peek(bus, cpu->ea);
-            instructions[cpu->opc].act(cpu);
+            act(cpu);
         } else {
-            instructions[cpu->opc].act(cpu);
+            act(cpu);
             bus_poke(bus, cpu->ea, cpu->opr1);
         }
 
@@ -888,7 +700,7 @@ static int aby(struct cpu *cpu, const struct bus *bus) {
     }
 }
 
-static int idx(struct cpu *cpu, const struct bus *bus) {
+static ALWAYS_INLINE int idx(struct cpu *cpu, const struct bus *bus, action act, uint8_t act_type) {
     switch (cpu->cycle) {
     case 1:
         cpu->ea = bus_peek(bus, cpu->pc++);
@@ -905,11 +717,11 @@ static int idx(struct cpu *cpu, const struct bus *bus) {
         cpu->ea = (cpu->ea << 8) | cpu->opr1;
         return 0;
     case 5:
-        if (instructions[cpu->opc].act_type == ACTION_RD) {
+        if (act_type == ACTION_RD) {
             cpu->opr1 = bus_peek(bus, cpu->ea);
-            instructions[cpu->opc].act(cpu);
+            act(cpu);
         } else {
-            instructions[cpu->opc].act(cpu);
+            act(cpu);
             bus_poke(bus, cpu->ea, cpu->opr1);
         }
 
@@ -919,7 +731,7 @@ static int idx(struct cpu *cpu, const struct bus *bus) {
     }
 }
 
-static int idy(struct cpu *cpu, const struct bus *bus) {
+static ALWAYS_INLINE int idy(struct cpu *cpu, const struct bus *bus, action act, uint8_t act_type) {
     switch (cpu->cycle) {
     case 1:
         cpu->ea = bus_peek(bus, cpu->pc++);
@@ -934,9 +746,9 @@ static int idy(struct cpu *cpu, const struct bus *bus) {
     case 4:
         cpu->opr1 = bus_peek(bus, cpu->ea);
 
-        if (instructions[cpu->opc].act_type == ACTION_RD
+        if (act_type == ACTION_RD
             && (uint16_t)cpu->opr2 + cpu->y <= 0xFF) {
-            instructions[cpu->opc].act(cpu);
+            act(cpu);
             return 1;
         }
 
@@ -944,11 +756,11 @@ static int idy(struct cpu *cpu, const struct bus *bus) {
         cpu->ea += cpu->opr2 + cpu->y;
         return 0;
     case 5:
-        if (instructions[cpu->opc].act_type == ACTION_RD) {
+        if (act_type == ACTION_RD) {
             cpu->opr1 = bus_peek(bus, cpu->ea);
-            instructions[cpu->opc].act(cpu);
+            act(cpu);
         } else {
-            instructions[cpu->opc].act(cpu);
+            act(cpu);
             bus_poke(bus, cpu->ea, cpu->opr1);
         }
 
@@ -958,11 +770,80 @@ static int idy(struct cpu *cpu, const struct bus *bus) {
     }
 }
 
-static int rel(struct cpu *cpu, const struct bus *bus) {
+#ifdef CPU_65C02
+
+// (zp)
+static ALWAYS_INLINE int zpi(struct cpu *cpu, const struct bus *bus, action act, uint8_t act_type) {
+    switch (cpu->cycle) {
+    case 1:
+        cpu->ea = bus_peek(bus, cpu->pc++);
+        return 0;
+    case 2:
+        cpu->opr2 = bus_peek(bus, cpu->ea);
+        return 0;
+    case 3:
+        cpu->ea = bus_peek(bus, (cpu->ea + 1) & 0x00FF);
+        cpu->ea = (cpu->ea << 8) | cpu->opr2;
+        return 0;
+    case 4:
+        if (act_type == ACTION_RD) {
+            cpu->opr1 = bus_peek(bus, cpu->ea);
+            act(cpu);
+        } else {
+            act(cpu);
+            bus_poke(bus, cpu->ea, cpu->opr1);
+        }
+
+        return 1;
+    default:
+        return 1;
+    }
+}
+
+// ASL, LSR, ROL and ROR abs,X, which only take the fix-up cycle when the
+// index crosses a page
+static ALWAYS_INLINE int abx_shift(struct cpu *cpu, const struct bus *bus, action act, uint8_t act_type) {
+    (void)act_type;
     switch (cpu->cycle) {
     case 1:
         cpu->opr2 = bus_peek(bus, cpu->pc++);
-        instructions[cpu->opc].act(cpu);
+        return 0;
+    case 2:
+        cpu->ea = bus_peek(bus, cpu->pc++);
+        cpu->ea = (cpu->ea << 8) | (uint8_t)(cpu->opr2 + cpu->x);
+        return 0;
+    case 3:
+        if ((uint16_t)cpu->opr2 + cpu->x > 0xFF) {
+            bus_peek(bus, cpu->pc - 1);
+            cpu->ea += 0x0100;
+            return 0;
+        }
+
+        cpu->cycle++;
+        /* fall through */
+    case 4:
+        cpu->opr1 = bus_peek(bus, cpu->ea);
+        return 0;
+    case 5:
+        modify(bus, cpu->ea, cpu->opr1);
+        act(cpu);
+        return 0;
+    case 6:
+        bus_poke(bus, cpu->ea, cpu->opr1);
+        return 1;
+    default:
+        return 1;
+    }
+}
+
+#endif
+
+static ALWAYS_INLINE int rel(struct cpu *cpu, const struct bus *bus, action act, uint8_t act_type) {
+    (void)act_type;
+    switch (cpu->cycle) {
+    case 1:
+        cpu->opr2 = bus_peek(bus, cpu->pc++);
+        act(cpu);
 
         if (!cpu->opr1) {
             return 1;
@@ -1003,6 +884,66 @@ static int rel(struct cpu *cpu, const struct bus *bus) {
     }
 }
 
+
+//
+// Decoded instruction handlers
+//
+
+// Length in bytes, base cycle count and CPU_OP_* flags for each procedure
+#define MEM_FLAGS(t) ((t) & ACTION_WR ? CPU_OP_WRITE : 0)
+
+#define INFO_brk(t)     2, 7, CPU_OP_BRANCH | CPU_OP_PUSH
+#define INFO_rti(t)     1, 6, CPU_OP_BRANCH
+#define INFO_php(t)     1, 3, CPU_OP_PUSH
+#define INFO_plp(t)     1, 4, 0
+#define INFO_pha(t)     1, 3, CPU_OP_PUSH
+#define INFO_pla(t)     1, 4, 0
+#define INFO_jsr(t)     3, 6, CPU_OP_BRANCH | CPU_OP_PUSH
+#define INFO_rts(t)     1, 6, CPU_OP_BRANCH
+#define INFO_jmp_abl(t) 3, 3, CPU_OP_BRANCH
+#ifdef CPU_65C02
+#define INFO_jmp_ind(t) 3, 6, CPU_OP_BRANCH
+#else
+#define INFO_jmp_ind(t) 3, 5, CPU_OP_BRANCH
+#endif
+#define INFO_illegal(t) 1, 2, CPU_OP_JAM
+#define INFO_imm(t)     2, 2, 0
+#define INFO_imp(t)     1, 2, 0
+#define INFO_acc(t)     1, 2, 0
+#define INFO_zpg(t)     2, ((t) == ACTION_RMW ? 5 : 3), MEM_FLAGS(t)
+#define INFO_zpx(t)     2, ((t) == ACTION_RMW ? 6 : 4), MEM_FLAGS(t)
+#define INFO_zpy(t)     2, 4, MEM_FLAGS(t)
+#define INFO_abl(t)     3, ((t) == ACTION_RMW ? 6 : 4), MEM_FLAGS(t)
+#define INFO_abx(t)     3, ((t) == ACTION_RMW ? 7 : (t) == ACTION_WR ? 5 : 4), MEM_FLAGS(t)
+#define INFO_aby(t)     3, ((t) == ACTION_WR ? 5 : 4), MEM_FLAGS(t)
+#define INFO_idx(t)     2, 6, MEM_FLAGS(t)
+#define INFO_idy(t)     2, ((t) == ACTION_WR ? 6 : 5), MEM_FLAGS(t)
+#define INFO_rel(t)     2, 2, CPU_OP_BRANCH
+
+#ifdef CPU_65C02
+#define INFO_jmp_iax(t)   3, 6, CPU_OP_BRANCH
+#define INFO_phr(t)       1, 3, CPU_OP_PUSH
+#define INFO_plr(t)       1, 4, 0
+#define INFO_nop1(t)      1, 1, 0
+#define INFO_zpi(t)       2, 5, MEM_FLAGS(t)
+#define INFO_abx_shift(t) 3, 6, MEM_FLAGS(t)
+#endif
+
+#define OP(o, p, a, t) \
+    static int decoded_##o(struct cpu *cpu, const struct bus *bus, const uint8_t *opr) { \
+        cpu->opc = o; \
+        cpu->pc++; \
+        return EXEC(o, p, act_##a, t, cpu, bus, opr); \
+    }
+#include "opcodes.def"
+#undef OP
+
+const struct cpu_op cpu_ops[256] = {
+#define OP(opc, p, a, t) [opc] = { decoded_##opc, INFO_##p(t) },
+#include "opcodes.def"
+#undef OP
+};
+
 //
 // Public functions
 //
@@ -1011,9 +952,139 @@ void cpu_init(struct cpu *cpu, uint16_t pc) {
     memset(cpu, 0, sizeof(struct cpu));
     cpu->pc = pc;
     cpu->sp = 0xFF;
+    cpu_set_p(cpu, 0);
+}
+
+void cpu_assert(struct cpu *cpu, uint8_t line) {
+    if (line & INTR_NMI && !(cpu->lines & INTR_NMI)) {
+        cpu->intr |= INTR_NMI;
+    }
+
+    cpu->intr |= line & INTR_IRQ;
+    cpu->lines |= line & (INTR_NMI | INTR_IRQ);
+}
+
+void cpu_release(struct cpu *cpu, uint8_t line) {
+    cpu->intr &= ~(line & INTR_IRQ);
+    cpu->lines &= ~(line & (INTR_NMI | INTR_IRQ));
+}
+
+//
+// Breakpoints and watchpoints
+//
+
+static void watch_hit(struct cpu_watch *watch, int reason, uint16_t addr, uint8_t data) {
+    if (watch->reason == 0) {
+        watch->reason = reason;
+        watch->addr = addr;
+        watch->data = data;
+    }
+}
+
+// Whether a bit that was hit stops the CPU
+static int watch_stops(struct cpu_watch *watch, int reason, uint16_t addr, uint8_t data) {
+    return watch->filter == NULL || watch->filter(watch->filter_ctx, watch->cpu, watch->under, reason, addr, data);
+}
+
+static uint8_t watch_peek(void *inst, uint16_t addr) {
+    struct cpu_watch *watch = inst;
+    uint8_t data = bus_peek(watch->under, addr);
+
+    if (watch->read[addr >> 3] & 1 << (addr & 7) && watch_stops(watch, CPU_STOP_READ, addr, data)) {
+        watch_hit(watch, CPU_STOP_READ, addr, data);
+    }
+
+    return data;
+}
+
+static void watch_poke(void *inst, uint16_t addr, uint8_t data) {
+    struct cpu_watch *watch = inst;
+    bus_poke(watch->under, addr, data);
+
+    if (watch->write[addr >> 3] & 1 << (addr & 7) && watch_stops(watch, CPU_STOP_WRITE, addr, data)) {
+        watch_hit(watch, CPU_STOP_WRITE, addr, data);
+    }
+}
+
+void cpu_watch_init(struct cpu_watch *watch) {
+    memset(watch, 0, sizeof(*watch));
+
+    watch->bus.inst = watch;
+    watch->bus.peek = watch_peek;
+    watch->bus.poke = watch_poke;
+}
+
+void cpu_watch_set(struct cpu_watch *watch, int kinds, uint16_t addr, uint32_t size, int on) {
+    uint8_t *maps[] = { watch->exec, watch->read, watch->write };
+
+    for (int i = 0; i < 3; i++) {
+        if (!(kinds & 1 << i)) {
+            continue;
+        }
+
+        for (uint32_t offset = 0; offset < size; offset++) {
+            uint16_t a = addr + offset;
+
+            if (on) {
+                maps[i][a >> 3] |= 1 << (a & 7);
+            } else {
+                maps[i][a >> 3] &= ~(1 << (a & 7));
+            }
+        }
+    }
+
+    if (kinds & (WATCH_READ | WATCH_WRITE)) {
+        watch->accesses = on;
+        for (int i = 0; i < 0x2000 && !watch->accesses; i++) {
+            watch->accesses = watch->read[i] | watch->write[i];
+        }
+    }
 }
 
-void cpu_tick(struct cpu *cpu, const struct bus *bus) {
+// Points the watch at the CPU and the caller's bus, and returns its own bus
+// in its place if it watches accesses. A CPU the host has moved off the
+// breakpoint it stopped at isn't going on from it.
+static const struct bus *watch_arm(struct cpu_watch *watch, struct cpu *cpu, const struct bus *bus) {
+    if (watch->resuming && cpu->pc != watch->resume_pc) {
+        watch->resuming = 0;
+    }
+
+    watch->reason = 0;
+    watch->under = bus;
+    watch->cpu = cpu;
+    return watch->accesses ? &watch->bus : bus;
+}
+
+// Whether an execute breakpoint stops the CPU at the PC. The instruction
+// runs when the CPU goes on from it.
+static int watch_exec(struct cpu *cpu) {
+    struct cpu_watch *watch = cpu->watch;
+    uint16_t pc = cpu->pc;
+
+    if (!(watch->exec[pc >> 3] & 1 << (pc & 7))) {
+        return 0;
+    }
+
+    if (watch->resuming && watch->resume_pc == pc) {
+        watch->resuming = 0;
+        return 0;
+    }
+
+    if (!watch_stops(watch, CPU_STOP_BREAK, pc, 0)) {
+        return 0;
+    }
+
+    watch->resuming = 1;
+    watch->resume_pc = pc;
+    watch_hit(watch, CPU_STOP_BREAK, pc, 0);
+    return 1;
+}
+
+//
+// Cycle-stepped engine
+//
+
+static void tick(struct cpu *cpu, const struct bus *bus) {
     if (cpu->intr & INTR_RESET) {
         if (cpu->cycle == 0) {
             cpu->cycle++;
@@ -1030,7 +1101,31 @@ void cpu_tick(struct cpu *cpu, const struct bus *bus) {
     }
 
     if (cpu->cycle == 0) {
+        uint8_t skip = cpu->intr & INTR_SKIP;
+
+        if (cpu->intr && poll(cpu)) {
+            bus_peek(bus, cpu->pc);
+            cpu->opc = OPC_BRK;
+            cpu->intr |= INTR_ENTRY;
+            cpu->cycle++;
+            return;
+        }
+
+        // stopped before the fetch, as if the check hadn't happened
+        if (cpu->watch != NULL && watch_exec(cpu)) {
+            cpu->intr |= skip;
+            return;
+        }
+
         cpu->opc = bus_peek(bus, cpu->pc++);
+
+#ifdef CPU_65C02
+        // the one-cycle NOPs end here
+        if ((cpu->opc & 0x03) == 0x03) {
+            return;
+        }
+#endif
+
         cpu->cycle++;
         return;
     }
@@ -1044,271 +1139,294 @@ void cpu_tick(struct cpu *cpu, const struct bus *bus) {
     }
 }
 
-void cpu_step(struct cpu *cpu, const struct bus *bus) {
+int cpu_tick(struct cpu *cpu, const struct bus *bus) {
+    if (cpu->watch == NULL) {
+        tick(cpu, bus);
+        return 0;
+    }
+
+    tick(cpu, watch_arm(cpu->watch, cpu, bus));
+    return cpu->watch->reason;
+}
+
+int cpu_step(struct cpu *cpu, const struct bus *bus) {
+    int stop;
+
     do {
-        cpu_tick(cpu, bus);
-    } while (cpu->cycle != 0);
+        stop = cpu_tick(cpu, bus);
+    } while (cpu->cycle != 0 && !stop);
+
+    return stop;
+}
+
+//
+// Instruction-atomic engine
+//
+
+// step() with the checks for an execute breakpoint, on the watch's bus
+static int watched_step(struct cpu *cpu, const struct bus *bus) {
+    uint8_t skip = cpu->intr & INTR_SKIP;
+
+    if (cpu->intr) {
+        if (cpu->intr & INTR_RESET) {
+            return exec_rst(cpu, bus);
+        }
+
+        if (poll(cpu)) {
+            return interrupt(cpu, bus);
+        }
+    }
+
+    if (watch_exec(cpu)) {
+        cpu->intr |= skip;
+        return 0;
+    }
+
+    cpu->opc = bus_peek(bus, cpu->pc++);
+    return exec(cpu, bus);
+}
+
+int cpu_step_fast(struct cpu *cpu, const struct bus *bus) {
+    if (cpu->watch != NULL) {
+        bus = watch_arm(cpu->watch, cpu, bus);
+    }
+
+    // a partially ticked instruction takes the slow path
+    if (cpu->cycle != 0) {
+        int cycles = 0;
+
+        do {
+            tick(cpu, bus);
+            cycles++;
+        } while (cpu->cycle != 0);
+
+        return cycles;
+    }
+
+    return cpu->watch != NULL ? watched_step(cpu, bus) : step(cpu, bus);
+}
+
+int cpu_pending(const struct cpu *cpu) {
+    return pending(cpu->intr, cpu);
+}
+
+uint64_t cpu_run_fast(struct cpu *cpu, const struct bus *bus, uint64_t cycles) {
+    uint64_t ran = 0;
+
+    if (cpu->watch != NULL) {
+        while (ran < cycles) {
+            ran += cpu_step_fast(cpu, bus);
+            if (cpu->watch->reason != 0) {
+                break;
+            }
+        }
+
+        return ran;
+    }
+
+    if (cpu->cycle != 0) {
+        ran = cpu_step_fast(cpu, bus);
+    }
+
+    return ran < cycles ? ran + run_fast(cpu, bus, cycles - ran) : ran;
+}
+
+//
+// Idle loops
+//
+
+#define IDLE_MAX 16 // most instructions in a loop that can be skipped
+
+// A loop being watched: the registers it started with, at head
+struct idle_loop {
+    int on;
+    int length;
+    uint16_t head;
+    uint8_t a, x, y, sp, p;
+    uint64_t start;
+};
+
+static void idle_watch(struct idle_loop *loop, const struct cpu *cpu, uint64_t cycles) {
+    loop->on = 1;
+    loop->length = 0;
+    loop->head = cpu->pc;
+    loop->a = cpu->a;
+    loop->x = cpu->x;
+    loop->y = cpu->y;
+    loop->sp = cpu->sp;
+    loop->p = cpu_get_p(cpu);
+    loop->start = cycles;
+}
+
+// Whether the loop came back as it started, with no interrupt to break in
+static int idle_same(const struct idle_loop *loop, const struct cpu *cpu) {
+    return cpu->a == loop->a && cpu->x == loop->x && cpu->y == loop->y
+        && cpu->sp == loop->sp && cpu_get_p(cpu) == loop->p
+        && !(cpu->intr & ~INTR_IRQ) && (!(cpu->intr & INTR_IRQ) || cpu->p & P_I);
+}
+
+// Skips whole iterations that would end by `max`
+static uint64_t idle_skip(struct cpu_idle *idle, uint64_t period, uint64_t cycles, uint64_t max) {
+    uint64_t skip = cycles < max ? (max - cycles) / period * period : 0;
+
+    idle->skipped += skip;
+
+    if (idle->hz != 0 && skip != 0) {
+        uint64_t ns = skip * 1000000000 / idle->hz;
+        struct timespec ts = { ns / 1000000000, ns % 1000000000 };
+        nanosleep(&ts, NULL);
+    }
+
+    return skip;
+}
+
+// Follows the instruction that just ran from `pc`, watching for loops back
+// to where it went
+static ALWAYS_INLINE void idle_step(struct idle_loop *loop, struct cpu *cpu, uint16_t pc, uint64_t *cycles, uint64_t max) {
+    uint8_t flags = cpu_ops[cpu->opc].flags;
+
+    if (flags & (CPU_OP_WRITE | CPU_OP_PUSH)) {
+        loop->on = 0;
+        return;
+    }
+
+    if (loop->on && cpu->pc == loop->head) {
+        if (idle_same(loop, cpu)) {
+            *cycles += idle_skip(cpu->idle, *cycles - loop->start, *cycles, max);
+        }
+
+        idle_watch(loop, cpu, *cycles);
+        return;
+    }
+
+    if (loop->on && ++loop->length > IDLE_MAX) {
+        loop->on = 0;
+    }
+
+    if (!loop->on && flags & CPU_OP_BRANCH && cpu->pc <= pc) {
+        idle_watch(loop, cpu, *cycles);
+    }
+}
+
+// cpu_run(), built once with `watch` NULL so that unwatched runs have no
+// checks for it, and once with cpu->watch. Instructions run here go through
+// the watch's bus.
+static ALWAYS_INLINE struct cpu_result run(struct cpu *cpu, const struct bus *bus, uint64_t max_cycles, struct cpu_watch *watch) {
+    struct cpu_result result = { 0, CPU_STOP_BUDGET };
+    struct idle_loop loop = { 0 };
+
+    const struct bus *run_bus = watch != NULL ? watch_arm(watch, cpu, bus) : bus;
+
+    while (result.cycles < max_cycles && (cpu->cycle != 0 || cpu->intr & INTR_RESET)) {
+        result.cycles += cpu_step_fast(cpu, bus);
+
+        if (watch != NULL && watch->reason != 0) {
+            result.reason = watch->reason;
+            return result;
+        }
+    }
+
+    while (result.cycles < max_cycles) {
+        uint16_t pc = cpu->pc;
+
+        if (cpu->intr && (cpu->intr & INTR_RESET || poll(cpu))) {
+            result.cycles += cpu_step_fast(cpu, bus);
+
+            if (watch != NULL && watch->reason != 0) {
+                result.reason = watch->reason;
+                break;
+            }
+
+            continue;
+        }
+
+        if (cpu->halt) {
+            cpu->halt = 0;
+            result.reason = CPU_STOP_HOST;
+            break;
+        }
+
+        if (watch != NULL && watch_exec(cpu)) {
+            result.reason = CPU_STOP_BREAK;
+            break;
+        }
+
+        cpu->opc = bus_peek(run_bus, pc);
+        if (cpu_ops[cpu->opc].flags & CPU_OP_JAM) {
+            result.reason = CPU_STOP_JAM;
+            break;
+        }
+
+        cpu->pc++;
+        result.cycles += exec(cpu, run_bus);
+
+        if (watch != NULL && watch->reason != 0) {
+            result.reason = watch->reason;
+            break;
+        }
+
+        if (cpu->idle != NULL && watch == NULL) {
+            idle_step(&loop, cpu, pc, &result.cycles, max_cycles);
+            continue;
+        }
+
+        if (cpu->pc == pc) {
+            result.reason = CPU_STOP_TRAP;
+            break;
+        }
+    }
+
+    return result;
+}
+
+struct cpu_result cpu_run(struct cpu *cpu, const struct bus *bus, uint64_t max_cycles) {
+    if (cpu->watch != NULL) {
+        return run(cpu, bus, max_cycles, cpu->watch);
+    }
+
+    return run(cpu, bus, max_cycles, NULL);
+}
+
+void cpu_halt(struct cpu *cpu) {
+    cpu->halt = 1;
 }
 
 //
 // Instruction table
 //
 
+// Each opcode's procedure with its action and action type as constants, so
+// the act_type checks fold away and the action is called directly
+#ifdef CPU_65C02
+
+// A decimal-mode ADC or SBC runs one more cycle once its procedure is done
+#define OP(o, p, a, t) \
+    static int tick_##o(struct cpu *cpu, const struct bus *bus) { \
+        if (DECIMAL_OP(o) && cpu->cycle == CYCLE_DECIMAL) { \
+            bus_peek(bus, cpu->pc); \
+            return 1; \
+        } \
+        if (!p(cpu, bus, act_##a, t)) { \
+            return 0; \
+        } \
+        if (DECIMAL_OP(o) && cpu_get_p(cpu) & P_D) { \
+            cpu->cycle = CYCLE_DECIMAL - 1; \
+            return 0; \
+        } \
+        return 1; \
+    }
+
+#else
+
+#define OP(o, p, a, t) \
+    static int tick_##o(struct cpu *cpu, const struct bus *bus) { return p(cpu, bus, act_##a, t); }
+
+#endif
+#include "opcodes.def"
+#undef OP
+
 static const struct instruction instructions[] = {
-/* 0x00 */ { .proc = brk,     .act = NULL, .act_type = 0          },
-/* 0x01 */ { .proc = idx,     .act = ora,  .act_type = ACTION_RD  },
-/* 0x02 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x03 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x04 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x05 */ { .proc = zpg,     .act = ora,  .act_type = ACTION_RD  },
-/* 0x06 */ { .proc = zpg,     .act = asl,  .act_type = ACTION_RMW },
-/* 0x07 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x08 */ { .proc = php,     .act = NULL, .act_type = 0          },
-/* 0x09 */ { .proc = imm,     .act = ora,  .act_type = ACTION_RD  },
-/* 0x0A */ { .proc = acc,     .act = asl,  .act_type = ACTION_RMW },
-/* 0x0B */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x0C */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x0D */ { .proc = abl,     .act = ora,  .act_type = ACTION_RD  },
-/* 0x0E */ { .proc = abl,     .act = asl,  .act_type = ACTION_RMW },
-/* 0x0F */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x10 */ { .proc = rel,     .act = bpl,  .act_type = 0          },
-/* 0x11 */ { .proc = idy,     .act = ora,  .act_type = ACTION_RD  },
-/* 0x12 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x13 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x14 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x15 */ { .proc = zpx,     .act = ora,  .act_type = ACTION_RD  },
-/* 0x16 */ { .proc = zpx,     .act = asl,  .act_type = ACTION_RMW },
-/* 0x17 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x18 */ { .proc = imp,     .act = clc,  .act_type = 0          },
-/* 0x19 */ { .proc = aby,     .act = ora,  .act_type = ACTION_RD  },
-/* 0x1A */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x1B */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x1C */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x1D */ { .proc = abx,     .act = ora,  .act_type = ACTION_RD  },
-/* 0x1E */ { .proc = abx,     .act = asl,  .act_type = ACTION_RMW },
-/* 0x1F */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x20 */ { .proc = jsr,     .act = NULL, .act_type = 0          },
-/* 0x21 */ { .proc = idx,     .act = and,  .act_type = ACTION_RD  },
-/* 0x22 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x23 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x24 */ { .proc = zpg,     .act = bit,  .act_type = ACTION_RD  },
-/* 0x25 */ { .proc = zpg,     .act = and,  .act_type = ACTION_RD  },
-/* 0x26 */ { .proc = zpg,     .act = rol,  .act_type = ACTION_RMW },
-/* 0x27 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x28 */ { .proc = plp,     .act = NULL, .act_type = 0          },
-/* 0x29 */ { .proc = imm,     .act = and,  .act_type = ACTION_RD  },
-/* 0x2A */ { .proc = acc,     .act = rol,  .act_type = ACTION_RMW },
-/* 0x2B */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x2C */ { .proc = abl,     .act = bit,  .act_type = ACTION_RD  },
-/* 0x2D */ { .proc = abl,     .act = and,  .act_type = ACTION_RD  },
-/* 0x2E */ { .proc = abl,     .act = rol,  .act_type = ACTION_RMW },
-/* 0x2F */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x30 */ { .proc = rel,     .act = bmi,  .act_type = 0          },
-/* 0x31 */ { .proc = idy,     .act = and,  .act_type = ACTION_RD  },
-/* 0x32 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x33 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x34 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x35 */ { .proc = zpx,     .act = and,  .act_type = ACTION_RD  },
-/* 0x36 */ { .proc = zpx,     .act = rol,  .act_type = ACTION_RMW },
-/* 0x37 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x38 */ { .proc = imp,     .act = sec,  .act_type = 0          },
-/* 0x39 */ { .proc = aby,     .act = and,  .act_type = ACTION_RD  },
-/* 0x3A */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x3B */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x3C */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x3D */ { .proc = abx,     .act = and,  .act_type = ACTION_RD  },
-/* 0x3E */ { .proc = abx,     .act = rol,  .act_type = ACTION_RMW },
-/* 0x3F */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x40 */ { .proc = rti,     .act = NULL, .act_type = 0          },
-/* 0x41 */ { .proc = idx,     .act = eor,  .act_type = ACTION_RD  },
-/* 0x42 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x43 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x44 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x45 */ { .proc = zpg,     .act = eor,  .act_type = ACTION_RD  },
-/* 0x46 */ { .proc = zpg,     .act = lsr,  .act_type = ACTION_RMW },
-/* 0x47 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x48 */ { .proc = pha,     .act = NULL, .act_type = 0          },
-/* 0x49 */ { .proc = imm,     .act = eor,  .act_type = ACTION_RD  },
-/* 0x4A */ { .proc = acc,     .act = lsr,  .act_type = ACTION_RMW },
-/* 0x4B */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x4C */ { .proc = jmp_abl, .act = NULL, .act_type = 0          },
-/* 0x4D */ { .proc = abl,     .act = eor,  .act_type = ACTION_RD  },
-/* 0x4E */ { .proc = abl,     .act = lsr,  .act_type = ACTION_RMW },
-/* 0x4F */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x50 */ { .proc = rel,     .act = bvc,  .act_type = 0          },
-/* 0x51 */ { .proc = idy,     .act = eor,  .act_type = ACTION_RD  },
-/* 0x52 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x53 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x54 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x55 */ { .proc = zpx,     .act = eor,  .act_type = ACTION_RD  },
-/* 0x56 */ { .proc = zpx,     .act = lsr,  .act_type = ACTION_RMW },
-/* 0x57 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x58 */ { .proc = imp,     .act = cli,  .act_type = 0          },
-/* 0x59 */ { .proc = aby,     .act = eor,  .act_type = ACTION_RD  },
-/* 0x5A */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x5B */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x5C */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x5D */ { .proc = abx,     .act = eor,  .act_type = ACTION_RD  },
-/* 0x5E */ { .proc = abx,     .act = lsr,  .act_type = ACTION_RMW },
-/* 0x5F */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x60 */ { .proc = rts,     .act = NULL, .act_type = 0          },
-/* 0x61 */ { .proc = idx,     .act = adc,  .act_type = ACTION_RD  },
-/* 0x62 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x63 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x64 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x65 */ { .proc = zpg,     .act = adc,  .act_type = ACTION_RD  },
-/* 0x66 */ { .proc = zpg,     .act = ror,  .act_type = ACTION_RMW },
-/* 0x67 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x68 */ { .proc = pla,     .act = NULL, .act_type = 0          },
-/* 0x69 */ { .proc = imm,     .act = adc,  .act_type = ACTION_RD  },
-/* 0x6A */ { .proc = acc,     .act = ror,  .act_type = ACTION_RMW },
-/* 0x6B */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x6C */ { .proc = jmp_ind, .act = NULL, .act_type = 0          },
-/* 0x6D */ { .proc = abl,     .act = adc,  .act_type = ACTION_RD  },
-/* 0x6E */ { .proc = abl,     .act = ror,  .act_type = ACTION_RMW },
-/* 0x6F */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x70 */ { .proc = rel,     .act = bvs,  .act_type = 0          },
-/* 0x71 */ { .proc = idy,     .act = adc,  .act_type = ACTION_RD  },
-/* 0x72 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x73 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x74 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x75 */ { .proc = zpx,     .act = adc,  .act_type = ACTION_RD  },
-/* 0x76 */ { .proc = zpx,     .act = ror,  .act_type = ACTION_RMW },
-/* 0x77 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x78 */ { .proc = imp,     .act = sei,  .act_type = 0          },
-/* 0x79 */ { .proc = aby,     .act = adc,  .act_type = ACTION_RD  },
-/* 0x7A */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x7B */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x7C */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x7D */ { .proc = abx,     .act = adc,  .act_type = ACTION_RD  },
-/* 0x7E */ { .proc = abx,     .act = ror,  .act_type = ACTION_RMW },
-/* 0x7F */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x80 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x81 */ { .proc = idx,     .act = sta,  .act_type = ACTION_WR  },
-/* 0x82 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x83 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x84 */ { .proc = zpg,     .act = sty,  .act_type = ACTION_WR  },
-/* 0x85 */ { .proc = zpg,     .act = sta,  .act_type = ACTION_WR  },
-/* 0x86 */ { .proc = zpg,     .act = stx,  .act_type = ACTION_WR  },
-/* 0x87 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x88 */ { .proc = imp,     .act = dey,  .act_type = 0          },
-/* 0x89 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x8A */ { .proc = imp,     .act = txa,  .act_type = 0          },
-/* 0x8B */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x8C */ { .proc = abl,     .act = sty,  .act_type = ACTION_WR  },
-/* 0x8D */ { .proc = abl,     .act = sta,  .act_type = ACTION_WR  },
-/* 0x8E */ { .proc = abl,     .act = stx,  .act_type = ACTION_WR  },
-/* 0x8F */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x90 */ { .proc = rel,     .act = bcc,  .act_type = 0          },
-/* 0x91 */ { .proc = idy,     .act = sta,  .act_type = ACTION_WR  },
-/* 0x92 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x93 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x94 */ { .proc = zpx,     .act = sty,  .act_type = ACTION_WR  },
-/* 0x95 */ { .proc = zpx,     .act = sta,  .act_type = ACTION_WR  },
-/* 0x96 */ { .proc = zpy,     .act = stx,  .act_type = ACTION_WR  },
-/* 0x97 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x98 */ { .proc = imp,     .act = tya,  .act_type = 0          },
-/* 0x99 */ { .proc = aby,     .act = sta,  .act_type = ACTION_WR  },
-/* 0x9A */ { .proc = imp,     .act = txs,  .act_type = 0          },
-/* 0x9B */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x9C */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x9D */ { .proc = abx,     .act = sta,  .act_type = ACTION_WR  },
-/* 0x9E */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0x9F */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xA0 */ { .proc = imm,     .act = ldy,  .act_type = ACTION_RD  },
-/* 0xA1 */ { .proc = idx,     .act = lda,  .act_type = ACTION_RD  },
-/* 0xA2 */ { .proc = imm,     .act = ldx,  .act_type = ACTION_RD  },
-/* 0xA3 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xA4 */ { .proc = zpg,     .act = ldy,  .act_type = ACTION_RD  },
-/* 0xA5 */ { .proc = zpg,     .act = lda,  .act_type = ACTION_RD  },
-/* 0xA6 */ { .proc = zpg,     .act = ldx,  .act_type = ACTION_RD  },
-/* 0xA7 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xA8 */ { .proc = imp,     .act = tay,  .act_type = 0          },
-/* 0xA9 */ { .proc = imm,     .act = lda,  .act_type = ACTION_RD  },
-/* 0xAA */ { .proc = imp,     .act = tax,  .act_type = 0          },
-/* 0xAB */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xAC */ { .proc = abl,     .act = ldy,  .act_type = ACTION_RD  },
-/* 0xAD */ { .proc = abl,     .act = lda,  .act_type = ACTION_RD  },
-/* 0xAE */ { .proc = abl,     .act = ldx,  .act_type = ACTION_RD  },
-/* 0xAF */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xB0 */ { .proc = rel,     .act = bcs,  .act_type = 0          },
-/* 0xB1 */ { .proc = idy,     .act = lda,  .act_type = ACTION_RD  },
-/* 0xB2 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xB3 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xB4 */ { .proc = zpx,     .act = ldy,  .act_type = ACTION_RD  },
-/* 0xB5 */ { .proc = zpx,     .act = lda,  .act_type = ACTION_RD  },
-/* 0xB6 */ { .proc = zpy,     .act = ldx,  .act_type = ACTION_RD  },
-/* 0xB7 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xB8 */ { .proc = imp,     .act = clv,  .act_type = 0          },
-/* 0xB9 */ { .proc = aby,     .act = lda,  .act_type = ACTION_RD  },
-/* 0xBA */ { .proc = imp,     .act = tsx,  .act_type = ACTION_RD  },
-/* 0xBB */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xBC */ { .proc = abx,     .act = ldy,  .act_type = ACTION_RD  },
-/* 0xBD */ { .proc = abx,     .act = lda,  .act_type = ACTION_RD  },
-/* 0xBE */ { .proc = aby,     .act = ldx,  .act_type = ACTION_RD  },
-/* 0xBF */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xC0 */ { .proc = imm,     .act = cpy,  .act_type = ACTION_RD  },
-/* 0xC1 */ { .proc = idx,     .act = cmp,  .act_type = ACTION_RD  },
-/* 0xC2 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xC3 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xC4 */ { .proc = zpg,     .act = cpy,  .act_type = ACTION_RD  },
-/* 0xC5 */ { .proc = zpg,     .act = cmp,  .act_type = ACTION_RD  },
-/* 0xC6 */ { .proc = zpg,     .act = dec,  .act_type = ACTION_RMW },
-/* 0xC7 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xC8 */ { .proc = imp,     .act = iny,  .act_type = ACTION_RMW },
-/* 0xC9 */ { .proc = imm,     .act = cmp,  .act_type = ACTION_RD  },
-/* 0xCA */ { .proc = imp,     .act = dex,  .act_type = 0          },
-/* 0xCB */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xCC */ { .proc = abl,     .act = cpy,  .act_type = ACTION_RD  },
-/* 0xCD */ { .proc = abl,     .act = cmp,  .act_type = ACTION_RD  },
-/* 0xCE */ { .proc = abl,     .act = dec,  .act_type = ACTION_RMW },
-/* 0xCF */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xD0 */ { .proc = rel,     .act = bne,  .act_type = 0          },
-/* 0xD1 */ { .proc = idy,     .act = cmp,  .act_type = ACTION_RD  },
-/* 0xD2 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xD3 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xD4 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xD5 */ { .proc = zpx,     .act = cmp,  .act_type = ACTION_RD  },
-/* 0xD6 */ { .proc = zpx,     .act = dec,  .act_type = ACTION_RMW },
-/* 0xD7 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xD8 */ { .proc = imp,     .act = cld,  .act_type = 0          },
-/* 0xD9 */ { .proc = aby,     .act = cmp,  .act_type = ACTION_RD  },
-/* 0xDA */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xDB */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xDC */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xDD */ { .proc = abx,     .act = cmp,  .act_type = ACTION_RD  },
-/* 0xDE */ { .proc = abx,     .act = dec,  .act_type = ACTION_RMW },
-/* 0xDF */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xE0 */ { .proc = imm,     .act = cpx,  .act_type = ACTION_RD  },
-/* 0xE1 */ { .proc = idx,     .act = sbc,  .act_type = ACTION_RD  },
-/* 0xE2 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xE3 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xE4 */ { .proc = zpg,     .act = cpx,  .act_type = ACTION_RD  },
-/* 0xE5 */ { .proc = zpg,     .act = sbc,  .act_type = ACTION_RD  },
-/* 0xE6 */ { .proc = zpg,     .act = inc,  .act_type = ACTION_RMW },
-/* 0xE7 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xE8 */ { .proc = imp,     .act = inx,  .act_type = ACTION_RMW },
-/* 0xE9 */ { .proc = imm,     .act = sbc,  .act_type = ACTION_RD  },
-/* 0xEA */ { .proc = imp,     .act = nop,  .act_type = 0          },
-/* 0xEB */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xEC */ { .proc = abl,     .act = cpx,  .act_type = ACTION_RD  },
-/* 0xED */ { .proc = abl,     .act = sbc,  .act_type = ACTION_RD  },
-/* 0xEE */ { .proc = abl,     .act = inc,  .act_type = ACTION_RMW },
-/* 0xEF */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xF0 */ { .proc = rel,     .act = beq,  .act_type = 0          },
-/* 0xF1 */ { .proc = idy,     .act = sbc,  .act_type = ACTION_RD  },
-/* 0xF2 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xF3 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xF4 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xF5 */ { .proc = zpx,     .act = sbc,  .act_type = ACTION_RD  },
-/* 0xF6 */ { .proc = zpx,     .act = inc,  .act_type = ACTION_RMW },
-/* 0xF7 */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xF8 */ { .proc = imp,     .act = sed,  .act_type = 0          },
-/* 0xF9 */ { .proc = aby,     .act = sbc,  .act_type = ACTION_RD  },
-/* 0xFA */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xFB */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xFC */ { .proc = illegal, .act = NULL, .act_type = 0          },
-/* 0xFD */ { .proc = abx,     .act = sbc,  .act_type = ACTION_RD  },
-/* 0xFE */ { .proc = abx,     .act = inc,  .act_type = ACTION_RMW },
-/* 0xFF */ { .proc = illegal, .act = NULL, .act_type = 0          },
+#define OP(opc, p, a, t) [opc] = { .proc = tick_##opc },
+#include "opcodes.def"
+#undef OP
 };
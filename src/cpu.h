@@ -5,9 +5,33 @@
 
 #include "bus.h"
 
+// The CPU the core is built for, fixed at compile time. Each build has only
+// its own opcode table and semantics compiled in.
+//
+//     (default)   NMOS 6502
+//     CPU_2A03    Ricoh 2A03, the NES CPU: an NMOS 6502 without decimal
+//                 mode. SED and CLD still set and clear D, but ADC and SBC
+//                 ignore it.
+//     CPU_65C02   CMOS 65C02, without the Rockwell and WDC bit instructions
+//                 or WAI and STP. Undefined opcodes are NOPs, JMP (abs) has
+//                 no page-wrap bug, decimal mode sets N and Z and takes a
+//                 cycle more, and resets, BRK and interrupts clear D.
+#if defined(CPU_2A03) && defined(CPU_65C02)
+#error "CPU_2A03 and CPU_65C02 are different CPUs"
+#endif
+
+// Pending interrupts in cpu->intr. INTR_NMI is latched on the NMI line's
+// rising edge and cleared when the NMI is taken; INTR_IRQ follows the IRQ
+// line. The rest are internal: INTR_ENTRY while cpu_tick() runs an NMI or
+// IRQ entry, and INTR_SKIP when the next interrupt check is skipped.
 #define INTR_RESET (1 << 0)
 #define INTR_NMI   (1 << 1)
 #define INTR_IRQ   (1 << 2)
+#define INTR_ENTRY (1 << 3)
+#define INTR_SKIP  (1 << 4)
+
+struct cpu_idle;
+struct cpu_watch;
 
 struct cpu {
     uint16_t pc;
@@ -21,7 +45,16 @@ struct cpu {
     uint8_t opr1;
     uint8_t opr2;
     uint8_t intr;
+    uint8_t lines;  // INTR_NMI and INTR_IRQ while devices hold them asserted
+    uint8_t last_i; // P_I before the last CLI, SEI or PLP, which the next
+                    // IRQ check still sees
     uint16_t ea;
+    uint8_t n;  // with CPU_LAZY_FLAGS, N is bit 7 of n
+    uint8_t z;  // and Z is set when z is 0
+
+    struct cpu_idle *idle;  // turns on idle-loop skipping in cpu_run()
+    struct cpu_watch *watch;    // breakpoints and watchpoints, or NULL
+    volatile uint8_t halt;  // set by cpu_halt() to stop cpu_run()
 };
 
 #define P_N (1 << 7)
@@ -33,8 +66,171 @@ struct cpu {
 #define P_Z (1 << 1)
 #define P_C (1 << 0)
 
+// The status register. Build with CPU_LAZY_FLAGS to have instructions store
+// the results N and Z come from instead of updating p, and fold them in only
+// when P is observed: PHP, BRK, branches and these accessors. Outside the
+// core, always go through cpu_get_p() and cpu_set_p() rather than p.
+inline uint8_t cpu_get_p(const struct cpu *cpu) {
+#ifdef CPU_LAZY_FLAGS
+    return (cpu->p & ~(P_N | P_Z)) | (cpu->n & P_N) | (cpu->z ? 0 : P_Z);
+#else
+    return cpu->p;
+#endif
+}
+
+inline void cpu_set_p(struct cpu *cpu, uint8_t p) {
+    cpu->p = p;
+#ifdef CPU_LAZY_FLAGS
+    cpu->n = p;
+    cpu->z = !(p & P_Z);
+#endif
+}
+
 void cpu_init(struct cpu *cpu, uint16_t pc);
-void cpu_tick(struct cpu *cpu, const struct bus *bus);
-void cpu_step(struct cpu *cpu, const struct bus *bus);
+
+// Assert and release the NMI and IRQ lines, from device code or bus callbacks
+// while the CPU runs. Interrupts are checked between instructions: an NMI is
+// taken after the rising edge of its line, an IRQ while its line is held and
+// I is clear. Either takes 7 cycles to reach the first handler instruction,
+// and an NMI that arrives before the vector is fetched takes over an IRQ or
+// BRK already under way, as on an NMOS 6502.
+void cpu_assert(struct cpu *cpu, uint8_t line);
+void cpu_release(struct cpu *cpu, uint8_t line);
+
+// cpu_tick() runs one cycle and cpu_step() the rest of the instruction.
+// Both return 0, or the enum cpu_stop reason a breakpoint or watchpoint
+// stopped them for (see struct cpu_watch).
+int cpu_tick(struct cpu *cpu, const struct bus *bus);
+int cpu_step(struct cpu *cpu, const struct bus *bus);
+
+// Instruction-atomic engine. Same bus accesses and cycle counts as cpu_tick(),
+// but each instruction runs start to finish in one call. cpu_step_fast()
+// returns the cycles the instruction took; cpu_run_fast() runs whole
+// instructions until at least `cycles` have elapsed and returns the total.
+int cpu_step_fast(struct cpu *cpu, const struct bus *bus);
+uint64_t cpu_run_fast(struct cpu *cpu, const struct bus *bus, uint64_t cycles);
+
+// Whether the next cpu_step_fast() starts a reset or interrupt, or skips an
+// interrupt check, rather than only running an instruction. Engines that run
+// instructions their own way hand over to cpu_step_fast() when it is set. An
+// IRQ held while I masks it doesn't count.
+int cpu_pending(const struct cpu *cpu);
+
+// Why cpu_run() returned
+enum cpu_stop {
+    CPU_STOP_BUDGET,    // ran at least max_cycles
+    CPU_STOP_TRAP,      // an instruction jumped or branched to itself
+    CPU_STOP_JAM,       // the next opcode is one the core does not implement
+    CPU_STOP_BREAK,     // the next instruction is at a breakpoint
+    CPU_STOP_HOST,      // cpu_halt() was called
+    CPU_STOP_READ,      // the CPU read an address being watched
+    CPU_STOP_WRITE,     // the CPU wrote an address being watched
+};
+
+struct cpu_result {
+    uint64_t cycles;
+    enum cpu_stop reason;
+};
+
+// Runs whole instructions like cpu_run_fast() until max_cycles have elapsed
+// or a stop condition fires. On a trap the looping instruction has run; on
+// a jam or breakpoint the CPU is left before the instruction, which has not.
+// Breakpoints are the execute bits of cpu->watch.
+struct cpu_result cpu_run(struct cpu *cpu, const struct bus *bus, uint64_t max_cycles);
+
+// Idle-loop skipping for cpu_run(), on while cpu->idle points here. A loop
+// that comes back to its start with the same registers without writing
+// memory is spinning on memory only a device can change. cpu_run() takes
+// devices to change memory only between calls, or to assert an interrupt,
+// so it skips whole iterations of such a loop up to max_cycles: callers run
+// up to their next device event. Reads in skipped iterations never reach
+// the bus. Cycle counts and the state cpu_run() stops in are the same as
+// without skipping, except that a jump to itself no longer stops the run.
+// Skipping is off while a watch is set.
+struct cpu_idle {
+    uint64_t skipped;   // cycles skipped so far
+    uint32_t hz;        // nonzero to sleep for skipped cycles at this clock rate
+};
+
+// Breakpoints and watchpoints, armed while cpu->watch points here, so a CPU
+// without one pays nothing. Each bitmap has a bit per address, set with
+// cpu_watch_set(). While armed, the CPU tests the PC against `exec` at each
+// instruction boundary and reaches the bus through the watch, which tests
+// each read and write against its bitmap and passes it on. The bus then
+// only sees callbacks, so armed runs go at the speed of a callback bus,
+// unless only execute bits are set: breakpoints alone leave the bus as it
+// is and cost a bit test per instruction.
+//
+// An execute breakpoint stops the CPU before the instruction: cpu_tick()
+// and cpu_step() return CPU_STOP_BREAK without running a cycle, and
+// cpu_step_fast() returns 0 cycles. Going on from there runs the
+// instruction, unless the host has moved the PC first. A read or write
+// watchpoint lets the access happen and stops at the next boundary: the end
+// of the cycle under cpu_tick() and cpu_step(), or of the instruction under
+// the other engines. cpu_run() returns the reason, and cpu_run_fast()
+// returns early. Every access the CPU makes counts, including fetches, stack
+// accesses and dummy accesses. dcache_run(), jit_run(), trace_run() and the
+// C++ Cpu don't look at the watch.
+//
+// A bit that is hit can be filtered: if `filter` is set, the CPU only stops
+// when it returns nonzero. It gets the caller's bus, and the data read or
+// written (0 for execute breakpoints), mid-instruction for watchpoints.
+#define WATCH_EXEC  (1 << 0)
+#define WATCH_READ  (1 << 1)
+#define WATCH_WRITE (1 << 2)
+
+struct cpu_watch {
+    uint8_t exec[0x2000];
+    uint8_t read[0x2000];
+    uint8_t write[0x2000];
+
+    // the last stop: CPU_STOP_BREAK, CPU_STOP_READ or CPU_STOP_WRITE with
+    // the address and the data read or written, or 0
+    int reason;
+    uint16_t addr;
+    uint8_t data;
+
+    int (*filter)(void *ctx, struct cpu *cpu, const struct bus *bus, int reason, uint16_t addr, uint8_t data);
+    void *filter_ctx;
+
+    // internal
+    struct bus bus;
+    const struct bus *under;
+    struct cpu *cpu;
+    int accesses;       // read or write bits are set
+    int resuming;
+    uint16_t resume_pc;
+};
+
+// Clears every bitmap and the filter.
+void cpu_watch_init(struct cpu_watch *watch);
+
+// Sets or clears the `kinds` (WATCH_*) bits for [addr, addr + size).
+void cpu_watch_set(struct cpu_watch *watch, int kinds, uint16_t addr, uint32_t size, int on);
+
+// Asks cpu_run() to return at the next instruction boundary. Safe to call
+// from a bus callback or another thread.
+void cpu_halt(struct cpu *cpu);
+
+// Pre-decoded execution, for engines that cache decoded instructions.
+// cpu_ops[opcode].exec runs that instruction with cpu->pc pointing at its
+// opcode, taking the operand bytes from `opr` instead of fetching them from
+// the bus. Every other bus access is the same as cpu_tick(). It returns the
+// cycles taken.
+#define CPU_OP_BRANCH (1 << 0) // may transfer control
+#define CPU_OP_WRITE  (1 << 1) // writes memory at cpu->ea
+#define CPU_OP_PUSH   (1 << 2) // writes the stack page
+#define CPU_OP_JAM    (1 << 3) // not implemented: does nothing for 2 cycles
+
+typedef int (*cpu_handler)(struct cpu *cpu, const struct bus *bus, const uint8_t *opr);
+
+struct cpu_op {
+    cpu_handler exec;
+    uint8_t length;
+    uint8_t cycles;
+    uint8_t flags;
+};
+
+extern const struct cpu_op cpu_ops[256];
 
 #endif
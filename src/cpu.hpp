@@ -0,0 +1,94 @@
+#ifndef __CPU_HPP__
+#define __CPU_HPP__
+
+#include <stddef.h>
+#include <stdint.h>
+
+extern "C" {
+#include "cpu.h"
+}
+
+// C++ front end to the instruction-atomic engine. Cpu<Bus> runs the same
+// code as cpu_step_fast() and cpu_run_fast(), but calls the bus policy
+// directly instead of through struct bus, so a simple bus compiles into the
+// engine. A bus policy is any class with
+//
+//     uint8_t peek(uint16_t addr);
+//     void poke(uint16_t addr, uint8_t data);
+//
+// and CBus makes a C struct bus into one. Build with the same CPU_* defines
+// as cpu.c, and link with it for cpu_init() and the decimal-mode tables.
+
+namespace mos6502 {
+
+namespace detail {
+
+template <class Bus>
+inline __attribute__((always_inline)) uint8_t bus_peek(Bus *bus, uint16_t addr) {
+    return bus->peek(addr);
+}
+
+template <class Bus>
+inline __attribute__((always_inline)) void bus_poke(Bus *bus, uint16_t addr, uint8_t data) {
+    bus->poke(addr, data);
+}
+
+#define CPU_TEMPLATE template <class Bus>
+#define CPU_BUS Bus *
+#include "cpu_exec.h"
+#undef CPU_TEMPLATE
+#undef CPU_BUS
+
+}
+
+// A struct bus as a bus policy
+class CBus {
+public:
+    explicit CBus(const struct bus *bus) : bus_(bus) {}
+
+    __attribute__((always_inline)) uint8_t peek(uint16_t addr) {
+        return ::bus_peek(bus_, addr);
+    }
+
+    __attribute__((always_inline)) void poke(uint16_t addr, uint8_t data) {
+        ::bus_poke(bus_, addr, data);
+    }
+
+private:
+    const struct bus *bus_;
+};
+
+// The registers are a plain struct cpu, so the C functions that take one
+// (cpu_get_p(), cpu_assert(), ...) work on them. Cpu never stops part-way
+// through an instruction; don't tick its registers with cpu_tick().
+template <class Bus>
+class Cpu {
+public:
+    struct cpu regs;
+
+    explicit Cpu(Bus &bus, uint16_t pc = 0) : bus_(&bus) {
+        cpu_init(&regs, pc);
+    }
+
+    Bus &bus() {
+        return *bus_;
+    }
+
+    // As cpu_step_fast(): runs one instruction and returns its cycles
+    int step() {
+        return detail::step(&regs, bus_);
+    }
+
+    // As cpu_run_fast(): runs whole instructions until at least `cycles`
+    // have elapsed and returns the total
+    uint64_t run(uint64_t cycles) {
+        return detail::run_fast(&regs, bus_, cycles);
+    }
+
+private:
+    Bus *bus_;
+};
+
+}
+
+#endif
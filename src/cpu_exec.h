@@ -0,0 +1,1147 @@
+#ifndef __CPU_EXEC_H__
+#define __CPU_EXEC_H__
+
+#include <stddef.h>
+
+#include "cpu.h"
+
+// The instruction-atomic engine behind cpu_step_fast() and cpu_run_fast(),
+// shared by cpu.c and the C++ front end in cpu.hpp. It is written against a
+// bus of type CPU_BUS, accessed only through bus_peek() and bus_poke(), and
+// every function that takes the bus is prefixed with CPU_TEMPLATE. cpu.c
+// defines them for struct bus; cpu.hpp makes them templates over a bus
+// policy so that simple buses compile into the engine. Define both, then
+// include this once.
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+typedef void (*action)(struct cpu *cpu);
+
+#define ACTION_RD  (1 << 0)
+#define ACTION_WR  (1 << 1)
+#define ACTION_RMW (ACTION_RD | ACTION_WR)
+
+// Actions are act_<name> after the action column of opcodes.def
+#define act_NULL NULL
+
+#ifdef CPU_LAZY_FLAGS
+
+// N and Z stay in cpu->n and cpu->z until cpu_get_p() folds them into P
+static void set_z(struct cpu *cpu, uint8_t data) {
+    cpu->z = data;
+}
+
+static void set_n(struct cpu *cpu, uint8_t data) {
+    cpu->n = data;
+}
+
+#else
+
+static void set_z(struct cpu *cpu, uint8_t data) {
+    cpu->p &= ~P_Z;
+    cpu->p |= data ? 0 : P_Z;
+}
+
+static void set_n(struct cpu *cpu, uint8_t data) {
+    cpu->p &= ~P_N;
+    cpu->p |= data & 0x80 ? P_N : 0;
+}
+
+#endif
+
+static void set_v(struct cpu *cpu, uint8_t in1, uint8_t in2, uint8_t out) {
+    /*
+    int u_over = (in1 & 0x80) && (in2 & 0x80) && !(out & 0x80);
+    int s_over = !(in1 & 0x80) && !(in2 & 0x80) && (out & 0x80);
+
+    cpu->p &= ~P_V;
+    cpu->p |= u_over || s_over ? P_V : 0;
+    */
+    cpu->p &= ~P_V;
+    cpu->p |= (in1 ^ out) & (in2 ^ out) & 0x80 ? P_V : 0;
+}
+
+CPU_TEMPLATE static void push_stack(struct cpu *cpu, CPU_BUS bus, uint8_t data) {
+    bus_poke(bus, 0x0100 | cpu->sp, data);
+    cpu->sp--;
+}
+
+CPU_TEMPLATE static uint8_t pop_stack(struct cpu *cpu, CPU_BUS bus) {
+    cpu->sp++;
+    return bus_peek(bus, 0x0100 | cpu->sp);
+}
+
+CPU_TEMPLATE static uint8_t curr_stack(struct cpu *cpu, CPU_BUS bus) {
+    return bus_peek(bus, 0x0100 | cpu->sp);
+}
+
+// The cycle a read-modify-write spends modifying: the NMOS 6502 writes the
+// value it read straight back, the 65C02 reads it again
+CPU_TEMPLATE static ALWAYS_INLINE void modify(CPU_BUS bus, uint16_t addr, uint8_t data) {
+#ifdef CPU_65C02
+    (void)data;
+    bus_peek(bus, addr);
+#else
+    bus_poke(bus, addr, data);
+#endif
+}
+
+//
+// Decimal mode
+//
+// ADC and SBC with D set look up their result in tables indexed by carry,
+// accumulator and operand, which cpu.c fills in. Each entry holds the
+// accumulator in the low byte and the N, V, Z and C flags in the high byte,
+// as an NMOS 6502 sets them for any input, valid BCD or not: N and V come
+// from the intermediate sum after the low-digit adjust, Z from the binary
+// sum, and SBC sets every flag as in binary mode. The 65C02 sets N and Z
+// from the result instead, and its SBC adjusts the binary difference, which
+// gives other results for invalid BCD. The 2A03 has no decimal mode, and builds for it
+// leave all of this out.
+//
+
+#ifndef CPU_2A03
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern uint16_t cpu_adc_decimal[2][256][256];
+extern uint16_t cpu_sbc_decimal[2][256][256];
+
+#ifdef __cplusplus
+}
+#endif
+
+static void set_decimal(struct cpu *cpu, uint16_t entry) {
+    uint8_t flags = entry >> 8;
+
+    cpu->a = entry & 0x00FF;
+    cpu->p &= ~(P_V | P_C);
+    cpu->p |= flags & (P_V | P_C);
+
+#ifdef CPU_65C02
+    set_z(cpu, cpu->a);
+    set_n(cpu, cpu->a);
+#else
+    set_z(cpu, flags & P_Z ? 0 : 1);
+    set_n(cpu, flags);
+#endif
+}
+
+#endif
+
+#ifdef CPU_65C02
+
+// ADC and SBC, which take a cycle more on the 65C02 with D set. The
+// decimal-mode result is ready a cycle late, and the CPU reads the next
+// opcode's address while it waits.
+#define DECIMAL_OP(o) (((o) & 0x60) == 0x60 && (((o) & 0x03) == 0x01 || ((o) & 0x1F) == 0x12))
+
+CPU_TEMPLATE static ALWAYS_INLINE int decimal_cycle(int cycles, struct cpu *cpu, CPU_BUS bus) {
+    if (!(cpu->p & P_D)) {
+        return cycles;
+    }
+
+    bus_peek(bus, cpu->pc);
+    return cycles + 1;
+}
+
+// cpu->cycle during that cycle under cpu_tick()
+#define CYCLE_DECIMAL 0xFF
+
+#endif
+
+//
+// Interrupts
+//
+
+#define OPC_BRK 0x00
+#define OPC_PLP 0x28
+#define OPC_CLI 0x58
+#define OPC_SEI 0x78
+
+// Whether an NMI or IRQ is taken before the next instruction. CLI, SEI and
+// PLP change I after the check at their end, so the check after one of them
+// still sees the old I. BRK and interrupt entries don't check at all, so the
+// first handler instruction always runs.
+static int poll(struct cpu *cpu) {
+    if (cpu->intr & INTR_SKIP) {
+        cpu->intr &= ~INTR_SKIP;
+        return 0;
+    }
+
+    if (cpu->intr & INTR_NMI) {
+        return 1;
+    }
+
+    if (!(cpu->intr & INTR_IRQ)) {
+        return 0;
+    }
+
+    if (cpu->opc == OPC_CLI || cpu->opc == OPC_SEI || cpu->opc == OPC_PLP) {
+        return !cpu->last_i;
+    }
+
+    return !(cpu->p & P_I);
+}
+
+// Whether the next instruction has to go through step(): a reset, a check
+// to skip, an NMI, or an IRQ poll() would take. An IRQ held while I masks it
+// doesn't count, so it leaves the fast paths alone. P, opc and last_i come
+// from `regs`, which run_fast() keeps apart from the cpu.
+static inline int pending(uint8_t intr, const struct cpu *regs) {
+    if (intr & ~INTR_IRQ) {
+        return 1;
+    }
+
+    if (!intr) {
+        return 0;
+    }
+
+    if (regs->opc == OPC_CLI || regs->opc == OPC_SEI || regs->opc == OPC_PLP) {
+        return !regs->last_i;
+    }
+
+    return !(regs->p & P_I);
+}
+
+// Address of the low byte of the vector a BRK, IRQ or NMI entry jumps
+// through. A pending NMI takes over.
+static uint16_t vector(struct cpu *cpu) {
+    if (cpu->intr & INTR_NMI) {
+        cpu->intr &= ~INTR_NMI;
+        return 0xFFFA;
+    }
+
+    return 0xFFFE;
+}
+
+// Flags a reset, BRK or interrupt entry clears along with setting I. The
+// 65C02 clears D so that handlers start in binary mode.
+#ifdef CPU_65C02
+#define P_ENTRY_CLEAR P_D
+#else
+#define P_ENTRY_CLEAR 0
+#endif
+
+//
+// Actions
+//
+
+static void act_ora(struct cpu *cpu) {
+    cpu->a |= cpu->opr1;
+    set_z(cpu, cpu->a);
+    set_n(cpu, cpu->a);
+}
+
+static void act_and(struct cpu *cpu) {
+    cpu->a &= cpu->opr1;
+    set_z(cpu, cpu->a);
+    set_n(cpu, cpu->a);
+}
+
+static void act_eor(struct cpu *cpu) {
+    cpu->a ^= cpu->opr1;
+    set_z(cpu, cpu->a);
+    set_n(cpu, cpu->a);
+}
+
+#ifndef CPU_2A03
+static void adc_bcd(struct cpu *cpu) {
+    set_decimal(cpu, cpu_adc_decimal[cpu->p & P_C][cpu->a][cpu->opr1]);
+}
+#endif
+
+static void act_adc(struct cpu *cpu) {
+#ifndef CPU_2A03
+    if (cpu->p & P_D) {
+        adc_bcd(cpu);
+        return;
+    }
+#endif
+
+    uint16_t result = cpu->a + cpu->opr1 + (cpu->p & P_C ? 1 : 0);
+
+    cpu->p &= ~P_C;
+    cpu->p |= result & 0x0100 ? P_C : 0;
+
+    set_v(cpu, cpu->a, cpu->opr1, result & 0x00FF);
+
+    cpu->a = result & 0x00FF;
+
+    set_z(cpu, cpu->a);
+    set_n(cpu, cpu->a);
+}
+
+#ifndef CPU_2A03
+static void sbc_bcd(struct cpu *cpu) {
+    set_decimal(cpu, cpu_sbc_decimal[cpu->p & P_C][cpu->a][cpu->opr1]);
+}
+#endif
+
+static void act_sbc(struct cpu *cpu) {
+#ifndef CPU_2A03
+    if (cpu->p & P_D) {
+        sbc_bcd(cpu);
+        return;
+    }
+#endif
+
+    cpu->opr1 = ~cpu->opr1;
+    act_adc(cpu);
+}
+
+static void act_cmp(struct cpu *cpu) {
+    uint8_t result = cpu->a - cpu->opr1;
+
+    cpu->p &= ~P_C;
+    cpu->p |= cpu->a >= cpu->opr1 ? P_C : 0;
+
+    set_z(cpu, result);
+    set_n(cpu, result);
+}
+
+static void act_cpx(struct cpu *cpu) {
+    uint8_t result = cpu->x - cpu->opr1;
+
+    cpu->p &= ~P_C;
+    cpu->p |= cpu->x >= cpu->opr1 ? P_C : 0;
+
+    set_z(cpu, result);
+    set_n(cpu, result);
+}
+
+static void act_cpy(struct cpu *cpu) {
+    uint8_t result = cpu->y - cpu->opr1;
+
+    cpu->p &= ~P_C;
+    cpu->p |= cpu->y >= cpu->opr1 ? P_C : 0;
+
+    set_z(cpu, result);
+    set_n(cpu, result);
+}
+
+static void act_dec(struct cpu *cpu) {
+    cpu->opr1--;
+    set_z(cpu, cpu->opr1);
+    set_n(cpu, cpu->opr1);
+}
+
+static void act_dex(struct cpu *cpu) {
+    cpu->x--;
+    set_z(cpu, cpu->x);
+    set_n(cpu, cpu->x);
+}
+
+static void act_dey(struct cpu *cpu) {
+    cpu->y--;
+    set_z(cpu, cpu->y);
+    set_n(cpu, cpu->y);
+}
+
+static void act_inc(struct cpu *cpu) {
+    cpu->opr1++;
+    set_z(cpu, cpu->opr1);
+    set_n(cpu, cpu->opr1);
+}
+
+static void act_inx(struct cpu *cpu) {
+    cpu->x++;
+    set_z(cpu, cpu->x);
+    set_n(cpu, cpu->x);
+}
+
+static void act_iny(struct cpu *cpu) {
+    cpu->y++;
+    set_z(cpu, cpu->y);
+    set_n(cpu, cpu->y);
+}
+
+static void act_asl(struct cpu *cpu) {
+    cpu->p &= ~P_C;
+    cpu->p |= cpu->opr1 & 0x80 ? P_C : 0;
+
+    cpu->opr1 <<= 1;
+    set_z(cpu, cpu->opr1);
+    set_n(cpu, cpu->opr1);
+}
+
+static void act_lsr(struct cpu *cpu) {
+    cpu->p &= ~P_C;
+    cpu->p |= cpu->opr1 & 0x01 ? P_C : 0;
+
+    cpu->opr1 >>= 1;
+    set_z(cpu, cpu->opr1);
+    set_n(cpu, cpu->opr1);
+
+}
+
+static void act_rol(struct cpu *cpu) {
+    uint8_t c = cpu->p & P_C;
+    cpu->p &= ~P_C;
+    cpu->p |= cpu->opr1 & 0x80 ? P_C : 0;
+
+    cpu->opr1 <<= 1;
+    cpu->opr1 |= c ? 0x01 : 0;
+    set_z(cpu, cpu->opr1);
+    set_n(cpu, cpu->opr1);
+}
+
+static void act_ror(struct cpu *cpu) {
+    uint8_t c = cpu->p & P_C;
+    cpu->p &= ~P_C;
+    cpu->p |= cpu->opr1 & 0x01 ? P_C : 0;
+
+    cpu->opr1 >>= 1;
+    cpu->opr1 |= c ? 0x80 : 0;
+    set_z(cpu, cpu->opr1);
+    set_n(cpu, cpu->opr1);
+}
+
+static void act_sta(struct cpu *cpu) {
+    cpu->opr1 = cpu->a;
+}
+
+static void act_stx(struct cpu *cpu) {
+    cpu->opr1 = cpu->x;
+}
+
+static void act_sty(struct cpu *cpu) {
+    cpu->opr1 = cpu->y;
+}
+
+static void act_tax(struct cpu *cpu) {
+    cpu->x = cpu->a;
+    set_z(cpu, cpu->a);
+    set_n(cpu, cpu->a);
+}
+
+static void act_tay(struct cpu *cpu) {
+    cpu->y = cpu->a;
+    set_z(cpu, cpu->a);
+    set_n(cpu, cpu->a);
+}
+
+static void act_txa(struct cpu *cpu) {
+    cpu->a = cpu->x;
+    set_z(cpu, cpu->a);
+    set_n(cpu, cpu->a);
+}
+
+static void act_tya(struct cpu *cpu) {
+    cpu->a = cpu->y;
+    set_z(cpu, cpu->a);
+    set_n(cpu, cpu->a);
+}
+
+static void act_tsx(struct cpu *cpu) {
+    cpu->x = cpu->sp;
+    set_z(cpu, cpu->x);
+    set_n(cpu, cpu->x);
+}
+
+static void act_txs(struct cpu *cpu) {
+    cpu->sp = cpu->x;
+}
+
+static void act_lda(struct cpu *cpu) {
+    cpu->a = cpu->opr1;
+    set_z(cpu, cpu->opr1);
+    set_n(cpu, cpu->opr1);
+}
+
+static void act_ldx(struct cpu *cpu) {
+    cpu->x = cpu->opr1;
+    set_z(cpu, cpu->opr1);
+    set_n(cpu, cpu->opr1);
+}
+
+static void act_ldy(struct cpu *cpu) {
+    cpu->y = cpu->opr1;
+    set_z(cpu, cpu->opr1);
+    set_n(cpu, cpu->opr1);
+}
+
+static void act_bpl(struct cpu *cpu) {
+    cpu->opr1 = !(cpu_get_p(cpu) & P_N);
+}
+
+static void act_bmi(struct cpu *cpu) {
+    cpu->opr1 = cpu_get_p(cpu) & P_N;
+}
+
+static void act_bne(struct cpu *cpu) {
+    cpu->opr1 = !(cpu_get_p(cpu) & P_Z);
+}
+
+static void act_beq(struct cpu *cpu) {
+    cpu->opr1 = cpu_get_p(cpu) & P_Z;
+}
+
+static void act_bcc(struct cpu *cpu) {
+    cpu->opr1 = !(cpu->p & P_C);
+}
+
+static void act_bcs(struct cpu *cpu) {
+    cpu->opr1 = cpu->p & P_C;
+}
+
+static void act_bvc(struct cpu *cpu) {
+    cpu->opr1 = !(cpu->p & P_V);
+}
+
+static void act_bvs(struct cpu *cpu) {
+    cpu->opr1 = cpu->p & P_V;
+}
+
+static void act_sec(struct cpu *cpu) {
+    cpu->p |= P_C;
+}
+
+static void act_sed(struct cpu *cpu) {
+    cpu->p |= P_D;
+}
+
+static void act_sei(struct cpu *cpu) {
+    cpu->last_i = cpu->p & P_I;
+    cpu->p |= P_I;
+}
+
+static void act_clc(struct cpu *cpu) {
+    cpu->p &= ~P_C;
+}
+
+static void act_cld(struct cpu *cpu) {
+    cpu->p &= ~P_D;
+}
+
+static void act_cli(struct cpu *cpu) {
+    cpu->last_i = cpu->p & P_I;
+    cpu->p &= ~P_I;
+}
+
+static void act_clv(struct cpu *cpu) {
+    cpu->p &= ~P_V;
+}
+
+static void act_bit(struct cpu *cpu) {
+    cpu->p &= ~P_V;
+    cpu->p |= cpu->opr1 & P_V;
+    set_n(cpu, cpu->opr1);
+    set_z(cpu, cpu->opr1 & cpu->a);
+}
+
+static void act_nop(struct cpu *cpu) {
+    (void)cpu;
+}
+
+#ifdef CPU_65C02
+
+static void act_stz(struct cpu *cpu) {
+    cpu->opr1 = 0;
+}
+
+static void act_tsb(struct cpu *cpu) {
+    set_z(cpu, cpu->opr1 & cpu->a);
+    cpu->opr1 |= cpu->a;
+}
+
+static void act_trb(struct cpu *cpu) {
+    set_z(cpu, cpu->opr1 & cpu->a);
+    cpu->opr1 &= ~cpu->a;
+}
+
+// BIT #imm only sets Z
+static void act_bit_imm(struct cpu *cpu) {
+    set_z(cpu, cpu->opr1 & cpu->a);
+}
+
+static void act_bra(struct cpu *cpu) {
+    cpu->opr1 = 1;
+}
+
+#endif
+
+//
+// Instruction-atomic handlers
+//
+// Each handler runs a whole instruction (after the opcode fetch) with the
+// same bus accesses, in the same order, as its procedure in cpu.c would
+// over several cpu_tick() calls. They return the number of cycles taken,
+// including the opcode fetch. The action and action type are always
+// constants at the call site, so once inlined the act_type checks fold away
+// and the action is called directly.
+//
+// When `opr` is not NULL the operand bytes are taken from it instead of
+// being fetched from the bus (see cpu_ops). Every other access is unchanged.
+//
+
+CPU_TEMPLATE static ALWAYS_INLINE uint8_t operand(CPU_BUS bus, uint16_t addr, const uint8_t *opr, int i) {
+    return opr ? opr[i] : bus_peek(bus, addr);
+}
+
+CPU_TEMPLATE static ALWAYS_INLINE int exec_brk(struct cpu *cpu, CPU_BUS bus, action act, uint8_t act_type, const uint8_t *opr) {
+    (void)act;
+    (void)act_type;
+    (void)opr;
+    bus_peek(bus, cpu->pc++);
+    push_stack(cpu, bus, (cpu->pc >> 8) & 0xFF);
+    push_stack(cpu, bus, cpu->pc & 0xFF);
+    push_stack(cpu, bus, cpu_get_p(cpu) | P_B | P_5);
+    cpu->ea = vector(cpu);
+    cpu->opr1 = bus_peek(bus, cpu->ea);
+    cpu->pc = bus_peek(bus, cpu->ea + 1);
+    cpu->pc = (cpu->pc << 8) | cpu->opr1;
+    cpu->p = (cpu->p | P_I) & ~P_ENTRY_CLEAR;
+    cpu->intr |= INTR_SKIP;
+    return 7;
+}
+
+// An NMI or IRQ entry, as cpu_tick() runs it through brk()
+CPU_TEMPLATE static int interrupt(struct cpu *cpu, CPU_BUS bus) {
+    bus_peek(bus, cpu->pc);
+    bus_peek(bus, cpu->pc);
+    push_stack(cpu, bus, (cpu->pc >> 8) & 0xFF);
+    push_stack(cpu, bus, cpu->pc & 0xFF);
+    push_stack(cpu, bus, cpu_get_p(cpu) | P_5);
+    cpu->ea = vector(cpu);
+    cpu->opr1 = bus_peek(bus, cpu->ea);
+    cpu->pc = bus_peek(bus, cpu->ea + 1);
+    cpu->pc = (cpu->pc << 8) | cpu->opr1;
+    cpu->p = (cpu->p | P_I) & ~P_ENTRY_CLEAR;
+    cpu->opc = OPC_BRK;
+    cpu->intr |= INTR_SKIP;
+    return 7;
+}
+
+// A reset, as cpu_tick() runs it through rst()
+CPU_TEMPLATE static int exec_rst(struct cpu *cpu, CPU_BUS bus) {
+    cpu->sp -= 3;
+    cpu->opr1 = bus_peek(bus, 0xFFFC);
+    cpu->pc = bus_peek(bus, 0xFFFD);
+    cpu->pc = (cpu->pc << 8) | cpu->opr1;
+    cpu->p = (cpu->p | P_I) & ~P_ENTRY_CLEAR;
+    cpu->intr &= ~INTR_RESET;
+    return 7;
+}
+
+CPU_TEMPLATE static ALWAYS_INLINE int exec_rti(struct cpu *cpu, CPU_BUS bus, action act, uint8_t act_type, const uint8_t *opr) {
+    (void)act;
+    (void)act_type;
+    (void)opr;
+    bus_peek(bus, cpu->pc);
+    curr_stack(cpu, bus);
+    cpu_set_p(cpu, pop_stack(cpu, bus) & ~(P_B | P_5));
+    cpu->opr1 = pop_stack(cpu, bus);
+    cpu->pc = pop_stack(cpu, bus);
+    cpu->pc = (cpu->pc << 8) | cpu->opr1;
+    return 6;
+}
+
+CPU_TEMPLATE static ALWAYS_INLINE int exec_php(struct cpu *cpu, CPU_BUS bus, action act, uint8_t act_type, const uint8_t *opr) {
+    (void)act;
+    (void)act_type;
+    (void)opr;
+    bus_peek(bus, cpu->pc);
+    push_stack(cpu, bus, cpu_get_p(cpu) | P_B | P_5);
+    return 3;
+}
+
+CPU_TEMPLATE static ALWAYS_INLINE int exec_plp(struct cpu *cpu, CPU_BUS bus, action act, uint8_t act_type, const uint8_t *opr) {
+    (void)act;
+    (void)act_type;
+    (void)opr;
+    bus_peek(bus, cpu->pc);
+    curr_stack(cpu, bus);
+    cpu->last_i = cpu->p & P_I;
+    cpu_set_p(cpu, pop_stack(cpu, bus) & ~(P_B | P_5));
+    return 4;
+}
+
+CPU_TEMPLATE static ALWAYS_INLINE int exec_pha(struct cpu *cpu, CPU_BUS bus, action act, uint8_t act_type, const uint8_t *opr) {
+    (void)act;
+    (void)act_type;
+    (void)opr;
+    bus_peek(bus, cpu->pc);
+    push_stack(cpu, bus, cpu->a);
+    return 3;
+}
+
+CPU_TEMPLATE static ALWAYS_INLINE int exec_pla(struct cpu *cpu, CPU_BUS bus, action act, uint8_t act_type, const uint8_t *opr) {
+    (void)act;
+    (void)act_type;
+    (void)opr;
+    bus_peek(bus, cpu->pc);
+    curr_stack(cpu, bus);
+    cpu->a = pop_stack(cpu, bus);
+    set_z(cpu, cpu->a);
+    set_n(cpu, cpu->a);
+    return 4;
+}
+
+CPU_TEMPLATE static ALWAYS_INLINE int exec_jsr(struct cpu *cpu, CPU_BUS bus, action act, uint8_t act_type, const uint8_t *opr) {
+    (void)act;
+    (void)act_type;
+    cpu->opr2 = operand(bus, cpu->pc++, opr, 0);
+    curr_stack(cpu, bus);
+    push_stack(cpu, bus, (cpu->pc >> 8) & 0xFF);
+    push_stack(cpu, bus, cpu->pc & 0xFF);
+    cpu->pc = operand(bus, cpu->pc, opr, 1);
+    cpu->pc = (cpu->pc << 8) | cpu->opr2;
+    return 6;
+}
+
+CPU_TEMPLATE static ALWAYS_INLINE int exec_rts(struct cpu *cpu, CPU_BUS bus, action act, uint8_t act_type, const uint8_t *opr) {
+    (void)act;
+    (void)act_type;
+    (void)opr;
+    bus_peek(bus, cpu->pc);
+    curr_stack(cpu, bus);
+    cpu->opr1 = pop_stack(cpu, bus);
+    cpu->pc = pop_stack(cpu, bus);
+    cpu->pc = (cpu->pc << 8) | cpu->opr1;
+    bus_peek(bus, cpu->pc);
+    cpu->pc++;
+    return 6;
+}
+
+CPU_TEMPLATE static ALWAYS_INLINE int exec_jmp_abl(struct cpu *cpu, CPU_BUS bus, action act, uint8_t act_type, const uint8_t *opr) {
+    (void)act;
+    (void)act_type;
+    cpu->opr1 = operand(bus, cpu->pc++, opr, 0);
+    cpu->pc = operand(bus, cpu->pc, opr, 1);
+    cpu->pc = (cpu->pc << 8) | cpu->opr1;
+    return 3;
+}
+
+CPU_TEMPLATE static ALWAYS_INLINE int exec_jmp_ind(struct cpu *cpu, CPU_BUS bus, action act, uint8_t act_type, const uint8_t *opr) {
+    (void)act;
+    (void)act_type;
+    cpu->opr1 = operand(bus, cpu->pc++, opr, 0);
+    cpu->ea = operand(bus, cpu->pc++, opr, 1);
+    cpu->ea = (cpu->ea << 8) | cpu->opr1;
+#ifdef CPU_65C02
+    bus_peek(bus, cpu->pc - 1);
+    cpu->opr2 = bus_peek(bus, cpu->ea);
+    cpu->pc = bus_peek(bus, cpu->ea + 1);
+    cpu->pc = (cpu->pc << 8) | cpu->opr2;
+    return 6;
+#else
+    cpu->opr2 = bus_peek(bus, cpu->ea);
+    cpu->ea &= 0xFF00;
+    cpu->ea |= (cpu->opr1 + 1) & 0x00FF;
+    cpu->pc = bus_peek(bus, cpu->ea);
+    cpu->pc = (cpu->pc << 8) | cpu->opr2;
+    return 5;
+#endif
+}
+
+CPU_TEMPLATE static ALWAYS_INLINE int exec_illegal(struct cpu *cpu, CPU_BUS bus, action act, uint8_t act_type, const uint8_t *opr) {
+    (void)cpu;
+    (void)bus;
+    (void)act;
+    (void)act_type;
+    (void)opr;
+    return 2;
+}
+
+#ifdef CPU_65C02
+
+CPU_TEMPLATE static ALWAYS_INLINE int exec_jmp_iax(struct cpu *cpu, CPU_BUS bus, action act, uint8_t act_type, const uint8_t *opr) {
+    (void)act;
+    (void)act_type;
+    cpu->opr1 = operand(bus, cpu->pc++, opr, 0);
+    cpu->ea = operand(bus, cpu->pc++, opr, 1);
+    cpu->ea = (cpu->ea << 8) | cpu->opr1;
+    bus_peek(bus, cpu->pc - 1);
+    cpu->ea += cpu->x;
+    cpu->opr2 = bus_peek(bus, cpu->ea);
+    cpu->pc = bus_peek(bus, cpu->ea + 1);
+    cpu->pc = (cpu->pc << 8) | cpu->opr2;
+    return 6;
+}
+
+CPU_TEMPLATE static ALWAYS_INLINE int exec_phr(struct cpu *cpu, CPU_BUS bus, action act, uint8_t act_type, const uint8_t *opr) {
+    (void)act_type;
+    (void)opr;
+    bus_peek(bus, cpu->pc);
+    act(cpu);
+    push_stack(cpu, bus, cpu->opr1);
+    return 3;
+}
+
+CPU_TEMPLATE static ALWAYS_INLINE int exec_plr(struct cpu *cpu, CPU_BUS bus, action act, uint8_t act_type, const uint8_t *opr) {
+    (void)act_type;
+    (void)opr;
+    bus_peek(bus, cpu->pc);
+    curr_stack(cpu, bus);
+    cpu->opr1 = pop_stack(cpu, bus);
+    act(cpu);
+    return 4;
+}
+
+CPU_TEMPLATE static ALWAYS_INLINE int exec_nop1(struct cpu *cpu, CPU_BUS bus, action act, uint8_t act_type, const uint8_t *opr) {
+    (void)cpu;
+    (void)bus;
+    (void)act;
+    (void)act_type;
+    (void)opr;
+    return 1;
+}
+
+#endif
+
+CPU_TEMPLATE static ALWAYS_INLINE int exec_imm(struct cpu *cpu, CPU_BUS bus, action act, uint8_t act_type, const uint8_t *opr) {
+    (void)act_type;
+    cpu->opr1 = operand(bus, cpu->pc++, opr, 0);
+    act(cpu);
+    return 2;
+}
+
+CPU_TEMPLATE static ALWAYS_INLINE int exec_imp(struct cpu *cpu, CPU_BUS bus, action act, uint8_t act_type, const uint8_t *opr) {
+    (void)act_type;
+    (void)opr;
+    bus_peek(bus, cpu->pc);
+    act(cpu);
+    return 2;
+}
+
+CPU_TEMPLATE static ALWAYS_INLINE int exec_acc(struct cpu *cpu, CPU_BUS bus, action act, uint8_t act_type, const uint8_t *opr) {
+    (void)act_type;
+    (void)opr;
+    bus_peek(bus, cpu->pc);
+    cpu->opr1 = cpu->a;
+    act(cpu);
+    cpu->a = cpu->opr1;
+    return 2;
+}
+
+// Shared tail of zpg, zpx, zpy and abl once the effective address is known.
+// Returns the cycles spent from the data access on.
+CPU_TEMPLATE static ALWAYS_INLINE int exec_mem(struct cpu *cpu, CPU_BUS bus, action act, uint8_t act_type) {
+    if (act_type == ACTION_WR) {
+        act(cpu);
+        bus_poke(bus, cpu->ea, cpu->opr1);
+        return 1;
+    }
+
+    cpu->opr1 = bus_peek(bus, cpu->ea);
+
+    if (act_type == ACTION_RD) {
+        act(cpu);
+        return 1;
+    }
+
+    modify(bus, cpu->ea, cpu->opr1);
+    act(cpu);
+    bus_poke(bus, cpu->ea, cpu->opr1);
+    return 3;
+}
+
+CPU_TEMPLATE static ALWAYS_INLINE int exec_zpg(struct cpu *cpu, CPU_BUS bus, action act, uint8_t act_type, const uint8_t *opr) {
+    cpu->ea = operand(bus, cpu->pc++, opr, 0);
+    return 2 + exec_mem(cpu, bus, act, act_type);
+}
+
+CPU_TEMPLATE static ALWAYS_INLINE int exec_zpx(struct cpu *cpu, CPU_BUS bus, action act, uint8_t act_type, const uint8_t *opr) {
+    cpu->ea = operand(bus, cpu->pc++, opr, 0);
+    bus_peek(bus, cpu->ea);
+    cpu->ea = (cpu->ea + cpu->x) & 0x00FF;
+    return 3 + exec_mem(cpu, bus, act, act_type);
+}
+
+CPU_TEMPLATE static ALWAYS_INLINE int exec_zpy(struct cpu *cpu, CPU_BUS bus, action act, uint8_t act_type, const uint8_t *opr) {
+    cpu->ea = operand(bus, cpu->pc++, opr, 0);
+    bus_peek(bus, cpu->ea);
+    cpu->ea = (cpu->ea + cpu->y) & 0x00FF;
+    return 3 + exec_mem(cpu, bus, act, act_type);
+}
+
+CPU_TEMPLATE static ALWAYS_INLINE int exec_abl(struct cpu *cpu, CPU_BUS bus, action act, uint8_t act_type, const uint8_t *opr) {
+    cpu->opr1 = operand(bus, cpu->pc++, opr, 0);
+    cpu->opr2 = operand(bus, cpu->pc++, opr, 1);
+    cpu->ea = cpu->opr2;
+    cpu->ea = (cpu->ea << 8) | cpu->opr1;
+    return 3 + exec_mem(cpu, bus, act, act_type);
+}
+
+CPU_TEMPLATE static ALWAYS_INLINE int exec_abx(struct cpu *cpu, CPU_BUS bus, action act, uint8_t act_type, const uint8_t *opr) {
+    cpu->opr2 = operand(bus, cpu->pc++, opr, 0);
+    cpu->ea = operand(bus, cpu->pc++, opr, 1);
+    cpu->ea = (cpu->ea << 8) | (uint8_t)(cpu->opr2 + cpu->x);
+    cpu->opr1 = bus_peek(bus, cpu->ea);
+
+    if (act_type == ACTION_RD && (uint16_t)cpu->opr2 + cpu->x <= 0xFF) {
+        act(cpu);
+        return 4;
+    }
+
+    cpu->ea &= 0xFF00;
+    cpu->ea += cpu->opr2 + cpu->x;
+    return 4 + exec_mem(cpu, bus, act, act_type);
+}
+
+CPU_TEMPLATE static ALWAYS_INLINE int exec_aby(struct cpu *cpu, CPU_BUS bus, action act, uint8_t act_type, const uint8_t *opr) {
+    cpu->opr2 = operand(bus, cpu->pc++, opr, 0);
+    cpu->ea = operand(bus, cpu->pc++, opr, 1);
+    cpu->ea = (cpu->ea << 8) | (uint8_t)(cpu->opr2 + cpu->y);
+    cpu->opr1 = bus_peek(bus, cpu->ea);
+
+    if (act_type == ACTION_RD && (uint16_t)cpu->opr2 + cpu->y <= 0xFF) {
+        act(cpu);
+        return 4;
+    }
+
+    cpu->ea &= 0xFF00;
+    cpu->ea += cpu->opr2 + cpu->y;
+
+    if (act_type == ACTION_RD) {
+        cpu->opr1 = bus_peek(bus, cpu->ea);
+        act(cpu);
+    } else {
+        act(cpu);
+        bus_poke(bus, cpu->ea, cpu->opr1);
+    }
+
+    return 5;
+}
+
+CPU_TEMPLATE static ALWAYS_INLINE int exec_idx(struct cpu *cpu, CPU_BUS bus, action act, uint8_t act_type, const uint8_t *opr) {
+    cpu->ea = operand(bus, cpu->pc++, opr, 0);
+    bus_peek(bus, cpu->ea);
+    cpu->ea = (cpu->ea + cpu->x) & 0x00FF;
+    cpu->opr1 = bus_peek(bus, cpu->ea);
+    cpu->ea = bus_peek(bus, (cpu->ea + 1) & 0x00FF);
+    cpu->ea = (cpu->ea << 8) | cpu->opr1;
+
+    if (act_type == ACTION_RD) {
+        cpu->opr1 = bus_peek(bus, cpu->ea);
+        act(cpu);
+    } else {
+        act(cpu);
+        bus_poke(bus, cpu->ea, cpu->opr1);
+    }
+
+    return 6;
+}
+
+CPU_TEMPLATE static ALWAYS_INLINE int exec_idy(struct cpu *cpu, CPU_BUS bus, action act, uint8_t act_type, const uint8_t *opr) {
+    cpu->ea = operand(bus, cpu->pc++, opr, 0);
+    cpu->opr2 = bus_peek(bus, cpu->ea);
+    cpu->ea = bus_peek(bus, (cpu->ea + 1) & 0x00FF);
+    cpu->ea = (cpu->ea << 8) | (uint8_t)(cpu->opr2 + cpu->y);
+    cpu->opr1 = bus_peek(bus, cpu->ea);
+
+    if (act_type == ACTION_RD && (uint16_t)cpu->opr2 + cpu->y <= 0xFF) {
+        act(cpu);
+        return 5;
+    }
+
+    cpu->ea &= 0xFF00;
+    cpu->ea += cpu->opr2 + cpu->y;
+
+    if (act_type == ACTION_RD) {
+        cpu->opr1 = bus_peek(bus, cpu->ea);
+        act(cpu);
+    } else {
+        act(cpu);
+        bus_poke(bus, cpu->ea, cpu->opr1);
+    }
+
+    return 6;
+}
+
+#ifdef CPU_65C02
+
+CPU_TEMPLATE static ALWAYS_INLINE int exec_zpi(struct cpu *cpu, CPU_BUS bus, action act, uint8_t act_type, const uint8_t *opr) {
+    cpu->ea = operand(bus, cpu->pc++, opr, 0);
+    cpu->opr2 = bus_peek(bus, cpu->ea);
+    cpu->ea = bus_peek(bus, (cpu->ea + 1) & 0x00FF);
+    cpu->ea = (cpu->ea << 8) | cpu->opr2;
+
+    if (act_type == ACTION_RD) {
+        cpu->opr1 = bus_peek(bus, cpu->ea);
+        act(cpu);
+    } else {
+        act(cpu);
+        bus_poke(bus, cpu->ea, cpu->opr1);
+    }
+
+    return 5;
+}
+
+CPU_TEMPLATE static ALWAYS_INLINE int exec_abx_shift(struct cpu *cpu, CPU_BUS bus, action act, uint8_t act_type, const uint8_t *opr) {
+    (void)act_type;
+    cpu->opr2 = operand(bus, cpu->pc++, opr, 0);
+    cpu->ea = operand(bus, cpu->pc++, opr, 1);
+    cpu->ea = (cpu->ea << 8) | (uint8_t)(cpu->opr2 + cpu->x);
+
+    int cross = (uint16_t)cpu->opr2 + cpu->x > 0xFF;
+    if (cross) {
+        bus_peek(bus, cpu->pc - 1);
+        cpu->ea += 0x0100;
+    }
+
+    return 3 + cross + exec_mem(cpu, bus, act, ACTION_RMW);
+}
+
+#endif
+
+CPU_TEMPLATE static ALWAYS_INLINE int exec_rel(struct cpu *cpu, CPU_BUS bus, action act, uint8_t act_type, const uint8_t *opr) {
+    (void)act_type;
+    cpu->opr2 = operand(bus, cpu->pc++, opr, 0);
+    act(cpu);
+
+    if (!cpu->opr1) {
+        return 2;
+    }
+
+    bus_peek(bus, cpu->pc);
+    cpu->ea = cpu->pc & 0x00FF;
+
+    if (cpu->opr2 & 0x80) {
+        cpu->ea -= ((uint8_t)~cpu->opr2) + 1;
+    } else {
+        cpu->ea += cpu->opr2;
+    }
+
+    if (!(cpu->ea & 0xFF00)) {
+        cpu->ea |= cpu->pc & 0xFF00;
+        cpu->pc = cpu->ea;
+        return 3;
+    }
+
+    cpu->ea &= 0x00FF;
+    cpu->ea |= cpu->pc & 0xFF00;
+    bus_peek(bus, cpu->ea);
+
+    if (cpu->opr2 & 0x80) {
+        cpu->pc -= ((uint8_t)~cpu->opr2) + 1;
+    } else {
+        cpu->pc += cpu->opr2;
+    }
+
+    return 4;
+}
+
+// An opcode's handler, with the 65C02's decimal-mode cycle where it has one
+#ifdef CPU_65C02
+#define EXEC(o, p, a, t, cpu, bus, opr) \
+    (DECIMAL_OP(o) ? decimal_cycle(exec_##p(cpu, bus, a, t, opr), cpu, bus) : exec_##p(cpu, bus, a, t, opr))
+#else
+#define EXEC(o, p, a, t, cpu, bus, opr) exec_##p(cpu, bus, a, t, opr)
+#endif
+
+CPU_TEMPLATE static ALWAYS_INLINE int exec(struct cpu *cpu, CPU_BUS bus) {
+    switch (cpu->opc) {
+#define OP(opc, p, a, t) case opc: return EXEC(opc, p, act_##a, t, cpu, bus, NULL);
+#include "opcodes.def"
+#undef OP
+    }
+
+    return 0;
+}
+
+//
+// Engines
+//
+
+// Runs the next instruction, or a pending reset or interrupt entry, from an
+// instruction boundary
+CPU_TEMPLATE static ALWAYS_INLINE int step(struct cpu *cpu, CPU_BUS bus) {
+    if (cpu->intr) {
+        if (cpu->intr & INTR_RESET) {
+            return exec_rst(cpu, bus);
+        }
+
+        if (poll(cpu)) {
+            return interrupt(cpu, bus);
+        }
+    }
+
+    cpu->opc = bus_peek(bus, cpu->pc++);
+    return exec(cpu, bus);
+}
+
+#if defined(__GNUC__) && !defined(CPU_NO_THREADED)
+
+// Direct-threaded variant: one label per opcode, each ending in its own
+// indirect jump to the next opcode's label. Registers live in a local copy of
+// the cpu for the duration of the run, except for the fields device code may
+// change under it. Pending resets and interrupts, and BRK, which an NMI can
+// take over, go through the real one.
+CPU_TEMPLATE static uint64_t run_fast(struct cpu *cpu, CPU_BUS bus, uint64_t cycles) {
+    static const void *const labels[256] = {
+#define OP(opc, p, a, t) &&op_##opc,
+#include "opcodes.def"
+#undef OP
+    };
+
+    uint64_t ran = 0;
+    struct cpu c = *cpu;
+
+#define SAVE() \
+    do { \
+        c.intr = cpu->intr; \
+        c.lines = cpu->lines; \
+        c.halt = cpu->halt; \
+        *cpu = c; \
+    } while (0)
+
+#define DISPATCH() \
+    do { \
+        if (ran >= cycles) { \
+            goto done; \
+        } \
+        if (cpu->intr && pending(cpu->intr, &c)) { \
+            goto slow; \
+        } \
+        c.opc = bus_peek(bus, c.pc++); \
+        goto *labels[c.opc]; \
+    } while (0)
+
+    DISPATCH();
+
+#define OP(opc, p, a, t) \
+    op_##opc: \
+    if (opc == OPC_BRK) { \
+        SAVE(); \
+        ran += EXEC(opc, p, act_##a, t, cpu, bus, NULL); \
+        c = *cpu; \
+    } else { \
+        ran += EXEC(opc, p, act_##a, t, &c, bus, NULL); \
+    } \
+    DISPATCH();
+#include "opcodes.def"
+#undef OP
+
+slow:
+    SAVE();
+    ran += step(cpu, bus);
+    c = *cpu;
+    DISPATCH();
+
+#undef DISPATCH
+
+done:
+    SAVE();
+#undef SAVE
+    return ran;
+}
+
+#else
+
+CPU_TEMPLATE static uint64_t run_fast(struct cpu *cpu, CPU_BUS bus, uint64_t cycles) {
+    uint64_t ran = 0;
+
+    while (ran < cycles) {
+        ran += step(cpu, bus);
+    }
+
+    return ran;
+}
+
+#endif
+
+#endif
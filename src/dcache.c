@@ -0,0 +1,173 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "dcache.h"
+
+#define DCACHE_BLOCK_MAX 32     // instructions per block
+#define DCACHE_BLOCKS    8192   // blocks decoded before a flush
+
+struct entry {
+    cpu_handler exec;
+    uint8_t opc;
+    uint8_t opr[2];
+    uint8_t length;
+    uint8_t cycles;
+    uint8_t flags;
+};
+
+struct block {
+    uint16_t pc;
+    uint16_t end;       // address of the last byte decoded
+    uint8_t n;
+    struct block *next; // next block starting in the same page
+    struct entry entries[DCACHE_BLOCK_MAX];
+};
+
+struct dcache {
+    uint8_t code_pages[256];
+    struct block *blocks[0x10000];
+    struct block *page_blocks[256];
+
+    struct block pool[DCACHE_BLOCKS];
+    size_t pool_n;
+};
+
+static void flush(struct dcache *dcache) {
+    memset(dcache->code_pages, 0, sizeof(dcache->code_pages));
+    memset(dcache->blocks, 0, sizeof(dcache->blocks));
+    memset(dcache->page_blocks, 0, sizeof(dcache->page_blocks));
+    dcache->pool_n = 0;
+}
+
+static void drop_page(struct dcache *dcache, uint8_t page) {
+    if (!dcache->code_pages[page]) {
+        return;
+    }
+
+    dcache->code_pages[page] = 0;
+
+    for (struct block *b = dcache->page_blocks[page]; b != NULL; b = b->next) {
+        dcache->blocks[b->pc] = NULL;
+    }
+
+    dcache->page_blocks[page] = NULL;
+
+    // the last instruction of a block in the previous page may spill over,
+    // from page FF into page 0 too
+    struct block **link = &dcache->page_blocks[(uint8_t)(page - 1)];
+    while (*link != NULL) {
+        struct block *b = *link;
+
+        if ((b->end >> 8) == page) {
+            dcache->blocks[b->pc] = NULL;
+            *link = b->next;
+        } else {
+            link = &b->next;
+        }
+    }
+}
+
+// Drops the pages an instruction wrote to, returning nonzero if any held code.
+static int track_writes(struct dcache *dcache, const struct cpu *cpu, uint8_t flags) {
+    int hit = 0;
+
+    if (flags & CPU_OP_WRITE && dcache->code_pages[cpu->ea >> 8]) {
+        drop_page(dcache, cpu->ea >> 8);
+        hit = 1;
+    }
+
+    if (flags & CPU_OP_PUSH && dcache->code_pages[0x01]) {
+        drop_page(dcache, 0x01);
+        hit = 1;
+    }
+
+    return hit;
+}
+
+static struct block *decode(struct dcache *dcache, const struct bus *bus, uint16_t pc) {
+    if (dcache->pool_n == DCACHE_BLOCKS) {
+        flush(dcache);
+    }
+
+    struct block *b = &dcache->pool[dcache->pool_n++];
+    uint16_t addr = pc;
+
+    b->n = 0;
+
+    while (b->n < DCACHE_BLOCK_MAX) {
+        struct entry *e = &b->entries[b->n++];
+        uint8_t opc = bus_peek(bus, addr);
+        const struct cpu_op *op = &cpu_ops[opc];
+
+        e->exec = op->exec;
+        e->opc = opc;
+        e->length = op->length;
+        e->cycles = op->cycles;
+        e->flags = op->flags;
+
+        for (int i = 1; i < op->length; i++) {
+            e->opr[i - 1] = bus_peek(bus, (uint16_t)(addr + i));
+        }
+
+        b->end = addr + op->length - 1;
+        addr += op->length;
+
+        if (op->flags & CPU_OP_BRANCH || (addr >> 8) != (pc >> 8)) {
+            break;
+        }
+    }
+
+    b->pc = pc;
+    b->next = dcache->page_blocks[pc >> 8];
+    dcache->page_blocks[pc >> 8] = b;
+    dcache->code_pages[pc >> 8] = 1;
+    dcache->code_pages[b->end >> 8] = 1;
+    dcache->blocks[pc] = b;
+
+    return b;
+}
+
+struct dcache *dcache_create(void) {
+    return calloc(1, sizeof(struct dcache));
+}
+
+void dcache_destroy(struct dcache *dcache) {
+    free(dcache);
+}
+
+uint64_t dcache_run(struct dcache *dcache, struct cpu *cpu, const struct bus *bus, uint64_t cycles) {
+    uint64_t ran = 0;
+
+    while (ran < cycles) {
+        // finish partial instructions, resets and interrupts the slow way
+        if (cpu->cycle != 0 || (cpu->intr && cpu_pending(cpu))) {
+            ran += cpu_step_fast(cpu, bus);
+            track_writes(dcache, cpu, cpu_ops[cpu->opc].flags);
+            continue;
+        }
+
+        const struct block *b = dcache->blocks[cpu->pc];
+        if (b == NULL) {
+            b = decode(dcache, bus, cpu->pc);
+        }
+
+        for (const struct entry *e = b->entries, *end = e + b->n; e < end && ran < cycles; e++) {
+            ran += e->exec(cpu, bus, e->opr);
+
+            // the rest of the block may have just been overwritten
+            if (e->flags & (CPU_OP_WRITE | CPU_OP_PUSH) && track_writes(dcache, cpu, e->flags)) {
+                break;
+            }
+
+            if (cpu->intr && cpu_pending(cpu)) {
+                break;
+            }
+        }
+    }
+
+    return ran;
+}
+
+void dcache_invalidate(struct dcache *dcache, uint16_t addr) {
+    drop_page(dcache, addr >> 8);
+}
@@ -0,0 +1,31 @@
+#ifndef __DCACHE_H__
+#define __DCACHE_H__
+
+#include <stdint.h>
+
+#include "bus.h"
+#include "cpu.h"
+
+// Caches decoded basic blocks by PC. Each entry holds an instruction's
+// opcode, handler (cpu_ops), operand bytes, length and base cycle count, so
+// loops skip fetching and decoding their instructions. Data accesses still
+// go through the bus and cycle counts match cpu_step_fast().
+//
+// Entries are read from the bus once, so code must run from memory that
+// reads without side effects. Writes made by the CPU to a page holding
+// cached code drop the blocks in that page. Anything else that changes code
+// (DMA, the host, bank switching) must call dcache_invalidate().
+
+struct dcache;
+
+struct dcache *dcache_create(void);
+void dcache_destroy(struct dcache *dcache);
+
+// Runs instructions until at least `cycles` have elapsed and returns the total.
+// A dcache holds code read through `bus`, so use one dcache per bus.
+uint64_t dcache_run(struct dcache *dcache, struct cpu *cpu, const struct bus *bus, uint64_t cycles);
+
+// Drops cached blocks covering addr's page.
+void dcache_invalidate(struct dcache *dcache, uint16_t addr);
+
+#endif
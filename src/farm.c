@@ -0,0 +1,234 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#include <sched.h>
+#endif
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "farm.h"
+
+#define FARM_LINE 64    // bytes in a cache line
+
+// A run of job indices, begin in the low half and end in the high half, so
+// that both change together in one compare-and-swap.
+#define RUN(begin, end) ((uint64_t)(begin) | (uint64_t)(end) << 32)
+#define BEGIN(run)      ((uint32_t)(run))
+#define END(run)        ((uint32_t)((run) >> 32))
+
+struct farm;
+
+struct worker {
+    _Alignas(FARM_LINE) _Atomic uint64_t run;
+    struct farm *farm;
+    unsigned id;
+    pthread_t thread;
+    int running;
+    uint8_t *arena;
+    uint32_t seed;
+
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t steals;
+};
+
+struct farm {
+    struct farm_job *jobs;
+    struct worker *workers;
+    unsigned threads;
+    int pin;
+};
+
+// Takes the next job from the front of the worker's own run
+static int take(struct worker *w, uint32_t *job) {
+    uint64_t run = atomic_load_explicit(&w->run, memory_order_relaxed);
+
+    while (BEGIN(run) < END(run)) {
+        if (atomic_compare_exchange_weak(&w->run, &run, RUN(BEGIN(run) + 1, END(run)))) {
+            *job = BEGIN(run);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Takes the back half of another worker's run, starting from a random one.
+// The first job is returned and the rest become the thief's run.
+static int steal(struct worker *w, uint32_t *job) {
+    struct farm *farm = w->farm;
+
+    w->seed = w->seed * 1103515245 + 12345;
+    unsigned first = (w->seed >> 16) % farm->threads;
+
+    for (unsigned k = 0; k < farm->threads; k++) {
+        struct worker *victim = &farm->workers[(first + k) % farm->threads];
+        if (victim == w) {
+            continue;
+        }
+
+        uint64_t run = atomic_load_explicit(&victim->run, memory_order_relaxed);
+
+        while (BEGIN(run) < END(run)) {
+            uint32_t mid = BEGIN(run) + (END(run) - BEGIN(run)) / 2;
+
+            if (atomic_compare_exchange_weak(&victim->run, &run, RUN(BEGIN(run), mid))) {
+                atomic_store(&w->run, RUN(mid + 1, END(run)));
+                w->steals++;
+                *job = mid;
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static void run_job(struct worker *w, struct farm_job *job) {
+    struct bus bus = { .inst = w->arena };
+    uint64_t ran = 0;
+
+    bus_map(&bus, 0x0000, 0x10000, w->arena);
+    uint64_t instructions = 0;
+
+    memcpy(w->arena, job->image, 0x10000);
+
+    while (ran < job->cycles) {
+        ran += cpu_step_fast(&job->cpu, &bus);
+        instructions++;
+    }
+
+    if (job->memory != NULL) {
+        memcpy(job->memory, w->arena, 0x10000);
+    }
+
+    job->ran = ran;
+    job->instructions = instructions;
+    job->worker = w->id;
+
+    w->cycles += ran;
+    w->instructions += instructions;
+}
+
+static void *work(void *arg) {
+    struct worker *w = arg;
+
+#ifdef __linux__
+    if (w->farm->pin) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(w->id % CPU_SETSIZE, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+#endif
+
+    uint32_t job;
+    while (take(w, &job) || steal(w, &job)) {
+        run_job(w, &w->farm->jobs[job]);
+    }
+
+    return NULL;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int farm_run(struct farm_job *jobs, size_t count, const struct farm_options *options, struct farm_stats *stats) {
+    if (count > UINT32_MAX) {
+        return -1;
+    }
+
+    struct farm farm = { .jobs = jobs };
+    farm.threads = options != NULL ? options->threads : 0;
+    farm.pin = options != NULL && options->pin;
+
+    if (farm.threads == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        farm.threads = online > 0 ? online : 1;
+    }
+
+    if (farm.threads > count) {
+        farm.threads = count > 0 ? count : 1;
+    }
+
+    farm.workers = aligned_alloc(FARM_LINE, farm.threads * sizeof(struct worker));
+    if (farm.workers == NULL) {
+        return -1;
+    }
+
+    // Deal the jobs out in equal runs
+    for (unsigned i = 0; i < farm.threads; i++) {
+        struct worker *w = &farm.workers[i];
+        memset(w, 0, sizeof(*w));
+        atomic_init(&w->run, RUN(count * i / farm.threads, count * (i + 1) / farm.threads));
+        w->farm = &farm;
+        w->id = i;
+        w->seed = i + 1;
+        w->arena = malloc(0x10000);
+    }
+
+    int result = 0;
+    unsigned started = 0;
+    double start = now();
+
+    for (unsigned i = 0; i < farm.threads; i++) {
+        if (farm.workers[i].arena == NULL) {
+            result = -1;
+            break;
+        }
+    }
+
+    // Workers that fail to start leave their runs to be stolen
+    if (result == 0) {
+        for (unsigned i = 0; i < farm.threads; i++) {
+            if (pthread_create(&farm.workers[i].thread, NULL, work, &farm.workers[i]) == 0) {
+                farm.workers[i].running = 1;
+                started++;
+            }
+        }
+
+        if (started == 0) {
+            result = -1;
+        }
+    }
+
+    if (stats != NULL) {
+        memset(stats, 0, sizeof(*stats));
+        stats->threads = started;
+    }
+
+    for (unsigned i = 0; i < farm.threads; i++) {
+        struct worker *w = &farm.workers[i];
+
+        if (w->running) {
+            pthread_join(w->thread, NULL);
+        }
+
+        if (stats != NULL) {
+            stats->cycles += w->cycles;
+            stats->instructions += w->instructions;
+            stats->steals += w->steals;
+        }
+
+        free(w->arena);
+    }
+
+    if (stats != NULL) {
+        stats->seconds = now() - start;
+    }
+
+    free(farm.workers);
+
+    return result;
+}
+
+double farm_mips(const struct farm_stats *stats) {
+    return stats->seconds > 0 ? stats->instructions / stats->seconds / 1e6 : 0;
+}
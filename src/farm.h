@@ -0,0 +1,48 @@
+#ifndef __FARM_H__
+#define __FARM_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpu.h"
+
+// Runs many independent jobs across a pool of threads. Each job is a 64K
+// memory image, a CPU state and a cycle budget, and runs over a flat bus with
+// cpu_step_fast(). Jobs are dealt out to the workers in equal runs up front;
+// a worker that runs out steals half of what is left of another's run. The
+// only shared state is each worker's run, taken from with compare-and-swap,
+// and each worker runs its jobs in its own 64K arena.
+
+struct farm_job {
+    const uint8_t *image;       // 64K memory to start from
+    uint8_t *memory;            // where to copy memory at the end, or NULL
+    struct cpu cpu;             // state to start from, and the state at the end
+    uint64_t cycles;            // runs until at least this many have elapsed
+
+    // results
+    uint64_t ran;               // cycles
+    uint64_t instructions;
+    unsigned worker;            // which worker ran it
+};
+
+struct farm_options {
+    unsigned threads;           // 0 for one per online CPU
+    int pin;                    // nonzero to pin worker i to CPU i
+};
+
+struct farm_stats {
+    unsigned threads;
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t steals;
+    double seconds;             // wall clock
+};
+
+// Runs every job and returns 0, or -1 if the workers could not be started.
+// `options` and `stats` may be NULL.
+int farm_run(struct farm_job *jobs, size_t count, const struct farm_options *options, struct farm_stats *stats);
+
+// Millions of instructions per second across all workers.
+double farm_mips(const struct farm_stats *stats);
+
+#endif
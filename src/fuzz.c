@@ -0,0 +1,203 @@
+#include <stdlib.h>
+
+#include "fuzz.h"
+
+// The engine from cpu_exec.h, built over a runner the way trace.c builds
+// it over a tracer: each access goes to the child's bus and is tested
+// against the watch's bits if it has one.
+struct runner {
+    const struct bus *under;
+    struct cpu_watch *watch;
+    int hit;
+};
+
+#define WATCHED(bits, addr) ((bits)[(addr) >> 3] & 1 << ((addr) & 7))
+
+// Records the first hit of a run in the watch, as cpu_run() would
+static void hit(struct runner *runner, int reason, uint16_t addr, uint8_t data) {
+    if (!runner->hit) {
+        runner->hit = 1;
+        runner->watch->reason = reason;
+        runner->watch->addr = addr;
+        runner->watch->data = data;
+    }
+}
+
+static inline __attribute__((always_inline)) uint8_t runner_peek(struct runner *runner, uint16_t addr) {
+    uint8_t data = bus_peek(runner->under, addr);
+
+    if (runner->watch != NULL && WATCHED(runner->watch->read, addr)) {
+        hit(runner, CPU_STOP_READ, addr, data);
+    }
+
+    return data;
+}
+
+static inline __attribute__((always_inline)) void runner_poke(struct runner *runner, uint16_t addr, uint8_t data) {
+    if (runner->watch != NULL && WATCHED(runner->watch->write, addr)) {
+        hit(runner, CPU_STOP_WRITE, addr, data);
+    }
+
+    bus_poke(runner->under, addr, data);
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#define CPU_TEMPLATE
+#define CPU_BUS struct runner *
+#define bus_peek runner_peek
+#define bus_poke runner_poke
+#include "cpu_exec.h"
+#undef bus_peek
+#undef bus_poke
+#pragma GCC diagnostic pop
+
+// The port, in front of the child's callbacks
+static uint8_t port_peek(void *inst, uint16_t addr) {
+    struct fuzz *fuzz = inst;
+
+    if (fuzz->config.port && addr == fuzz->config.port_addr) {
+        return fuzz->at < fuzz->size ? fuzz->data[fuzz->at++] : 0;
+    }
+
+    return fuzz->peek(fuzz->inst, addr);
+}
+
+static void port_poke(void *inst, uint16_t addr, uint8_t data) {
+    struct fuzz *fuzz = inst;
+    fuzz->poke(fuzz->inst, addr, data);
+}
+
+struct fuzz *fuzz_new(const struct cpu *cpu, const struct bus *bus, const struct fuzz_config *config) {
+    if (config->port && bus->read[config->port_addr >> 8] != NULL) {
+        return NULL;
+    }
+
+    struct fuzz *fuzz = calloc(1, sizeof(*fuzz));
+    if (fuzz == NULL) {
+        return NULL;
+    }
+
+    fuzz->config = *config;
+    fuzz->map = fuzz->own_map;
+    fuzz->base = cow_base_new(cpu, bus);
+    fuzz->child = fuzz->base != NULL ? cow_child_new(fuzz->base) : NULL;
+
+    if (fuzz->child == NULL) {
+        fuzz_free(fuzz);
+        return NULL;
+    }
+
+    struct bus *child_bus = &fuzz->child->bus;
+    fuzz->inst = child_bus->inst;
+    fuzz->peek = child_bus->peek;
+    fuzz->poke = child_bus->poke;
+    child_bus->inst = fuzz;
+    child_bus->peek = port_peek;
+    child_bus->poke = port_poke;
+
+    return fuzz;
+}
+
+void fuzz_free(struct fuzz *fuzz) {
+    if (fuzz->child != NULL) {
+        cow_child_free(fuzz->child);
+    }
+    if (fuzz->base != NULL) {
+        cow_base_free(fuzz->base);
+    }
+    free(fuzz);
+}
+
+void fuzz_exit(struct fuzz *fuzz, uint16_t pc, int on) {
+    if (on) {
+        fuzz->exits[pc >> 3] |= 1 << (pc & 7);
+    } else {
+        fuzz->exits[pc >> 3] &= ~(1 << (pc & 7));
+    }
+}
+
+// An edge's counter: the origin is hashed so that edges from neighbouring
+// instructions to neighbouring targets don't collide
+static inline uint8_t *edge(uint8_t *map, uint16_t from, uint16_t to) {
+    return &map[(uint16_t)((from * 0x9E3779B1u) >> 16 ^ to)];
+}
+
+static enum fuzz_result run(struct fuzz *fuzz, uint64_t *ran) {
+    struct cpu *cpu = &fuzz->child->cpu;
+    struct runner runner = { &fuzz->child->bus, cpu->watch, 0 };
+    const uint8_t *exits = fuzz->exits;
+    uint8_t *map = fuzz->map;
+    uint64_t max_cycles = fuzz->config.max_cycles;
+
+    if (runner.watch != NULL) {
+        runner.watch->reason = 0;
+    }
+
+    while (*ran < max_cycles) {
+        uint16_t pc = cpu->pc;
+
+        if (WATCHED(exits, pc)) {
+            return FUZZ_OK;
+        }
+
+        // a masked IRQ leaves the instruction to the checks below
+        if (cpu->intr && (cpu->intr & INTR_RESET || poll(cpu))) {
+            *ran += step(cpu, &runner);
+            (*edge(map, pc, cpu->pc))++;
+        } else {
+            if (runner.watch != NULL && WATCHED(runner.watch->exec, pc)) {
+                hit(&runner, CPU_STOP_BREAK, pc, 0);
+                return FUZZ_WATCH;
+            }
+
+            cpu->opc = runner_peek(&runner, pc);
+            if (cpu_ops[cpu->opc].flags & CPU_OP_JAM) {
+                return FUZZ_JAM;
+            }
+
+            cpu->pc++;
+            *ran += exec(cpu, &runner);
+
+            if (cpu_ops[cpu->opc].flags & CPU_OP_BRANCH) {
+                if (cpu->pc == pc) {
+                    return FUZZ_TRAP;
+                }
+                (*edge(map, pc, cpu->pc))++;
+            }
+        }
+
+        if (runner.hit) {
+            return FUZZ_WATCH;
+        }
+    }
+
+    return FUZZ_TIMEOUT;
+}
+
+enum fuzz_result fuzz_run(struct fuzz *fuzz, const uint8_t *data, size_t size) {
+    struct cow_child *child = fuzz->child;
+    const struct fuzz_config *config = &fuzz->config;
+
+    cow_child_reset(child);
+
+    size_t n = size < config->input_size ? size : config->input_size;
+    for (size_t i = 0; i < n; i++) {
+        bus_poke(&child->bus, config->input_addr + i, data[i]);
+    }
+
+    if (config->length) {
+        bus_poke(&child->bus, config->length_addr, size);
+        bus_poke(&child->bus, config->length_addr + 1, size >> 8);
+    }
+
+    fuzz->data = data;
+    fuzz->size = size;
+    fuzz->at = 0;
+
+    // the map is bytes and may alias the fuzz, so the count is kept in a local
+    uint64_t cycles = 0;
+    enum fuzz_result result = run(fuzz, &cycles);
+    fuzz->cycles = cycles;
+    return result;
+}
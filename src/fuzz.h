@@ -0,0 +1,84 @@
+#ifndef __FUZZ_H__
+#define __FUZZ_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bus.h"
+#include "cow.h"
+#include "cpu.h"
+
+// Coverage-guided fuzzing of guest code. fuzz_new() forks a booted machine
+// with cow.h, and each fuzz_run() resets the fork, puts the input where the
+// guest looks for it and runs until the guest reaches an exit or something
+// goes wrong. As it runs, every branch, jump, call, return and interrupt
+// bumps a counter in an edge map, indexed by a hash of where it was and
+// where it went, the way AFL and libFuzzer's extra counters expect.
+//
+// A run crashes if it traps anywhere but an exit (an instruction that
+// jumps or branches to itself), reaches an opcode the core doesn't
+// implement, or hits a bit in the child's cpu.watch. The watch isn't armed:
+// the run checks its execute, read and write bits itself, records the hit
+// in it the way cpu_run() would, and doesn't call its filter.
+
+#define FUZZ_MAP 0x10000        // bytes in an edge map
+
+enum fuzz_result {
+    FUZZ_OK,                    // reached an exit
+    FUZZ_TIMEOUT,               // ran max_cycles without reaching one
+    FUZZ_TRAP,
+    FUZZ_JAM,
+    FUZZ_WATCH,
+};
+
+#define FUZZ_CRASHED(result) ((result) >= FUZZ_TRAP)
+
+struct fuzz_config {
+    // the input is written from input_addr, up to input_size bytes of it
+    uint16_t input_addr;
+    uint16_t input_size;
+
+    // if set, the input's length is written at length_addr, low byte first
+    int length;
+    uint16_t length_addr;
+
+    // if set, reads of port_addr return the input a byte at a time, then 0.
+    // Its page can't be mapped in the parent.
+    int port;
+    uint16_t port_addr;
+
+    uint64_t max_cycles;
+};
+
+struct fuzz {
+    struct cow_child *child;    // the machine each run uses
+    uint8_t *map;               // FUZZ_MAP edge counters, which runs don't clear
+    uint8_t exits[0x2000];      // a bit for each PC a run ends well at
+    uint64_t cycles;            // taken by the last run
+
+    // internal
+    struct fuzz_config config;
+    struct cow_base *base;
+    uint8_t own_map[FUZZ_MAP];
+    const uint8_t *data;
+    size_t size;
+    size_t at;
+    void *inst;
+    uint8_t (*peek)(void *inst, uint16_t addr);
+    void (*poke)(void *inst, uint16_t addr, uint8_t data);
+};
+
+// Forks the machine as it is now, with a map of its own. Returns NULL on
+// failure or if the port's page is mapped.
+struct fuzz *fuzz_new(const struct cpu *cpu, const struct bus *bus, const struct fuzz_config *config);
+
+void fuzz_free(struct fuzz *fuzz);
+
+// Sets or clears an exit
+void fuzz_exit(struct fuzz *fuzz, uint16_t pc, int on);
+
+// Runs one input from the fork. The child is left as the run left it until
+// the next run.
+enum fuzz_result fuzz_run(struct fuzz *fuzz, const uint8_t *data, size_t size);
+
+#endif
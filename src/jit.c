@@ -0,0 +1,1067 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jit.h"
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define JIT_X86_64 1
+#include <sys/mman.h>
+#else
+#define JIT_X86_64 0
+#endif
+
+#define JIT_HOT         2           // visits before a block is translated
+#define JIT_BLOCK_MAX   32          // instructions per block
+#define JIT_BLOCKS      8192        // blocks translated before a flush
+#define JIT_CODE_SIZE   (4 << 20)   // bytes of host code before a flush
+#define JIT_CODE_MAX    8192        // upper bound on one block's host code
+#define JIT_PAGE_WRITES 64          // code writes before a page is left interpreted
+
+struct jit;
+
+// Returns the cycles run. Sets jit->write_hit and jit->hit_page if an
+// instruction wrote to a page holding translated code, in which case the
+// block stops right after it.
+typedef uint64_t (*block_fn)(struct cpu *cpu, const struct bus *bus, struct jit *jit);
+
+struct block {
+    block_fn code;
+    uint16_t pc;
+    uint16_t end;       // address of the last byte translated
+    struct block *next; // next block starting in the same page
+    uint8_t opr[JIT_BLOCK_MAX][2];
+};
+
+struct jit {
+    // read and written by translated code
+    uint8_t code_pages[256];
+    uint8_t nz[256];
+    uint8_t write_hit;
+    uint8_t hit_page;
+
+    uint8_t data_pages[256];    // pages whose host memory translations use
+    uint8_t page_writes[256];
+    uint8_t hits[0x10000];
+    struct block *blocks[0x10000];
+    struct block *page_blocks[256];
+
+    struct block pool[JIT_BLOCKS];
+    size_t pool_n;
+
+    uint8_t *code;
+    size_t code_n;
+};
+
+static void flush(struct jit *jit) {
+    memset(jit->code_pages, 0, sizeof(jit->code_pages));
+    memset(jit->data_pages, 0, sizeof(jit->data_pages));
+    memset(jit->blocks, 0, sizeof(jit->blocks));
+    memset(jit->page_blocks, 0, sizeof(jit->page_blocks));
+    jit->pool_n = 0;
+    jit->code_n = 0;
+}
+
+static void drop_page(struct jit *jit, uint8_t page) {
+    if (!jit->code_pages[page]) {
+        return;
+    }
+
+    jit->code_pages[page] = 0;
+
+    for (struct block *b = jit->page_blocks[page]; b != NULL; b = b->next) {
+        jit->blocks[b->pc] = NULL;
+    }
+
+    jit->page_blocks[page] = NULL;
+
+    if (page == 0) {
+        return;
+    }
+
+    // the last instruction of a block in the previous page may spill over
+    struct block **link = &jit->page_blocks[page - 1];
+    while (*link != NULL) {
+        struct block *b = *link;
+
+        if ((b->end >> 8) == page) {
+            jit->blocks[b->pc] = NULL;
+            *link = b->next;
+        } else {
+            link = &b->next;
+        }
+    }
+}
+
+static void code_write(struct jit *jit, uint8_t page) {
+    if (!jit->code_pages[page]) {
+        return;
+    }
+
+    // pages that keep getting rewritten are left to the interpreter
+    if (jit->page_writes[page] < JIT_PAGE_WRITES) {
+        jit->page_writes[page]++;
+    }
+
+    drop_page(jit, page);
+}
+
+// Drops the pages an interpreted instruction could have written to.
+static void track_writes(struct jit *jit, const struct cpu *cpu) {
+    if (cpu_ops[cpu->opc].flags & CPU_OP_WRITE) {
+        code_write(jit, cpu->ea >> 8);
+    }
+
+    if (cpu_ops[cpu->opc].flags & CPU_OP_PUSH) {
+        code_write(jit, 0x01);
+    }
+}
+
+#if JIT_X86_64
+
+//
+// x86-64 emitter
+//
+// Translated code keeps cpu in rbx, bus in r12, the jit in r14 and the
+// cycle count in r13d. Instructions with a template below become host code
+// working directly on struct cpu and on the host memory of pages the bus
+// maps, with the page table's pointers baked in; everything else
+// becomes a call to the decoded handler:
+//
+//     cycles += cpu_ops[opc].exec(cpu, bus, &block->opr[i]);
+//
+// Native code only brings cpu->pc, the cycle count and cpu->opc up to date
+// where the block can exit, and leaves opr1, opr2 and ea alone. poll() needs
+// opc, and last_i after CLI, SEI and PLP, to see I as the 6502 would.
+//
+// Between instructions, blocks test cpu->intr and leave through a stub if
+// it is set and cpu_pending() would say so, so interrupts a handler's bus
+// access raises are taken at the next instruction boundary.
+//
+
+// Addressing mode and action of each opcode, from the table cpu.c uses
+enum mode {
+    MODE_brk, MODE_rti, MODE_php, MODE_plp, MODE_pha, MODE_pla, MODE_jsr,
+    MODE_rts, MODE_jmp_abl, MODE_jmp_ind, MODE_illegal, MODE_imm, MODE_imp,
+    MODE_acc, MODE_zpg, MODE_zpx, MODE_zpy, MODE_abl, MODE_abx, MODE_aby,
+    MODE_idx, MODE_idy, MODE_rel, MODE_jmp_iax, MODE_phr, MODE_plr, MODE_nop1,
+    MODE_zpi, MODE_abx_shift,
+};
+
+enum act {
+    ACT_NULL, ACT_ora, ACT_and, ACT_eor, ACT_adc, ACT_sbc, ACT_cmp, ACT_cpx,
+    ACT_cpy, ACT_dec, ACT_dex, ACT_dey, ACT_inc, ACT_inx, ACT_iny, ACT_asl,
+    ACT_lsr, ACT_rol, ACT_ror, ACT_sta, ACT_stx, ACT_sty, ACT_tax, ACT_tay,
+    ACT_txa, ACT_tya, ACT_tsx, ACT_txs, ACT_lda, ACT_ldx, ACT_ldy, ACT_bpl,
+    ACT_bmi, ACT_bne, ACT_beq, ACT_bcc, ACT_bcs, ACT_bvc, ACT_bvs, ACT_sec,
+    ACT_sed, ACT_sei, ACT_clc, ACT_cld, ACT_cli, ACT_clv, ACT_bit, ACT_nop,
+    ACT_stz, ACT_tsb, ACT_trb, ACT_bit_imm, ACT_bra,
+};
+
+static const uint8_t modes[256] = {
+#define OP(o, p, a, t) [o] = MODE_##p,
+#include "opcodes.def"
+#undef OP
+};
+
+static const uint8_t acts[256] = {
+#define OP(o, p, a, t) [o] = ACT_##a,
+#include "opcodes.def"
+#undef OP
+};
+
+#define CPU(field) ((uint8_t)offsetof(struct cpu, field))
+
+// x86 condition codes
+#define CC_E  0x04
+#define CC_NE 0x05
+
+struct emitter {
+    struct jit *jit;
+    const struct bus *bus;
+    uint8_t *p;
+    uint16_t pc;            // address of the instruction being translated
+    int pc_synced;          // cpu->pc already holds pc
+    uint32_t pending;       // cycles run by native code, not yet in r13d
+    uint8_t opc;            // the instruction being translated
+    int opc_synced;         // cpu->opc already holds opc
+    uint8_t *hits[JIT_BLOCK_MAX * 2];
+    int hits_n;             // jcc rel32 operands to patch to the write-hit stub
+    uint8_t *exits[JIT_BLOCK_MAX * 2];
+    int exits_n;            // jmp rel32 operands to patch to the epilogue
+    struct {
+        uint8_t *at;        // jne rel32 operand to patch to the stub
+        uint16_t pc;
+        uint8_t opc;
+        uint32_t cycles;
+    } polls[JIT_BLOCK_MAX];
+    int polls_n;            // instruction boundaries that test cpu->intr
+};
+
+static void out(struct emitter *e, const uint8_t *bytes, size_t n) {
+    memcpy(e->p, bytes, n);
+    e->p += n;
+}
+
+#define OUT(e, ...) \
+    out(e, (const uint8_t[]){ __VA_ARGS__ }, sizeof((const uint8_t[]){ __VA_ARGS__ }))
+
+static void out16(struct emitter *e, uint16_t value) {
+    out(e, (const uint8_t *)&value, sizeof(value));
+}
+
+static void out32(struct emitter *e, uint32_t value) {
+    out(e, (const uint8_t *)&value, sizeof(value));
+}
+
+static void out64(struct emitter *e, uint64_t value) {
+    out(e, (const uint8_t *)&value, sizeof(value));
+}
+
+static void patch_rel32(uint8_t *at, const uint8_t *target) {
+    int32_t rel = (int32_t)(target - (at + 4));
+    memcpy(at, &rel, sizeof(rel));
+}
+
+static void set_pc(struct emitter *e, uint16_t pc) {
+    OUT(e, 0x66, 0xC7, 0x43, CPU(pc));                  // mov word [rbx + pc], imm16
+    out16(e, pc);
+}
+
+static void add_cycles(struct emitter *e, uint32_t cycles) {
+    if (cycles) {
+        OUT(e, 0x41, 0x81, 0xC5);                       // add r13d, imm32
+        out32(e, cycles);
+    }
+}
+
+static void flush_cycles(struct emitter *e) {
+    add_cycles(e, e->pending);
+    e->pending = 0;
+}
+
+static void sync_opc(struct emitter *e) {
+    if (!e->opc_synced) {
+        OUT(e, 0xC6, 0x43, CPU(opc), e->opc);           // mov byte [rbx + opc], imm8
+        e->opc_synced = 1;
+    }
+}
+
+static void jump_exit(struct emitter *e) {
+    OUT(e, 0xE9);                                       // jmp rel32
+    e->exits[e->exits_n++] = e->p;
+    out32(e, 0);
+}
+
+static void jump_hit(struct emitter *e) {
+    OUT(e, 0x0F, 0x80 | CC_NE);                         // jne rel32
+    e->hits[e->hits_n++] = e->p;
+    out32(e, 0);
+}
+
+// Leaves through the write-hit stub if `page` holds translated code.
+// cpu->pc, the cycle count and cpu->opc must already be up to date.
+static void check_page(struct emitter *e, uint8_t page) {
+    OUT(e, 0x41, 0x80, 0xBE);                           // cmp byte [r14 + code_pages + page], 0
+    out32(e, offsetof(struct jit, code_pages) + page);
+    OUT(e, 0x00);
+    OUT(e, 0xB8);                                       // mov eax, page
+    out32(e, page);
+    jump_hit(e);
+}
+
+// Tests for an interrupt before the instruction at e->pc, leaving through a
+// stub that poll_stubs() emits if there may be one.
+static void check_intr(struct emitter *e) {
+    OUT(e, 0x80, 0x7B, CPU(intr), 0x00);               // cmp byte [rbx + intr], 0
+    OUT(e, 0x0F, 0x80 | CC_NE);                         // jne rel32
+    e->polls[e->polls_n].at = e->p;
+    e->polls[e->polls_n].pc = e->pc;
+    e->polls[e->polls_n].opc = e->opc;
+    e->polls[e->polls_n].cycles = e->pending;
+    e->polls_n++;
+    out32(e, 0);
+}
+
+// Emits the stubs check_intr() jumps to. Each goes back into the block if
+// only an IRQ is held while I masks it, as cpu_pending() decides, and
+// otherwise brings cpu->pc, the cycle count and cpu->opc up to date and
+// leaves.
+static void poll_stubs(struct emitter *e, const uint8_t *epilogue) {
+    for (int i = 0; i < e->polls_n; i++) {
+        uint8_t opc = e->polls[i].opc;
+        int delayed = acts[opc] == ACT_cli || acts[opc] == ACT_sei || modes[opc] == MODE_plp;
+
+        patch_rel32(e->polls[i].at, e->p);
+
+        OUT(e, 0xF6, 0x43, CPU(intr), (uint8_t)~INTR_IRQ); // test byte [rbx + intr], ~IRQ
+        OUT(e, 0x75, 0);                                // jne rel8 leave
+        uint8_t *other = e->p;
+
+        // test byte [rbx + last_i or p], I
+        OUT(e, 0xF6, 0x43, delayed ? CPU(last_i) : CPU(p), P_I);
+        OUT(e, 0x74, 0);                                // je rel8 leave
+        uint8_t *unmasked = e->p;
+
+        OUT(e, 0xE9);                                   // jmp rel32 back
+        out32(e, 0);
+        patch_rel32(e->p - 4, e->polls[i].at + 4);
+
+        other[-1] = (uint8_t)(e->p - other);
+        unmasked[-1] = (uint8_t)(e->p - unmasked);
+
+        set_pc(e, e->polls[i].pc);
+        OUT(e, 0xC6, 0x43, CPU(opc), opc);              // mov byte [rbx + opc], imm8
+        add_cycles(e, e->polls[i].cycles);
+        OUT(e, 0xE9);                                   // jmp rel32 epilogue
+        out32(e, 0);
+        patch_rel32(e->p - 4, epilogue);
+    }
+}
+
+#ifdef CPU_LAZY_FLAGS
+
+// Sets N and Z from al, and C from cl if `carry`.
+static void set_flags(struct emitter *e, uint8_t mask, int carry) {
+    (void)mask;
+    OUT(e, 0x88, 0x43, CPU(n));                         // mov [rbx + n], al
+    OUT(e, 0x88, 0x43, CPU(z));                         // mov [rbx + z], al
+    if (carry) {
+        OUT(e, 0x80, 0x63, CPU(p), (uint8_t)~P_C);      // and byte [rbx + p], ~C
+        OUT(e, 0x08, 0x4B, CPU(p));                     // or byte [rbx + p], cl
+    }
+}
+
+// Sets ZF if `flag` is clear.
+static void test_flag(struct emitter *e, uint8_t flag) {
+    if (flag == P_Z) {
+        OUT(e, 0x80, 0x7B, CPU(z), 0x00);               // cmp byte [rbx + z], 0
+        OUT(e, 0x0F, 0x94, 0xC0);                       // sete al
+        OUT(e, 0x84, 0xC0);                             // test al, al
+    } else if (flag == P_N) {
+        OUT(e, 0xF6, 0x43, CPU(n), 0x80);               // test byte [rbx + n], 0x80
+    } else {
+        OUT(e, 0xF6, 0x43, CPU(p), flag);               // test byte [rbx + p], flag
+    }
+}
+
+// Loads P into cl, as cpu_get_p() would build it.
+static void get_p(struct emitter *e) {
+    OUT(e, 0x8A, 0x4B, CPU(p));                         // mov cl, [rbx + p]
+    OUT(e, 0x80, 0xE1, (uint8_t)~(P_N | P_Z));          // and cl, ~(N | Z)
+    OUT(e, 0x8A, 0x43, CPU(n));                         // mov al, [rbx + n]
+    OUT(e, 0x24, P_N);                                  // and al, N
+    OUT(e, 0x08, 0xC1);                                 // or cl, al
+    OUT(e, 0x80, 0x7B, CPU(z), 0x00);                   // cmp byte [rbx + z], 0
+    OUT(e, 0x0F, 0x94, 0xC0);                           // sete al
+    OUT(e, 0x00, 0xC0);                                 // add al, al
+    OUT(e, 0x08, 0xC1);                                 // or cl, al
+}
+
+// Stores al as P, as cpu_set_p() would.
+static void set_p(struct emitter *e) {
+    OUT(e, 0x88, 0x43, CPU(p));                         // mov [rbx + p], al
+    OUT(e, 0x88, 0x43, CPU(n));                         // mov [rbx + n], al
+    OUT(e, 0xA8, P_Z);                                  // test al, Z
+    OUT(e, 0x0F, 0x94, 0xC2);                           // sete dl
+    OUT(e, 0x88, 0x53, CPU(z));                         // mov [rbx + z], dl
+}
+
+#else
+
+// Sets N and Z in cpu->p from al, clearing the rest of `mask` and or-ing
+// in cl if `carry`.
+static void set_flags(struct emitter *e, uint8_t mask, int carry) {
+    OUT(e, 0x0F, 0xB6, 0xC0);                           // movzx eax, al
+    OUT(e, 0x41, 0x0F, 0xB6, 0x94, 0x06);               // movzx edx, byte [r14 + rax + nz]
+    out32(e, offsetof(struct jit, nz));
+    if (carry) {
+        OUT(e, 0x08, 0xCA);                             // or dl, cl
+    }
+    OUT(e, 0x80, 0x63, CPU(p), (uint8_t)~mask);         // and byte [rbx + p], ~mask
+    OUT(e, 0x08, 0x53, CPU(p));                         // or byte [rbx + p], dl
+}
+
+// Sets ZF if `flag` is clear.
+static void test_flag(struct emitter *e, uint8_t flag) {
+    OUT(e, 0xF6, 0x43, CPU(p), flag);                   // test byte [rbx + p], flag
+}
+
+static void get_p(struct emitter *e) {
+    OUT(e, 0x8A, 0x4B, CPU(p));                         // mov cl, [rbx + p]
+}
+
+static void set_p(struct emitter *e) {
+    OUT(e, 0x88, 0x43, CPU(p));                         // mov [rbx + p], al
+}
+
+#endif
+
+// How an instruction uses its operand, which decides the page table it must
+// be mapped in
+enum access { ACCESS_READ = 1, ACCESS_WRITE = 2, ACCESS_MODIFY = 3 };
+
+// The host memory `page` is mapped to for `access`, or NULL if it goes to the
+// callbacks. A page read and written has to be the same memory both ways.
+static uint8_t *host(struct emitter *e, uint8_t page, int access) {
+    const uint8_t *read = e->bus->read[page];
+    uint8_t *write = e->bus->write[page];
+    uint8_t *memory;
+
+    switch (access) {
+    case ACCESS_READ:
+        memory = (uint8_t *)read;
+        break;
+    case ACCESS_WRITE:
+        memory = write;
+        break;
+    default:
+        memory = read == write ? write : NULL;
+        break;
+    }
+
+    if (memory != NULL) {
+        e->jit->data_pages[page] = 1;
+    }
+
+    return memory;
+}
+
+// Emits code leaving the host address of a zpg, zpx, zpy or abl operand in
+// rsi. Returns 0 if the operand's page isn't mapped for `access`.
+static int address(struct emitter *e, uint8_t mode, const uint8_t *opr, int access, uint8_t *page) {
+    uint16_t addr = opr[0];
+    uint8_t *memory;
+    uint8_t index;
+
+    switch (mode) {
+    case MODE_zpg:
+        break;
+    case MODE_abl:
+        addr |= opr[1] << 8;
+        break;
+    case MODE_zpx:
+    case MODE_zpy:
+        memory = host(e, 0x00, access);
+        if (memory == NULL) {
+            return 0;
+        }
+
+        index = mode == MODE_zpx ? CPU(x) : CPU(y);
+        OUT(e, 0x0F, 0xB6, 0x43, index);                // movzx eax, byte [rbx + index]
+        OUT(e, 0x04, opr[0]);                           // add al, imm8
+        OUT(e, 0x48, 0xBE);                             // mov rsi, imm64
+        out64(e, (uint64_t)(uintptr_t)memory);
+        OUT(e, 0x48, 0x8D, 0x34, 0x06);                 // lea rsi, [rsi + rax]
+        *page = 0x00;
+        return 1;
+    default:
+        return 0;
+    }
+
+    memory = host(e, addr >> 8, access);
+    if (memory == NULL) {
+        return 0;
+    }
+
+    OUT(e, 0x48, 0xBE);                                 // mov rsi, imm64
+    out64(e, (uint64_t)(uintptr_t)(memory + (addr & 0xFF)));
+    *page = addr >> 8;
+    return 1;
+}
+
+// Emits code loading a read operand into al. Returns 0 if it can't.
+static int load(struct emitter *e, uint8_t mode, const uint8_t *opr) {
+    uint8_t page;
+
+    if (mode == MODE_imm) {
+        OUT(e, 0xB0, opr[0]);                           // mov al, imm8
+        return 1;
+    }
+
+    if (!address(e, mode, opr, ACCESS_READ, &page)) {
+        return 0;
+    }
+
+    OUT(e, 0x0F, 0xB6, 0x06);                           // movzx eax, byte [rsi]
+    return 1;
+}
+
+// Follows a native write to `page`: brings cpu->pc and the cycle count up
+// to date and leaves if the page holds translated code.
+static void wrote(struct emitter *e, uint16_t next, uint8_t cycles, uint8_t page) {
+    set_pc(e, next);
+    e->pending += cycles;
+    flush_cycles(e);
+    sync_opc(e);
+    check_page(e, page);
+    e->pc_synced = 1;
+}
+
+static void branch(struct emitter *e, uint8_t flag, int set, uint16_t next, uint8_t offset) {
+    uint16_t target = next + (int8_t)offset;
+    uint8_t taken = (target & 0xFF00) == (next & 0xFF00) ? 3 : 4;
+
+    sync_opc(e);
+    test_flag(e, flag);
+    OUT(e, 0x70 | (set ? CC_E : CC_NE), 0);             // j(not taken) rel8
+    uint8_t *skip = e->p;
+
+    set_pc(e, target);
+    add_cycles(e, e->pending + taken);
+    jump_exit(e);
+
+    skip[-1] = (uint8_t)(e->p - skip);
+
+    set_pc(e, next);
+    add_cycles(e, e->pending + 2);
+    jump_exit(e);
+
+    e->pending = 0;
+}
+
+// Emits host code for the instruction at e->pc. Returns 0 to fall back to
+// calling its handler.
+static int native(struct emitter *e, uint8_t opc, const uint8_t *opr) {
+    static const uint8_t regs[] = {
+        [ACT_lda] = CPU(a), [ACT_ldx] = CPU(x), [ACT_ldy] = CPU(y),
+        [ACT_sta] = CPU(a), [ACT_stx] = CPU(x), [ACT_sty] = CPU(y),
+        [ACT_cmp] = CPU(a), [ACT_cpx] = CPU(x), [ACT_cpy] = CPU(y),
+        [ACT_inx] = CPU(x), [ACT_iny] = CPU(y),
+        [ACT_dex] = CPU(x), [ACT_dey] = CPU(y),
+    };
+
+    static const uint8_t moves[][2] = {
+        [ACT_tax] = { CPU(a), CPU(x) }, [ACT_tay] = { CPU(a), CPU(y) },
+        [ACT_txa] = { CPU(x), CPU(a) }, [ACT_tya] = { CPU(y), CPU(a) },
+        [ACT_tsx] = { CPU(sp), CPU(x) }, [ACT_txs] = { CPU(x), CPU(sp) },
+    };
+
+    const struct cpu_op *op = &cpu_ops[opc];
+    uint8_t mode = modes[opc];
+    uint8_t act = acts[opc];
+    uint16_t next = e->pc + op->length;
+    uint8_t *memory;
+    uint8_t page;
+
+    e->opc = opc;
+    e->opc_synced = 0;
+
+    switch (act) {
+    case ACT_lda:
+    case ACT_ldx:
+    case ACT_ldy:
+        if (!load(e, mode, opr)) {
+            return 0;
+        }
+
+        OUT(e, 0x88, 0x43, regs[act]);                  // mov [rbx + reg], al
+        set_flags(e, P_N | P_Z, 0);
+        break;
+
+    case ACT_ora:
+    case ACT_and:
+    case ACT_eor:
+        if (!load(e, mode, opr)) {
+            return 0;
+        }
+
+        // or/and/xor al, [rbx + a]
+        OUT(e, act == ACT_ora ? 0x0A : act == ACT_and ? 0x22 : 0x32, 0x43, CPU(a));
+        OUT(e, 0x88, 0x43, CPU(a));                     // mov [rbx + a], al
+        set_flags(e, P_N | P_Z, 0);
+        break;
+
+    case ACT_cmp:
+    case ACT_cpx:
+    case ACT_cpy:
+        if (!load(e, mode, opr)) {
+            return 0;
+        }
+
+        OUT(e, 0x8A, 0x53, regs[act]);                  // mov dl, [rbx + reg]
+        OUT(e, 0x28, 0xC2);                             // sub dl, al
+        OUT(e, 0x0F, 0x93, 0xC1);                       // setae cl
+        OUT(e, 0x88, 0xD0);                             // mov al, dl
+        set_flags(e, P_N | P_Z | P_C, 1);
+        break;
+
+    case ACT_bit:
+        if (!load(e, mode, opr)) {
+            return 0;
+        }
+
+#ifdef CPU_LAZY_FLAGS
+        OUT(e, 0x88, 0x43, CPU(n));                     // mov [rbx + n], al
+        OUT(e, 0x88, 0xC1);                             // mov cl, al
+        OUT(e, 0x80, 0xE1, P_V);                        // and cl, V
+        OUT(e, 0x22, 0x43, CPU(a));                     // and al, [rbx + a]
+        OUT(e, 0x88, 0x43, CPU(z));                     // mov [rbx + z], al
+        OUT(e, 0x80, 0x63, CPU(p), (uint8_t)~P_V);      // and byte [rbx + p], ~V
+        OUT(e, 0x08, 0x4B, CPU(p));                     // or byte [rbx + p], cl
+        break;
+#endif
+        OUT(e, 0x88, 0xC1);                             // mov cl, al
+        OUT(e, 0x80, 0xE1, P_N | P_V);                  // and cl, N | V
+        OUT(e, 0x22, 0x43, CPU(a));                     // and al, [rbx + a]
+        OUT(e, 0x0F, 0xB6, 0xC0);                       // movzx eax, al
+        OUT(e, 0x41, 0x0F, 0xB6, 0x94, 0x06);           // movzx edx, byte [r14 + rax + nz]
+        out32(e, offsetof(struct jit, nz));
+        OUT(e, 0x80, 0xE2, P_Z);                        // and dl, Z
+        OUT(e, 0x08, 0xCA);                             // or dl, cl
+        OUT(e, 0x80, 0x63, CPU(p), (uint8_t)~(P_N | P_V | P_Z));
+        OUT(e, 0x08, 0x53, CPU(p));                     // or byte [rbx + p], dl
+        break;
+
+    case ACT_sta:
+    case ACT_stx:
+    case ACT_sty:
+        if (!address(e, mode, opr, ACCESS_WRITE, &page)) {
+            return 0;
+        }
+
+        OUT(e, 0x8A, 0x43, regs[act]);                  // mov al, [rbx + reg]
+        OUT(e, 0x88, 0x06);                             // mov [rsi], al
+        wrote(e, next, op->cycles, page);
+        return 1;
+
+    case ACT_inc:
+    case ACT_dec:
+        if (!address(e, mode, opr, ACCESS_MODIFY, &page)) {
+            return 0;
+        }
+
+        OUT(e, 0x0F, 0xB6, 0x06);                       // movzx eax, byte [rsi]
+        OUT(e, 0xFE, act == ACT_inc ? 0xC0 : 0xC8);     // inc/dec al
+        OUT(e, 0x88, 0x06);                             // mov [rsi], al
+        set_flags(e, P_N | P_Z, 0);
+        wrote(e, next, op->cycles, page);
+        return 1;
+
+    case ACT_asl:
+    case ACT_lsr:
+    case ACT_rol:
+    case ACT_ror:
+        if (mode == MODE_acc) {
+            OUT(e, 0x8A, 0x43, CPU(a));                 // mov al, [rbx + a]
+        } else if (address(e, mode, opr, ACCESS_MODIFY, &page)) {
+            OUT(e, 0x0F, 0xB6, 0x06);                   // movzx eax, byte [rsi]
+        } else {
+            return 0;
+        }
+
+        if (act == ACT_rol || act == ACT_ror) {
+            OUT(e, 0x8A, 0x53, CPU(p));                 // mov dl, [rbx + p]
+            OUT(e, 0x80, 0xE2, P_C);                    // and dl, C
+        }
+
+        OUT(e, 0x88, 0xC1);                             // mov cl, al
+
+        if (act == ACT_asl || act == ACT_rol) {
+            OUT(e, 0xC0, 0xE9, 0x07);                   // shr cl, 7
+            OUT(e, 0x00, 0xC0);                         // add al, al
+        } else {
+            OUT(e, 0x80, 0xE1, 0x01);                   // and cl, 1
+            OUT(e, 0xD0, 0xE8);                         // shr al, 1
+        }
+
+        if (act == ACT_ror) {
+            OUT(e, 0xC0, 0xE2, 0x07);                   // shl dl, 7
+        }
+
+        if (act == ACT_rol || act == ACT_ror) {
+            OUT(e, 0x08, 0xD0);                         // or al, dl
+        }
+
+        if (mode == MODE_acc) {
+            OUT(e, 0x88, 0x43, CPU(a));                 // mov [rbx + a], al
+            set_flags(e, P_N | P_Z | P_C, 1);
+            break;
+        }
+
+        OUT(e, 0x88, 0x06);                             // mov [rsi], al
+        set_flags(e, P_N | P_Z | P_C, 1);
+        wrote(e, next, op->cycles, page);
+        return 1;
+
+    case ACT_inx:
+    case ACT_iny:
+    case ACT_dex:
+    case ACT_dey:
+        OUT(e, 0x8A, 0x43, regs[act]);                  // mov al, [rbx + reg]
+        OUT(e, 0xFE, act == ACT_inx || act == ACT_iny ? 0xC0 : 0xC8);
+        OUT(e, 0x88, 0x43, regs[act]);                  // mov [rbx + reg], al
+        set_flags(e, P_N | P_Z, 0);
+        break;
+
+    case ACT_tax:
+    case ACT_tay:
+    case ACT_txa:
+    case ACT_tya:
+    case ACT_tsx:
+    case ACT_txs:
+        OUT(e, 0x8A, 0x43, moves[act][0]);              // mov al, [rbx + from]
+        OUT(e, 0x88, 0x43, moves[act][1]);              // mov [rbx + to], al
+        if (act != ACT_txs) {
+            set_flags(e, P_N | P_Z, 0);
+        }
+        break;
+
+    case ACT_clc: OUT(e, 0x80, 0x63, CPU(p), (uint8_t)~P_C); break;
+    case ACT_cld: OUT(e, 0x80, 0x63, CPU(p), (uint8_t)~P_D); break;
+    case ACT_clv: OUT(e, 0x80, 0x63, CPU(p), (uint8_t)~P_V); break;
+    case ACT_sec: OUT(e, 0x80, 0x4B, CPU(p), P_C); break;
+    case ACT_sed: OUT(e, 0x80, 0x4B, CPU(p), P_D); break;
+
+    case ACT_cli:
+    case ACT_sei:
+        OUT(e, 0x8A, 0x43, CPU(p));                     // mov al, [rbx + p]
+        OUT(e, 0x24, P_I);                              // and al, I
+        OUT(e, 0x88, 0x43, CPU(last_i));                // mov [rbx + last_i], al
+        if (act == ACT_cli) {
+            OUT(e, 0x80, 0x63, CPU(p), (uint8_t)~P_I);  // and byte [rbx + p], ~I
+        } else {
+            OUT(e, 0x80, 0x4B, CPU(p), P_I);            // or byte [rbx + p], I
+        }
+        break;
+
+    case ACT_nop: break;
+
+    case ACT_bpl: branch(e, P_N, 0, next, opr[0]); return 1;
+    case ACT_bmi: branch(e, P_N, 1, next, opr[0]); return 1;
+    case ACT_bvc: branch(e, P_V, 0, next, opr[0]); return 1;
+    case ACT_bvs: branch(e, P_V, 1, next, opr[0]); return 1;
+    case ACT_bcc: branch(e, P_C, 0, next, opr[0]); return 1;
+    case ACT_bcs: branch(e, P_C, 1, next, opr[0]); return 1;
+    case ACT_bne: branch(e, P_Z, 0, next, opr[0]); return 1;
+    case ACT_beq: branch(e, P_Z, 1, next, opr[0]); return 1;
+
+    case ACT_NULL:
+        switch (mode) {
+        case MODE_jmp_abl:
+            set_pc(e, opr[0] | opr[1] << 8);
+            add_cycles(e, e->pending + op->cycles);
+            e->pending = 0;
+            sync_opc(e);
+            jump_exit(e);
+            return 1;
+
+        case MODE_pha:
+        case MODE_php:
+            memory = host(e, 0x01, ACCESS_WRITE);
+            if (memory == NULL) {
+                return 0;
+            }
+
+            if (mode == MODE_pha) {
+                OUT(e, 0x8A, 0x4B, CPU(a));             // mov cl, [rbx + a]
+            } else {
+                get_p(e);
+                OUT(e, 0x80, 0xC9, P_B | P_5);          // or cl, B | 5
+            }
+            OUT(e, 0x0F, 0xB6, 0x43, CPU(sp));          // movzx eax, byte [rbx + sp]
+            OUT(e, 0x48, 0xBE);                         // mov rsi, imm64
+            out64(e, (uint64_t)(uintptr_t)memory);
+            OUT(e, 0x88, 0x0C, 0x06);                   // mov [rsi + rax], cl
+            OUT(e, 0xFE, 0x4B, CPU(sp));                // dec byte [rbx + sp]
+            wrote(e, next, op->cycles, 0x01);
+            return 1;
+
+        case MODE_pla:
+        case MODE_plp:
+            memory = host(e, 0x01, ACCESS_READ);
+            if (memory == NULL) {
+                return 0;
+            }
+
+            OUT(e, 0xFE, 0x43, CPU(sp));                // inc byte [rbx + sp]
+            OUT(e, 0x0F, 0xB6, 0x43, CPU(sp));          // movzx eax, byte [rbx + sp]
+            OUT(e, 0x48, 0xBE);                         // mov rsi, imm64
+            out64(e, (uint64_t)(uintptr_t)memory);
+            OUT(e, 0x0F, 0xB6, 0x04, 0x06);             // movzx eax, byte [rsi + rax]
+            if (mode == MODE_pla) {
+                OUT(e, 0x88, 0x43, CPU(a));             // mov [rbx + a], al
+                set_flags(e, P_N | P_Z, 0);
+            } else {
+                OUT(e, 0x8A, 0x4B, CPU(p));             // mov cl, [rbx + p]
+                OUT(e, 0x80, 0xE1, P_I);                // and cl, I
+                OUT(e, 0x88, 0x4B, CPU(last_i));        // mov [rbx + last_i], cl
+                OUT(e, 0x24, (uint8_t)~(P_B | P_5));    // and al, ~(B | 5)
+                set_p(e);
+            }
+            break;
+
+        default:
+            return 0;
+        }
+        break;
+
+    default:
+        return 0;
+    }
+
+    e->pending += op->cycles;
+    e->pc_synced = 0;
+    return 1;
+}
+
+// Emits a call to the instruction's decoded handler.
+static void call(struct emitter *e, uint8_t opc, const uint8_t *opr) {
+    const struct cpu_op *op = &cpu_ops[opc];
+
+    if (!e->pc_synced) {
+        set_pc(e, e->pc);
+    }
+
+    flush_cycles(e);
+
+    OUT(e, 0x48, 0x89, 0xDF);                           // mov rdi, rbx
+    OUT(e, 0x4C, 0x89, 0xE6);                           // mov rsi, r12
+    OUT(e, 0x48, 0xBA);                                 // mov rdx, imm64
+    out64(e, (uint64_t)(uintptr_t)opr);
+
+    intptr_t rel = (intptr_t)(uintptr_t)op->exec - (intptr_t)(uintptr_t)(e->p + 5);
+    if (rel == (int32_t)rel) {
+        OUT(e, 0xE8);                                   // call rel32
+        out32(e, (uint32_t)rel);
+    } else {
+        OUT(e, 0x48, 0xB8);                             // mov rax, imm64
+        out64(e, (uint64_t)(uintptr_t)op->exec);
+        OUT(e, 0xFF, 0xD0);                             // call rax
+    }
+
+    OUT(e, 0x41, 0x01, 0xC5);                           // add r13d, eax
+    e->opc_synced = 1;                                  // the handler set it
+
+    if (op->flags & CPU_OP_WRITE) {
+        OUT(e, 0x0F, 0xB6, 0x43, CPU(ea) + 1);          // movzx eax, byte [rbx + ea + 1]
+        OUT(e, 0x41, 0x80, 0xBC, 0x06);                 // cmp byte [r14 + rax + code_pages], 0
+        out32(e, offsetof(struct jit, code_pages));
+        OUT(e, 0x00);
+        jump_hit(e);
+    }
+
+    if (op->flags & CPU_OP_PUSH) {
+        check_page(e, 0x01);
+    }
+
+    e->pc_synced = 1;
+}
+
+static struct block *translate(struct jit *jit, const struct bus *bus, uint16_t pc) {
+    if (jit->pool_n == JIT_BLOCKS || jit->code_n + JIT_CODE_MAX > JIT_CODE_SIZE) {
+        flush(jit);
+    }
+
+    struct block *b = &jit->pool[jit->pool_n++];
+    uint8_t *start = jit->code + jit->code_n;
+
+    struct emitter emitter = {
+        .jit = jit,
+        .bus = bus,
+        .p = start,
+        .pc = pc,
+        .pc_synced = 1,
+        .opc_synced = 1,
+    };
+    struct emitter *e = &emitter;
+
+    OUT(e, 0x53);                                       // push rbx
+    OUT(e, 0x41, 0x54);                                 // push r12
+    OUT(e, 0x41, 0x55);                                 // push r13
+    OUT(e, 0x41, 0x56);                                 // push r14
+    OUT(e, 0x41, 0x57);                                 // push r15
+    OUT(e, 0x48, 0x89, 0xFB);                           // mov rbx, rdi
+    OUT(e, 0x49, 0x89, 0xF4);                           // mov r12, rsi
+    OUT(e, 0x49, 0x89, 0xD6);                           // mov r14, rdx
+    OUT(e, 0x45, 0x31, 0xED);                           // xor r13d, r13d
+
+    int ended = 0;
+
+    for (int i = 0; i < JIT_BLOCK_MAX && !ended; i++) {
+        uint8_t opc = bus_peek(bus, e->pc);
+        const struct cpu_op *op = &cpu_ops[opc];
+
+        if (i > 0) {
+            check_intr(e);
+        }
+
+        for (int j = 1; j < op->length; j++) {
+            b->opr[i][j - 1] = bus_peek(bus, (uint16_t)(e->pc + j));
+        }
+
+        if (!native(e, opc, b->opr[i])) {
+            call(e, opc, b->opr[i]);
+        }
+
+        b->end = e->pc + op->length - 1;
+        ended = op->flags & CPU_OP_BRANCH;
+        e->pc += op->length;
+
+        if ((e->pc >> 8) != (pc >> 8)) {
+            break;
+        }
+    }
+
+    if (!ended) {
+        if (!e->pc_synced) {
+            set_pc(e, e->pc);
+        }
+        flush_cycles(e);
+        sync_opc(e);
+    }
+
+    uint8_t *epilogue = e->p;
+    OUT(e, 0x44, 0x89, 0xE8);                           // mov eax, r13d
+    OUT(e, 0x41, 0x5F);                                 // pop r15
+    OUT(e, 0x41, 0x5E);                                 // pop r14
+    OUT(e, 0x41, 0x5D);                                 // pop r13
+    OUT(e, 0x41, 0x5C);                                 // pop r12
+    OUT(e, 0x5B);                                       // pop rbx
+    OUT(e, 0xC3);                                       // ret
+
+    for (int i = 0; i < e->exits_n; i++) {
+        patch_rel32(e->exits[i], epilogue);
+    }
+
+    for (int i = 0; i < e->hits_n; i++) {
+        patch_rel32(e->hits[i], e->p);
+    }
+
+    OUT(e, 0x41, 0x88, 0x86);                           // mov [r14 + hit_page], al
+    out32(e, offsetof(struct jit, hit_page));
+    OUT(e, 0x41, 0xC6, 0x86);                           // mov byte [r14 + write_hit], 1
+    out32(e, offsetof(struct jit, write_hit));
+    OUT(e, 0x01);
+    OUT(e, 0xE9);                                       // jmp rel32 epilogue
+    out32(e, 0);
+    patch_rel32(e->p - 4, epilogue);
+
+    poll_stubs(e, epilogue);
+
+    jit->code_n += e->p - start;
+
+    b->code = (block_fn)(uintptr_t)start;
+    b->pc = pc;
+    b->next = jit->page_blocks[pc >> 8];
+    jit->page_blocks[pc >> 8] = b;
+    jit->code_pages[pc >> 8] = 1;
+    jit->code_pages[b->end >> 8] = 1;
+    jit->blocks[pc] = b;
+
+    return b;
+}
+
+// Translates with the code buffer writable, for as long as that takes.
+// Returns NULL, leaving the block to the interpreter, if it can't be.
+static struct block *emit(struct jit *jit, const struct bus *bus, uint16_t pc) {
+    if (mprotect(jit->code, JIT_CODE_SIZE, PROT_READ | PROT_WRITE) != 0) {
+        return NULL;
+    }
+
+    struct block *b = translate(jit, bus, pc);
+
+    if (mprotect(jit->code, JIT_CODE_SIZE, PROT_READ | PROT_EXEC) != 0) {
+        // not executable, so nothing may run from it
+        flush(jit);
+        munmap(jit->code, JIT_CODE_SIZE);
+        jit->code = NULL;
+        return NULL;
+    }
+
+    return b;
+}
+
+#endif
+
+struct jit *jit_create(void) {
+    struct jit *jit = calloc(1, sizeof(struct jit));
+    if (jit == NULL) {
+        return NULL;
+    }
+
+    for (int i = 0; i < 256; i++) {
+        jit->nz[i] = (i & P_N) | (i == 0 ? P_Z : 0);
+    }
+
+#if JIT_X86_64
+    // ask for somewhere near the handlers so blocks can use call rel32, and
+    // keep it executable or writable but never both
+    uintptr_t near = ((uintptr_t)cpu_ops[0].exec + (1u << 30)) & ~(uintptr_t)0xFFFF;
+    void *code = mmap((void *)near, JIT_CODE_SIZE, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code != MAP_FAILED && mprotect(code, JIT_CODE_SIZE, PROT_READ | PROT_EXEC) != 0) {
+        munmap(code, JIT_CODE_SIZE);
+        code = MAP_FAILED;
+    }
+    jit->code = code == MAP_FAILED ? NULL : code;
+#endif
+
+    return jit;
+}
+
+void jit_destroy(struct jit *jit) {
+    if (jit == NULL) {
+        return;
+    }
+
+#if JIT_X86_64
+    if (jit->code != NULL) {
+        munmap(jit->code, JIT_CODE_SIZE);
+    }
+#endif
+
+    free(jit);
+}
+
+uint64_t jit_run(struct jit *jit, struct cpu *cpu, const struct bus *bus, uint64_t cycles) {
+    uint64_t ran = 0;
+
+    while (ran < cycles) {
+        struct block *b = jit->blocks[cpu->pc];
+
+#if JIT_X86_64
+        if (b == NULL && jit->code != NULL && cpu->cycle == 0 && !(cpu->intr && cpu_pending(cpu))
+            && jit->page_writes[cpu->pc >> 8] < JIT_PAGE_WRITES) {
+            if (jit->hits[cpu->pc] < JIT_HOT) {
+                jit->hits[cpu->pc]++;
+            } else {
+                b = emit(jit, bus, cpu->pc);
+            }
+        }
+#endif
+
+        if (b == NULL || cpu->cycle != 0 || (cpu->intr && cpu_pending(cpu))) {
+            ran += cpu_step_fast(cpu, bus);
+            track_writes(jit, cpu);
+            continue;
+        }
+
+        ran += b->code(cpu, bus, jit);
+
+        if (jit->write_hit) {
+            jit->write_hit = 0;
+            code_write(jit, jit->hit_page);
+        }
+    }
+
+    return ran;
+}
+
+void jit_invalidate(struct jit *jit, uint16_t addr) {
+    drop_page(jit, addr >> 8);
+}
+
+void jit_remap(struct jit *jit, uint16_t addr, uint32_t size) {
+    for (uint32_t offset = 0; offset < size; offset += 0x100) {
+        uint8_t page = (addr + offset) >> 8;
+
+        // translations have the old pointers baked in
+        if (jit->data_pages[page]) {
+            flush(jit);
+            return;
+        }
+
+        drop_page(jit, page);
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef __JIT_H__
+#define __JIT_H__
+
+#include <stdint.h>
+
+#include "bus.h"
+#include "cpu.h"
+
+// Translates hot basic blocks into x86-64 host code. Common instructions are
+// emitted inline; the rest call their decoded handlers (cpu_ops) with the
+// operands baked in. Blocks skip fetching their opcodes and operands from the
+// bus, so code must run from memory that reads without side effects. Data
+// accesses to pages the bus maps (bus_map()) reach its host memory directly,
+// and the rest go through the callbacks. Cycle counts are exact at every
+// block exit. Blocks test for interrupts between instructions and leave when
+// one is pending, so they are taken at the same instruction boundary as
+// under cpu_step_fast().
+//
+// Writes made by the CPU to a page holding translated code drop the blocks
+// in that page. Anything else that changes code (DMA, the host) must call
+// jit_invalidate(), and anything that changes the bus's page tables (bank
+// switching, bus_map()) must call jit_remap(), as from a mapper's `remapped`.
+//
+// Host code is never writable and executable at once: the buffer is only
+// made writable while a block is translated. Dropping blocks leaves it be.
+//
+// On other hosts, or if executable memory is unavailable, jit_run() simply
+// interprets.
+
+struct jit;
+
+struct jit *jit_create(void);
+void jit_destroy(struct jit *jit);
+
+// Runs whole blocks until at least `cycles` have elapsed and returns the total.
+// A jit caches code read through `bus`, so use one jit per bus.
+uint64_t jit_run(struct jit *jit, struct cpu *cpu, const struct bus *bus, uint64_t cycles);
+
+// Drops translations covering addr's page.
+void jit_invalidate(struct jit *jit, uint16_t addr);
+
+// Drops translations of code in [addr, addr + size), and every translation if
+// one reaches memory in the range directly, after its pages were remapped.
+void jit_remap(struct jit *jit, uint16_t addr, uint32_t size);
+
+#endif
@@ -0,0 +1,353 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "loader.h"
+
+static int add_segment(struct image *image, uint32_t addr, uint32_t size, const uint8_t *data) {
+    if (size == 0) {
+        return 0;
+    }
+
+    if (addr + size > 0x10000 || image->segments_n == IMAGE_SEGMENTS) {
+        return -1;
+    }
+
+    image->segments[image->segments_n++] = (struct image_segment){ addr, size, data };
+    return 0;
+}
+
+// Looks for addr in the segments, returning -1 if none covers it
+static int image_byte(const struct image *image, uint16_t addr) {
+    for (size_t i = 0; i < image->segments_n; i++) {
+        const struct image_segment *segment = &image->segments[i];
+
+        if (addr >= segment->addr && (uint32_t)(addr - segment->addr) < segment->size) {
+            return segment->data[addr - segment->addr];
+        }
+    }
+
+    return -1;
+}
+
+static int parse_raw(struct image *image, const uint8_t *data, size_t size) {
+    if (size > 0x10000) {
+        return -1;
+    }
+
+    return add_segment(image, 0x10000 - size, size, data);
+}
+
+static int parse_prg(struct image *image, const uint8_t *data, size_t size) {
+    if (size < 2) {
+        return -1;
+    }
+
+    uint16_t load = data[0] | data[1] << 8;
+    image->reset = load;
+
+    return add_segment(image, load, size - 2, data + 2);
+}
+
+#define INES_HEADER  16
+#define INES_TRAINER 512
+
+static int parse_ines(struct image *image, const uint8_t *data, size_t size) {
+    if (size < INES_HEADER || memcmp(data, "NES\x1A", 4) != 0) {
+        return -1;
+    }
+
+    size_t offset = INES_HEADER + (data[6] & 0x04 ? INES_TRAINER : 0);
+
+    image->prg_size = data[4] * 0x4000;
+    image->chr_size = data[5] * 0x2000;
+    image->mapper = data[6] >> 4 | (data[7] & 0xF0);
+
+    if (image->prg_size == 0 || size < offset + image->prg_size + image->chr_size) {
+        return -1;
+    }
+
+    image->prg = data + offset;
+    image->chr = image->chr_size ? data + offset + image->prg_size : NULL;
+
+    // as the NES mappers power up: the first bank at 0x8000, the last at 0xC000
+    const uint8_t *last = image->prg + image->prg_size - 0x4000;
+    if (add_segment(image, 0x8000, 0x4000, image->prg) != 0 || add_segment(image, 0xC000, 0x4000, last) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int hex_byte(const uint8_t *text, size_t size, size_t at) {
+    if (at + 2 > size) {
+        return -1;
+    }
+
+    int value = 0;
+    for (int i = 0; i < 2; i++) {
+        uint8_t c = text[at + i];
+        int digit;
+
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        } else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else {
+            return -1;
+        }
+
+        value = value << 4 | digit;
+    }
+
+    return value;
+}
+
+static int parse_hex(struct image *image, const uint8_t *text, size_t size) {
+    image->decoded = calloc(1, 0x10000);
+    if (image->decoded == NULL) {
+        return -1;
+    }
+
+    int has_start = 0;
+    size_t at = 0;
+
+    while (at < size) {
+        if (text[at] == '\r' || text[at] == '\n' || text[at] == ' ' || text[at] == '\t') {
+            at++;
+            continue;
+        }
+
+        if (text[at] != ':') {
+            return -1;
+        }
+
+        // ":" count, address (2 bytes), type, data, checksum
+        uint8_t record[5 + 255];
+        int count = hex_byte(text, size, at + 1);
+        if (count < 0) {
+            return -1;
+        }
+
+        for (int i = 0; i < count + 5; i++) {
+            int byte = hex_byte(text, size, at + 1 + 2 * i);
+            if (byte < 0) {
+                return -1;
+            }
+            record[i] = byte;
+        }
+
+        uint8_t sum = 0;
+        for (int i = 0; i < count + 5; i++) {
+            sum += record[i];
+        }
+        if (sum != 0) {
+            return -1;
+        }
+
+        at += 1 + 2 * (count + 5);
+
+        uint16_t addr = record[1] << 8 | record[2];
+        const uint8_t *bytes = record + 4;
+
+        switch (record[3]) {
+        case 0x00: {
+            if (addr + count > 0x10000) {
+                return -1;
+            }
+
+            memcpy(image->decoded + addr, bytes, count);
+
+            // runs of records grow one segment
+            struct image_segment *last = image->segments_n ? &image->segments[image->segments_n - 1] : NULL;
+            if (last != NULL && last->addr + last->size == addr) {
+                last->size += count;
+            } else if (add_segment(image, addr, count, image->decoded + addr) != 0) {
+                return -1;
+            }
+            break;
+        }
+        case 0x01:
+            if (!has_start && image->segments_n > 0) {
+                image->reset = image->segments[0].addr;
+            }
+            return 0;
+        case 0x02:
+        case 0x04:
+            // only the first 64K
+            if (count != 2 || bytes[0] != 0 || bytes[1] != 0) {
+                return -1;
+            }
+            break;
+        case 0x03:
+        case 0x05:
+            if (count != 4) {
+                return -1;
+            }
+            image->reset = bytes[2] << 8 | bytes[3];
+            has_start = 1;
+            break;
+        default:
+            return -1;
+        }
+    }
+
+    // no end-of-file record
+    return -1;
+}
+
+int image_parse(struct image *image, const uint8_t *data, size_t size, enum image_format format) {
+    memset(image, 0, sizeof(*image));
+
+    if (format == IMAGE_AUTO) {
+        if (size >= 4 && memcmp(data, "NES\x1A", 4) == 0) {
+            format = IMAGE_INES;
+        } else if (size > 0 && data[0] == ':') {
+            format = IMAGE_HEX;
+        } else {
+            format = IMAGE_RAW;
+        }
+    }
+
+    image->format = format;
+
+    int result;
+    switch (format) {
+    case IMAGE_PRG:
+        result = parse_prg(image, data, size);
+        break;
+    case IMAGE_INES:
+        result = parse_ines(image, data, size);
+        break;
+    case IMAGE_HEX:
+        result = parse_hex(image, data, size);
+        break;
+    default:
+        result = parse_raw(image, data, size);
+        if (result == 0 && image->segments_n > 0) {
+            image->reset = image->segments[0].addr;
+        }
+        break;
+    }
+
+    if (result != 0) {
+        free(image->decoded);
+        image->decoded = NULL;
+        return -1;
+    }
+
+    int lo = image_byte(image, 0xFFFC);
+    int hi = image_byte(image, 0xFFFD);
+    if (lo >= 0 && hi >= 0) {
+        image->reset = hi << 8 | lo;
+        image->has_vector = 1;
+    }
+
+    return 0;
+}
+
+int image_open(struct image *image, const char *path, enum image_format format) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return -1;
+    }
+
+    // the mapping stays valid once the file is closed
+    void *file = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (file == MAP_FAILED) {
+        return -1;
+    }
+
+    if (format == IMAGE_AUTO) {
+        const char *dot = strrchr(path, '.');
+        if (dot != NULL && strcasecmp(dot, ".prg") == 0) {
+            format = IMAGE_PRG;
+        }
+    }
+
+    if (image_parse(image, file, st.st_size, format) != 0) {
+        munmap(file, st.st_size);
+        return -1;
+    }
+
+    image->file = file;
+    image->file_size = st.st_size;
+    return 0;
+}
+
+void image_close(struct image *image) {
+    if (image->file != NULL) {
+        munmap((void *)image->file, image->file_size);
+    }
+
+    free(image->decoded);
+    memset(image, 0, sizeof(*image));
+}
+
+void image_copy(const struct image *image, uint8_t *memory) {
+    for (size_t i = 0; i < image->segments_n; i++) {
+        const struct image_segment *segment = &image->segments[i];
+        memcpy(memory + segment->addr, segment->data, segment->size);
+    }
+
+    if (!image->has_vector) {
+        memory[0xFFFC] = image->reset & 0xFF;
+        memory[0xFFFD] = image->reset >> 8;
+    }
+}
+
+uint32_t image_map(const struct image *image, struct bus *bus) {
+    uint32_t partial = 0;
+
+    for (size_t i = 0; i < image->segments_n; i++) {
+        const struct image_segment *segment = &image->segments[i];
+
+        uint32_t start = (segment->addr + 0xFF) & ~0xFF;
+        uint32_t end = (segment->addr + segment->size) & ~0xFF;
+
+        if (start >= end) {
+            partial += segment->size;
+            continue;
+        }
+
+        bus_map_rom(bus, start, end - start, segment->data + (start - segment->addr));
+        partial += segment->size - (end - start);
+    }
+
+    return partial;
+}
+
+int image_mapper(const struct image *image, struct mapper *mapper,
+    void *inst, uint8_t (*peek)(void *, uint16_t), void (*poke)(void *, uint16_t, uint8_t)) {
+    if (image->format != IMAGE_INES) {
+        return -1;
+    }
+
+    switch (image->mapper) {
+    case 0:
+        mapper_nrom(mapper, image->prg, image->prg_size, inst, peek, poke);
+        return 0;
+    case 1:
+        mapper_mmc1(mapper, image->prg, image->prg_size, NULL, inst, peek, poke);
+        return 0;
+    case 2:
+        mapper_uxrom(mapper, image->prg, image->prg_size, inst, peek, poke);
+        return 0;
+    }
+
+    return -1;
+}
@@ -0,0 +1,79 @@
+#ifndef __LOADER_H__
+#define __LOADER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bus.h"
+#include "mapper.h"
+
+#define IMAGE_SEGMENTS 16
+
+// Loads program images by mapping the file read-only. Raw, PRG and iNES
+// segments point straight into the mapping, so nothing is copied until the
+// image is written to RAM, and every machine built from one image (or one
+// file, through the page cache) shares its ROM. Intel HEX is text, so it is
+// decoded once into a 64K buffer that belongs to the image.
+
+enum image_format {
+    IMAGE_AUTO,                 // iNES or HEX by content, PRG by .prg, else raw
+    IMAGE_RAW,                  // up to 64K, ending at 0xFFFF
+    IMAGE_PRG,                  // C64: a 2-byte load address, then the data
+    IMAGE_INES,                 // NES cartridge
+    IMAGE_HEX,                  // Intel HEX, 16-bit addresses
+};
+
+// `size` bytes that belong at `addr`
+struct image_segment {
+    uint16_t addr;
+    uint32_t size;
+    const uint8_t *data;
+};
+
+struct image {
+    enum image_format format;
+
+    struct image_segment segments[IMAGE_SEGMENTS];
+    size_t segments_n;
+
+    // where to start: the reset vector when the image covers it, else the
+    // HEX start address, the PRG load address or the first segment
+    uint16_t reset;
+    int has_vector;             // nonzero if the image covers 0xFFFC-0xFFFD
+
+    // iNES
+    const uint8_t *prg;
+    uint32_t prg_size;
+    const uint8_t *chr;
+    uint32_t chr_size;
+    unsigned mapper;            // iNES mapper number
+
+    // the mapping, and the decoded HEX
+    const uint8_t *file;
+    size_t file_size;
+    uint8_t *decoded;
+};
+
+// Maps and parses the file at `path`. Returns 0, or -1 if it can't be read
+// or isn't a valid image.
+int image_open(struct image *image, const char *path, enum image_format format);
+
+// Parses an image already in memory, which must outlive it.
+int image_parse(struct image *image, const uint8_t *data, size_t size, enum image_format format);
+
+void image_close(struct image *image);
+
+// Copies the segments into 64K of memory, and the reset vector if the image
+// doesn't cover it.
+void image_copy(const struct image *image, uint8_t *memory);
+
+// Maps each whole page of the segments as ROM straight from the image, and
+// returns the number of bytes in partial pages, which are left as they were.
+uint32_t image_map(const struct image *image, struct bus *bus);
+
+// Sets up `mapper` for an iNES image with its PRG ROM in place. Returns 0,
+// or -1 for mappers mapper.h doesn't have. MMC1 gets no PRG RAM.
+int image_mapper(const struct image *image, struct mapper *mapper,
+    void *inst, uint8_t (*peek)(void *, uint16_t), void (*poke)(void *, uint16_t, uint8_t));
+
+#endif
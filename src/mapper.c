@@ -0,0 +1,322 @@
+#include <string.h>
+
+#include "mapper.h"
+
+static uint8_t mapper_peek(void *inst, uint16_t addr) {
+    struct mapper *mapper = inst;
+
+    return mapper->peek(mapper->inst, addr);
+}
+
+static void mapper_poke(void *inst, uint16_t addr, uint8_t data) {
+    struct mapper *mapper = inst;
+
+    if (mapper->write != NULL && mapper->write(mapper, addr, data)) {
+        return;
+    }
+
+    mapper->poke(mapper->inst, addr, data);
+}
+
+static void remapped(struct mapper *mapper, uint16_t addr, uint32_t size) {
+    if (mapper->remapped != NULL) {
+        mapper->remapped(mapper->remapped_ctx, addr, size);
+    }
+}
+
+void mapper_init(struct mapper *mapper, void *inst,
+    uint8_t (*peek)(void *inst, uint16_t addr),
+    void (*poke)(void *inst, uint16_t addr, uint8_t data)) {
+    memset(mapper, 0, sizeof(*mapper));
+
+    mapper->bus.inst = mapper;
+    mapper->bus.peek = mapper_peek;
+    mapper->bus.poke = mapper_poke;
+
+    mapper->inst = inst;
+    mapper->peek = peek;
+    mapper->poke = poke;
+}
+
+static void show(struct mapper *mapper, const struct mapper_window *window) {
+    uint8_t *bank = window->banks + window->bank * window->size;
+
+    if (window->writable) {
+        bus_map(&mapper->bus, window->addr, window->size, bank);
+    } else {
+        bus_map_rom(&mapper->bus, window->addr, window->size, bank);
+    }
+}
+
+int mapper_window(struct mapper *mapper, uint16_t addr, uint32_t size, uint8_t *banks, uint32_t count, int writable) {
+    if (mapper->windows_n == MAPPER_WINDOWS) {
+        return -1;
+    }
+
+    struct mapper_window *window = &mapper->windows[mapper->windows_n];
+    window->addr = addr;
+    window->size = size;
+    window->banks = banks;
+    window->count = count;
+    window->writable = writable;
+    window->bank = 0;
+
+    show(mapper, window);
+    return mapper->windows_n++;
+}
+
+void mapper_select(struct mapper *mapper, int window, uint32_t bank) {
+    struct mapper_window *w = &mapper->windows[window];
+
+    bank %= w->count;
+    if (bank == w->bank) {
+        return;
+    }
+
+    w->bank = bank;
+    show(mapper, w);
+    remapped(mapper, w->addr, w->size);
+}
+
+void mapper_restore(struct mapper *mapper, const struct mapper *saved) {
+    struct mapper now = *mapper;
+    int moved = memcmp(now.bus.read, saved->bus.read, sizeof(now.bus.read)) != 0
+        || memcmp(now.bus.write, saved->bus.write, sizeof(now.bus.write)) != 0;
+
+    *mapper = *saved;
+    mapper->bus.inst = mapper;
+    mapper->inst = now.inst;
+    mapper->peek = now.peek;
+    mapper->poke = now.poke;
+    mapper->remapped = now.remapped;
+    mapper->remapped_ctx = now.remapped_ctx;
+
+    if (moved) {
+        remapped(mapper, 0x0000, 0x10000);
+    }
+}
+
+//
+// NROM
+//
+
+void mapper_nrom(struct mapper *mapper, const uint8_t *prg, uint32_t prg_size,
+    void *inst, uint8_t (*peek)(void *, uint16_t), void (*poke)(void *, uint16_t, uint8_t)) {
+    mapper_init(mapper, inst, peek, poke);
+
+    // PRG ROM windows are never written through
+    uint8_t *banks = (uint8_t *)prg;
+
+    if (prg_size > 0x4000) {
+        mapper_window(mapper, 0x8000, 0x8000, banks, 1, 0);
+    } else {
+        mapper_window(mapper, 0x8000, 0x4000, banks, 1, 0);
+        mapper_window(mapper, 0xC000, 0x4000, banks, 1, 0);
+    }
+}
+
+//
+// UxROM
+//
+
+static int uxrom_write(struct mapper *mapper, uint16_t addr, uint8_t data) {
+    if (addr < 0x8000) {
+        return 0;
+    }
+
+    mapper_select(mapper, 0, data);
+    return 1;
+}
+
+void mapper_uxrom(struct mapper *mapper, const uint8_t *prg, uint32_t prg_size,
+    void *inst, uint8_t (*peek)(void *, uint16_t), void (*poke)(void *, uint16_t, uint8_t)) {
+    mapper_init(mapper, inst, peek, poke);
+
+    uint8_t *banks = (uint8_t *)prg;
+    uint32_t count = prg_size / 0x4000;
+
+    mapper_window(mapper, 0x8000, 0x4000, banks, count, 0);
+    mapper_window(mapper, 0xC000, 0x4000, banks, count, 0);
+    mapper_select(mapper, 1, count - 1);
+
+    mapper->write = uxrom_write;
+}
+
+//
+// MMC1
+//
+
+#define MMC1_PRG_LO 0           // windows
+#define MMC1_PRG_HI 1
+
+static void mmc1_update(struct mapper *mapper) {
+    uint8_t bank = mapper->mmc1.prg & 0x0F;
+
+    switch (mapper->mmc1.control >> 2 & 3) {
+    case 0:
+    case 1:
+        // 32K at 0x8000
+        mapper_select(mapper, MMC1_PRG_LO, bank & ~1);
+        mapper_select(mapper, MMC1_PRG_HI, bank | 1);
+        break;
+    case 2:
+        // first bank at 0x8000, 16K at 0xC000
+        mapper_select(mapper, MMC1_PRG_LO, 0);
+        mapper_select(mapper, MMC1_PRG_HI, bank);
+        break;
+    case 3:
+        // 16K at 0x8000, last bank at 0xC000
+        mapper_select(mapper, MMC1_PRG_LO, bank);
+        mapper_select(mapper, MMC1_PRG_HI, mapper->windows[MMC1_PRG_HI].count - 1);
+        break;
+    }
+
+    if (mapper->mmc1.ram != NULL) {
+        if (mapper->mmc1.prg & 0x10) {
+            bus_unmap(&mapper->bus, 0x6000, 0x2000);
+        } else {
+            bus_map(&mapper->bus, 0x6000, 0x2000, mapper->mmc1.ram);
+        }
+    }
+}
+
+static int mmc1_write(struct mapper *mapper, uint16_t addr, uint8_t data) {
+    if (addr < 0x8000) {
+        return 0;
+    }
+
+    if (data & 0x80) {
+        mapper->mmc1.shift = 0x10;
+        mapper->mmc1.control |= 0x0C;
+        mmc1_update(mapper);
+        return 1;
+    }
+
+    // the fifth write finds the marker bit in bit 0 and loads a register
+    int full = mapper->mmc1.shift & 1;
+    mapper->mmc1.shift = mapper->mmc1.shift >> 1 | (data & 1) << 4;
+    if (!full) {
+        return 1;
+    }
+
+    uint8_t value = mapper->mmc1.shift;
+    mapper->mmc1.shift = 0x10;
+
+    switch (addr >> 13 & 3) {
+    case 0:
+        mapper->mmc1.control = value;
+        break;
+    case 1:
+        mapper->mmc1.chr[0] = value;
+        break;
+    case 2:
+        mapper->mmc1.chr[1] = value;
+        break;
+    case 3:
+        mapper->mmc1.prg = value;
+        break;
+    }
+
+    mmc1_update(mapper);
+    return 1;
+}
+
+void mapper_mmc1(struct mapper *mapper, const uint8_t *prg, uint32_t prg_size, uint8_t *ram,
+    void *inst, uint8_t (*peek)(void *, uint16_t), void (*poke)(void *, uint16_t, uint8_t)) {
+    mapper_init(mapper, inst, peek, poke);
+
+    uint8_t *banks = (uint8_t *)prg;
+    uint32_t count = prg_size / 0x4000;
+
+    mapper_window(mapper, 0x8000, 0x4000, banks, count, 0);
+    mapper_window(mapper, 0xC000, 0x4000, banks, count, 0);
+
+    // powers up with the last bank fixed at 0xC000
+    mapper->mmc1.shift = 0x10;
+    mapper->mmc1.control = 0x0C;
+    mapper->mmc1.ram = ram;
+    mmc1_update(mapper);
+
+    mapper->write = mmc1_write;
+}
+
+//
+// C64 PLA
+//
+
+#define C64_LORAM  0x01
+#define C64_HIRAM  0x02
+#define C64_CHAREN 0x04
+
+// ROM over RAM: reads from `rom`, writes to the RAM underneath
+static void overlay(struct mapper *mapper, uint16_t addr, uint32_t size, const uint8_t *rom) {
+    uint8_t *ram = mapper->c64.ram + addr;
+
+    bus_map(&mapper->bus, addr, size, ram);
+
+    if (rom != NULL) {
+        bus_map_rom(&mapper->bus, addr, size, rom);
+        for (uint32_t offset = 0; offset < size; offset += 0x100) {
+            mapper->bus.write[(addr + offset) >> 8] = ram + offset;
+        }
+    }
+}
+
+static void c64_update(struct mapper *mapper) {
+    // undriven port lines are pulled high
+    const uint8_t *ram = mapper->c64.ram;
+    uint8_t config = (ram[1] | ~ram[0]) & (C64_LORAM | C64_HIRAM | C64_CHAREN);
+
+    if (config == mapper->c64.config) {
+        return;
+    }
+
+    mapper->c64.config = config;
+
+    int loram = config & C64_LORAM;
+    int hiram = config & C64_HIRAM;
+
+    overlay(mapper, 0xA000, 0x2000, loram && hiram ? mapper->c64.basic : NULL);
+    overlay(mapper, 0xE000, 0x2000, hiram ? mapper->c64.kernal : NULL);
+
+    if (!loram && !hiram) {
+        overlay(mapper, 0xD000, 0x1000, NULL);
+    } else if (config & C64_CHAREN) {
+        bus_unmap(&mapper->bus, 0xD000, 0x1000);
+    } else {
+        overlay(mapper, 0xD000, 0x1000, mapper->c64.chargen);
+    }
+
+    remapped(mapper, 0xA000, 0x6000);
+}
+
+static int c64_write(struct mapper *mapper, uint16_t addr, uint8_t data) {
+    if (addr >= 0x100) {
+        return 0;
+    }
+
+    mapper->c64.ram[addr] = data;
+    if (addr < 2) {
+        c64_update(mapper);
+    }
+
+    return 1;
+}
+
+void mapper_c64(struct mapper *mapper, uint8_t *ram, const uint8_t *basic, const uint8_t *kernal, const uint8_t *chargen,
+    void *inst, uint8_t (*peek)(void *, uint16_t), void (*poke)(void *, uint16_t, uint8_t)) {
+    mapper_init(mapper, inst, peek, poke);
+
+    mapper->c64.ram = ram;
+    mapper->c64.basic = basic;
+    mapper->c64.kernal = kernal;
+    mapper->c64.chargen = chargen;
+    mapper->c64.config = 0xFF;
+
+    // zero page writes come through c64_write to catch the port
+    bus_map(&mapper->bus, 0x0000, 0x10000, ram);
+    bus_map_watched(&mapper->bus, 0x0000, 0x100, ram);
+
+    mapper->write = c64_write;
+    c64_update(mapper);
+}
@@ -0,0 +1,121 @@
+#ifndef __MAPPER_H__
+#define __MAPPER_H__
+
+#include <stdint.h>
+
+#include "bus.h"
+
+#define MAPPER_WINDOWS 8
+
+// Bank switching on top of the bus page tables. A window is a range of the
+// address space that shows one of several equal-sized banks laid end to end
+// in host memory. Selecting a bank repoints the window's pages, so accesses
+// never check which bank is in; a swap costs one pointer per 256-byte page
+// of the window (64 for a 16K bank) however often it happens.
+//
+// The mapper owns a struct bus: give the CPU &mapper->bus. Pages no window
+// covers go to the device callbacks passed to mapper_init(), and may still
+// be mapped with bus_map() for RAM. Writes to ROM windows reach the mapper's
+// registers first and the device poke if no register claims them.
+//
+// Swapping changes code under the CPU without it writing, so a dcache or
+// jit running on the bus must be told through `remapped`.
+
+struct mapper;
+
+struct mapper_window {
+    uint16_t addr;              // multiple of 256
+    uint32_t size;              // bank size, multiple of 256
+    uint8_t *banks;             // `count` banks of `size` bytes
+    uint32_t count;
+    int writable;               // nonzero for RAM banks
+    uint32_t bank;              // selected
+};
+
+struct mapper {
+    struct bus bus;
+
+    // devices behind the pages no window covers
+    void *inst;
+    uint8_t (*peek)(void *inst, uint16_t addr);
+    void (*poke)(void *inst, uint16_t addr, uint8_t data);
+
+    // called with the range after each swap, or NULL
+    void (*remapped)(void *ctx, uint16_t addr, uint32_t size);
+    void *remapped_ctx;
+
+    // register writes, returning nonzero when the write is taken
+    int (*write)(struct mapper *mapper, uint16_t addr, uint8_t data);
+
+    struct mapper_window windows[MAPPER_WINDOWS];
+    unsigned windows_n;
+
+    union {
+        struct {
+            uint8_t shift;      // serial port, 0x10 when empty
+            uint8_t control;    // mirroring (bits 0-1), PRG mode, CHR mode
+            uint8_t chr[2];     // CHR banks, for the PPU
+            uint8_t prg;        // PRG bank, bit 4 disables PRG RAM
+            uint8_t *ram;       // 8K at 0x6000, or NULL
+        } mmc1;
+
+        struct {
+            uint8_t *ram;       // 64K
+            const uint8_t *basic;
+            const uint8_t *kernal;
+            const uint8_t *chargen;
+            uint8_t config;     // LORAM, HIRAM and CHAREN as last mapped
+        } c64;
+    };
+};
+
+// Sends every page to the device callbacks, with no windows or registers.
+void mapper_init(struct mapper *mapper, void *inst,
+    uint8_t (*peek)(void *inst, uint16_t addr),
+    void (*poke)(void *inst, uint16_t addr, uint8_t data));
+
+// Adds a window showing bank 0 and returns its index, or -1 if there are
+// already MAPPER_WINDOWS. ROM windows are never written through `banks`.
+int mapper_window(struct mapper *mapper, uint16_t addr, uint32_t size, uint8_t *banks, uint32_t count, int writable);
+
+// Shows `bank` (modulo the bank count) in a window. Reselecting the bank
+// that is in does nothing.
+void mapper_select(struct mapper *mapper, int window, uint32_t bank);
+
+// A copy of the struct saves a mapper's banks and registers; this puts them
+// back, along with the pages they mapped, and reports the whole address
+// space through `remapped` if any page moved. The devices and `remapped`
+// stay as they are. Restore the mapper before a snapshot of its bus, so the
+// snapshot's pages go back into the banks they were saved from.
+void mapper_restore(struct mapper *mapper, const struct mapper *saved);
+
+//
+// Reference mappers. Each calls mapper_init() first, so set `remapped`
+// afterwards. The NES mappers cover the CPU side only: CHR banking and
+// mirroring are left in the registers for a PPU to read.
+//
+
+// iNES mapper 0: 16K of PRG mirrored at 0x8000 and 0xC000, or 32K.
+void mapper_nrom(struct mapper *mapper, const uint8_t *prg, uint32_t prg_size,
+    void *inst, uint8_t (*peek)(void *, uint16_t), void (*poke)(void *, uint16_t, uint8_t));
+
+// iNES mapper 2: a 16K bank chosen by writes to 0x8000-0xFFFF at 0x8000,
+// and the last bank at 0xC000.
+void mapper_uxrom(struct mapper *mapper, const uint8_t *prg, uint32_t prg_size,
+    void *inst, uint8_t (*peek)(void *, uint16_t), void (*poke)(void *, uint16_t, uint8_t));
+
+// iNES mapper 1: registers loaded a bit at a time through 0x8000-0xFFFF,
+// 16K or 32K PRG banking, and 8K of PRG RAM at 0x6000 if `ram` isn't NULL.
+// The MMC1 ignores the second of two writes on consecutive cycles, which
+// this doesn't model.
+void mapper_mmc1(struct mapper *mapper, const uint8_t *prg, uint32_t prg_size, uint8_t *ram,
+    void *inst, uint8_t (*peek)(void *, uint16_t), void (*poke)(void *, uint16_t, uint8_t));
+
+// The C64 PLA without a cartridge: the processor port at 0x0000 and 0x0001
+// lays BASIC (8K), the KERNAL (8K), the character ROM (4K) or I/O over the
+// 64K of RAM, and writes under the ROMs land in RAM. I/O goes to the device
+// callbacks. The port reads back as written.
+void mapper_c64(struct mapper *mapper, uint8_t *ram, const uint8_t *basic, const uint8_t *kernal, const uint8_t *chargen,
+    void *inst, uint8_t (*peek)(void *, uint16_t), void (*poke)(void *, uint16_t, uint8_t));
+
+#endif
@@ -0,0 +1,229 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "snapshot.h"
+
+// Copies the machine's state into `cpu`, leaving the host's settings
+static void put_cpu(struct cpu *cpu, const struct cpu *saved) {
+    struct cpu_idle *idle = cpu->idle;
+    struct cpu_watch *watch = cpu->watch;
+    uint8_t halt = cpu->halt;
+
+    memcpy(cpu, saved, sizeof(*cpu));
+    cpu->idle = idle;
+    cpu->watch = watch;
+    cpu->halt = halt;
+}
+
+// Puts a saved page back. A page mapped only for reading is written only
+// if it is the memory it was saved from and has changed, so ROM never is.
+static void put_page(const struct bus *bus, int page, const uint8_t *from, const uint8_t *saved) {
+    if (bus->write[page] != NULL) {
+        memcpy(bus->write[page], saved, 256);
+    } else if (bus->read[page] != NULL && bus->read[page] == from && memcmp(from, saved, 256) != 0) {
+        memcpy((uint8_t *)bus->read[page], saved, 256);
+    }
+}
+
+void snapshot_save(struct snapshot *snapshot, const struct cpu *cpu, const struct bus *bus) {
+    memcpy(&snapshot->cpu, cpu, sizeof(*cpu));
+
+    for (int page = 0; page < BUS_PAGES; page++) {
+        snapshot->from[page] = bus_memory(bus, page);
+        snapshot->saved[page] = snapshot->from[page] != NULL;
+        if (snapshot->saved[page]) {
+            memcpy(snapshot->pages[page], snapshot->from[page], 256);
+        }
+    }
+}
+
+void snapshot_restore(const struct snapshot *snapshot, struct cpu *cpu, const struct bus *bus) {
+    for (int page = 0; page < BUS_PAGES; page++) {
+        if (snapshot->saved[page]) {
+            put_page(bus, page, snapshot->from[page], snapshot->pages[page]);
+        }
+    }
+
+    put_cpu(cpu, &snapshot->cpu);
+}
+
+//
+// Rewind ring
+//
+
+struct entry {
+    struct cpu cpu;
+    uint64_t stamp;
+    uint64_t first;             // slot of its first changed page
+    uint32_t n;                 // changed pages, 0 for the latest
+};
+
+// Changed pages go into slots in the order they are pushed, so the oldest
+// snapshot's pages are always the next to be reused.
+struct snapshot_ring {
+    struct entry *entries;
+    unsigned capacity;
+    unsigned oldest;
+    unsigned count;
+
+    uint8_t (*slots)[256];
+    uint8_t *slot_pages;        // the page in each slot
+    const uint8_t **slot_from;  // and the memory it came from
+    size_t slots_n;
+    uint64_t head;              // slots used, ever
+    uint64_t tail;              // slots freed, ever
+
+    // the pages as of the latest snapshot, and the memory they came from
+    uint8_t mapped[BUS_PAGES];
+    const uint8_t *from[BUS_PAGES];
+    uint8_t image[BUS_PAGES][256];
+};
+
+struct snapshot_ring *snapshot_ring_new(size_t budget, unsigned capacity) {
+    if (budget < BUS_PAGES * 256 || capacity == 0) {
+        return NULL;
+    }
+
+    struct snapshot_ring *ring = calloc(1, sizeof(*ring));
+    if (ring == NULL) {
+        return NULL;
+    }
+
+    ring->capacity = capacity;
+    ring->slots_n = budget / 256;
+    ring->entries = calloc(capacity, sizeof(*ring->entries));
+    ring->slots = malloc(ring->slots_n * 256);
+    ring->slot_pages = malloc(ring->slots_n);
+    ring->slot_from = malloc(ring->slots_n * sizeof(*ring->slot_from));
+
+    if (ring->entries == NULL || ring->slots == NULL || ring->slot_pages == NULL || ring->slot_from == NULL) {
+        snapshot_ring_free(ring);
+        return NULL;
+    }
+
+    return ring;
+}
+
+void snapshot_ring_free(struct snapshot_ring *ring) {
+    free(ring->slot_from);
+    free(ring->slot_pages);
+    free(ring->slots);
+    free(ring->entries);
+    free(ring);
+}
+
+static struct entry *entry(const struct snapshot_ring *ring, unsigned back) {
+    return &ring->entries[(ring->oldest + ring->count - 1 - back) % ring->capacity];
+}
+
+static void drop_oldest(struct snapshot_ring *ring) {
+    ring->tail += ring->entries[ring->oldest].n;
+    ring->oldest = (ring->oldest + 1) % ring->capacity;
+    ring->count--;
+}
+
+void snapshot_ring_push(struct snapshot_ring *ring, const struct cpu *cpu, const struct bus *bus, uint64_t stamp) {
+    // the latest keeps the pages that changed since it, as they were
+    if (ring->count > 0) {
+        struct entry *latest = entry(ring, 0);
+
+        for (int page = 0; page < BUS_PAGES; page++) {
+            const uint8_t *now = bus_memory(bus, page);
+            if (now == NULL) {
+                continue;
+            }
+
+            if (ring->mapped[page]) {
+                if (now == ring->from[page] && memcmp(now, ring->image[page], 256) == 0) {
+                    continue;
+                }
+
+                // the budget holds every page, so the latest never has to go
+                if (ring->head - ring->tail == ring->slots_n) {
+                    drop_oldest(ring);
+                }
+
+                size_t slot = ring->head++ % ring->slots_n;
+                memcpy(ring->slots[slot], ring->image[page], 256);
+                ring->slot_pages[slot] = page;
+                ring->slot_from[slot] = ring->from[page];
+                latest->n++;
+            }
+
+            memcpy(ring->image[page], now, 256);
+            ring->mapped[page] = 1;
+            ring->from[page] = now;
+        }
+    } else {
+        for (int page = 0; page < BUS_PAGES; page++) {
+            ring->from[page] = bus_memory(bus, page);
+            ring->mapped[page] = ring->from[page] != NULL;
+            if (ring->mapped[page]) {
+                memcpy(ring->image[page], ring->from[page], 256);
+            }
+        }
+    }
+
+    if (ring->count == ring->capacity) {
+        drop_oldest(ring);
+    }
+
+    ring->count++;
+    struct entry *pushed = entry(ring, 0);
+    memcpy(&pushed->cpu, cpu, sizeof(*cpu));
+    pushed->stamp = stamp;
+    pushed->first = ring->head;
+    pushed->n = 0;
+}
+
+unsigned snapshot_ring_count(const struct snapshot_ring *ring) {
+    return ring->count;
+}
+
+uint64_t snapshot_ring_stamp(const struct snapshot_ring *ring, unsigned back) {
+    return back < ring->count ? entry(ring, back)->stamp : 0;
+}
+
+int snapshot_ring_find(const struct snapshot_ring *ring, uint64_t stamp) {
+    for (unsigned back = 0; back < ring->count; back++) {
+        if (entry(ring, back)->stamp <= stamp) {
+            return back;
+        }
+    }
+
+    return -1;
+}
+
+int snapshot_ring_rewind(struct snapshot_ring *ring, unsigned back, struct cpu *cpu, const struct bus *bus) {
+    if (back >= ring->count) {
+        return -1;
+    }
+
+    // A page's value at the target is in the first slot holding it from the
+    // target on, or in the image if it hasn't changed since
+    struct entry *target = entry(ring, back);
+    uint8_t done[BUS_PAGES] = { 0 };
+
+    for (uint64_t at = target->first; at < ring->head; at++) {
+        size_t slot = at % ring->slots_n;
+        uint8_t page = ring->slot_pages[slot];
+
+        if (!done[page]) {
+            memcpy(ring->image[page], ring->slots[slot], 256);
+            ring->from[page] = ring->slot_from[slot];
+            done[page] = 1;
+        }
+    }
+
+    for (int page = 0; page < BUS_PAGES; page++) {
+        if (ring->mapped[page]) {
+            put_page(bus, page, ring->from[page], ring->image[page]);
+        }
+    }
+
+    ring->head = target->first;
+    ring->count -= back;
+    target->n = 0;
+    put_cpu(cpu, &target->cpu);
+    return 0;
+}
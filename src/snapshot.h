@@ -0,0 +1,63 @@
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bus.h"
+#include "cpu.h"
+
+// Snapshots hold the CPU and every page the bus maps, as the bus maps it
+// when saved and restored. Pages mapped for writing go back through
+// write[]. A page mapped only for reading goes back only if it still reads
+// the memory it was saved from and that memory changed, which ROM never
+// does: that is RAM whose writes a mapper watches, like the C64's zero
+// page. Pages served by the callbacks aren't saved, so devices save their
+// own state, and a mapper is saved by copying it and put back with
+// mapper_restore() before the snapshot. Restoring keeps the CPU's idle,
+// watch and halt, which belong to the host rather than to the machine.
+
+struct snapshot {
+    struct cpu cpu;
+    uint8_t saved[BUS_PAGES];   // the page was mapped
+    const uint8_t *from[BUS_PAGES]; // the memory it was saved from
+    uint8_t pages[BUS_PAGES][256];
+};
+
+void snapshot_save(struct snapshot *snapshot, const struct cpu *cpu, const struct bus *bus);
+
+void snapshot_restore(const struct snapshot *snapshot, struct cpu *cpu, const struct bus *bus);
+
+// A ring of snapshots for rewinding. Push one every K frames or cycles and
+// the ring keeps the latest in full and, for each one before it, only the
+// pages that changed after it, found by comparing with the latest. When
+// those pages would go over the budget, or the snapshots over their count,
+// the oldest snapshots are dropped. Going back to any snapshot copies each
+// page at most twice, however far back it is.
+
+struct snapshot_ring;
+
+// `budget` is the bytes kept for changed pages, at least 64K, and
+// `capacity` the most snapshots kept. Returns NULL on failure.
+struct snapshot_ring *snapshot_ring_new(size_t budget, unsigned capacity);
+
+void snapshot_ring_free(struct snapshot_ring *ring);
+
+// Takes a snapshot stamped with the caller's frame or cycle count, which
+// should only grow.
+void snapshot_ring_push(struct snapshot_ring *ring, const struct cpu *cpu, const struct bus *bus, uint64_t stamp);
+
+// The number of snapshots held, and the stamp of the one `back` from the
+// latest, which is 0
+unsigned snapshot_ring_count(const struct snapshot_ring *ring);
+uint64_t snapshot_ring_stamp(const struct snapshot_ring *ring, unsigned back);
+
+// How far back the latest snapshot stamped at or before `stamp` is, or -1
+// if they are all later
+int snapshot_ring_find(const struct snapshot_ring *ring, uint64_t stamp);
+
+// Restores the snapshot `back` from the latest and drops the ones after it,
+// so that it becomes the latest. Returns 0, or -1 if there isn't one.
+int snapshot_ring_rewind(struct snapshot_ring *ring, unsigned back, struct cpu *cpu, const struct bus *bus);
+
+#endif
@@ -0,0 +1,702 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+#define TRACE_CHUNK      (64 * 1024)    // bytes in a chunk of the ring
+#define TRACE_CHUNKS     64             // chunks in the ring
+#define TRACE_RECORD_MAX 128            // room for a keyframe and a record
+#define TRACE_LINE       64             // bytes in a cache line
+
+// bus accesses a record can take: the opcode, operands and the rest
+#define TRACE_RAW (3 + TRACE_ACCESSES)
+
+// An access as it is made, packed so that saving it can't alias the CPU
+#define RAW(addr, data, write) ((addr) | (uint32_t)(data) << 16 | (uint32_t)(write) << 24)
+#define RAW_ADDR(raw)  ((uint16_t)(raw))
+#define RAW_DATA(raw)  ((uint8_t)((raw) >> 16))
+#define RAW_WRITE(raw) ((raw) >> 24)
+
+// The file is a header, then chunks, each a 4-byte length and its records
+#define TRACE_MAGIC   "TR65"
+#define TRACE_VERSION 1
+
+#if defined(CPU_2A03)
+#define TRACE_VARIANT 1
+#elif defined(CPU_65C02)
+#define TRACE_VARIANT 2
+#else
+#define TRACE_VARIANT 0
+#endif
+
+// A record is a tag, then the fields it flags, in this order: the ext byte,
+// the PC, the opcode and operands (not for entries or keyframes), A, X, Y,
+// P, SP, the cycles and the accesses. A keyframe holds the full state
+// instead: PC, A, X, Y, SP, P and an 8-byte cycle stamp.
+#define TAG_PC     (1 << 0)     // the PC isn't the last one plus its length
+#define TAG_A      (1 << 1)
+#define TAG_X      (1 << 2)
+#define TAG_Y      (1 << 3)
+#define TAG_P      (1 << 4)
+#define TAG_CYCLES (1 << 5)     // not the opcode's base count, as a varint
+#define TAG_ACCESS (1 << 6)     // a count byte, then each access
+#define TAG_EXT    (1 << 7)
+
+#define EXT_SP    (1 << 0)
+#define EXT_ENTRY (1 << 1)
+#define EXT_KEY   (1 << 2)
+
+// An access is a varint of its address's zigzagged distance from the last
+// one, shifted left with the write flag in bit 0, then its data.
+
+#define OPC_JSR 0x20
+
+// What the encoder and decoder both keep between records
+struct state {
+    uint16_t pc;                // where the next record is expected
+    uint8_t a;
+    uint8_t x;
+    uint8_t y;
+    uint8_t sp;
+    uint8_t p;
+    uint64_t cycle;
+    uint16_t addr;              // of the last access
+};
+
+struct trace {
+    uint32_t raw[TRACE_RAW];    // RAW() of each access by the current record
+
+    struct state state;
+    uint8_t *chunk;
+    size_t used;
+    int fresh;                  // the next record needs a keyframe first
+
+    uint8_t (*ring)[TRACE_CHUNK];
+    uint32_t sizes[TRACE_CHUNKS];
+    _Alignas(TRACE_LINE) _Atomic uint64_t head;     // chunks filled
+    _Alignas(TRACE_LINE) _Atomic uint64_t tail;     // chunks written
+    _Atomic int closing;
+
+    int fd;
+    int failed;
+    pthread_t thread;
+};
+
+//
+// Writing
+//
+
+// The engine from cpu_exec.h, built over a tracer the way cpu.hpp builds it
+// over a bus class: each access goes to the caller's bus and is saved in
+// `raw` on the way. The tracer lives on trace_run()'s stack so that the
+// compiler can keep it in registers.
+struct tracer {
+    const struct bus *under;
+    uint32_t *raw;
+    unsigned n;
+};
+
+static inline __attribute__((always_inline)) uint8_t traced_peek(struct tracer *tracer, uint16_t addr) {
+    uint8_t data = bus_peek(tracer->under, addr);
+
+    if (tracer->n < TRACE_RAW) {
+        tracer->raw[tracer->n++] = RAW(addr, data, 0);
+    }
+
+    return data;
+}
+
+static inline __attribute__((always_inline)) void traced_poke(struct tracer *tracer, uint16_t addr, uint8_t data) {
+    bus_poke(tracer->under, addr, data);
+
+    if (tracer->n < TRACE_RAW) {
+        tracer->raw[tracer->n++] = RAW(addr, data, 1);
+    }
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#define CPU_TEMPLATE
+#define CPU_BUS struct tracer *
+#define bus_peek traced_peek
+#define bus_poke traced_poke
+#include "cpu_exec.h"
+#undef bus_peek
+#undef bus_poke
+#pragma GCC diagnostic pop
+
+static int write_all(int fd, const void *data, size_t size) {
+    const uint8_t *at = data;
+
+    while (size > 0) {
+        ssize_t n = write(fd, at, size);
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (n <= 0) {
+            return -1;
+        }
+
+        at += n;
+        size -= n;
+    }
+
+    return 0;
+}
+
+// Writes chunks as they fill, until the trace is closed and all are written
+static void *writer(void *arg) {
+    struct trace *trace = arg;
+    uint64_t tail = 0;
+
+    for (;;) {
+        uint64_t head = atomic_load_explicit(&trace->head, memory_order_acquire);
+
+        if (tail == head) {
+            if (atomic_load(&trace->closing) && atomic_load(&trace->head) == tail) {
+                break;
+            }
+
+            struct timespec ts = { 0, 100000 };
+            nanosleep(&ts, NULL);
+            continue;
+        }
+
+        uint32_t size = trace->sizes[tail % TRACE_CHUNKS];
+        uint8_t length[4] = { size, size >> 8, size >> 16, size >> 24 };
+
+        // after a failure, keep emptying the ring so the CPU never waits on it
+        if (!trace->failed &&
+            (write_all(trace->fd, length, 4) != 0 || write_all(trace->fd, trace->ring[tail % TRACE_CHUNKS], size) != 0)) {
+            trace->failed = 1;
+        }
+
+        atomic_store_explicit(&trace->tail, ++tail, memory_order_release);
+    }
+
+    return NULL;
+}
+
+// Hands the current chunk to the writer
+static void publish(struct trace *trace) {
+    uint64_t head = atomic_load_explicit(&trace->head, memory_order_relaxed);
+
+    trace->sizes[head % TRACE_CHUNKS] = trace->used;
+    atomic_store_explicit(&trace->head, head + 1, memory_order_release);
+}
+
+// Starts the next chunk once the writer has freed it
+static void next_chunk(struct trace *trace) {
+    publish(trace);
+
+    uint64_t head = atomic_load_explicit(&trace->head, memory_order_relaxed);
+    while (head - atomic_load_explicit(&trace->tail, memory_order_acquire) >= TRACE_CHUNKS) {
+        sched_yield();
+    }
+
+    trace->chunk = trace->ring[head % TRACE_CHUNKS];
+    trace->used = 0;
+    trace->fresh = 1;
+}
+
+struct trace *trace_open(const char *path) {
+    struct trace *trace = calloc(1, sizeof(*trace));
+    if (trace == NULL) {
+        return NULL;
+    }
+
+    trace->ring = malloc(TRACE_CHUNKS * sizeof(*trace->ring));
+    trace->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    uint8_t header[8] = { 'T', 'R', '6', '5', TRACE_VERSION, TRACE_VARIANT, 0, 0 };
+
+    if (trace->ring == NULL || trace->fd < 0 || write_all(trace->fd, header, sizeof(header)) != 0) {
+        goto fail;
+    }
+
+    trace->chunk = trace->ring[0];
+    trace->fresh = 1;
+    atomic_init(&trace->head, 0);
+    atomic_init(&trace->tail, 0);
+    atomic_init(&trace->closing, 0);
+
+    if (pthread_create(&trace->thread, NULL, writer, trace) != 0) {
+        goto fail;
+    }
+
+    return trace;
+
+fail:
+    if (trace->fd >= 0) {
+        close(trace->fd);
+    }
+    free(trace->ring);
+    free(trace);
+    return NULL;
+}
+
+int trace_close(struct trace *trace) {
+    if (trace->used > 0) {
+        publish(trace);
+    }
+
+    atomic_store(&trace->closing, 1);
+    pthread_join(trace->thread, NULL);
+
+    int result = trace->failed ? -1 : 0;
+    if (close(trace->fd) != 0) {
+        result = -1;
+    }
+
+    free(trace->ring);
+    free(trace);
+    return result;
+}
+
+static inline uint8_t *put_varint(uint8_t *at, uint64_t value) {
+    while (value >= 0x80) {
+        *at++ = value | 0x80;
+        value >>= 7;
+    }
+
+    *at++ = value;
+    return at;
+}
+
+static void keyframe(struct trace *trace, uint16_t pc) {
+    struct state *s = &trace->state;
+    uint8_t *at = trace->chunk + trace->used;
+
+    s->pc = pc;
+    s->addr = 0;
+
+    *at++ = TAG_EXT;
+    *at++ = EXT_KEY;
+    *at++ = pc;
+    *at++ = pc >> 8;
+    *at++ = s->a;
+    *at++ = s->x;
+    *at++ = s->y;
+    *at++ = s->sp;
+    *at++ = s->p;
+    for (int i = 0; i < 8; i++) {
+        *at++ = s->cycle >> (8 * i);
+    }
+
+    trace->used = at - trace->chunk;
+    trace->fresh = 0;
+}
+
+// Encodes what the instruction (or entry) at pc just did from the accesses
+// it made
+static void record(struct trace *trace, const struct cpu *cpu, uint16_t pc, int entry, int cycles, unsigned raw_n) {
+    if (trace->used > TRACE_CHUNK - TRACE_RECORD_MAX) {
+        next_chunk(trace);
+    }
+
+    if (trace->fresh) {
+        keyframe(trace, pc);
+    }
+
+    struct state *s = &trace->state;
+    uint32_t *raw = trace->raw;
+
+    uint8_t opc = cpu->opc;
+    int length = entry ? 0 : cpu_ops[opc].length;
+
+    // the operands are fetched right after the opcode, except by JSR, which
+    // pushes the return address before fetching the high byte
+    if (opc == OPC_JSR && !entry) {
+        uint32_t high = raw[5];
+        raw[5] = raw[4];
+        raw[4] = raw[3];
+        raw[3] = raw[2];
+        raw[2] = high;
+    }
+
+    const uint32_t *accesses = raw + length;
+    unsigned n = raw_n - length;
+    if (n > TRACE_ACCESSES) {
+        n = TRACE_ACCESSES;
+    }
+
+    uint8_t p = cpu_get_p(cpu);
+    uint8_t tag = 0;
+    uint8_t ext = 0;
+
+    tag |= pc != s->pc ? TAG_PC : 0;
+    tag |= cpu->a != s->a ? TAG_A : 0;
+    tag |= cpu->x != s->x ? TAG_X : 0;
+    tag |= cpu->y != s->y ? TAG_Y : 0;
+    tag |= p != s->p ? TAG_P : 0;
+    tag |= entry || cycles != cpu_ops[opc].cycles ? TAG_CYCLES : 0;
+    tag |= n != 0 ? TAG_ACCESS : 0;
+    ext |= cpu->sp != s->sp ? EXT_SP : 0;
+    ext |= entry ? EXT_ENTRY : 0;
+    tag |= ext ? TAG_EXT : 0;
+
+    // every field is stored and only kept if flagged, which is cheaper than
+    // branching on registers that change at random
+    uint8_t *at = trace->chunk + trace->used;
+    *at++ = tag;
+    *at = ext;
+    at += ext != 0;
+    at[0] = pc;
+    at[1] = pc >> 8;
+    at += tag & TAG_PC ? 2 : 0;
+    at[0] = opc;
+    at[1] = RAW_DATA(raw[1]);
+    at[2] = RAW_DATA(raw[2]);
+    at += length;
+    *at = cpu->a;
+    at += (tag & TAG_A) != 0;
+    *at = cpu->x;
+    at += (tag & TAG_X) != 0;
+    *at = cpu->y;
+    at += (tag & TAG_Y) != 0;
+    *at = p;
+    at += (tag & TAG_P) != 0;
+    *at = cpu->sp;
+    at += (ext & EXT_SP) != 0;
+
+    s->a = cpu->a;
+    s->x = cpu->x;
+    s->y = cpu->y;
+    s->p = p;
+    s->sp = cpu->sp;
+
+    if (tag & TAG_CYCLES) {
+        at = put_varint(at, cycles);
+    }
+
+    if (n != 0) {
+        uint16_t last = s->addr;
+        *at++ = n;
+
+        for (unsigned i = 0; i < n; i++) {
+            int16_t delta = RAW_ADDR(accesses[i]) - last;
+            uint32_t zigzag = (uint32_t)(delta * 2) ^ (uint32_t)(delta >> 15);
+
+            at = put_varint(at, zigzag << 1 | RAW_WRITE(accesses[i]));
+            *at++ = RAW_DATA(accesses[i]);
+            last = RAW_ADDR(accesses[i]);
+        }
+
+        s->addr = last;
+    }
+
+    trace->used = at - trace->chunk;
+    s->pc = pc + length;
+    s->cycle += cycles;
+}
+
+uint64_t trace_run(struct trace *trace, struct cpu *cpu, const struct bus *bus, uint64_t cycles) {
+    uint64_t ran = 0;
+
+    struct state *s = &trace->state;
+    struct tracer tracer = { bus, trace->raw, 0 };
+
+    // a partly ticked instruction finishes without being recorded
+    if (cpu->cycle != 0) {
+        ran += cpu_step_fast(cpu, bus);
+        s->cycle += ran;
+        trace->fresh = 1;
+    }
+
+    // the host may have changed the registers since the last run
+    uint8_t p = cpu_get_p(cpu);
+    if (cpu->a != s->a || cpu->x != s->x || cpu->y != s->y || cpu->sp != s->sp || p != s->p) {
+        s->a = cpu->a;
+        s->x = cpu->x;
+        s->y = cpu->y;
+        s->sp = cpu->sp;
+        s->p = p;
+        trace->fresh = 1;
+    }
+
+    while (ran < cycles) {
+        uint16_t pc = cpu->pc;
+        int reset = cpu->intr & INTR_RESET;
+
+        tracer.n = 0;
+        int ran_now = step(cpu, &tracer);
+
+        // an NMI or IRQ entry runs as a BRK that reads its opcode twice
+        int entry = reset || (cpu->opc == OPC_BRK && tracer.n >= 2 && RAW_ADDR(trace->raw[1]) == pc);
+
+        record(trace, cpu, pc, entry, ran_now, tracer.n);
+        ran += ran_now;
+    }
+
+    return ran;
+}
+
+//
+// Reading
+//
+
+struct trace_reader {
+    FILE *file;
+    struct state state;
+    struct trace_mark mark;     // of the current chunk
+    uint64_t offset;            // of the next chunk
+    int marking;                // the next keyframe starts the chunk
+    uint8_t chunk[TRACE_CHUNK];
+    size_t size;
+    size_t at;
+};
+
+struct trace_reader *trace_reader_open(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    uint8_t header[8];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, TRACE_MAGIC, 4) != 0 ||
+        header[4] != TRACE_VERSION || header[5] != TRACE_VARIANT) {
+        fclose(file);
+        return NULL;
+    }
+
+    struct trace_reader *reader = calloc(1, sizeof(*reader));
+    if (reader == NULL) {
+        fclose(file);
+        return NULL;
+    }
+
+    reader->file = file;
+    reader->offset = sizeof(header);
+    return reader;
+}
+
+void trace_reader_close(struct trace_reader *reader) {
+    fclose(reader->file);
+    free(reader);
+}
+
+// Loads the next chunk. Returns 1, 0 at the end of the file, or -1.
+static int load_chunk(struct trace_reader *reader) {
+    uint8_t length[4];
+    size_t got = fread(length, 1, 4, reader->file);
+
+    if (got == 0 && feof(reader->file)) {
+        return 0;
+    }
+
+    uint32_t size = length[0] | length[1] << 8 | length[2] << 16 | (uint32_t)length[3] << 24;
+    if (got != 4 || size == 0 || size > TRACE_CHUNK || fread(reader->chunk, 1, size, reader->file) != size) {
+        return -1;
+    }
+
+    reader->mark.offset = reader->offset;
+    reader->offset += 4 + size;
+    reader->marking = 1;
+    reader->size = size;
+    reader->at = 0;
+    return 1;
+}
+
+// The next n bytes of the chunk, or NULL if it ends first
+static const uint8_t *take(struct trace_reader *reader, size_t n) {
+    if (reader->size - reader->at < n) {
+        return NULL;
+    }
+
+    const uint8_t *at = reader->chunk + reader->at;
+    reader->at += n;
+    return at;
+}
+
+static int take_byte(struct trace_reader *reader, uint8_t *byte) {
+    const uint8_t *at = take(reader, 1);
+    if (at == NULL) {
+        return -1;
+    }
+
+    *byte = *at;
+    return 0;
+}
+
+static int take_varint(struct trace_reader *reader, uint64_t *value) {
+    *value = 0;
+
+    for (int shift = 0; shift < 64; shift += 7) {
+        uint8_t byte;
+        if (take_byte(reader, &byte) != 0) {
+            return -1;
+        }
+
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+static int read_keyframe(struct trace_reader *reader) {
+    struct state *s = &reader->state;
+    const uint8_t *at = take(reader, 15);
+
+    if (at == NULL) {
+        return -1;
+    }
+
+    s->pc = at[0] | at[1] << 8;
+    s->a = at[2];
+    s->x = at[3];
+    s->y = at[4];
+    s->sp = at[5];
+    s->p = at[6];
+    s->cycle = 0;
+    for (int i = 0; i < 8; i++) {
+        s->cycle |= (uint64_t)at[7 + i] << (8 * i);
+    }
+    s->addr = 0;
+
+    if (reader->marking) {
+        struct trace_mark *mark = &reader->mark;
+        mark->cycle = s->cycle;
+        mark->pc = s->pc;
+        mark->a = s->a;
+        mark->x = s->x;
+        mark->y = s->y;
+        mark->sp = s->sp;
+        mark->p = s->p;
+        reader->marking = 0;
+    }
+
+    return 0;
+}
+
+int trace_read(struct trace_reader *reader, struct trace_record *record) {
+    struct state *s = &reader->state;
+    uint8_t tag;
+    uint8_t ext;
+
+    for (;;) {
+        if (reader->at == reader->size) {
+            int loaded = load_chunk(reader);
+            if (loaded <= 0) {
+                return loaded;
+            }
+        }
+
+        ext = 0;
+        if (take_byte(reader, &tag) != 0 || (tag & TAG_EXT && take_byte(reader, &ext) != 0)) {
+            return -1;
+        }
+
+        if (!(ext & EXT_KEY)) {
+            // every chunk starts with a keyframe
+            if (reader->marking) {
+                return -1;
+            }
+            break;
+        }
+
+        if (read_keyframe(reader) != 0) {
+            return -1;
+        }
+    }
+
+    memset(record, 0, sizeof(*record));
+    record->kind = ext & EXT_ENTRY ? TRACE_ENTRY : TRACE_INSTRUCTION;
+    record->cycle = s->cycle;
+
+    if (tag & TAG_PC) {
+        const uint8_t *at = take(reader, 2);
+        if (at == NULL) {
+            return -1;
+        }
+        s->pc = at[0] | at[1] << 8;
+    }
+    record->pc = s->pc;
+
+    if (record->kind == TRACE_INSTRUCTION) {
+        if (take_byte(reader, &record->opcode) != 0) {
+            return -1;
+        }
+
+        record->length = cpu_ops[record->opcode].length;
+        for (int i = 0; i < record->length - 1; i++) {
+            if (take_byte(reader, &record->operands[i]) != 0) {
+                return -1;
+            }
+        }
+    }
+
+    if ((tag & TAG_A && take_byte(reader, &s->a) != 0) ||
+        (tag & TAG_X && take_byte(reader, &s->x) != 0) ||
+        (tag & TAG_Y && take_byte(reader, &s->y) != 0) ||
+        (tag & TAG_P && take_byte(reader, &s->p) != 0) ||
+        (ext & EXT_SP && take_byte(reader, &s->sp) != 0)) {
+        return -1;
+    }
+
+    record->a = s->a;
+    record->x = s->x;
+    record->y = s->y;
+    record->sp = s->sp;
+    record->p = s->p;
+
+    uint64_t cycles = cpu_ops[record->opcode].cycles;
+    if (tag & TAG_CYCLES && (take_varint(reader, &cycles) != 0 || cycles > UINT32_MAX)) {
+        return -1;
+    }
+    record->cycles = cycles;
+
+    if (tag & TAG_ACCESS) {
+        uint8_t n;
+        if (take_byte(reader, &n) != 0 || n > TRACE_ACCESSES) {
+            return -1;
+        }
+
+        for (unsigned i = 0; i < n; i++) {
+            uint64_t packed;
+            uint8_t data;
+            if (take_varint(reader, &packed) != 0 || take_byte(reader, &data) != 0) {
+                return -1;
+            }
+
+            uint32_t zigzag = packed >> 1;
+            int32_t delta = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+
+            s->addr += delta;
+            record->accesses[i] = (struct trace_access){ s->addr, data, packed & 1 };
+        }
+
+        record->accesses_n = n;
+    }
+
+    s->pc += record->length;
+    s->cycle += record->cycles;
+    return 1;
+}
+
+void trace_reader_mark(const struct trace_reader *reader, struct trace_mark *mark) {
+    *mark = reader->mark;
+}
+
+int trace_reader_seek(struct trace_reader *reader, uint64_t offset) {
+    if (fseeko(reader->file, offset, SEEK_SET) != 0) {
+        return -1;
+    }
+
+    reader->offset = offset;
+    reader->size = 0;
+    reader->at = 0;
+    return 0;
+}
@@ -0,0 +1,108 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdint.h>
+
+#include "bus.h"
+#include "cpu.h"
+
+// Execution traces. trace_run() runs instructions like cpu_step_fast() and
+// records each one: its PC, opcode and operands, the registers after it, its
+// cycles, and every other bus access it made. Records are delta-encoded
+// against the one before (PC only when it doesn't follow on, registers only
+// when they change, cycles only when they aren't the opcode's base count,
+// addresses relative to the last access), so most take a few bytes.
+//
+// The CPU thread encodes into a ring of chunks and a writer thread writes
+// full chunks to the file. The two share nothing but the ring's two
+// counters, and the CPU thread only waits if the writer falls a whole ring
+// behind. Each chunk starts with the full CPU state, so a reader can start
+// at any chunk.
+//
+// A trace only decodes with a core built for the same CPU variant.
+
+#define TRACE_ACCESSES 16       // most bus accesses kept per record
+
+struct trace;
+
+// Creates or truncates the file at `path` and starts the writer thread.
+// Returns NULL on failure.
+struct trace *trace_open(const char *path);
+
+// Writes what is left, stops the writer and frees the trace. Returns 0, or -1
+// if anything failed to be written.
+int trace_close(struct trace *trace);
+
+// Runs and records instructions until at least `cycles` have elapsed, and
+// returns the cycles run. Interrupt and reset entries are recorded too. It
+// runs whole instructions and, like dcache_run(), doesn't look at the watch.
+uint64_t trace_run(struct trace *trace, struct cpu *cpu, const struct bus *bus, uint64_t cycles);
+
+// Reading a trace back
+
+enum trace_kind {
+    TRACE_INSTRUCTION,
+    TRACE_ENTRY,                // an interrupt or reset entry, with no opcode
+};
+
+struct trace_access {
+    uint16_t addr;
+    uint8_t data;
+    uint8_t write;
+};
+
+struct trace_record {
+    enum trace_kind kind;
+    uint64_t cycle;             // cycles traced before this record
+    uint16_t pc;
+    uint8_t opcode;
+    uint8_t operands[2];
+    uint8_t length;             // 1 to 3, or 0 for an entry
+
+    // registers after the record
+    uint8_t a;
+    uint8_t x;
+    uint8_t y;
+    uint8_t sp;
+    uint8_t p;
+
+    uint32_t cycles;
+
+    // accesses other than the opcode and operand fetches, in order
+    struct trace_access accesses[TRACE_ACCESSES];
+    uint8_t accesses_n;
+};
+
+struct trace_reader;
+
+// Returns NULL if the file can't be read, isn't a trace, or was recorded by
+// another CPU variant.
+struct trace_reader *trace_reader_open(const char *path);
+
+void trace_reader_close(struct trace_reader *reader);
+
+// Reads the next record. Returns 1, 0 at the end of the trace, or -1 if the
+// trace is corrupt.
+int trace_read(struct trace_reader *reader, struct trace_record *record);
+
+// Where the chunk holding the last record read starts in the file, and the
+// state it starts from: the PC and registers before its first record, and
+// the cycles traced before it.
+struct trace_mark {
+    uint64_t offset;
+    uint64_t cycle;
+    uint16_t pc;
+    uint8_t a;
+    uint8_t x;
+    uint8_t y;
+    uint8_t sp;
+    uint8_t p;
+};
+
+void trace_reader_mark(const struct trace_reader *reader, struct trace_mark *mark);
+
+// Goes back or forward to a chunk at a mark's offset, so that the next
+// trace_read() returns its first record. Returns 0 or -1.
+int trace_reader_seek(struct trace_reader *reader, uint64_t offset);
+
+#endif
@@ -0,0 +1,404 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tracedb.h"
+
+// The file is a header, then for reads and then writes the index of each
+// address's first access (with one more for the end), then the marks, then
+// the accesses. It is in the host's byte order.
+#define TRACEDB_MAGIC   "TD65"
+#define TRACEDB_VERSION 1
+#define TRACEDB_STARTS  (0x10000 + 1)
+
+#define READS  0
+#define WRITES 1
+
+struct header {
+    char magic[4];
+    uint32_t version;
+    uint64_t trace_size;
+    uint64_t records;
+    uint64_t cycles;
+    uint64_t marks_n;
+    uint64_t entries_n;
+};
+
+struct entry {
+    uint64_t cycle;
+    uint16_t pc;
+    uint8_t opcode;
+    uint8_t data;
+} __attribute__((packed));
+
+struct tracedb {
+    uint8_t *file;
+    size_t size;
+    const struct header *header;
+    const uint64_t (*starts)[TRACEDB_STARTS];
+    const struct trace_mark *marks;
+    const struct entry *entries;
+    struct trace_reader *reader;
+};
+
+static size_t file_size(uint64_t marks_n, uint64_t entries_n) {
+    return sizeof(struct header) + 2 * TRACEDB_STARTS * sizeof(uint64_t) +
+        marks_n * sizeof(struct trace_mark) + entries_n * sizeof(struct entry);
+}
+
+static void layout(struct tracedb *db) {
+    db->header = (const struct header *)db->file;
+    db->starts = (const uint64_t (*)[TRACEDB_STARTS])(db->file + sizeof(struct header));
+    db->marks = (const struct trace_mark *)(db->starts + 2);
+    db->entries = (const struct entry *)(db->marks + db->header->marks_n);
+}
+
+//
+// Building
+//
+
+// Reads the trace, counting each address's reads and writes into `starts`
+// and collecting the marks. Returns 0 or -1.
+static int count(struct trace_reader *reader, struct header *header, uint64_t (*starts)[TRACEDB_STARTS],
+    struct trace_mark **marks) {
+    struct trace_record r;
+    size_t room = 0;
+    int got;
+
+    while ((got = trace_read(reader, &r)) == 1) {
+        struct trace_mark mark;
+        trace_reader_mark(reader, &mark);
+
+        if (header->marks_n == 0 || mark.offset != (*marks)[header->marks_n - 1].offset) {
+            if (header->marks_n == room) {
+                room = room ? room * 2 : 1024;
+                struct trace_mark *grown = realloc(*marks, room * sizeof(**marks));
+                if (grown == NULL) {
+                    return -1;
+                }
+                *marks = grown;
+            }
+            (*marks)[header->marks_n++] = mark;
+        }
+
+        for (int i = 0; i < r.accesses_n; i++) {
+            starts[r.accesses[i].write][r.accesses[i].addr + 1]++;
+        }
+
+        header->records++;
+        header->cycles += r.cycles;
+    }
+
+    return got;
+}
+
+// Reads the trace again, putting each access at the next free place for
+// its address. Accesses come in cycle order, so each address's stay sorted.
+static int fill(struct trace_reader *reader, uint64_t (*next)[TRACEDB_STARTS], struct entry *entries) {
+    struct trace_record r;
+    int got;
+
+    while ((got = trace_read(reader, &r)) == 1) {
+        for (int i = 0; i < r.accesses_n; i++) {
+            const struct trace_access *access = &r.accesses[i];
+            entries[next[access->write][access->addr]++] = (struct entry){
+                r.cycle, r.pc, r.opcode, access->data,
+            };
+        }
+    }
+
+    return got;
+}
+
+int tracedb_build(const char *trace_path, const char *db_path) {
+    struct stat st;
+    if (stat(trace_path, &st) != 0) {
+        return -1;
+    }
+
+    struct trace_reader *reader = trace_reader_open(trace_path);
+    if (reader == NULL) {
+        return -1;
+    }
+
+    struct header header = { .magic = TRACEDB_MAGIC, .version = TRACEDB_VERSION, .trace_size = st.st_size };
+    uint64_t (*starts)[TRACEDB_STARTS] = calloc(2, sizeof(*starts));
+    uint64_t (*next)[TRACEDB_STARTS] = malloc(2 * sizeof(*next));
+    struct trace_mark *marks = NULL;
+    int fd = -1;
+    int result = -1;
+
+    if (starts == NULL || next == NULL || count(reader, &header, starts, &marks) != 0) {
+        goto done;
+    }
+
+    // reads first, then writes
+    for (int kind = READS; kind <= WRITES; kind++) {
+        if (kind == WRITES) {
+            starts[WRITES][0] = starts[READS][0x10000];
+        }
+        for (int i = 0; i < 0x10000; i++) {
+            starts[kind][i + 1] += starts[kind][i];
+        }
+    }
+    header.entries_n = starts[WRITES][0x10000];
+    memcpy(next, starts, 2 * sizeof(*next));
+
+    size_t size = file_size(header.marks_n, header.entries_n);
+    fd = open(db_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, size) != 0) {
+        goto done;
+    }
+
+    uint8_t *file = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (file == MAP_FAILED) {
+        goto done;
+    }
+
+    struct tracedb db = { .file = file };
+    memcpy(file, &header, sizeof(header));
+    layout(&db);
+    memcpy((void *)db.starts, starts, 2 * sizeof(*starts));
+    memcpy((void *)db.marks, marks, header.marks_n * sizeof(*marks));
+
+    if (header.marks_n == 0) {
+        result = 0;
+    } else if (trace_reader_seek(reader, marks[0].offset) == 0) {
+        result = fill(reader, next, (struct entry *)db.entries);
+    }
+
+    munmap(file, size);
+
+done:
+    if (fd >= 0) {
+        if (close(fd) != 0) {
+            result = -1;
+        }
+        if (result != 0) {
+            unlink(db_path);
+        }
+    }
+    free(marks);
+    free(next);
+    free(starts);
+    trace_reader_close(reader);
+    return result;
+}
+
+//
+// Querying
+//
+
+struct tracedb *tracedb_open(const char *db_path, const char *trace_path) {
+    struct stat st;
+    if (stat(trace_path, &st) != 0) {
+        return NULL;
+    }
+
+    int fd = open(db_path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat db_st;
+    if (fstat(fd, &db_st) != 0 || (size_t)db_st.st_size < file_size(0, 0)) {
+        close(fd);
+        return NULL;
+    }
+
+    // the mapping stays valid once the file is closed
+    void *file = mmap(NULL, db_st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (file == MAP_FAILED) {
+        return NULL;
+    }
+
+    const struct header *header = file;
+    if (memcmp(header->magic, TRACEDB_MAGIC, 4) != 0 || header->version != TRACEDB_VERSION ||
+        header->trace_size != (uint64_t)st.st_size ||
+        file_size(header->marks_n, header->entries_n) != (size_t)db_st.st_size) {
+        munmap(file, db_st.st_size);
+        return NULL;
+    }
+
+    struct tracedb *db = calloc(1, sizeof(*db));
+    if (db == NULL || (db->reader = trace_reader_open(trace_path)) == NULL) {
+        free(db);
+        munmap(file, db_st.st_size);
+        return NULL;
+    }
+
+    db->file = file;
+    db->size = db_st.st_size;
+    layout(db);
+    return db;
+}
+
+void tracedb_close(struct tracedb *db) {
+    trace_reader_close(db->reader);
+    munmap(db->file, db->size);
+    free(db);
+}
+
+uint64_t tracedb_records(const struct tracedb *db) {
+    return db->header->records;
+}
+
+uint64_t tracedb_cycles(const struct tracedb *db) {
+    return db->header->cycles;
+}
+
+// The first of an address's accesses of one kind made from `cycle` on
+static uint64_t lower_bound(const struct tracedb *db, int kind, uint16_t addr, uint64_t cycle) {
+    uint64_t lo = db->starts[kind][addr];
+    uint64_t hi = db->starts[kind][addr + 1];
+
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (db->entries[mid].cycle < cycle) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+static void access_at(const struct tracedb *db, int kind, uint16_t addr, uint64_t i, struct tracedb_access *access) {
+    const struct entry *e = &db->entries[i];
+    *access = (struct tracedb_access){ e->cycle, addr, e->pc, e->opcode, e->data, kind == WRITES };
+}
+
+int tracedb_last_write(const struct tracedb *db, uint16_t addr, uint64_t cycle, struct tracedb_access *access) {
+    uint64_t i = lower_bound(db, WRITES, addr, cycle);
+    if (i == db->starts[WRITES][addr]) {
+        return 0;
+    }
+
+    access_at(db, WRITES, addr, i - 1, access);
+    return 1;
+}
+
+uint64_t tracedb_accesses(const struct tracedb *db, uint16_t first_addr, uint16_t last_addr,
+    uint64_t first_cycle, uint64_t end_cycle, int kinds,
+    void (*fn)(void *ctx, const struct tracedb_access *access), void *ctx) {
+    uint64_t n = 0;
+
+    for (uint32_t addr = first_addr; addr <= last_addr; addr++) {
+        for (int kind = READS; kind <= WRITES; kind++) {
+            if (!(kinds & (kind == WRITES ? TRACEDB_WRITES : TRACEDB_READS))) {
+                continue;
+            }
+
+            uint64_t end = db->starts[kind][addr + 1];
+            for (uint64_t i = lower_bound(db, kind, addr, first_cycle); i < end && db->entries[i].cycle < end_cycle; i++) {
+                if (fn != NULL) {
+                    struct tracedb_access access;
+                    access_at(db, kind, addr, i, &access);
+                    fn(ctx, &access);
+                }
+                n++;
+            }
+        }
+    }
+
+    return n;
+}
+
+// Reads from the last checkpoint before `cycle` to the record running at
+// it, keeping the registers before each record in `cpu`
+static int find(struct tracedb *db, uint64_t cycle, struct trace_record *record, struct cpu *cpu) {
+    if (cycle >= db->header->cycles) {
+        return 0;
+    }
+
+    uint64_t lo = 0;
+    uint64_t hi = db->header->marks_n;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (db->marks[mid].cycle <= cycle) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo == 0 || trace_reader_seek(db->reader, db->marks[lo - 1].offset) != 0) {
+        return -1;
+    }
+
+    const struct trace_mark *mark = &db->marks[lo - 1];
+    cpu_init(cpu, mark->pc);
+    cpu->a = mark->a;
+    cpu->x = mark->x;
+    cpu->y = mark->y;
+    cpu->sp = mark->sp;
+    cpu_set_p(cpu, mark->p);
+
+    for (;;) {
+        if (trace_read(db->reader, record) != 1) {
+            return -1;
+        }
+
+        if (record->cycle + record->cycles > cycle) {
+            break;
+        }
+
+        cpu->a = record->a;
+        cpu->x = record->x;
+        cpu->y = record->y;
+        cpu->sp = record->sp;
+        cpu_set_p(cpu, record->p);
+    }
+
+    cpu->pc = record->pc;
+    cpu->last_i = cpu_get_p(cpu) & P_I;
+    return 1;
+}
+
+int tracedb_record(struct tracedb *db, uint64_t cycle, struct trace_record *record) {
+    struct cpu cpu;
+    return find(db, cycle, record, &cpu);
+}
+
+int tracedb_state(struct tracedb *db, uint64_t cycle, struct cpu *cpu, uint8_t *memory, uint8_t *known) {
+    struct trace_record record;
+    int found = find(db, cycle, &record, cpu);
+
+    if (found != 1 || (memory == NULL && known == NULL)) {
+        return found;
+    }
+
+    // the latest access before the record, or failing that the first read
+    // after it, if nothing was written in between
+    for (uint32_t addr = 0; addr < 0x10000; addr++) {
+        uint64_t read = lower_bound(db, READS, addr, record.cycle);
+        uint64_t write = lower_bound(db, WRITES, addr, record.cycle);
+        int has_read = read > db->starts[READS][addr];
+        int has_write = write > db->starts[WRITES][addr];
+        const struct entry *e = NULL;
+
+        if (has_read && (!has_write || db->entries[read - 1].cycle > db->entries[write - 1].cycle)) {
+            e = &db->entries[read - 1];
+        } else if (has_write) {
+            e = &db->entries[write - 1];
+        } else if (read < db->starts[READS][addr + 1] &&
+            (write == db->starts[WRITES][addr + 1] || db->entries[read].cycle <= db->entries[write].cycle)) {
+            e = &db->entries[read];
+        }
+
+        if (memory != NULL) {
+            memory[addr] = e != NULL ? e->data : 0;
+        }
+        if (known != NULL) {
+            known[addr] = e != NULL;
+        }
+    }
+
+    return 1;
+}
@@ -0,0 +1,75 @@
+#ifndef __TRACEDB_H__
+#define __TRACEDB_H__
+
+#include <stdint.h>
+
+#include "cpu.h"
+#include "trace.h"
+
+// An index over a trace written by trace_run(), for asking what happened
+// without reading the whole trace. tracedb_build() reads the trace once to
+// count and once to fill, and writes a file holding every access each
+// record made, sorted by address and then by cycle, with reads and writes
+// kept apart, and the trace's chunk marks as register checkpoints. The
+// file is memory-mapped for queries, so that a lookup is a binary search
+// over one address's accesses and touches a few pages.
+//
+// Accesses are stamped with the cycle their instruction started on.
+// Opcode and operand fetches aren't indexed; they are in the records.
+
+#define TRACEDB_READS  (1 << 0)
+#define TRACEDB_WRITES (1 << 1)
+
+struct tracedb;
+
+struct tracedb_access {
+    uint64_t cycle;             // of the record that made it
+    uint16_t addr;
+    uint16_t pc;                // of the record that made it
+    uint8_t opcode;             // of the record, or 0 for an entry
+    uint8_t data;
+    uint8_t write;
+};
+
+// Indexes the trace at `trace_path` into a new file at `db_path`. Returns 0
+// or -1.
+int tracedb_build(const char *trace_path, const char *db_path);
+
+// Opens an index along with the trace it was built from, which is read for
+// tracedb_record() and tracedb_state(). Returns NULL if either can't be
+// read or they don't belong together.
+struct tracedb *tracedb_open(const char *db_path, const char *trace_path);
+
+void tracedb_close(struct tracedb *db);
+
+// The number of records in the trace and the cycles they took
+uint64_t tracedb_records(const struct tracedb *db);
+uint64_t tracedb_cycles(const struct tracedb *db);
+
+// Finds the last write to `addr` by a record that started before `cycle`.
+// Returns 1, or 0 if there wasn't one.
+int tracedb_last_write(const struct tracedb *db, uint16_t addr, uint64_t cycle, struct tracedb_access *access);
+
+// Calls `fn` for each TRACEDB_READS and TRACEDB_WRITES access in `kinds` to
+// an address from `first_addr` to `last_addr` by a record that started from
+// `first_cycle` up to but not including `end_cycle`. Goes address by
+// address, reads before writes, in cycle order. `fn` may be NULL. Returns
+// the number of accesses.
+uint64_t tracedb_accesses(const struct tracedb *db, uint16_t first_addr, uint16_t last_addr,
+    uint64_t first_cycle, uint64_t end_cycle, int kinds,
+    void (*fn)(void *ctx, const struct tracedb_access *access), void *ctx);
+
+// Reads the record running at `cycle`. Returns 1, 0 if `cycle` is past the
+// end of the trace, or -1 if the trace can't be read.
+int tracedb_record(struct tracedb *db, uint64_t cycle, struct trace_record *record);
+
+// Rebuilds the state before the record running at `cycle`: the PC and
+// registers in `cpu`, which is otherwise as cpu_init() leaves it, and each
+// byte of memory the trace shows, with `known` set to 1 for those and 0 for
+// the rest. `memory` and `known` are 64K each and may be NULL. Registers a
+// host changed between trace_run() calls show from the next chunk or record
+// on. Returns 1, 0 if `cycle` is past the end of the trace, or -1 if the
+// trace can't be read.
+int tracedb_state(struct tracedb *db, uint64_t cycle, struct cpu *cpu, uint8_t *memory, uint8_t *known);
+
+#endif
@@ -0,0 +1,357 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "undo.h"
+
+// The most writes an instruction or entry makes: BRK and interrupt entries
+// push three bytes
+#define UNDO_POKES 3
+
+// The state before an instruction, and what its writes overwrote
+struct entry {
+    uint16_t pc;
+    uint8_t a;
+    uint8_t x;
+    uint8_t y;
+    uint8_t sp;
+    uint8_t p;
+    uint8_t intr;
+    uint8_t last_i;
+    uint8_t opc;                // the one before, which the IRQ check looks at
+    uint8_t cycles;
+    uint8_t pokes;
+    uint8_t old[UNDO_POKES];
+    uint16_t addr[UNDO_POKES];
+};
+
+struct undo {
+    struct entry *entries;
+    size_t capacity;
+    size_t head;                // where the next entry goes
+    size_t depth;
+
+    // the registers as the journal left them, to tell if the host changed them
+    uint16_t pc;
+    uint8_t a;
+    uint8_t x;
+    uint8_t y;
+    uint8_t sp;
+    uint8_t p;
+};
+
+//
+// Journaling
+//
+
+// The engine from cpu_exec.h, built over a journal the way trace.c builds
+// it over a tracer: reads go straight to the caller's bus, and writes note
+// the byte they overwrite in the current entry on the way.
+struct journal {
+    const struct bus *under;
+    struct entry *entry;
+    const uint8_t *watched;     // cpu->watch's write bits, or NULL
+    int lost;                   // an entry ran out of room for writes
+    int hit;
+    uint16_t hit_addr;
+    uint8_t hit_data;
+};
+
+static inline __attribute__((always_inline)) uint8_t journal_peek(struct journal *journal, uint16_t addr) {
+    return bus_peek(journal->under, addr);
+}
+
+static inline __attribute__((always_inline)) void journal_poke(struct journal *journal, uint16_t addr, uint8_t data) {
+    uint8_t *page = journal->under->write[addr >> 8];
+
+    if (journal->watched != NULL && journal->watched[addr >> 3] & 1 << (addr & 7)) {
+        journal->hit = 1;
+        journal->hit_addr = addr;
+        journal->hit_data = data;
+    }
+
+    if (page != NULL) {
+        struct entry *entry = journal->entry;
+
+        if (entry->pokes < UNDO_POKES) {
+            entry->addr[entry->pokes] = addr;
+            entry->old[entry->pokes] = page[addr & 0xFF];
+            entry->pokes++;
+        } else {
+            journal->lost = 1;
+        }
+
+        page[addr & 0xFF] = data;
+        return;
+    }
+
+    journal->under->poke(journal->under->inst, addr, data);
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#define CPU_TEMPLATE
+#define CPU_BUS struct journal *
+#define bus_peek journal_peek
+#define bus_poke journal_poke
+#include "cpu_exec.h"
+#undef bus_peek
+#undef bus_poke
+#pragma GCC diagnostic pop
+
+struct undo *undo_new(size_t budget) {
+    if (budget < sizeof(struct entry)) {
+        return NULL;
+    }
+
+    struct undo *undo = calloc(1, sizeof(*undo));
+    if (undo == NULL) {
+        return NULL;
+    }
+
+    undo->capacity = budget / sizeof(struct entry);
+    undo->entries = malloc(undo->capacity * sizeof(struct entry));
+    if (undo->entries == NULL) {
+        free(undo);
+        return NULL;
+    }
+
+    return undo;
+}
+
+void undo_free(struct undo *undo) {
+    free(undo->entries);
+    free(undo);
+}
+
+void undo_clear(struct undo *undo) {
+    undo->depth = 0;
+}
+
+size_t undo_depth(const struct undo *undo) {
+    return undo->depth;
+}
+
+// Clears the journal if the host moved the CPU since it was last used
+static void check_host(struct undo *undo, const struct cpu *cpu) {
+    if (cpu->pc != undo->pc || cpu->a != undo->a || cpu->x != undo->x || cpu->y != undo->y ||
+        cpu->sp != undo->sp || cpu_get_p(cpu) != undo->p) {
+        undo->depth = 0;
+    }
+}
+
+static void leave(struct undo *undo, const struct cpu *cpu) {
+    undo->pc = cpu->pc;
+    undo->a = cpu->a;
+    undo->x = cpu->x;
+    undo->y = cpu->y;
+    undo->sp = cpu->sp;
+    undo->p = cpu_get_p(cpu);
+}
+
+// Whether an execute breakpoint stops the CPU at pc, as cpu_run() decides
+static int stops_at(struct cpu *cpu, const struct bus *bus, uint16_t pc) {
+    struct cpu_watch *watch = cpu->watch;
+
+    if (watch == NULL || !(watch->exec[pc >> 3] & 1 << (pc & 7))) {
+        return 0;
+    }
+
+    return watch->filter == NULL || watch->filter(watch->filter_ctx, cpu, bus, CPU_STOP_BREAK, pc, 0);
+}
+
+static void stop(struct cpu *cpu, struct cpu_result *result, int reason, uint16_t addr, uint8_t data) {
+    result->reason = reason;
+
+    if (cpu->watch != NULL) {
+        cpu->watch->reason = reason;
+        cpu->watch->addr = addr;
+        cpu->watch->data = data;
+    }
+}
+
+// Claims the next entry, dropping the oldest if the ring is full
+static struct entry *claim(struct undo *undo) {
+    struct entry *entry = &undo->entries[undo->head];
+
+    if (++undo->head == undo->capacity) {
+        undo->head = 0;
+    }
+    if (undo->depth < undo->capacity) {
+        undo->depth++;
+    }
+
+    return entry;
+}
+
+struct cpu_result undo_run(struct undo *undo, struct cpu *cpu, const struct bus *bus, uint64_t max_cycles) {
+    struct cpu_result result = { 0, CPU_STOP_BUDGET };
+    struct journal journal = { bus, NULL, NULL, 0, 0, 0, 0 };
+    int first = 1;
+
+    if (cpu->watch != NULL) {
+        cpu->watch->reason = 0;
+        journal.watched = cpu->watch->write;
+    }
+
+    if (cpu->cycle != 0) {
+        result.cycles += cpu_step_fast(cpu, bus);
+        undo->depth = 0;
+    } else {
+        check_host(undo, cpu);
+    }
+
+    while (result.cycles < max_cycles) {
+        uint16_t pc = cpu->pc;
+        uint8_t intr = cpu->intr;
+        uint8_t opc = cpu->opc;
+        int entering = intr && (intr & INTR_RESET || poll(cpu));
+
+        if (!entering) {
+            if (cpu->halt) {
+                cpu->halt = 0;
+                result.reason = CPU_STOP_HOST;
+                break;
+            }
+
+            if (!first && stops_at(cpu, bus, pc)) {
+                stop(cpu, &result, CPU_STOP_BREAK, pc, 0);
+                break;
+            }
+
+            cpu->opc = bus_peek(bus, pc);
+            if (cpu_ops[cpu->opc].flags & CPU_OP_JAM) {
+                result.reason = CPU_STOP_JAM;
+                break;
+            }
+        }
+
+        first = 0;
+
+        struct entry *entry = claim(undo);
+        entry->pc = pc;
+        entry->a = cpu->a;
+        entry->x = cpu->x;
+        entry->y = cpu->y;
+        entry->sp = cpu->sp;
+        entry->p = cpu_get_p(cpu);
+        entry->intr = intr;
+        entry->last_i = cpu->last_i;
+        entry->opc = opc;
+        entry->pokes = 0;
+        journal.entry = entry;
+
+        if (entering) {
+            entry->cycles = step(cpu, &journal);
+        } else {
+            cpu->pc++;
+            entry->cycles = exec(cpu, &journal);
+        }
+        result.cycles += entry->cycles;
+
+        if (journal.lost) {
+            undo->depth = 0;
+            journal.lost = 0;
+        }
+
+        if (journal.hit) {
+            stop(cpu, &result, CPU_STOP_WRITE, journal.hit_addr, journal.hit_data);
+            break;
+        }
+
+        if (!entering && cpu->pc == pc) {
+            result.reason = CPU_STOP_TRAP;
+            break;
+        }
+    }
+
+    leave(undo, cpu);
+    return result;
+}
+
+//
+// Going back
+//
+
+// Takes back the last entry, returning it
+static const struct entry *back(struct undo *undo, struct cpu *cpu, const struct bus *bus) {
+    undo->head = (undo->head + undo->capacity - 1) % undo->capacity;
+    undo->depth--;
+
+    const struct entry *entry = &undo->entries[undo->head];
+
+    for (int i = entry->pokes - 1; i >= 0; i--) {
+        uint8_t *page = bus->write[entry->addr[i] >> 8];
+        if (page != NULL) {
+            page[entry->addr[i] & 0xFF] = entry->old[i];
+        }
+    }
+
+    cpu->pc = entry->pc;
+    cpu->a = entry->a;
+    cpu->x = entry->x;
+    cpu->y = entry->y;
+    cpu->sp = entry->sp;
+    cpu_set_p(cpu, entry->p);
+    cpu->intr = entry->intr;
+    cpu->last_i = entry->last_i;
+    cpu->opc = entry->opc;
+    cpu->cycle = 0;
+
+    return entry;
+}
+
+int undo_step_back(struct undo *undo, struct cpu *cpu, const struct bus *bus) {
+    check_host(undo, cpu);
+
+    if (undo->depth == 0) {
+        return 0;
+    }
+
+    int cycles = back(undo, cpu, bus)->cycles;
+    leave(undo, cpu);
+    return cycles;
+}
+
+struct cpu_result undo_run_back(struct undo *undo, struct cpu *cpu, const struct bus *bus, uint64_t max_cycles) {
+    struct cpu_result result = { 0, CPU_STOP_BUDGET };
+    const uint8_t *watched = cpu->watch != NULL ? cpu->watch->write : NULL;
+
+    if (cpu->watch != NULL) {
+        cpu->watch->reason = 0;
+    }
+
+    check_host(undo, cpu);
+
+    while (result.cycles < max_cycles && undo->depth > 0) {
+        // the last watched write the entry made, and the byte it wrote
+        const struct entry *last = &undo->entries[(undo->head + undo->capacity - 1) % undo->capacity];
+        int hit = -1;
+        uint8_t data = 0;
+
+        for (int i = last->pokes - 1; watched != NULL && i >= 0; i--) {
+            uint16_t addr = last->addr[i];
+            const uint8_t *page = bus->write[addr >> 8];
+
+            if (watched[addr >> 3] & 1 << (addr & 7)) {
+                hit = addr;
+                data = page != NULL ? page[addr & 0xFF] : 0;
+                break;
+            }
+        }
+
+        result.cycles += back(undo, cpu, bus)->cycles;
+
+        if (hit >= 0) {
+            stop(cpu, &result, CPU_STOP_WRITE, hit, data);
+            break;
+        }
+
+        if (stops_at(cpu, bus, cpu->pc)) {
+            stop(cpu, &result, CPU_STOP_BREAK, cpu->pc, 0);
+            break;
+        }
+    }
+
+    leave(undo, cpu);
+    return result;
+}
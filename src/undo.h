@@ -0,0 +1,56 @@
+#ifndef __UNDO_H__
+#define __UNDO_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bus.h"
+#include "cpu.h"
+
+// An undo journal for stepping backwards. undo_run() runs whole
+// instructions like cpu_run() and, before each one, notes the registers
+// and the byte each write is about to overwrite. undo_step_back() puts them
+// back, and undo_run_back() does so until a breakpoint or a watched write.
+//
+// The journal is a ring of fixed-size entries within a byte budget, so the
+// oldest are dropped as new ones come in. Only writes to pages the bus maps
+// for writing can be undone: devices behind the callbacks keep their state,
+// and undoing goes back over them as if they hadn't been written. If the
+// host changes the registers between calls, the journal is cleared, since
+// it would no longer lead back from where the CPU is. Changes the host
+// makes to memory aren't undone.
+//
+// Both directions stop at the execute and write bits of cpu->watch, setting
+// its reason, address and data. Breakpoints go through its filter as under
+// cpu_run(); writes don't, and its read bits aren't looked at.
+
+struct undo;
+
+// Returns NULL on failure or if `budget` is too small for an entry.
+struct undo *undo_new(size_t budget);
+
+void undo_free(struct undo *undo);
+
+// Forgets everything journaled
+void undo_clear(struct undo *undo);
+
+// The number of instructions that can be stepped back over
+size_t undo_depth(const struct undo *undo);
+
+// Runs and journals instructions until at least max_cycles have elapsed or
+// a breakpoint, jam, trap, watched write or cpu_halt() stops it, the way
+// cpu_run() does. A partly ticked instruction finishes first and clears the
+// journal.
+struct cpu_result undo_run(struct undo *undo, struct cpu *cpu, const struct bus *bus, uint64_t max_cycles);
+
+// Takes back the last instruction or interrupt entry. Returns the cycles it
+// took, or 0 if the journal is empty.
+int undo_step_back(struct undo *undo, struct cpu *cpu, const struct bus *bus);
+
+// Steps back until max_cycles have been taken back, the journal runs out
+// (both CPU_STOP_BUDGET), the CPU is back at a breakpoint (CPU_STOP_BREAK)
+// or an instruction that wrote a watched address has been taken back
+// (CPU_STOP_WRITE, with the watch's data the byte it wrote).
+struct cpu_result undo_run_back(struct undo *undo, struct cpu *cpu, const struct bus *bus, uint64_t max_cycles);
+
+#endif
@@ -1,53 +1,234 @@
+#include "dcache.h"
+#include "jit.h"
+#include "loader.h"
 #include "test.h"
 
+// Every bus access made by one instruction, so the fast engine can be checked
+// against cpu_tick() access by access.
+struct access {
+    uint16_t addr;
+    uint8_t data;
+    uint8_t write;
+};
+
+static struct machine {
+    uint8_t memory[0x10000];
+    struct access log[16];
+    size_t log_n;
+} ref, fast, run, paged, stop, cached, jit;
+
+static uint8_t image[0x10000];
+
 static uint8_t peek(void *inst, uint16_t addr) {
-    uint8_t *mem = (uint8_t *)inst;
+    struct machine *m = (struct machine *)inst;
 
-    return mem[addr];
+    if (m->log_n < COUNT(m->log)) {
+        m->log[m->log_n++] = (struct access){ addr, m->memory[addr], 0 };
+    }
+
+    return m->memory[addr];
 }
 
 static void poke(void *inst, uint16_t addr, uint8_t data) {
-    uint8_t *mem = (uint8_t *)inst;
+    struct machine *m = (struct machine *)inst;
+
+    if (m->log_n < COUNT(m->log)) {
+        m->log[m->log_n++] = (struct access){ addr, data, 1 };
+    }
+
+    m->memory[addr] = data;
+}
+
+static int same_state(const struct cpu *a, const struct cpu *b) {
+    return a->pc == b->pc && a->sp == b->sp && cpu_get_p(a) == cpu_get_p(b)
+        && a->a == b->a && a->x == b->x && a->y == b->y;
+}
 
-    mem[addr] = data;
+static int same_log(const struct machine *a, const struct machine *b) {
+    return a->log_n == b->log_n
+        && memcmp(a->log, b->log, a->log_n * sizeof(a->log[0])) == 0;
 }
 
 int main(void) {
     TEST_INIT();
 
-    uint8_t memory[0x10000];
+    struct bus ref_bus = {
+        .inst = &ref,
+        .peek = peek,
+        .poke = poke
+    };
 
-    struct bus bus = {
-        .inst = memory,
+    struct bus fast_bus = {
+        .inst = &fast,
         .peek = peek,
         .poke = poke
     };
 
-    FILE *bin = fopen("./test/6502_functional_test/6502_functional_test.bin", "r");
-    if (bin == NULL) {
+    struct bus run_bus = {
+        .inst = &run,
+        .peek = peek,
+        .poke = poke
+    };
+
+    struct bus paged_bus = {
+        .inst = &paged,
+        .peek = peek,
+        .poke = poke
+    };
+
+    struct bus stop_bus = {
+        .inst = &stop,
+        .peek = peek,
+        .poke = poke
+    };
+
+    struct bus cached_bus = {
+        .inst = &cached,
+        .peek = peek,
+        .poke = poke
+    };
+
+    struct bus jit_bus = {
+        .inst = &jit,
+        .peek = peek,
+        .poke = poke
+    };
+
+    struct image bin;
+    if (image_open(&bin, "./test/6502_functional_test/6502_functional_test.bin", IMAGE_RAW) != 0) {
         printf("FAIL unable to open file\n");
         return 1;
     }
 
-    size_t bytes_read = fread(memory, 1, 0x10000, bin);
-    if (bytes_read != 65536) {
-        printf("FAIL read 0x%04lX bytes out of expected 64K\n", bytes_read);
+    if (bin.segments[0].size != 0x10000) {
+        printf("FAIL read 0x%04X bytes out of expected 64K\n", bin.segments[0].size);
         return 1;
     }
 
-    fclose(bin);
+    image_copy(&bin, image);
+    image_close(&bin);
+
+    memcpy(ref.memory, image, sizeof(ref.memory));
+    memcpy(fast.memory, image, sizeof(fast.memory));
+    memcpy(run.memory, image, sizeof(run.memory));
+    memcpy(paged.memory, image, sizeof(paged.memory));
+    memcpy(stop.memory, image, sizeof(stop.memory));
+    memcpy(cached.memory, image, sizeof(cached.memory));
 
     struct cpu cpu;
     cpu_init(&cpu, 0x0400);
 
+    struct cpu fast_cpu;
+    cpu_init(&fast_cpu, 0x0400);
+
+    uint64_t cycles = 0;
     uint16_t prev_pc;
     do {
         prev_pc = cpu.pc;
-        cpu_step(&cpu, &bus);
+
+        ref.log_n = 0;
+        int ref_cycles = 0;
+        do {
+            cpu_tick(&cpu, &ref_bus);
+            ref_cycles++;
+        } while (cpu.cycle != 0);
+
+        fast.log_n = 0;
+        int fast_cycles = cpu_step_fast(&fast_cpu, &fast_bus);
+
+        if (fast_cycles != ref_cycles || !same_state(&cpu, &fast_cpu) || !same_log(&ref, &fast)) {
+            printf("FAIL cpu_step_fast diverged from cpu_tick at 0x%04X (opcode 0x%02X)\n",
+                prev_pc, cpu.opc);
+            return 1;
+        }
+
+        cycles += ref_cycles;
     } while (prev_pc != cpu.pc);
 
+    // cpu_run_fast() should land in the same trap after the same number of cycles
+    struct cpu run_cpu;
+    cpu_init(&run_cpu, 0x0400);
+
+    uint64_t run_cycles = cpu_run_fast(&run_cpu, &run_bus, cycles);
+
+    if (run_cycles != cycles || !same_state(&cpu, &run_cpu)
+        || memcmp(ref.memory, run.memory, sizeof(run.memory)) != 0) {
+        printf("FAIL cpu_run_fast stopped at 0x%04X after %lu cycles\n",
+            run_cpu.pc, (unsigned long)run_cycles);
+        return 1;
+    }
+
+    // and so should it through a bus that maps memory directly, with the
+    // test's data page left on the callbacks
+    bus_map(&paged_bus, 0x0000, 0x10000, paged.memory);
+    bus_unmap(&paged_bus, 0x0200, 0x100);
+
+    struct cpu paged_cpu;
+    cpu_init(&paged_cpu, 0x0400);
+
+    uint64_t paged_cycles = cpu_run_fast(&paged_cpu, &paged_bus, cycles);
+
+    if (paged_cycles != cycles || !same_state(&cpu, &paged_cpu)
+        || memcmp(ref.memory, paged.memory, sizeof(paged.memory)) != 0) {
+        printf("FAIL cpu_run_fast (mapped) stopped at 0x%04X after %lu cycles\n",
+            paged_cpu.pc, (unsigned long)paged_cycles);
+        return 1;
+    }
+
+    // cpu_run() should find the trap by itself
+    struct cpu stop_cpu;
+    cpu_init(&stop_cpu, 0x0400);
+
+    struct cpu_result result = cpu_run(&stop_cpu, &stop_bus, UINT64_MAX);
+
+    if (result.reason != CPU_STOP_TRAP || result.cycles != cycles || !same_state(&cpu, &stop_cpu)
+        || memcmp(ref.memory, stop.memory, sizeof(stop.memory)) != 0) {
+        printf("FAIL cpu_run stopped (%d) at 0x%04X after %lu cycles\n",
+            result.reason, stop_cpu.pc, (unsigned long)result.cycles);
+        return 1;
+    }
+
+    // and so should the decoded-block cache
+    struct cpu cached_cpu;
+    cpu_init(&cached_cpu, 0x0400);
+
+    struct dcache *dcache = dcache_create();
+    uint64_t cached_cycles = dcache_run(dcache, &cached_cpu, &cached_bus, cycles);
+    dcache_destroy(dcache);
+
+    if (cached_cycles != cycles || !same_state(&cpu, &cached_cpu)
+        || memcmp(ref.memory, cached.memory, sizeof(cached.memory)) != 0) {
+        printf("FAIL dcache_run stopped at 0x%04X after %lu cycles\n",
+            cached_cpu.pc, (unsigned long)cached_cycles);
+        return 1;
+    }
+
+    // and so should the JIT, both through the bus and with memory mapped
+    for (int mapped = 0; mapped <= 1; mapped++) {
+        memcpy(jit.memory, image, sizeof(jit.memory));
+
+        struct cpu jit_cpu;
+        cpu_init(&jit_cpu, 0x0400);
+
+        struct bus bus = jit_bus;
+        if (mapped) {
+            bus_map(&bus, 0x0000, 0x10000, jit.memory);
+        }
+
+        struct jit *j = jit_create();
+        uint64_t jit_cycles = jit_run(j, &jit_cpu, &bus, cycles);
+        jit_destroy(j);
+
+        if (jit_cycles != cycles || !same_state(&cpu, &jit_cpu)
+            || memcmp(ref.memory, jit.memory, sizeof(jit.memory)) != 0) {
+            printf("FAIL jit_run%s stopped at 0x%04X after %lu cycles\n",
+                mapped ? " (mapped)" : "", jit_cpu.pc, (unsigned long)jit_cycles);
+            return 1;
+        }
+    }
+
     if (cpu.pc == 0x3469) {
-        printf("PASS\n");
+        printf("PASS (%lu cycles)\n", (unsigned long)cycles);
     } else {
         printf("FAIL at 0x%04X\n", cpu.pc);
     }
@@ -0,0 +1,169 @@
+#include <stdlib.h>
+
+#include "batch.h"
+#include "batch_step.h"
+#include "test.h"
+
+#define ORIGIN 0x06E0
+#define LANES  67
+
+static uint8_t memory[LANES][0x10000];
+static uint8_t lane_memory[0x10000];
+
+static uint8_t peek(void *inst, uint16_t addr) {
+    return ((uint8_t *)inst)[addr];
+}
+
+static void poke(void *inst, uint16_t addr, uint8_t data) {
+    ((uint8_t *)inst)[addr] = data;
+}
+
+static int same_state(const struct cpu *a, const struct cpu *b) {
+    return a->pc == b->pc && a->sp == b->sp && cpu_get_p(a) == cpu_get_p(b)
+        && a->a == b->a && a->x == b->x && a->y == b->y;
+}
+
+// Each lane runs the same program on its own data. With `spread` set the
+// lanes loop different numbers of times and drift far apart; without it they
+// only split at the branches that test their data and soon meet again.
+static void run_program(int spread) {
+    uint8_t program[] = {
+        0xA6, 0x00,         // start: LDX $00
+        0xA0, 0x00,         //        LDY #$00
+        0x8A,               // loop:  TXA
+        0x0A,               //        ASL A
+        0x7D, 0x00, 0x03,   //        ADC $0300,X
+        0x99, 0x00, 0x04,   //        STA $0400,Y
+        0x59, 0x00, 0x03,   //        EOR $0300,Y
+        0x85, 0x10,         //        STA $10
+        0x46, 0x10,         //        LSR $10
+        0x26, 0x11,         //        ROL $11
+        0xE6, 0x12,         //        INC $12
+        0x24, 0x11,         //        BIT $11
+        0x30, 0x02,         //        BMI skip
+        0xC8,               //        INY
+        0xC8,               //        INY
+        0xB1, 0x20,         // skip:  LDA ($20),Y
+        0x81, 0x22,         //        STA ($22,X)
+        0x6A,               //        ROR A
+        0x50, 0x01,         //        BVC bin
+        0xF8,               //        SED
+        0xE9, 0x07,         // bin:   SBC #$07
+        0xD8,               //        CLD
+        0xCA,               //        DEX
+        0xD0, 0xD9,         //        BNE loop
+        0x48,               //        PHA
+        0x08,               //        PHP
+        0x20, 0x17, 0x07,   //        JSR sub
+        0x68,               //        PLA
+        0x28,               //        PLP
+        0xC6, 0x00,         //        DEC $00
+        0x4C, 0xE0, 0x06,   //        JMP start
+        0xBA,               // sub:   TSX
+        0x98,               //        TYA
+        0x38,               //        SEC
+        0xF5, 0x30,         //        SBC $30,X
+        0x96, 0x30,         //        STX $30,Y
+        0xC5, 0x12,         //        CMP $12
+        0x90, 0x01,         //        BCC done
+        0x18,               //        CLC
+        0x60,               // done:  RTS
+    };
+
+    struct batch *batch = batch_create(LANES);
+    assert(batch != NULL);
+    assert(batch_lanes(batch) == LANES);
+
+    struct cpu cpus[LANES];
+    uint64_t ref_cycles[LANES] = { 0 };
+    uint32_t seed = 1;
+
+    for (size_t i = 0; i < LANES; i++) {
+        uint8_t *m = memory[i];
+
+        memset(m, 0, 0x10000);
+        memcpy(m + ORIGIN, program, sizeof(program));
+        m[0x00] = spread ? i * 7 + 1 : 0x40;
+
+        // zero page pointers all land in $0505-$0606
+        for (int addr = 0x13; addr < 0x100; addr++) {
+            seed = seed * 1103515245 + 12345;
+            m[addr] = 0x05 + ((seed >> 16) & 1);
+        }
+
+        for (int addr = 0x0300; addr < 0x0400; addr++) {
+            seed = seed * 1103515245 + 12345;
+            m[addr] = seed >> 16;
+        }
+
+        batch_write(batch, i, 0x0000, m, 0x10000);
+
+        cpu_init(&cpus[i], ORIGIN);
+        batch_set(batch, i, &cpus[i]);
+    }
+
+    for (int round = 0; round < 200; round++) {
+        batch_run(batch, 997);
+
+        for (size_t i = 0; i < LANES; i++) {
+            struct bus bus = { .inst = memory[i], .peek = peek, .poke = poke };
+            uint64_t stop = ref_cycles[i] + 997;
+
+            while (ref_cycles[i] < stop) {
+                ref_cycles[i] += cpu_step_fast(&cpus[i], &bus);
+            }
+
+            struct cpu lane;
+            batch_get(batch, i, &lane);
+
+            assert(ref_cycles[i] == batch_cycles(batch, i));
+            assert(same_state(&cpus[i], &lane));
+            batch_read(batch, i, 0x0000, lane_memory, 0x10000);
+            assert(memcmp(memory[i], lane_memory, 0x10000) == 0);
+        }
+    }
+
+    batch_destroy(batch);
+}
+
+void test_divergent(void) {
+    run_program(1);
+}
+
+void test_lockstep(void) {
+    run_program(0);
+}
+
+// More lanes than a vector of byte counters can count: the group's size
+// must not wrap
+void test_count(void) {
+    size_t n = 300 * BATCH_ALIGN;
+    uint8_t *mask = aligned_alloc(BATCH_ALIGN, n);
+    assert(mask != NULL);
+
+    memset(mask, 0xFF, n);
+    assert(batch_count_sse2(mask, n) == n);
+    mask[n - 1] = 0;
+    assert(batch_count_sse2(mask, n) == n - 1);
+    memset(mask, 0, n);
+    assert(batch_count_sse2(mask, n) == 0);
+
+    if (__builtin_cpu_supports("avx2")) {
+        memset(mask, 0xFF, n);
+        assert(batch_count_avx2(mask, n) == n);
+        mask[0] = 0;
+        assert(batch_count_avx2(mask, n) == n - 1);
+    }
+
+    free(mask);
+}
+
+int main(void) {
+    TEST_INIT();
+
+    TEST(test_divergent);
+    TEST(test_lockstep);
+    TEST(test_count);
+
+    return 0;
+}
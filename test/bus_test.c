@@ -10,10 +10,67 @@ void test_write_then_read(void) {
     }
 }
 
+static uint8_t pages[0x300];
+static uint8_t io[0x100];
+
+static uint8_t io_peek(void *inst, uint16_t addr) {
+    return ((uint8_t *)inst)[addr & 0xFF];
+}
+
+static void io_poke(void *inst, uint16_t addr, uint8_t data) {
+    ((uint8_t *)inst)[addr & 0xFF] = data;
+}
+
+void test_mapped_pages(void) {
+    struct bus bus = { .inst = io, .peek = io_peek, .poke = io_poke };
+    memset(pages, 0, sizeof(pages));
+    memset(io, 0, sizeof(io));
+
+    // RAM at 0x0000 mirrored at 0x0800, ROM at 0xFF00, the rest to io
+    bus_map(&bus, 0x0000, 0x200, pages);
+    bus_map(&bus, 0x0800, 0x200, pages);
+    bus_map_rom(&bus, 0xFF00, 0x100, pages + 0x200);
+    pages[0x2FC] = 0x34;
+
+    bus_poke(&bus, 0x0123, 0xAA);
+    assert(pages[0x123] == 0xAA);
+    assert(bus_peek(&bus, 0x0923) == 0xAA);
+
+    bus_poke(&bus, 0x09FF, 0x55);
+    assert(bus_peek(&bus, 0x01FF) == 0x55);
+
+    assert(bus_peek(&bus, 0xFFFC) == 0x34);
+    bus_poke(&bus, 0xFFFC, 0x12);
+    assert(pages[0x2FC] == 0x34);
+    assert(io[0xFC] == 0x12);
+
+    bus_poke(&bus, 0x4016, 0x01);
+    assert(io[0x16] == 0x01);
+    assert(bus_peek(&bus, 0x4016) == 0x01);
+
+    // watched RAM is read in place and written through poke
+    bus_map_watched(&bus, 0x0200, 0x100, pages + 0x100);
+    assert(bus.ram[0x02] && !bus.ram[0x01] && !bus.ram[0xFF]);
+    assert(bus_peek(&bus, 0x0223) == 0xAA);
+    bus_poke(&bus, 0x0223, 0x66);
+    assert(io[0x23] == 0x66 && pages[0x123] == 0xAA);
+    assert(bus_memory(&bus, 0x02) == pages + 0x100 && bus_memory(&bus, 0x09) == pages + 0x100);
+    assert(bus_memory(&bus, 0xFF) == pages + 0x200 && bus_memory(&bus, 0x40) == NULL);
+    bus_unmap(&bus, 0x0200, 0x100);
+    assert(!bus.ram[0x02]);
+
+    bus_unmap(&bus, 0x0800, 0x200);
+    bus_poke(&bus, 0x0923, 0x77);
+    assert(pages[0x123] == 0xAA);
+    assert(io[0x23] == 0x77);
+    assert(bus_peek(&bus, 0x0123) == 0xAA);
+}
+
 int main(void) {
     TEST_INIT();
 
     TEST(test_write_then_read);
+    TEST(test_mapped_pages);
 
     return 0;
 }
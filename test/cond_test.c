@@ -0,0 +1,178 @@
+#include "test.h"
+#include "cond.h"
+
+// INX; STX $0300; LDA $0300; JMP $F000
+static const uint8_t program[] = { 0xE8, 0x8E, 0x00, 0x03, 0xAD, 0x00, 0x03, 0x4C, 0x00, 0xF0 };
+
+static struct cpu_watch watch;
+
+static int32_t eval(const char *text, const struct cpu *cpu, uint32_t hits, uint8_t data) {
+    char error[64];
+    struct cond *cond = cond_compile(text, error, sizeof(error));
+    if (cond == NULL) {
+        printf("%s: %s\n", text, error);
+        assert(0);
+    }
+
+    int32_t value = cond_eval(cond, cpu, test_bus(), hits, data);
+    cond_free(cond);
+    return value;
+}
+
+void test_compile(void) {
+    static const char *bad[] = { "", "A ==", "foo", "mem[1", "mem 1", "(1", "1 2", "$", "%2", "A = 1" };
+    char error[64];
+
+    for (size_t i = 0; i < COUNT(bad); i++) {
+        error[0] = 0;
+        assert(cond_compile(bad[i], error, sizeof(error)) == NULL);
+        assert(error[0] != 0);
+    }
+
+    assert(cond_compile("1 2", NULL, 0) == NULL);
+
+    // deeper than the stack
+    char deep[256] = "";
+    for (int i = 0; i < 40; i++) {
+        strcat(deep, "1+(");
+    }
+    strcat(deep, "1");
+    for (int i = 0; i < 40; i++) {
+        strcat(deep, ")");
+    }
+    assert(cond_compile(deep, error, sizeof(error)) == NULL);
+}
+
+void test_eval(void) {
+    struct cpu cpu;
+    cpu_init(&cpu, 0xF000);
+    cpu.a = 0xFF;
+    cpu.x = 0x10;
+    cpu.y = 3;
+    cpu_set_p(&cpu, P_C | P_Z);
+
+    uint8_t ram[0x20] = { [0x10] = 101, [0x11] = 0x12 };
+    test_load_ram(ram, sizeof(ram));
+
+    assert(eval("1 + 2 * 3", &cpu, 0, 0) == 7);
+    assert(eval("(1 + 2) * 3", &cpu, 0, 0) == 9);
+    assert(eval("$FF == 255 && 0xff == %11111111", &cpu, 0, 0) == 1);
+    assert(eval("10 - 3 - 2", &cpu, 0, 0) == 5);
+    assert(eval("-1 < 0 && ~0 == -1 && !5 == 0", &cpu, 0, 0) == 1);
+    assert(eval("1 << 4 | 3 & 1 ^ 2", &cpu, 0, 0) == 0x13);
+    assert(eval("17 / 5 + 17 % 5", &cpu, 0, 0) == 5);
+    assert(eval("7 / 0 + 7 % 0", &cpu, 0, 0) == 0);
+
+    // registers, flags and memory
+    assert(eval("A == $FF && X == 16 && y == 3", &cpu, 0, 0) == 1);
+    assert(eval("C && Z && !N && !v", &cpu, 0, 0) == 1);
+    assert(eval("PC == $F000 && SP == $FF", &cpu, 0, 0) == 1);
+    assert(eval("P & $03", &cpu, 0, 0) == 3);
+    assert(eval("A==$FF && mem[$10]>100", &cpu, 0, 0) == 1);
+    assert(eval("mem[X + 1] == $12", &cpu, 0, 0) == 1);
+    assert(eval("MEM[mem[$11] - 2]", &cpu, 0, 0) == 101);
+
+    // && and || give 0 or 1, and skip their right side
+    assert(eval("3 && 5", &cpu, 0, 0) == 1);
+    assert(eval("0 || 7", &cpu, 0, 0) == 1);
+    assert(eval("0 && 1 || 2", &cpu, 0, 0) == 1);
+    assert(eval("1 || 1 / 0 == 0 && 0", &cpu, 0, 0) == 1);
+
+    assert(eval("hits % 4 == 0", &cpu, 8, 0) == 1);
+    assert(eval("data == $2A", &cpu, 0, 0x2A) == 1);
+}
+
+void test_break(void) {
+    const struct bus *bus = test_bus();
+    struct cpu cpu;
+
+    test_load_rom(program, sizeof(program));
+    cpu_init(&cpu, TEST_ROM_OFFSET);
+    cpu_watch_init(&watch);
+    cpu.watch = &watch;
+
+    struct cond_set *set = cond_set_create(&watch);
+    char error[64];
+
+    // the LDA on the third lap
+    assert(cond_set_add(set, WATCH_EXEC, TEST_ROM_OFFSET + 4, "hits == 3", error, sizeof(error)) == 0);
+    assert(cond_set_add(set, WATCH_EXEC, TEST_ROM_OFFSET + 7, "x ==", error, sizeof(error)) == -1);
+
+    struct cpu_result result = cpu_run(&cpu, bus, 1000);
+    assert(result.reason == CPU_STOP_BREAK);
+    assert(cpu.pc == TEST_ROM_OFFSET + 4 && cpu.x == 3);
+    assert(cond_set_hits(set, WATCH_EXEC, TEST_ROM_OFFSET + 4) == 3);
+    assert(cond_set_evals(set) == 3);
+
+    // replaced by a register condition
+    assert(cond_set_add(set, WATCH_EXEC, TEST_ROM_OFFSET + 4, "X == 5 || X == $FE", error, sizeof(error)) == 0);
+    result = cpu_run(&cpu, bus, 1000);
+    assert(result.reason == CPU_STOP_BREAK && cpu.x == 5);
+
+    // unconditional, from the set and straight on the watch
+    assert(cond_set_add(set, WATCH_EXEC, TEST_ROM_OFFSET + 7, NULL, error, sizeof(error)) == 0);
+    result = cpu_run(&cpu, bus, 1000);
+    assert(result.reason == CPU_STOP_BREAK && cpu.pc == TEST_ROM_OFFSET + 7);
+
+    cond_set_remove(set, WATCH_EXEC, TEST_ROM_OFFSET + 7);
+    cpu_watch_set(&watch, WATCH_EXEC, TEST_ROM_OFFSET + 1, 1, 1);
+    result = cpu_run(&cpu, bus, 1000);
+    assert(result.reason == CPU_STOP_BREAK && cpu.pc == TEST_ROM_OFFSET + 1);
+    cpu_watch_set(&watch, WATCH_EXEC, TEST_ROM_OFFSET + 1, 1, 0);
+
+    // never true: runs out the budget
+    cond_set_remove(set, WATCH_EXEC, TEST_ROM_OFFSET + 4);
+    assert(cond_set_add(set, WATCH_EXEC, TEST_ROM_OFFSET + 4, "A == X + 1", error, sizeof(error)) == 0);
+    result = cpu_run(&cpu, bus, 1000);
+    assert(result.reason == CPU_STOP_BUDGET);
+
+    cond_set_destroy(set);
+    assert(watch.filter == NULL);
+}
+
+void test_access(void) {
+    const struct bus *bus = test_bus();
+    struct cpu cpu;
+
+    test_load_rom(program, sizeof(program));
+    cpu_init(&cpu, TEST_ROM_OFFSET);
+    cpu_watch_init(&watch);
+    cpu.watch = &watch;
+
+    struct cond_set *set = cond_set_create(&watch);
+
+    // STX of 4, then LDA of it on the next lap
+    assert(cond_set_add(set, WATCH_WRITE, 0x0300, "data == 4", NULL, 0) == 0);
+    assert(cond_set_add(set, WATCH_READ, 0x0300, "data == 5 && A == 4", NULL, 0) == 0);
+
+    struct cpu_result result = cpu_run(&cpu, bus, 1000);
+    assert(result.reason == CPU_STOP_WRITE);
+    assert(watch.data == 4 && cpu.x == 4);
+    assert(cond_set_hits(set, WATCH_WRITE, 0x0300) == 4);
+    assert(cond_set_hits(set, WATCH_READ, 0x0300) == 3);
+
+    result = cpu_run(&cpu, bus, 1000);
+    assert(result.reason == CPU_STOP_READ);
+    assert(watch.data == 5 && cpu.a == 5);
+
+    // step stops the same way
+    cond_set_remove(set, WATCH_READ, 0x0300);
+    assert(cond_set_add(set, WATCH_WRITE, 0x0300, "data == 7", NULL, 0) == 0);
+    int reason;
+    while ((reason = cpu_step(&cpu, bus)) == 0) {
+    }
+    assert(reason == CPU_STOP_WRITE && watch.data == 7);
+
+    cond_set_destroy(set);
+}
+
+int main(void) {
+    TEST_INIT();
+
+    TEST(test_compile);
+    TEST(test_eval);
+    TEST(test_break);
+    TEST(test_access);
+
+    return 0;
+}
@@ -0,0 +1,181 @@
+#include <stdlib.h>
+
+#include "test.h"
+#include "cow.h"
+#include "mapper.h"
+
+static uint8_t ram[0x0800];
+static uint8_t rom[0x1000];
+static uint8_t frozen[0x10000];
+
+// A device at $4000-$40FF that remembers the last write
+static uint8_t latch;
+
+static uint8_t device_peek(void *inst, uint16_t addr) {
+    (void)inst;
+    return addr >> 8 == 0x40 ? latch : 0;
+}
+
+static void device_poke(void *inst, uint16_t addr, uint8_t data) {
+    (void)inst;
+    if (addr >> 8 == 0x40) {
+        latch = data;
+    }
+}
+
+// 2K of RAM mirrored four times, like the NES, and the loop in ROM
+static void load(struct bus *bus, struct cpu *cpu) {
+    memset(ram, 0, sizeof(ram));
+    memset(rom, 0, sizeof(rom));
+    memcpy(rom, test_loop, sizeof(test_loop));
+
+    *bus = (struct bus){ .peek = device_peek, .poke = device_poke };
+    for (int mirror = 0; mirror < 0x2000; mirror += 0x0800) {
+        bus_map(bus, mirror, 0x0800, ram);
+    }
+    bus_map_rom(bus, 0xF000, 0x1000, rom);
+
+    cpu_init(cpu, 0xF000);
+}
+
+static void assert_base(const struct cow_child *child, const struct cpu *cpu) {
+    for (int addr = 0; addr < 0x10000; addr++) {
+        assert(bus_peek(&child->bus, addr) == frozen[addr]);
+    }
+    assert(child->cpu.pc == cpu->pc && child->cpu.a == cpu->a && child->cpu.x == cpu->x && child->cpu.y == cpu->y);
+    assert(child->dirty_n == 0);
+}
+
+void test_fork(void) {
+    struct bus bus;
+    struct cpu cpu;
+    load(&bus, &cpu);
+
+    cpu_run_fast(&cpu, &bus, 5000);
+
+    struct cow_base *base = cow_base_new(&cpu, &bus);
+    assert(base != NULL);
+    for (int addr = 0; addr < 0x10000; addr++) {
+        frozen[addr] = bus_peek(&bus, addr);
+    }
+    struct cpu forked = cpu;
+
+    // the parent goes on without the children seeing it
+    cpu_run_fast(&cpu, &bus, 5000);
+    ram[0x0523] = 0xAA;
+
+    struct cow_child *a = cow_child_new(base);
+    struct cow_child *b = cow_child_new(base);
+    assert(a != NULL && b != NULL);
+    assert_base(a, &forked);
+
+    // they share the base's pages until they write
+    assert(a->bus.read[0x02] == b->bus.read[0x02] && a->bus.write[0x02] == NULL);
+
+    cpu_run_fast(&a->cpu, &a->bus, 3000);
+    assert(a->dirty_n == 2);    // the stack and $0200
+    assert(a->bus.read[0x02] != b->bus.read[0x02]);
+
+    // a write reaches each mirror, and only in the child that made it
+    bus_poke(&b->bus, 0x1FF0, 0x5A);
+    assert(bus_peek(&b->bus, 0x07F0) == 0x5A && bus_peek(&b->bus, 0x0FF0) == 0x5A);
+    assert(bus_peek(&a->bus, 0x07F0) == frozen[0x07F0]);
+    assert(ram[0x07F0] == frozen[0x07F0]);
+    assert(b->dirty_n == 1);
+
+    // ROM and devices are the parent's, and writes to ROM go nowhere
+    assert(bus_peek(&a->bus, 0xF000) == 0xA2);
+    bus_poke(&b->bus, 0xF000, 0x00);
+    assert(bus_peek(&b->bus, 0xF000) == 0xA2 && b->bus.write[0xF0] == NULL);
+    assert(b->dirty_n == 1);
+    bus_poke(&a->bus, 0x4000, 0x77);
+    assert(latch == 0x77 && bus_peek(&b->bus, 0x4000) == 0x77);
+    latch = 0;
+
+    // resetting puts back what they wrote, however often
+    static struct cpu_idle idle;
+    a->cpu.idle = &idle;
+    for (int i = 0; i < 3; i++) {
+        cow_child_reset(a);
+        cow_child_reset(b);
+        assert_base(a, &forked);
+        assert_base(b, &forked);
+        assert(a->cpu.idle == &idle);
+
+        cpu_run_fast(&a->cpu, &a->bus, 10000 * (i + 1));
+        bus_poke(&a->bus, 0x0800 | i, i);
+    }
+
+    // and a child runs the same as the parent did from the fork
+    cow_child_reset(a);
+    cpu_run_fast(&a->cpu, &a->bus, 5000);
+    assert(a->cpu.pc == cpu.pc && a->cpu.x == cpu.x && a->cpu.y == cpu.y);
+    for (int addr = 0x0100; addr < 0x0300; addr++) {
+        assert(bus_peek(&a->bus, addr) == ram[addr]);
+    }
+
+    cow_child_free(a);
+    cow_child_free(b);
+    cow_base_free(base);
+}
+
+// The C64's mapper reads ROM over RAM and watches the zero page through its
+// callbacks
+void test_mapper(void) {
+    static uint8_t c64[0x10000];
+    static uint8_t basic[0x2000], kernal[0x2000], chargen[0x1000];
+    memset(c64, 0, sizeof(c64));
+    memset(basic, 0xBA, sizeof(basic));
+    memset(kernal, 0x4C, sizeof(kernal));
+    memset(chargen, 0xC6, sizeof(chargen));
+
+    struct mapper mapper;
+    mapper_c64(&mapper, c64, basic, kernal, chargen, NULL, device_peek, device_poke);
+    bus_poke(&mapper.bus, 0x0000, 0x2F);
+    bus_poke(&mapper.bus, 0x0001, 0x37);
+    c64[0xE000] = 0x11;
+
+    struct cpu cpu;
+    cpu_init(&cpu, 0xE000);
+    struct cow_base *base = cow_base_new(&cpu, &mapper.bus);
+    struct cow_child *a = cow_child_new(base);
+    struct cow_child *b = cow_child_new(base);
+    assert(base != NULL && a != NULL && b != NULL);
+
+    // ROM over RAM reads the ROM, and writes under it stay the child's
+    assert(bus_peek(&a->bus, 0xE000) == 0x4C && bus_peek(&a->bus, 0xA000) == 0xBA);
+    bus_poke(&a->bus, 0xE000, 0x22);
+    assert(bus_peek(&a->bus, 0xE000) == 0x4C);
+    assert(c64[0xE000] == 0x11);
+    assert(a->dirty_n == 1);
+
+    // the zero page is the child's too, port included
+    bus_poke(&a->bus, 0x0010, 0x33);
+    bus_poke(&a->bus, 0x0001, 0x30);
+    assert(bus_peek(&a->bus, 0x0010) == 0x33 && bus_peek(&a->bus, 0x0001) == 0x30);
+    assert(c64[0x0010] == 0 && c64[0x0001] == 0x37);
+    assert(bus_peek(&b->bus, 0x0010) == 0 && bus_peek(&b->bus, 0x0001) == 0x37);
+    assert(bus_peek(&mapper.bus, 0xA000) == 0xBA);
+
+    // and the child keeps the banks it was forked with
+    assert(bus_peek(&a->bus, 0xA000) == 0xBA);
+
+    cow_child_reset(a);
+    assert(bus_peek(&a->bus, 0x0010) == 0 && bus_peek(&a->bus, 0x0001) == 0x37);
+    assert(a->bus.write[0x00] == NULL && a->bus.write[0xE0] == NULL);
+    bus_poke(&a->bus, 0xE000, 0x44);
+    assert(bus_peek(&a->bus, 0xE000) == 0x4C);
+
+    cow_child_free(a);
+    cow_child_free(b);
+    cow_base_free(base);
+}
+
+int main(void) {
+    TEST_INIT();
+
+    TEST(test_fork);
+    TEST(test_mapper);
+
+    return 0;
+}
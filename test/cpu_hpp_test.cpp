@@ -0,0 +1,187 @@
+extern "C" {
+#include "test.h"
+}
+
+#include "cpu.hpp"
+
+// A flat 64K bus that logs every access, as a policy and through struct bus
+struct access {
+    uint16_t addr;
+    uint8_t data;
+    uint8_t write;
+};
+
+struct LogBus {
+    uint8_t memory[0x10000];
+    struct access log[16];
+    size_t log_n;
+
+    uint8_t peek(uint16_t addr) {
+        if (log_n < COUNT(log)) {
+            log[log_n++] = { addr, memory[addr], 0 };
+        }
+
+        return memory[addr];
+    }
+
+    void poke(uint16_t addr, uint8_t data) {
+        if (log_n < COUNT(log)) {
+            log[log_n++] = { addr, data, 1 };
+        }
+
+        memory[addr] = data;
+    }
+};
+
+static uint8_t log_peek(void *inst, uint16_t addr) {
+    return static_cast<LogBus *>(inst)->peek(addr);
+}
+
+static void log_poke(void *inst, uint16_t addr, uint8_t data) {
+    static_cast<LogBus *>(inst)->poke(addr, data);
+}
+
+static LogBus ref, policy, run;
+
+static int same_state(const struct cpu *a, const struct cpu *b) {
+    return a->pc == b->pc && a->sp == b->sp && cpu_get_p(a) == cpu_get_p(b)
+        && a->a == b->a && a->x == b->x && a->y == b->y;
+}
+
+static int same_log(const LogBus &a, const LogBus &b) {
+    return a.log_n == b.log_n && memcmp(a.log, b.log, a.log_n * sizeof(a.log[0])) == 0;
+}
+
+static void load(LogBus &bus) {
+    FILE *bin = fopen("./test/6502_functional_test/6502_functional_test.bin", "r");
+    assert(bin != NULL);
+
+    size_t bytes_read = fread(bus.memory, 1, sizeof(bus.memory), bin);
+    fclose(bin);
+
+    assert(bytes_read == sizeof(bus.memory));
+}
+
+static uint64_t functional_cycles;
+
+// Cpu<LogBus>::step() makes the same accesses as cpu_step_fast() over the
+// same bus through struct bus, instruction by instruction
+void test_step(void) {
+    load(ref);
+    load(policy);
+
+    struct bus ref_bus = {};
+    ref_bus.inst = &ref;
+    ref_bus.peek = log_peek;
+    ref_bus.poke = log_poke;
+
+    struct cpu cpu;
+    cpu_init(&cpu, 0x0400);
+
+    mos6502::Cpu<LogBus> fast(policy, 0x0400);
+
+    uint64_t cycles = 0;
+    uint16_t prev_pc;
+    do {
+        prev_pc = cpu.pc;
+
+        ref.log_n = 0;
+        int ref_cycles = cpu_step_fast(&cpu, &ref_bus);
+
+        policy.log_n = 0;
+        int fast_cycles = fast.step();
+
+        assert(fast_cycles == ref_cycles);
+        assert(same_state(&cpu, &fast.regs));
+        assert(same_log(ref, policy));
+
+        cycles += ref_cycles;
+    } while (prev_pc != cpu.pc);
+
+    assert(cpu.pc == 0x3469);
+    functional_cycles = cycles;
+}
+
+// run() lands in the same trap after the same cycles, through a policy and
+// through struct bus
+void test_run(void) {
+    load(run);
+
+    mos6502::Cpu<LogBus> cpu(run, 0x0400);
+    assert(cpu.run(functional_cycles) == functional_cycles);
+    assert(cpu.regs.pc == 0x3469);
+    assert(memcmp(run.memory, ref.memory, sizeof(run.memory)) == 0);
+
+    load(run);
+
+    struct bus bus = {};
+    bus.inst = &run;
+    bus.peek = log_peek;
+    bus.poke = log_poke;
+
+    mos6502::CBus cbus(&bus);
+    mos6502::Cpu<mos6502::CBus> c(cbus, 0x0400);
+    assert(c.run(functional_cycles) == functional_cycles);
+    assert(c.regs.pc == 0x3469);
+    assert(memcmp(run.memory, ref.memory, sizeof(run.memory)) == 0);
+}
+
+// Resets and interrupts run as they do under cpu_tick()
+void test_reset_and_irq(void) {
+    uint8_t program[] = {
+        0x58,               // start: CLI
+        0xE8,               // loop:  INX
+        0x4C, 0x01, 0xF0,   //        JMP loop
+        0xC8,               // irq:   INY
+        0x40,               //        RTI
+    };
+
+    uint8_t rom[TEST_ROM_SIZE] = {};
+    memcpy(rom, program, sizeof(program));
+    rom[0xFFC] = 0x00;      // reset to start
+    rom[0xFFD] = 0xF0;
+    rom[0xFFE] = 0x05;      // IRQ to irq
+    rom[0xFFF] = 0xF0;
+    test_load_rom(rom, sizeof(rom));
+
+    mos6502::CBus bus(test_bus());
+    mos6502::Cpu<mos6502::CBus> fast(bus);
+    fast.regs.intr |= INTR_RESET;
+
+    struct cpu cpu;
+    cpu_init(&cpu, 0);
+    cpu.intr |= INTR_RESET;
+
+    for (int i = 0; i < 40; i++) {
+        if (i == 10) {
+            cpu_assert(&cpu, INTR_IRQ);
+            cpu_assert(&fast.regs, INTR_IRQ);
+        }
+
+        if (i == 12) {
+            cpu_release(&cpu, INTR_IRQ);
+            cpu_release(&fast.regs, INTR_IRQ);
+        }
+
+        int cycles = 0;
+        do {
+            cpu_tick(&cpu, test_bus());
+            cycles++;
+        } while (cpu.cycle != 0);
+
+        assert(fast.step() == cycles);
+        assert(same_state(&cpu, &fast.regs));
+    }
+
+    assert(cpu.y == 1);
+}
+
+int main(void) {
+    TEST_INIT();
+
+    TEST(test_step);
+    TEST(test_run);
+    TEST(test_reset_and_irq);
+
+    return 0;
+}
@@ -52,7 +52,7 @@ void test_ora_idx(void) {
 
         assert(cpu.cycle == 0);
         assert(cpu.a == tests[i].expected_a);
-        assert(cpu.p == tests[i].expected_p);
+        assert(cpu_get_p(&cpu) == tests[i].expected_p);
     }
 }
 
@@ -96,7 +96,7 @@ void test_ora_zpg(void) {
 
         assert(cpu.cycle == 0);
         assert(cpu.a == tests[i].expected_a);
-        assert(cpu.p == tests[i].expected_p);
+        assert(cpu_get_p(&cpu) == tests[i].expected_p);
     }
 }
 
@@ -152,7 +152,7 @@ void test_ora_zpx(void) {
 
         assert(cpu.cycle == 0);
         assert(cpu.a == tests[i].expected_a);
-        assert(cpu.p == tests[i].expected_p);
+        assert(cpu_get_p(&cpu) == tests[i].expected_p);
     }
 }
 
@@ -197,7 +197,7 @@ void test_ora_abl(void) {
 
         assert(cpu.cycle == 0);
         assert(cpu.a == tests[i].expected_a);
-        assert(cpu.p == tests[i].expected_p);
+        assert(cpu_get_p(&cpu) == tests[i].expected_p);
     }
 }
 
@@ -255,7 +255,7 @@ void test_ora_abx(void) {
 
         assert(ticks == tests[i].expected_ticks);
         assert(cpu.a == tests[i].expected_a);
-        assert(cpu.p == tests[i].expected_p);
+        assert(cpu_get_p(&cpu) == tests[i].expected_p);
     }
 }
 
@@ -313,7 +313,7 @@ void test_ora_aby(void) {
 
         assert(ticks == tests[i].expected_ticks);
         assert(cpu.a == tests[i].expected_a);
-        assert(cpu.p == tests[i].expected_p);
+        assert(cpu_get_p(&cpu) == tests[i].expected_p);
     }
 }
 
@@ -375,7 +375,7 @@ void test_ora_idy(void) {
 
         assert(ticks == tests[i].expected_ticks);
         assert(cpu.a == tests[i].expected_a);
-        assert(cpu.p == tests[i].expected_p);
+        assert(cpu_get_p(&cpu) == tests[i].expected_p);
     }
 }
 
@@ -414,7 +414,7 @@ void test_ora_imm(void) {
 
         assert(cpu.cycle == 0);
         assert(cpu.a == tests[i].expected_a);
-        assert(cpu.p == tests[i].expected_p);
+        assert(cpu_get_p(&cpu) == tests[i].expected_p);
     }
 }
 
@@ -458,7 +458,7 @@ void test_asl_acc(void) {
 
         assert(cpu.cycle == 0);
         assert(cpu.a == tests[i].expected_a);
-        assert(cpu.p == tests[i].expected_p);
+        assert(cpu_get_p(&cpu) == tests[i].expected_p);
     }
 }
 
@@ -506,7 +506,7 @@ void test_asl_zpg(void) {
         uint16_t addr = tests[i].prg[1];
         assert(bus_peek(bus, addr) == tests[i].expected_data);
         assert(cpu.cycle == 0);
-        assert(cpu.p == tests[i].expected_p);
+        assert(cpu_get_p(&cpu) == tests[i].expected_p);
     }
 }
 
@@ -563,7 +563,7 @@ void test_asl_zpx(void) {
 
         assert(cpu.cycle == 0);
         assert(bus_peek(bus, tests[i].addr) == tests[i].expected_data);
-        assert(cpu.p == tests[i].expected_p);
+        assert(cpu_get_p(&cpu) == tests[i].expected_p);
     }
 }
 
@@ -590,7 +590,7 @@ void test_asl_abl(void) {
     assert(cpu.cycle == 0);
     assert(bus_peek(bus, 0x0180) == 0xAA);
     assert(cpu.pc == TEST_ROM_OFFSET + 3);
-    assert(cpu.p == P_N);
+    assert(cpu_get_p(&cpu) == P_N);
 }
 
 void test_asl_abx(void) {
@@ -613,6 +613,7 @@ void test_asl_abx(void) {
         uint8_t x;
         uint8_t expected_data;
         uint8_t expected_p;
+        int cycles;
     } tests[] = {
         {
             .addr = 0x0100,
@@ -620,6 +621,7 @@ void test_asl_abx(void) {
             .x = 0xF0,
             .expected_data = 0x04,
             .expected_p = 0,
+            .cycles = 7,
         },
         {
             .addr = 0x00FE,
@@ -627,6 +629,11 @@ void test_asl_abx(void) {
             .x = 0x0E,
             .expected_data = 0x80,
             .expected_p = P_N,
+#ifdef CPU_65C02
+            .cycles = 6,    // no fix-up cycle without a page cross
+#else
+            .cycles = 7,
+#endif
         },
     };
 
@@ -635,17 +642,13 @@ void test_asl_abx(void) {
         cpu_init(&cpu, TEST_ROM_OFFSET);
         cpu.x = tests[i].x;
 
-        cpu_tick(&cpu, bus);
-        cpu_tick(&cpu, bus);
-        cpu_tick(&cpu, bus);
-        cpu_tick(&cpu, bus);
-        cpu_tick(&cpu, bus);
-        cpu_tick(&cpu, bus);
-        cpu_tick(&cpu, bus);
+        for (int t = 0; t < tests[i].cycles; t++) {
+            cpu_tick(&cpu, bus);
+        }
 
         assert(cpu.cycle == 0);
         assert(bus_peek(bus, tests[i].addr) == tests[i].expected_data);
-        assert(cpu.p == tests[i].expected_p);
+        assert(cpu_get_p(&cpu) == tests[i].expected_p);
     }
 }
 
@@ -981,7 +984,7 @@ void test_php(void) {
     test_load_rom(program, sizeof(program));
     cpu_init(&cpu, TEST_ROM_OFFSET);
 
-    cpu.p = P_C | P_N;
+    cpu_set_p(&cpu, P_C | P_N);
 
     cpu_tick(&cpu, bus);
     cpu_tick(&cpu, bus);
@@ -990,7 +993,7 @@ void test_php(void) {
 
     assert(cpu.cycle == 0);
     assert(cpu.sp == 0xFE);
-    assert(bus_peek(bus, 0x01FF) == (cpu.p | P_B | (1 << 5)));
+    assert(bus_peek(bus, 0x01FF) == (cpu_get_p(&cpu) | P_B | (1 << 5)));
 }
 
 void test_bpl(void) {
@@ -1057,7 +1060,7 @@ void test_bpl(void) {
 
         cpu_init(&cpu, TEST_ROM_OFFSET);
         cpu.pc += offset;
-        cpu.p = tests[i].p;
+        cpu_set_p(&cpu, tests[i].p);
 
         for (int tick = 0; tick < tests[i].ticks; tick++) {
             cpu_tick(&cpu, bus);
@@ -1132,7 +1135,7 @@ void test_bne(void) {
 
         cpu_init(&cpu, TEST_ROM_OFFSET);
         cpu.pc += offset;
-        cpu.p = tests[i].p;
+        cpu_set_p(&cpu, tests[i].p);
 
         for (int tick = 0; tick < tests[i].ticks; tick++) {
             cpu_tick(&cpu, bus);
@@ -1152,14 +1155,14 @@ void test_clc(void) {
     test_load_rom(program, sizeof(program));
     cpu_init(&cpu, TEST_ROM_OFFSET);
 
-    cpu.p = P_C | P_N;
+    cpu_set_p(&cpu, P_C | P_N);
 
     cpu_tick(&cpu, bus);
     cpu_tick(&cpu, bus);
 
     assert(cpu.cycle == 0);
     assert(cpu.pc == TEST_ROM_OFFSET + 1);
-    assert(cpu.p == P_N);
+    assert(cpu_get_p(&cpu) == P_N);
 }
 
 void test_jsr(void) {
@@ -1241,14 +1244,14 @@ void test_adc(void) {
 
         cpu_init(&cpu, TEST_ROM_OFFSET);
         cpu.a = tests[i].a;
-        cpu.p = tests[i].p;
+        cpu_set_p(&cpu, tests[i].p);
 
         cpu_tick(&cpu, bus);
         cpu_tick(&cpu, bus);
 
         assert(cpu.cycle == 0);
         assert(cpu.a == tests[i].expected_a);
-        assert(cpu.p == tests[i].expected_p);
+        assert(cpu_get_p(&cpu) == tests[i].expected_p);
     }
 }
 
@@ -1312,17 +1315,155 @@ void test_sbc(void) {
 
         cpu_init(&cpu, TEST_ROM_OFFSET);
         cpu.a = tests[i].a;
-        cpu.p = tests[i].p;
+        cpu_set_p(&cpu, tests[i].p);
 
         cpu_tick(&cpu, bus);
         cpu_tick(&cpu, bus);
 
         assert(cpu.cycle == 0);
         assert(cpu.a == tests[i].expected_a);
-        assert(cpu.p == tests[i].expected_p);
+        assert(cpu_get_p(&cpu) == tests[i].expected_p);
+    }
+}
+
+#ifndef CPU_2A03
+
+// NMOS decimal mode worked a nibble at a time, as a reference for the tables
+static void decimal_adc(uint8_t a, uint8_t b, uint8_t c, uint8_t *result, uint8_t *p) {
+    int al = (a & 0x0F) + (b & 0x0F) + c;
+    int ah = (a >> 4) + (b >> 4);
+
+    if (al > 9) {
+        al += 6;
+        ah++;
+    }
+
+    *p = P_D;
+    *p |= ((a + b + c) & 0xFF) == 0 ? P_Z : 0;
+    *p |= ah & 0x08 ? P_N : 0;
+    *p |= ~(a ^ b) & (a ^ (ah << 4)) & 0x80 ? P_V : 0;
+
+    if (ah > 9) {
+        ah += 6;
+    }
+
+    *p |= ah > 15 ? P_C : 0;
+    *result = (ah << 4) | (al & 0x0F);
+}
+
+#ifdef CPU_65C02
+
+// The 65C02 subtracts in binary, then takes 6 from each digit that borrowed
+static void decimal_sbc(uint8_t a, uint8_t b, uint8_t c, uint8_t *result, uint8_t *p) {
+    int diff = a - b - !c;
+    int fixed = diff;
+
+    if ((a & 0x0F) < (b & 0x0F) + !c) {
+        fixed -= 0x06;
+    }
+
+    if (diff < 0) {
+        fixed -= 0x60;
+    }
+
+    *p = P_D;
+    *p |= diff & 0xFF00 ? 0 : P_C;
+    *p |= (a ^ b) & (a ^ diff) & 0x80 ? P_V : 0;
+    *result = fixed & 0xFF;
+}
+
+#else
+
+static void decimal_sbc(uint8_t a, uint8_t b, uint8_t c, uint8_t *result, uint8_t *p) {
+    int diff = a - b - !c;
+    int al = (a & 0x0F) - (b & 0x0F) - !c;
+    int ah = (a >> 4) - (b >> 4);
+
+    if (al & 0x10) {
+        al -= 6;
+        ah--;
+    }
+
+    if (ah & 0x10) {
+        ah -= 6;
+    }
+
+    *p = P_D;
+    *p |= diff & 0xFF00 ? 0 : P_C;
+    *p |= diff & 0xFF ? 0 : P_Z;
+    *p |= diff & 0x80 ? P_N : 0;
+    *p |= (a ^ b) & (a ^ diff) & 0x80 ? P_V : 0;
+    *result = ((ah & 0x0F) << 4) | (al & 0x0F);
+}
+
+#endif
+
+// The 65C02 sets N and Z from the result
+#ifdef CPU_65C02
+#define DECIMAL_P(a, p) (((p) & ~(P_N | P_Z)) | ((a) & P_N) | ((a) ? 0 : P_Z))
+#else
+#define DECIMAL_P(a, p) (p)
+#endif
+
+void test_decimal(void) {
+    const struct bus *bus = test_bus();
+    struct cpu cpu;
+
+    for (int c = 0; c < 2; c++) {
+        for (int a = 0; a < 256; a++) {
+            for (int b = 0; b < 256; b++) {
+                uint8_t prg[] = { 0x69, b, 0xE9, b };
+                uint8_t expected_a;
+                uint8_t expected_p;
+
+                test_load_rom(prg, sizeof(prg));
+
+                decimal_adc(a, b, c, &expected_a, &expected_p);
+                cpu_init(&cpu, TEST_ROM_OFFSET);
+                cpu.a = a;
+                cpu_set_p(&cpu, P_D | c);
+                cpu_step(&cpu, bus);
+
+                assert(cpu.a == expected_a);
+                assert(cpu_get_p(&cpu) == DECIMAL_P(expected_a, expected_p));
+
+                decimal_sbc(a, b, c, &expected_a, &expected_p);
+                cpu.a = a;
+                cpu_set_p(&cpu, P_D | c);
+                cpu_step(&cpu, bus);
+
+                assert(cpu.a == expected_a);
+                assert(cpu_get_p(&cpu) == DECIMAL_P(expected_a, expected_p));
+            }
+        }
     }
 }
 
+#else
+
+// ADC and SBC ignore D
+void test_decimal(void) {
+    uint8_t program[] = { 0xF8, 0x69, 0x09, 0xE9, 0x01 };  // SED, ADC #$09, SBC #$01
+
+    const struct bus *bus = test_bus();
+    struct cpu cpu;
+
+    test_load_rom(program, sizeof(program));
+    cpu_init(&cpu, TEST_ROM_OFFSET);
+    cpu.a = 0x01;
+
+    cpu_step(&cpu, bus);
+    cpu_step(&cpu, bus);
+    assert(cpu.a == 0x0A);
+    assert(cpu_get_p(&cpu) == P_D);
+
+    cpu_step(&cpu, bus);
+    assert(cpu.a == 0x08);
+    assert(cpu_get_p(&cpu) == (P_D | P_C));
+}
+
+#endif
+
 void test_cmp(void) {
     const struct bus *bus = test_bus();
     struct cpu cpu;
@@ -1362,14 +1503,14 @@ void test_cmp(void) {
 
         cpu_init(&cpu, TEST_ROM_OFFSET);
         cpu.a = tests[i].a;
-        cpu.p = tests[i].p;
+        cpu_set_p(&cpu, tests[i].p);
 
         cpu_tick(&cpu, bus);
         cpu_tick(&cpu, bus);
 
         assert(cpu.cycle == 0);
         assert(cpu.a == tests[i].expected_a);
-        assert(cpu.p == tests[i].expected_p);
+        assert(cpu_get_p(&cpu) == tests[i].expected_p);
     }
 }
 
@@ -1386,7 +1527,7 @@ void test_simple_load_and_store(void) {
     test_load_rom(program, sizeof(program));
     cpu_init(&cpu, TEST_ROM_OFFSET);
 
-    while (!(cpu.p & P_I)) {
+    while (!(cpu_get_p(&cpu) & P_I)) {
         cpu_step(&cpu, bus);
     }
 
@@ -1395,6 +1536,718 @@ void test_simple_load_and_store(void) {
     assert(bus_peek(bus, 0x0202) == 0x08);
 }
 
+void test_run_budget(void) {
+    uint8_t program[] = { 0xE8, 0x4C, 0x00, 0xF0 };     // INX, JMP $F000
+
+    const struct bus *bus = test_bus();
+    struct cpu cpu;
+
+    test_load_rom(program, sizeof(program));
+    cpu_init(&cpu, TEST_ROM_OFFSET);
+
+    struct cpu_result result = cpu_run(&cpu, bus, 20);
+
+    assert(result.reason == CPU_STOP_BUDGET);
+    assert(result.cycles == 20);
+    assert(cpu.x == 4);
+    assert(cpu.pc == TEST_ROM_OFFSET);
+}
+
+void test_run_trap(void) {
+    uint8_t program[] = { 0xE8, 0xD0, 0xFD, 0x4C, 0x03, 0xF0 };    // INX, BNE *-1, JMP *
+
+    const struct bus *bus = test_bus();
+    struct cpu cpu;
+
+    test_load_rom(program, sizeof(program));
+    cpu_init(&cpu, TEST_ROM_OFFSET);
+
+    struct cpu_result result = cpu_run(&cpu, bus, 100000);
+
+    assert(result.reason == CPU_STOP_TRAP);
+    assert(result.cycles == 256 * 2 + 255 * 3 + 2 + 3);
+    assert(cpu.x == 0);
+    assert(cpu.pc == TEST_ROM_OFFSET + 3);
+}
+
+// The 65C02 has no opcodes that jam
+#ifndef CPU_65C02
+
+void test_run_jam(void) {
+    uint8_t program[] = { 0xE8, 0xE8, 0x02 };           // INX, INX, JAM
+
+    const struct bus *bus = test_bus();
+    struct cpu cpu;
+
+    test_load_rom(program, sizeof(program));
+    cpu_init(&cpu, TEST_ROM_OFFSET);
+
+    struct cpu_result result = cpu_run(&cpu, bus, 100);
+
+    assert(result.reason == CPU_STOP_JAM);
+    assert(result.cycles == 4);
+    assert(cpu.x == 2);
+    assert(cpu.pc == TEST_ROM_OFFSET + 2);
+}
+
+#endif
+
+void test_run_break(void) {
+    uint8_t program[] = { 0xE8, 0xE8, 0xE8, 0x4C, 0x00, 0xF0 };    // INX x3, JMP $F000
+    static struct cpu_watch watch;
+    uint16_t at = TEST_ROM_OFFSET + 2;
+
+    const struct bus *bus = test_bus();
+    struct cpu cpu;
+
+    test_load_rom(program, sizeof(program));
+    cpu_init(&cpu, TEST_ROM_OFFSET);
+
+    cpu_watch_init(&watch);
+    cpu_watch_set(&watch, WATCH_EXEC | WATCH_READ, at, 1, 1);
+    cpu_watch_set(&watch, WATCH_READ, at, 1, 0);
+    cpu.watch = &watch;
+
+    // breakpoints alone leave the bus as it is
+    assert(!watch.accesses);
+
+    struct cpu_result result = cpu_run(&cpu, bus, 100);
+    assert(result.reason == CPU_STOP_BREAK);
+    assert(result.cycles == 4);
+    assert(cpu.pc == at);
+
+    // resuming runs the instruction at the breakpoint and stops there again
+    result = cpu_run(&cpu, bus, 100);
+    assert(result.reason == CPU_STOP_BREAK);
+    assert(result.cycles == 2 + 3 + 2 + 2);
+    assert(cpu.pc == at);
+    assert(cpu.x == 5);
+
+    // moving the PC off it means the next visit stops without running it
+    cpu.pc = TEST_ROM_OFFSET;
+    result = cpu_run(&cpu, bus, 100);
+    assert(result.reason == CPU_STOP_BREAK);
+    assert(result.cycles == 4);
+    assert(cpu.pc == at);
+    assert(cpu.x == 7);
+}
+
+static struct cpu *halting;
+
+static uint8_t halt_peek(void *inst, uint16_t addr) {
+    (void)inst;
+    return bus_peek(test_bus(), addr);
+}
+
+// Stops the CPU when it writes to $0300
+static void halt_poke(void *inst, uint16_t addr, uint8_t data) {
+    (void)inst;
+    bus_poke(test_bus(), addr, data);
+
+    if (addr == 0x0300) {
+        cpu_halt(halting);
+    }
+}
+
+void test_run_halt(void) {
+    uint8_t program[] = { 0xE8, 0x8E, 0x00, 0x03, 0xE8, 0x4C, 0x00, 0xF0 };   // INX, STX $0300, INX, JMP $F000
+
+    struct bus bus = { .peek = halt_peek, .poke = halt_poke };
+    struct cpu cpu;
+
+    test_load_rom(program, sizeof(program));
+    cpu_init(&cpu, TEST_ROM_OFFSET);
+    halting = &cpu;
+
+    struct cpu_result result = cpu_run(&cpu, &bus, 100);
+
+    assert(result.reason == CPU_STOP_HOST);
+    assert(result.cycles == 6);
+    assert(cpu.pc == TEST_ROM_OFFSET + 4);
+    assert(cpu.halt == 0);
+    assert(bus_peek(&bus, 0x0300) == 1);
+}
+
+static struct cpu_watch watch;
+
+// INX, STX $0300, LDA $0300, JMP $F000
+static const uint8_t watched[] = { 0xE8, 0x8E, 0x00, 0x03, 0xAD, 0x00, 0x03, 0x4C, 0x00, 0xF0 };
+
+void test_watch_exec(void) {
+    const struct bus *bus = test_bus();
+    struct cpu cpu;
+
+    test_load_rom(watched, sizeof(watched));
+    cpu_init(&cpu, TEST_ROM_OFFSET);
+    cpu_watch_init(&watch);
+    cpu_watch_set(&watch, WATCH_EXEC, TEST_ROM_OFFSET + 4, 1, 1);
+    cpu.watch = &watch;
+
+    // stops before LDA without running a cycle, then goes on through it
+    assert(cpu_step(&cpu, bus) == 0);
+    assert(cpu_step(&cpu, bus) == 0);
+    assert(cpu_step(&cpu, bus) == CPU_STOP_BREAK);
+    assert(cpu.pc == TEST_ROM_OFFSET + 4 && cpu.cycle == 0);
+    assert(watch.addr == TEST_ROM_OFFSET + 4);
+    assert(cpu_tick(&cpu, bus) == 0);
+    assert(cpu.cycle == 1);
+    assert(cpu_step(&cpu, bus) == 0);
+    assert(cpu.a == 1);
+
+    // the same under the instruction-atomic engine
+    assert(cpu_step_fast(&cpu, bus) == 3);
+    assert(cpu_run_fast(&cpu, bus, 100) == 2 + 4);
+    assert(watch.reason == CPU_STOP_BREAK);
+    assert(cpu.pc == TEST_ROM_OFFSET + 4);
+    assert(cpu_step_fast(&cpu, bus) == 4);
+
+    // and cpu_run(), which stops at it again on the next lap
+    struct cpu_result result = cpu_run(&cpu, bus, 100);
+    assert(result.reason == CPU_STOP_BREAK);
+    assert(result.cycles == 3 + 2 + 4);
+    assert(cpu.x == 3);
+
+    // disarmed
+    cpu.watch = NULL;
+    result = cpu_run(&cpu, bus, 30);
+    assert(result.reason == CPU_STOP_BUDGET);
+}
+
+void test_watch_access(void) {
+    const struct bus *bus = test_bus();
+    struct cpu cpu;
+
+    test_load_rom(watched, sizeof(watched));
+    cpu_init(&cpu, TEST_ROM_OFFSET);
+    cpu_watch_init(&watch);
+    cpu_watch_set(&watch, WATCH_WRITE, 0x0300, 1, 1);
+    cpu.watch = &watch;
+
+    // STX's write is its last cycle
+    assert(cpu_step(&cpu, bus) == 0);
+    assert(cpu_tick(&cpu, bus) == 0);
+    assert(cpu_step(&cpu, bus) == CPU_STOP_WRITE);
+    assert(cpu.cycle == 0);
+    assert(watch.addr == 0x0300 && watch.data == 1);
+    assert(bus_peek(bus, 0x0300) == 1);
+
+    // reads stop the cycle they happen in, partway through LDA
+    cpu_watch_set(&watch, WATCH_WRITE, 0x0300, 1, 0);
+    cpu_watch_set(&watch, WATCH_READ, 0x0300, 1, 1);
+    assert(cpu_step(&cpu, bus) == CPU_STOP_READ);
+    assert(cpu.cycle == 0 && cpu.a == 1);
+
+    // cpu_run() and cpu_run_fast() finish the instruction
+    struct cpu_result result = cpu_run(&cpu, bus, 100);
+    assert(result.reason == CPU_STOP_READ);
+    assert(result.cycles == 3 + 2 + 4 + 4);
+    assert(cpu.pc == TEST_ROM_OFFSET + 7 && cpu.a == 2);
+
+    assert(cpu_run_fast(&cpu, bus, 100) == 3 + 2 + 4 + 4);
+    assert(watch.reason == CPU_STOP_READ);
+    assert(cpu.a == 3);
+
+    // stack writes count too
+    uint8_t jsr[] = { 0x20, 0x00, 0xF0 };   // JSR $F000
+    test_load_rom(jsr, sizeof(jsr));
+    cpu_init(&cpu, TEST_ROM_OFFSET);
+    cpu_watch_init(&watch);
+    cpu_watch_set(&watch, WATCH_WRITE, 0x0100, 0x100, 1);
+    cpu.watch = &watch;
+
+    result = cpu_run(&cpu, bus, 100);
+    assert(result.reason == CPU_STOP_WRITE);
+    assert(result.cycles == 6);
+    assert(watch.addr == 0x01FF);
+}
+
+// ROM for the interrupt tests: `program` at $F000, an IRQ handler at $F100
+// that counts in X, and an NMI handler at $F200 that counts in Y
+static void load_interrupt_rom(const uint8_t *program, size_t size) {
+    static uint8_t rom[TEST_ROM_SIZE];
+
+    memset(rom, 0xEA, sizeof(rom));
+    memcpy(rom, program, size);
+
+    rom[0x100] = 0xE8;  // INX
+    rom[0x101] = 0x40;  // RTI
+    rom[0x200] = 0xC8;  // INY
+    rom[0x201] = 0x40;  // RTI
+
+    rom[0xFFA] = 0x00;  // NMI vector
+    rom[0xFFB] = 0xF2;
+    rom[0xFFE] = 0x00;  // IRQ/BRK vector
+    rom[0xFFF] = 0xF1;
+
+    test_load_rom(rom, sizeof(rom));
+}
+
+static int tick_instruction(struct cpu *cpu, const struct bus *bus) {
+    int cycles = 0;
+
+    do {
+        cpu_tick(cpu, bus);
+        cycles++;
+    } while (cpu->cycle != 0);
+
+    return cycles;
+}
+
+void test_irq(void) {
+    uint8_t program[] = { 0x58, 0xEA, 0xEA };  // CLI, NOP, NOP
+
+    const struct bus *bus = test_bus();
+    struct cpu cpu;
+
+    load_interrupt_rom(program, sizeof(program));
+    cpu_init(&cpu, TEST_ROM_OFFSET);
+    cpu_set_p(&cpu, P_I | P_C);
+
+    tick_instruction(&cpu, bus);
+
+    // asserted partway through the first NOP, taken when it ends
+    cpu_tick(&cpu, bus);
+    cpu_assert(&cpu, INTR_IRQ);
+    cpu_tick(&cpu, bus);
+    assert(cpu.cycle == 0);
+    assert(cpu.pc == TEST_ROM_OFFSET + 2);
+
+    assert(tick_instruction(&cpu, bus) == 7);
+    assert(cpu.pc == 0xF100);
+    assert(cpu.sp == 0xFC);
+    assert(bus_peek(bus, 0x01FF) == 0xF0);
+    assert(bus_peek(bus, 0x01FE) == 0x02);
+    assert(bus_peek(bus, 0x01FD) == (P_C | P_5));
+    assert(cpu_get_p(&cpu) & P_I);
+
+    // the handler's first instruction runs, RTI clears I and the line is
+    // still held, so the IRQ is taken again straight away
+    assert(tick_instruction(&cpu, bus) == 2);
+    assert(tick_instruction(&cpu, bus) == 6);
+    assert(cpu.pc == TEST_ROM_OFFSET + 2);
+    assert(tick_instruction(&cpu, bus) == 7);
+    assert(cpu.pc == 0xF100);
+
+    cpu_release(&cpu, INTR_IRQ);
+    tick_instruction(&cpu, bus);
+    tick_instruction(&cpu, bus);
+    tick_instruction(&cpu, bus);
+    assert(cpu.x == 2);
+    assert(cpu.pc == TEST_ROM_OFFSET + 3);
+}
+
+void test_irq_masked(void) {
+    uint8_t program[] = { 0xEA, 0xEA, 0x58, 0xEA, 0xEA };  // NOP, NOP, CLI, NOP, NOP
+
+    const struct bus *bus = test_bus();
+    struct cpu cpu;
+
+    load_interrupt_rom(program, sizeof(program));
+    cpu_init(&cpu, TEST_ROM_OFFSET);
+    cpu_set_p(&cpu, P_I);
+    cpu_assert(&cpu, INTR_IRQ);
+
+    assert(cpu_step_fast(&cpu, bus) == 2);
+    assert(cpu_step_fast(&cpu, bus) == 2);
+
+    // the instruction after CLI still runs before the IRQ is taken
+    assert(cpu_step_fast(&cpu, bus) == 2);
+    assert(cpu_step_fast(&cpu, bus) == 2);
+    assert(cpu.pc == TEST_ROM_OFFSET + 4);
+    assert(cpu_step_fast(&cpu, bus) == 7);
+    assert(cpu.pc == 0xF100);
+
+    // likewise when the threaded engine runs the masked instructions
+    cpu_init(&cpu, TEST_ROM_OFFSET);
+    cpu_set_p(&cpu, P_I);
+    cpu_assert(&cpu, INTR_IRQ);
+    assert(cpu_run_fast(&cpu, bus, 2 + 2 + 2) == 6);
+    assert(cpu_run_fast(&cpu, bus, 2) == 2);
+    assert(cpu.pc == TEST_ROM_OFFSET + 4);
+    assert(cpu_run_fast(&cpu, bus, 1) == 7);
+    assert(cpu.pc == 0xF100);
+}
+
+void test_irq_sei(void) {
+    uint8_t program[] = { 0x78, 0xEA };  // SEI, NOP
+
+    const struct bus *bus = test_bus();
+    struct cpu cpu;
+
+    load_interrupt_rom(program, sizeof(program));
+    cpu_init(&cpu, TEST_ROM_OFFSET);
+
+    // an IRQ that arrives during SEI is still taken after it, with I set
+    // in the pushed P
+    cpu_tick(&cpu, bus);
+    cpu_assert(&cpu, INTR_IRQ);
+    cpu_tick(&cpu, bus);
+
+    assert(tick_instruction(&cpu, bus) == 7);
+    assert(cpu.pc == 0xF100);
+    assert(bus_peek(bus, 0x01FD) == (P_I | P_5));
+
+    // and not again once it returns
+    tick_instruction(&cpu, bus);
+    tick_instruction(&cpu, bus);
+    assert(tick_instruction(&cpu, bus) == 2);
+    assert(cpu.pc == TEST_ROM_OFFSET + 2);
+}
+
+void test_nmi(void) {
+    uint8_t program[] = { 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA };
+
+    const struct bus *bus = test_bus();
+    struct cpu cpu;
+
+    load_interrupt_rom(program, sizeof(program));
+    cpu_init(&cpu, TEST_ROM_OFFSET);
+    cpu_set_p(&cpu, P_I);
+
+    // taken once for each rising edge, whatever I says
+    cpu_assert(&cpu, INTR_NMI);
+    assert(cpu_step_fast(&cpu, bus) == 7);
+    assert(cpu.pc == 0xF200);
+    assert(bus_peek(bus, 0x01FE) == 0x00);
+
+    cpu_step_fast(&cpu, bus);
+    cpu_step_fast(&cpu, bus);
+    assert(cpu.pc == TEST_ROM_OFFSET);
+
+    cpu_assert(&cpu, INTR_NMI);
+    assert(cpu_step_fast(&cpu, bus) == 2);
+    assert(cpu.pc == TEST_ROM_OFFSET + 1);
+
+    cpu_release(&cpu, INTR_NMI);
+    cpu_assert(&cpu, INTR_NMI);
+    assert(cpu_step_fast(&cpu, bus) == 7);
+    assert(cpu.pc == 0xF200);
+    assert(cpu.y == 1);
+    cpu_step_fast(&cpu, bus);
+    assert(cpu.y == 2);
+}
+
+void test_nmi_hijack(void) {
+    uint8_t program[] = { 0x00, 0x00 };  // BRK
+
+    const struct bus *bus = test_bus();
+    struct cpu cpu;
+
+    load_interrupt_rom(program, sizeof(program));
+    cpu_init(&cpu, TEST_ROM_OFFSET);
+
+    // an NMI partway through BRK sends it to the NMI handler, with B still
+    // set in the pushed P
+    cpu_tick(&cpu, bus);
+    cpu_tick(&cpu, bus);
+    cpu_tick(&cpu, bus);
+    cpu_assert(&cpu, INTR_NMI);
+
+    assert(tick_instruction(&cpu, bus) == 4);
+    assert(cpu.pc == 0xF200);
+    assert(bus_peek(bus, 0x01FD) == (P_B | P_5));
+    assert(!(cpu.intr & INTR_NMI));
+
+    // likewise an IRQ entry, with B clear
+    cpu_init(&cpu, TEST_ROM_OFFSET + 2);
+    cpu_assert(&cpu, INTR_IRQ);
+    cpu_tick(&cpu, bus);
+    cpu_tick(&cpu, bus);
+    cpu_assert(&cpu, INTR_NMI);
+
+    assert(tick_instruction(&cpu, bus) == 5);
+    assert(cpu.pc == 0xF200);
+    assert(bus_peek(bus, 0x01FD) == P_5);
+}
+
+static struct cpu *signalled;
+
+static uint8_t signal_peek(void *inst, uint16_t addr) {
+    (void)inst;
+    return bus_peek(test_bus(), addr);
+}
+
+// Writing $0300 asserts the lines in the value written
+static void signal_poke(void *inst, uint16_t addr, uint8_t data) {
+    (void)inst;
+    bus_poke(test_bus(), addr, data);
+
+    if (addr == 0x0300) {
+        cpu_assert(signalled, data);
+    }
+}
+
+void test_interrupt_run(void) {
+    uint8_t program[] = {
+        0x58,               // CLI
+        0xA9, INTR_IRQ,     // LDA #INTR_IRQ
+        0x8D, 0x00, 0x03,   // STA $0300
+        0xEA,               // NOP
+        0x4C, 0x06, 0xF0,   // JMP $F006
+    };
+
+    struct bus bus = { .peek = signal_peek, .poke = signal_poke };
+    struct cpu cpu;
+
+    load_interrupt_rom(program, sizeof(program));
+
+    // a device raises IRQ from a bus write, and the whole-instruction engines
+    // take it right after that instruction
+    cpu_init(&cpu, TEST_ROM_OFFSET);
+    signalled = &cpu;
+    assert(cpu_run_fast(&cpu, &bus, 2 + 2 + 4 + 7) == 15);
+    assert(cpu.pc == 0xF100);
+
+    cpu_init(&cpu, TEST_ROM_OFFSET);
+    struct cpu_result result = cpu_run(&cpu, &bus, 2 + 2 + 4 + 7);
+    assert(result.cycles == 15);
+    assert(cpu.pc == 0xF100);
+
+    // with I left set, it is held off and the run ends on budget
+    cpu_init(&cpu, TEST_ROM_OFFSET + 1);
+    cpu_set_p(&cpu, P_I);
+    assert(cpu_run_fast(&cpu, &bus, 1000) >= 1000);
+    assert(cpu.x == 0);
+    assert(cpu.intr == INTR_IRQ);
+    assert(cpu_get_p(&cpu) == P_I);
+}
+
+// Runs `program` from $F000 for `cycles` with and without idle skipping,
+// which must end in the same state, and returns the cycles skipped
+static uint64_t run_idle(const uint8_t *program, size_t size, uint64_t cycles) {
+    const struct bus *bus = test_bus();
+    struct cpu_idle idle = { 0 };
+    struct cpu plain;
+    struct cpu skipping;
+
+    load_interrupt_rom(program, size);
+    memset(bus->inst, 0, TEST_RAM_SIZE);
+
+    cpu_init(&plain, TEST_ROM_OFFSET);
+    struct cpu_result plain_result = cpu_run(&plain, bus, cycles);
+
+    memset(bus->inst, 0, TEST_RAM_SIZE);
+
+    cpu_init(&skipping, TEST_ROM_OFFSET);
+    skipping.idle = &idle;
+    struct cpu_result result = cpu_run(&skipping, bus, cycles);
+
+    assert(result.reason == CPU_STOP_BUDGET);
+    assert(result.cycles == plain_result.cycles || plain_result.reason == CPU_STOP_TRAP);
+    assert(skipping.pc == plain.pc || plain_result.reason == CPU_STOP_TRAP);
+    assert(skipping.a == plain.a && skipping.x == plain.x && skipping.y == plain.y);
+    assert(cpu_get_p(&skipping) == cpu_get_p(&plain));
+
+    return idle.skipped;
+}
+
+void test_idle_poll(void) {
+    uint8_t program[] = {
+        0xA2, 0x05,         //        LDX #$05
+        0xCA,               // count: DEX
+        0xD0, 0xFD,         //        BNE count
+        0x2C, 0x00, 0x03,   // wait:  BIT $0300
+        0x10, 0xFB,         //        BPL wait
+    };
+
+    // the count loop changes X each time round and is not skipped
+    uint64_t skipped = run_idle(program, sizeof(program), 100000 + 3);
+    assert(skipped > 99000);
+    assert(skipped % 7 == 0);
+}
+
+void test_idle_busy(void) {
+    uint8_t program[] = {
+        0xAD, 0x00, 0x03,   // loop:  LDA $0300
+        0x8D, 0x01, 0x03,   //        STA $0301
+        0x4C, 0x00, 0xF0,   //        JMP loop
+    };
+
+    assert(run_idle(program, sizeof(program), 10000) == 0);
+}
+
+void test_idle_self(void) {
+    uint8_t program[] = { 0x4C, 0x00, 0xF0 };   // JMP *
+
+    assert(run_idle(program, sizeof(program), 10001) == 9993);
+}
+
+void test_idle_interrupt(void) {
+    uint8_t program[] = { 0x58, 0x4C, 0x01, 0xF0 };   // CLI, JMP *
+
+    const struct bus *bus = test_bus();
+    struct cpu_idle idle = { 0 };
+    struct cpu cpu;
+
+    load_interrupt_rom(program, sizeof(program));
+    cpu_init(&cpu, TEST_ROM_OFFSET);
+    cpu.idle = &idle;
+
+    // a device that raises IRQ every 1000 cycles gets its handler run each time
+    for (int i = 0; i < 10; i++) {
+        cpu_run(&cpu, bus, 1000);
+        cpu_assert(&cpu, INTR_IRQ);
+        cpu_run(&cpu, bus, 7 + 2);
+        cpu_release(&cpu, INTR_IRQ);
+        assert(cpu.x == i + 1);
+    }
+
+    assert(idle.skipped > 9000);
+}
+
+#ifdef CPU_65C02
+
+// Each case runs one instruction from the start of ROM under cpu_tick() and
+// again under cpu_step_fast(), with the byte it works on at $0010 and a
+// pointer to it at $0020
+void test_65c02_instructions(void) {
+    const struct bus *bus = test_bus();
+
+    struct {
+        uint8_t prg[3];
+        uint8_t a;
+        uint8_t x;
+        uint8_t p;
+        uint8_t data;
+        uint8_t expected_a;
+        uint8_t expected_data;
+        uint8_t expected_p;
+        uint8_t length;
+        int cycles;
+    } tests[] = {
+        // STZ zp, zp,X, abs and abs,X
+        { { 0x64, 0x10 }, 0, 0, 0, 0xAA, 0, 0x00, 0, 2, 3 },
+        { { 0x74, 0x08 }, 0, 8, 0, 0xAA, 0, 0x00, 0, 2, 4 },
+        { { 0x9C, 0x10, 0x00 }, 0, 0, 0, 0xAA, 0, 0x00, 0, 3, 4 },
+        { { 0x9E, 0x08, 0x00 }, 0, 8, 0, 0xAA, 0, 0x00, 0, 3, 5 },
+        // TSB zp and TRB abs set Z from A & M
+        { { 0x04, 0x10 }, 0x0F, 0, 0, 0x30, 0x0F, 0x3F, P_Z, 2, 5 },
+        { { 0x1C, 0x10, 0x00 }, 0x30, 0, 0, 0x3F, 0x30, 0x0F, 0, 3, 6 },
+        // LDA (zp) and STA (zp)
+        { { 0xB2, 0x20 }, 0, 0, 0, 0x80, 0x80, 0x80, P_N, 2, 5 },
+        { { 0x92, 0x20 }, 0x55, 0, 0, 0x00, 0x55, 0x55, 0, 2, 5 },
+        // BIT #imm only sets Z, BIT zp,X sets N, V and Z
+        { { 0x89, 0x01 }, 0x02, 0, P_N | P_V, 0, 0x02, 0, P_N | P_V | P_Z, 2, 2 },
+        { { 0x34, 0x08 }, 0x00, 8, 0, 0xC0, 0x00, 0xC0, P_N | P_V | P_Z, 2, 4 },
+        // INC A and DEC A
+        { { 0x1A }, 0xFF, 0, 0, 0, 0x00, 0, P_Z, 1, 2 },
+        { { 0x3A }, 0x00, 0, 0, 0, 0xFF, 0, P_N, 1, 2 },
+        // ASL abs,X without a page cross
+        { { 0x1E, 0x10, 0x00 }, 0, 0, 0, 0x40, 0, 0x80, P_N, 3, 6 },
+        // decimal ADC sets N and Z from the result and takes a cycle more
+        { { 0x69, 0x01 }, 0x99, 0, P_D, 0, 0x00, 0, P_D | P_Z | P_C, 2, 3 },
+        { { 0x72, 0x20 }, 0x09, 0, P_D, 0x01, 0x10, 0x01, P_D, 2, 6 },
+        // undefined opcodes are NOPs
+        { { 0x03 }, 0, 0, 0, 0, 0, 0, 0, 1, 1 },
+        { { 0x02, 0xFF }, 0, 0, 0, 0, 0, 0, 0, 2, 2 },
+        { { 0x44, 0x10 }, 0, 0, 0, 0, 0, 0, 0, 2, 3 },
+        { { 0xDC, 0x10, 0x00 }, 0, 0, 0, 0, 0, 0, 0, 3, 4 },
+    };
+
+    for (size_t i = 0; i < COUNT(tests); i++) {
+        test_load_rom(tests[i].prg, 3);
+
+        for (int fast = 0; fast <= 1; fast++) {
+            uint8_t data[0x30] = { [0x10] = tests[i].data, [0x20] = 0x10, [0x21] = 0x00 };
+            test_load_ram(data, sizeof(data));
+
+            struct cpu cpu;
+            cpu_init(&cpu, TEST_ROM_OFFSET);
+            cpu.a = tests[i].a;
+            cpu.x = tests[i].x;
+            cpu_set_p(&cpu, tests[i].p);
+
+            int cycles = fast ? cpu_step_fast(&cpu, bus) : tick_instruction(&cpu, bus);
+
+            assert(cycles == tests[i].cycles);
+            assert(cpu.pc == TEST_ROM_OFFSET + tests[i].length);
+            assert(cpu.a == tests[i].expected_a);
+            assert(bus_peek(bus, 0x0010) == tests[i].expected_data);
+            assert(cpu_get_p(&cpu) == tests[i].expected_p);
+        }
+    }
+}
+
+void test_65c02_stack(void) {
+    uint8_t program[] = { 0xDA, 0x7A, 0x5A, 0xFA };    // PHX, PLY, PHY, PLX
+
+    const struct bus *bus = test_bus();
+    struct cpu cpu;
+
+    test_load_rom(program, sizeof(program));
+    cpu_init(&cpu, TEST_ROM_OFFSET);
+    cpu.x = 0x80;
+
+    assert(tick_instruction(&cpu, bus) == 3);
+    assert(cpu.sp == 0xFE);
+    assert(tick_instruction(&cpu, bus) == 4);
+    assert(cpu.y == 0x80);
+    assert(cpu_get_p(&cpu) == P_N);
+
+    cpu.y = 0x00;
+    assert(cpu_step_fast(&cpu, bus) == 3);
+    assert(cpu_step_fast(&cpu, bus) == 4);
+    assert(cpu.x == 0x00);
+    assert(cpu.sp == 0xFF);
+    assert(cpu_get_p(&cpu) == P_Z);
+}
+
+void test_65c02_jumps(void) {
+    const struct bus *bus = test_bus();
+
+    uint8_t data[0x0400] = { 0 };
+    data[0x02FF] = 0x00;    // JMP ($02FF) reads $0300 for the high byte,
+    data[0x0300] = 0xF1;    // not $0200
+    data[0x0200] = 0xEE;
+    data[0x0202] = 0x00;
+    data[0x0203] = 0xF2;
+    test_load_ram(data, sizeof(data));
+
+    struct {
+        uint8_t prg[3];
+        uint8_t x;
+        uint16_t expected_pc;
+        int cycles;
+    } tests[] = {
+        { { 0x6C, 0xFF, 0x02 }, 0, 0xF100, 6 },   // JMP ($02FF)
+        { { 0x7C, 0x00, 0x02 }, 2, 0xF200, 6 },   // JMP ($0200,X)
+        { { 0x80, 0x10 }, 0, TEST_ROM_OFFSET + 0x12, 3 },  // BRA
+    };
+
+    for (size_t i = 0; i < COUNT(tests); i++) {
+        test_load_rom(tests[i].prg, 3);
+
+        for (int fast = 0; fast <= 1; fast++) {
+            struct cpu cpu;
+            cpu_init(&cpu, TEST_ROM_OFFSET);
+            cpu.x = tests[i].x;
+
+            int cycles = fast ? cpu_step_fast(&cpu, bus) : tick_instruction(&cpu, bus);
+
+            assert(cycles == tests[i].cycles);
+            assert(cpu.pc == tests[i].expected_pc);
+        }
+    }
+}
+
+void test_65c02_brk(void) {
+    uint8_t program[] = { 0x00, 0x00 };                 // BRK
+
+    const struct bus *bus = test_bus();
+    struct cpu cpu;
+
+    load_interrupt_rom(program, sizeof(program));
+    cpu_init(&cpu, TEST_ROM_OFFSET);
+    cpu_set_p(&cpu, P_D);
+
+    assert(tick_instruction(&cpu, bus) == 7);
+    assert(cpu.pc == 0xF100);
+    assert(cpu_get_p(&cpu) == P_I);
+    assert(bus_peek(bus, 0x01FD) == (P_D | P_B | P_5));
+}
+
+#endif
+
 int main(void) {
     TEST_INIT();
 
@@ -1431,9 +2284,39 @@ int main(void) {
     TEST(test_jsr);
     TEST(test_adc);
     TEST(test_sbc);
+    TEST(test_decimal);
     TEST(test_cmp);
 
     TEST(test_simple_load_and_store);
 
+    TEST(test_run_budget);
+    TEST(test_run_trap);
+#ifndef CPU_65C02
+    TEST(test_run_jam);
+#endif
+    TEST(test_run_break);
+    TEST(test_run_halt);
+    TEST(test_watch_exec);
+    TEST(test_watch_access);
+
+    TEST(test_irq);
+    TEST(test_irq_masked);
+    TEST(test_irq_sei);
+    TEST(test_nmi);
+    TEST(test_nmi_hijack);
+    TEST(test_interrupt_run);
+
+    TEST(test_idle_poll);
+    TEST(test_idle_busy);
+    TEST(test_idle_self);
+    TEST(test_idle_interrupt);
+
+#ifdef CPU_65C02
+    TEST(test_65c02_instructions);
+    TEST(test_65c02_stack);
+    TEST(test_65c02_jumps);
+    TEST(test_65c02_brk);
+#endif
+
     return 0;
 }
@@ -0,0 +1,211 @@
+#include "dcache.h"
+#include "test.h"
+
+#define ORIGIN 0x0200
+
+static struct machine {
+    uint8_t memory[0x10000];
+} ref, cached;
+
+static uint8_t peek(void *inst, uint16_t addr) {
+    return ((struct machine *)inst)->memory[addr];
+}
+
+static void poke(void *inst, uint16_t addr, uint8_t data) {
+    ((struct machine *)inst)->memory[addr] = data;
+}
+
+static struct bus ref_bus = { .inst = &ref, .peek = peek, .poke = poke };
+static struct bus cached_bus = { .inst = &cached, .peek = peek, .poke = poke };
+
+static void load(const uint8_t *program, size_t program_n) {
+    memset(ref.memory, 0, sizeof(ref.memory));
+    memcpy(ref.memory + ORIGIN, program, program_n);
+    memcpy(cached.memory, ref.memory, sizeof(cached.memory));
+}
+
+static int same_state(const struct cpu *a, const struct cpu *b) {
+    return a->pc == b->pc && a->sp == b->sp && cpu_get_p(a) == cpu_get_p(b)
+        && a->a == b->a && a->x == b->x && a->y == b->y;
+}
+
+void test_self_modifying(void) {
+    uint8_t program[] = {
+        0xA9, 0x00,         // loop:  LDA #$00
+        0x18,               //        CLC
+        0x69, 0x01,         //        ADC #$01
+        0x8D, 0x01, 0x02,   //        STA loop + 1
+        0xE6, 0x40,         //        INC $40
+        0xA6, 0x40,         //        LDX $40
+        0xE0, 0x80,         //        CPX #$80
+        0xD0, 0xF0,         //        BNE loop
+        0xA9, 0x60,         //        LDA #$60 (RTS)
+        0x9D, 0x00, 0x03,   //        STA $0300,X
+        0x20, 0x80, 0x03,   //        JSR $0380
+        0x4C, 0x18, 0x02,   // done:  JMP done
+    };
+
+    load(program, sizeof(program));
+
+    struct cpu ref_cpu;
+    cpu_init(&ref_cpu, ORIGIN);
+
+    struct cpu cached_cpu;
+    cpu_init(&cached_cpu, ORIGIN);
+
+    struct dcache *dcache = dcache_create();
+    assert(dcache != NULL);
+
+    uint64_t ref_cycles = 0;
+    uint64_t cached_cycles = 0;
+
+    // one instruction at a time, so every write is checked as it happens
+    while (cached_cycles < 20000) {
+        cached_cycles += dcache_run(dcache, &cached_cpu, &cached_bus, 1);
+
+        while (ref_cycles < cached_cycles) {
+            ref_cycles += cpu_step_fast(&ref_cpu, &ref_bus);
+        }
+
+        assert(ref_cycles == cached_cycles);
+        assert(same_state(&ref_cpu, &cached_cpu));
+        assert(memcmp(ref.memory, cached.memory, sizeof(cached.memory)) == 0);
+    }
+
+    assert(cached.memory[ORIGIN + 1] == 0x80);
+    assert(cached_cpu.pc == 0x0218);
+
+    dcache_destroy(dcache);
+}
+
+// A block in page FF that runs on into page 0 must go when page 0 is written
+void test_wrap(void) {
+    uint8_t program[] = {
+        0xA9, 0x00,         // FFFF:  LDA #$00
+        0xE6, 0x00,         // 0001:  INC $00
+        0x4C, 0xFF, 0xFF,   // 0003:  JMP $FFFF
+    };
+
+    memset(ref.memory, 0, sizeof(ref.memory));
+    ref.memory[0xFFFF] = program[0];
+    memcpy(ref.memory, program + 1, sizeof(program) - 1);
+    memcpy(cached.memory, ref.memory, sizeof(cached.memory));
+
+    struct cpu ref_cpu;
+    cpu_init(&ref_cpu, 0xFFFF);
+
+    struct cpu cached_cpu;
+    cpu_init(&cached_cpu, 0xFFFF);
+
+    struct dcache *dcache = dcache_create();
+    assert(dcache != NULL);
+
+    uint64_t ref_cycles = 0;
+    uint64_t cached_cycles = 0;
+
+    while (cached_cycles < 2000) {
+        cached_cycles += dcache_run(dcache, &cached_cpu, &cached_bus, 1);
+
+        while (ref_cycles < cached_cycles) {
+            ref_cycles += cpu_step_fast(&ref_cpu, &ref_bus);
+        }
+
+        assert(ref_cycles == cached_cycles);
+        assert(same_state(&ref_cpu, &cached_cpu));
+    }
+
+    assert(cached_cpu.a != 0x00);
+
+    dcache_destroy(dcache);
+}
+
+void test_invalidate(void) {
+    uint8_t program[] = {
+        0xA9, 0x01,         // loop:  LDA #$01
+        0x4C, 0x00, 0x02,   //        JMP loop
+    };
+
+    load(program, sizeof(program));
+
+    struct cpu cpu;
+    cpu_init(&cpu, ORIGIN);
+
+    struct dcache *dcache = dcache_create();
+    dcache_run(dcache, &cpu, &cached_bus, 100);
+    assert(cpu.a == 0x01);
+
+    // the host changes the code behind the cache's back
+    cached.memory[ORIGIN + 1] = 0x02;
+    dcache_run(dcache, &cpu, &cached_bus, 100);
+    assert(cpu.a == 0x01);
+
+    dcache_invalidate(dcache, ORIGIN + 1);
+    dcache_run(dcache, &cpu, &cached_bus, 100);
+    assert(cpu.a == 0x02);
+
+    dcache_destroy(dcache);
+}
+
+void test_masked_irq(void) {
+    uint8_t program[] = {
+        0xA2, 0x00,         //        LDX #$00
+        0xE8,               // loop:  INX
+        0xE0, 0x40,         //        CPX #$40
+        0xD0, 0xFB,         //        BNE loop
+        0x58,               //        CLI
+        0xEA,               //        NOP
+        0xEA,               //        NOP
+        0x4C, 0x0A, 0x02,   // done:  JMP done
+    };
+
+    load(program, sizeof(program));
+
+    // a handler that counts and returns with I clear, so it runs again
+    ref.memory[0x0300] = 0xE6;  // INC $40
+    ref.memory[0x0301] = 0x40;
+    ref.memory[0x0302] = 0x40;  // RTI
+    ref.memory[0xFFFF] = 0x03;
+    memcpy(cached.memory, ref.memory, sizeof(cached.memory));
+
+    struct cpu ref_cpu;
+    cpu_init(&ref_cpu, ORIGIN);
+    cpu_set_p(&ref_cpu, P_I);
+    cpu_assert(&ref_cpu, INTR_IRQ);
+
+    struct cpu cached_cpu = ref_cpu;
+
+    struct dcache *dcache = dcache_create();
+    assert(dcache != NULL);
+
+    // the IRQ waits for the loop and the instruction after CLI
+    uint64_t ref_cycles = 0;
+    uint64_t cached_cycles = 0;
+
+    while (cached_cycles < 2000) {
+        cached_cycles += dcache_run(dcache, &cached_cpu, &cached_bus, 50);
+
+        while (ref_cycles < cached_cycles) {
+            ref_cycles += cpu_step_fast(&ref_cpu, &ref_bus);
+        }
+
+        assert(ref_cycles == cached_cycles);
+        assert(same_state(&ref_cpu, &cached_cpu));
+        assert(memcmp(ref.memory, cached.memory, sizeof(cached.memory)) == 0);
+    }
+
+    assert(cached_cpu.x == 0x40);
+    assert(cached.memory[0x40] > 10);
+
+    dcache_destroy(dcache);
+}
+
+int main(void) {
+    TEST_INIT();
+
+    TEST(test_self_modifying);
+    TEST(test_wrap);
+    TEST(test_invalidate);
+    TEST(test_masked_irq);
+
+    return 0;
+}
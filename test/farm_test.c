@@ -0,0 +1,115 @@
+#include <stdlib.h>
+
+#include "farm.h"
+#include "test.h"
+
+#define JOBS 300
+
+static uint8_t images[JOBS][0x10000];
+static uint8_t memory[JOBS][0x10000];
+static uint8_t expected[0x10000];
+static struct farm_job jobs[JOBS];
+
+static uint8_t peek(void *inst, uint16_t addr) {
+    return ((uint8_t *)inst)[addr];
+}
+
+static void poke(void *inst, uint16_t addr, uint8_t data) {
+    ((uint8_t *)inst)[addr] = data;
+}
+
+// Every job sums a table of its own for its own number of cycles, and must
+// end exactly where running it alone does.
+static void run_jobs(const struct farm_options *options) {
+    uint8_t program[] = {
+        0xA2, 0x00,         // start: LDX #$00
+        0x18,               // loop:  CLC
+        0x7D, 0x00, 0x03,   //        ADC $0300,X
+        0x9D, 0x00, 0x04,   //        STA $0400,X
+        0xE8,               //        INX
+        0xD0, 0xF7,         //        BNE loop
+        0xE6, 0x10,         //        INC $10
+        0x4C, 0x00, 0x02,   //        JMP start
+    };
+
+    uint32_t seed = 1;
+
+    for (size_t i = 0; i < JOBS; i++) {
+        memset(images[i], 0, 0x10000);
+        memcpy(images[i] + 0x0200, program, sizeof(program));
+
+        for (int addr = 0x0300; addr < 0x0400; addr++) {
+            seed = seed * 1103515245 + 12345;
+            images[i][addr] = seed >> 16;
+        }
+
+        jobs[i] = (struct farm_job){ .image = images[i], .memory = memory[i] };
+        cpu_init(&jobs[i].cpu, 0x0200);
+        jobs[i].cycles = 1000 + (seed >> 8) % 50000;
+    }
+
+    struct farm_stats stats;
+    assert(farm_run(jobs, JOBS, options, &stats) == 0);
+    assert(stats.threads >= 1);
+
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+
+    for (size_t i = 0; i < JOBS; i++) {
+        struct cpu cpu;
+        struct bus bus = { .inst = expected, .peek = peek, .poke = poke };
+        uint64_t ran = 0;
+        uint64_t n = 0;
+
+        memcpy(expected, images[i], 0x10000);
+        cpu_init(&cpu, 0x0200);
+        while (ran < jobs[i].cycles) {
+            ran += cpu_step_fast(&cpu, &bus);
+            n++;
+        }
+
+        assert(jobs[i].ran == ran);
+        assert(jobs[i].instructions == n);
+        assert(jobs[i].worker < stats.threads);
+        assert(jobs[i].cpu.pc == cpu.pc && jobs[i].cpu.a == cpu.a && jobs[i].cpu.x == cpu.x);
+        assert(cpu_get_p(&jobs[i].cpu) == cpu_get_p(&cpu));
+        assert(memcmp(memory[i], expected, 0x10000) == 0);
+
+        cycles += ran;
+        instructions += n;
+    }
+
+    assert(stats.cycles == cycles);
+    assert(stats.instructions == instructions);
+}
+
+void test_default(void) {
+    run_jobs(NULL);
+}
+
+void test_threads(void) {
+    struct farm_options options = { .threads = 7 };
+    run_jobs(&options);
+}
+
+void test_pinned(void) {
+    struct farm_options options = { .threads = 3, .pin = 1 };
+    run_jobs(&options);
+}
+
+void test_empty(void) {
+    struct farm_stats stats;
+    assert(farm_run(NULL, 0, NULL, &stats) == 0);
+    assert(stats.instructions == 0);
+}
+
+int main(void) {
+    TEST_INIT();
+
+    TEST(test_default);
+    TEST(test_threads);
+    TEST(test_pinned);
+    TEST(test_empty);
+
+    return 0;
+}
@@ -0,0 +1,275 @@
+#include <stdlib.h>
+
+#include "test.h"
+#include "fuzz.h"
+
+// A parser of the input at $0400: "BUG" jams, "W" writes $0300 and "L"
+// hangs in a loop. Everything else reaches the exit at $F027.
+static const uint8_t parser[] = {
+    0xAD, 0x00, 0x04,           // F000 LDA $0400
+    0xC9, 0x42,                 //      CMP #'B'
+    0xD0, 0x0F,                 //      BNE $F016
+    0xAD, 0x01, 0x04,           //      LDA $0401
+    0xC9, 0x55,                 //      CMP #'U'
+    0xD0, 0x08,                 //      BNE $F016
+    0xAD, 0x02, 0x04,           //      LDA $0402
+    0xC9, 0x47,                 //      CMP #'G'
+    0xD0, 0x01,                 //      BNE $F016
+    0x02,                       //      JAM
+    0xAD, 0x00, 0x04,           // F016 LDA $0400
+    0xC9, 0x57,                 //      CMP #'W'
+    0xD0, 0x03,                 //      BNE $F020
+    0x8D, 0x00, 0x03,           //      STA $0300
+    0xC9, 0x4C,                 // F020 CMP #'L'
+    0xD0, 0x03,                 //      BNE $F027
+    0x4C, 0x24, 0xF0,           // F024 JMP $F024
+    0x4C, 0x27, 0xF0,           // F027 JMP $F027
+};
+
+// Copies three bytes from the port at $4000 to $10-$12
+static const uint8_t reader[] = {
+    0xAD, 0x00, 0x40,           // F100 LDA $4000
+    0x85, 0x10,                 //      STA $10
+    0xAD, 0x00, 0x40,           //      LDA $4000
+    0x85, 0x11,                 //      STA $11
+    0xAD, 0x00, 0x40,           //      LDA $4000
+    0x85, 0x12,                 //      STA $12
+    0x4C, 0x0F, 0xF1,           // F10F JMP $F10F
+};
+
+static uint8_t ram[0x1000];
+static uint8_t rom[0x1000];
+
+static uint8_t device_peek(void *inst, uint16_t addr) {
+    (void)inst;
+    (void)addr;
+    return 0xFF;
+}
+
+static void device_poke(void *inst, uint16_t addr, uint8_t data) {
+    (void)inst;
+    (void)addr;
+    (void)data;
+}
+
+static void load(struct bus *bus, struct cpu *cpu, uint16_t pc) {
+    memset(ram, 0, sizeof(ram));
+    memset(rom, 0, sizeof(rom));
+    memcpy(rom, parser, sizeof(parser));
+    memcpy(rom + 0x100, reader, sizeof(reader));
+
+    *bus = (struct bus){ .peek = device_peek, .poke = device_poke };
+    bus_map(bus, 0x0000, 0x1000, ram);
+    bus_map_rom(bus, 0xF000, 0x1000, rom);
+
+    cpu_init(cpu, pc);
+}
+
+static struct fuzz *new_parser(void) {
+    struct bus bus;
+    struct cpu cpu;
+    load(&bus, &cpu, 0xF000);
+
+    struct fuzz_config config = {
+        .input_addr = 0x0400,
+        .input_size = 16,
+        .length = 1,
+        .length_addr = 0x0020,
+        .max_cycles = 10000,
+    };
+
+    struct fuzz *fuzz = fuzz_new(&cpu, &bus, &config);
+    assert(fuzz != NULL);
+    fuzz_exit(fuzz, 0xF027, 1);
+    return fuzz;
+}
+
+static enum fuzz_result run(struct fuzz *fuzz, const char *input) {
+    return fuzz_run(fuzz, (const uint8_t *)input, strlen(input));
+}
+
+// The number of edges in the map
+static int edges(const struct fuzz *fuzz) {
+    int n = 0;
+    for (int i = 0; i < FUZZ_MAP; i++) {
+        n += fuzz->map[i] != 0;
+    }
+    return n;
+}
+
+void test_results(void) {
+    struct fuzz *fuzz = new_parser();
+
+    assert(run(fuzz, "") == FUZZ_OK);
+    assert(fuzz->child->cpu.pc == 0xF027);
+    assert(run(fuzz, "BUX") == FUZZ_OK);
+    assert(run(fuzz, "BUG") == FUZZ_JAM);
+    assert(fuzz->child->cpu.pc == 0xF015);
+    assert(run(fuzz, "L") == FUZZ_TRAP);
+    assert(fuzz->child->cpu.pc == 0xF024);
+
+    // the input and its length are in place, and only for the run
+    assert(run(fuzz, "BUGS") == FUZZ_JAM);
+    assert(bus_peek(&fuzz->child->bus, 0x0403) == 'S');
+    assert(bus_peek(&fuzz->child->bus, 0x0020) == 4 && bus_peek(&fuzz->child->bus, 0x0021) == 0);
+    assert(run(fuzz, "W") == FUZZ_OK);
+    assert(bus_peek(&fuzz->child->bus, 0x0403) == 0);
+    assert(bus_peek(&fuzz->child->bus, 0x0300) == 'W');
+    assert(ram[0x0300] == 0 && ram[0x0400] == 0);
+
+    // the exit at the loop makes it a clean end
+    fuzz_exit(fuzz, 0xF024, 1);
+    assert(run(fuzz, "L") == FUZZ_OK);
+    fuzz_exit(fuzz, 0xF024, 0);
+
+    // watchpoints are crashes, and say where they were hit
+    static struct cpu_watch watch;
+    cpu_watch_init(&watch);
+    cpu_watch_set(&watch, WATCH_WRITE, 0x0300, 1, 1);
+    fuzz->child->cpu.watch = &watch;
+    assert(run(fuzz, "X") == FUZZ_OK);
+    assert(run(fuzz, "W") == FUZZ_WATCH);
+    assert(watch.reason == CPU_STOP_WRITE && watch.addr == 0x0300 && watch.data == 'W');
+
+    cpu_watch_set(&watch, WATCH_EXEC, 0xF024, 1, 1);
+    assert(run(fuzz, "L") == FUZZ_WATCH);
+    assert(watch.reason == CPU_STOP_BREAK && fuzz->child->cpu.pc == 0xF024);
+    fuzz->child->cpu.watch = NULL;
+
+    // a run that doesn't reach an exit in time
+    fuzz->config.max_cycles = 10;
+    assert(run(fuzz, "") == FUZZ_TIMEOUT);
+    assert(fuzz->cycles >= 10);
+
+    fuzz_free(fuzz);
+}
+
+void test_port(void) {
+    struct bus bus;
+    struct cpu cpu;
+    load(&bus, &cpu, 0xF100);
+
+    struct fuzz_config config = { .port = 1, .port_addr = 0x4000, .max_cycles = 1000 };
+
+    // the port's page must go to the callbacks
+    bus_map(&bus, 0x4000, 0x100, ram);
+    assert(fuzz_new(&cpu, &bus, &config) == NULL);
+    bus_unmap(&bus, 0x4000, 0x100);
+
+    struct fuzz *fuzz = fuzz_new(&cpu, &bus, &config);
+    assert(fuzz != NULL);
+    fuzz_exit(fuzz, 0xF10F, 1);
+
+    assert(run(fuzz, "hi") == FUZZ_OK);
+    assert(bus_peek(&fuzz->child->bus, 0x10) == 'h');
+    assert(bus_peek(&fuzz->child->bus, 0x11) == 'i');
+    assert(bus_peek(&fuzz->child->bus, 0x12) == 0);
+
+    // the rest of the page is still the device's
+    assert(bus_peek(&fuzz->child->bus, 0x4001) == 0xFF);
+
+    fuzz_free(fuzz);
+}
+
+void test_coverage(void) {
+    struct fuzz *fuzz = new_parser();
+
+    // each new byte of "BUG" finds new edges, and the same input finds none
+    static const char *inputs[] = { "", "B", "BU", "BUG" };
+    int last = 0;
+    for (size_t i = 0; i < COUNT(inputs); i++) {
+        run(fuzz, inputs[i]);
+        int n = edges(fuzz);
+        assert(n > last);
+        run(fuzz, inputs[i]);
+        assert(edges(fuzz) == n);
+        last = n;
+    }
+
+    // and the counts go up with each run
+    memset(fuzz->map, 0, FUZZ_MAP);
+    run(fuzz, "");
+    run(fuzz, "");
+    int twice = 0;
+    for (int i = 0; i < FUZZ_MAP; i++) {
+        assert(fuzz->map[i] == 0 || fuzz->map[i] == 2);
+        twice += fuzz->map[i] == 2;
+    }
+    assert(twice > 0);
+
+    fuzz_free(fuzz);
+}
+
+// A small fuzzer: mutate one byte of an input from the corpus, and keep the
+// result if it finds an edge no input has. It finds "BUG" byte by byte
+// where random inputs would take millions of runs.
+void test_guided(void) {
+    struct fuzz *fuzz = new_parser();
+    static uint8_t seen[FUZZ_MAP];
+    static uint8_t corpus[64][3];
+    int corpus_n = 1;
+    uint32_t rng = 1;
+    int found = 0;
+
+    memset(seen, 0, sizeof(seen));
+    memset(corpus, 0, sizeof(corpus));
+
+    for (int i = 0; i < 100000 && !found; i++) {
+        uint8_t input[3];
+        rng = rng * 1103515245 + 12345;
+        memcpy(input, corpus[(rng >> 16) % corpus_n], 3);
+        rng = rng * 1103515245 + 12345;
+        input[(rng >> 16) % 3] = rng >> 24;
+
+        memset(fuzz->map, 0, FUZZ_MAP);
+        enum fuzz_result result = fuzz_run(fuzz, input, 3);
+        found = result == FUZZ_JAM;
+
+        int new = 0;
+        for (int e = 0; e < FUZZ_MAP; e++) {
+            if (fuzz->map[e] && !seen[e]) {
+                seen[e] = 1;
+                new = 1;
+            }
+        }
+        if (new && corpus_n < 64) {
+            memcpy(corpus[corpus_n++], input, 3);
+        }
+    }
+
+    assert(found);
+    fuzz_free(fuzz);
+}
+
+// A held IRQ that I masks doesn't hide crashes
+void test_masked_irq(void) {
+    struct bus bus;
+    struct cpu cpu;
+    load(&bus, &cpu, 0xF000);
+    cpu_set_p(&cpu, P_I);
+    cpu_assert(&cpu, INTR_IRQ);
+
+    struct fuzz_config config = { .input_addr = 0x0400, .input_size = 16, .max_cycles = 10000 };
+    struct fuzz *fuzz = fuzz_new(&cpu, &bus, &config);
+    assert(fuzz != NULL);
+    fuzz_exit(fuzz, 0xF027, 1);
+
+    assert(run(fuzz, "") == FUZZ_OK);
+    assert(run(fuzz, "BUG") == FUZZ_JAM);
+    assert(run(fuzz, "L") == FUZZ_TRAP);
+    assert(fuzz->child->cpu.pc == 0xF024 && fuzz->child->cpu.sp == 0xFF);
+
+    fuzz_free(fuzz);
+}
+
+int main(void) {
+    TEST_INIT();
+
+    TEST(test_results);
+    TEST(test_port);
+    TEST(test_masked_irq);
+    TEST(test_coverage);
+    TEST(test_guided);
+
+    return 0;
+}
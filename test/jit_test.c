@@ -0,0 +1,377 @@
+#include <stdio.h>
+
+#include "jit.h"
+#include "test.h"
+
+#define ORIGIN 0x0200
+
+static struct machine {
+    uint8_t memory[0x10000];
+} ref, jit;
+
+static uint8_t peek(void *inst, uint16_t addr) {
+    return ((struct machine *)inst)->memory[addr];
+}
+
+static void poke(void *inst, uint16_t addr, uint8_t data) {
+    ((struct machine *)inst)->memory[addr] = data;
+}
+
+static int same_state(const struct cpu *a, const struct cpu *b) {
+    return a->pc == b->pc && a->sp == b->sp && cpu_get_p(a) == cpu_get_p(b)
+        && a->a == b->a && a->x == b->x && a->y == b->y;
+}
+
+// Runs `program` under the JIT a block at a time, checking cycles, registers
+// and memory against cpu_step_fast() at every exit.
+static void check(const uint8_t *program, size_t program_n, uint64_t cycles, int mapped) {
+    struct bus ref_bus = { .inst = &ref, .peek = peek, .poke = poke };
+    struct bus jit_bus = { .inst = &jit, .peek = peek, .poke = poke };
+
+    memset(ref.memory, 0, sizeof(ref.memory));
+    memcpy(ref.memory + ORIGIN, program, program_n);
+    memcpy(jit.memory, ref.memory, sizeof(jit.memory));
+
+    struct cpu ref_cpu;
+    cpu_init(&ref_cpu, ORIGIN);
+
+    struct cpu jit_cpu;
+    cpu_init(&jit_cpu, ORIGIN);
+
+    if (mapped) {
+        bus_map(&jit_bus, 0x0000, 0x10000, jit.memory);
+    }
+
+    struct jit *j = jit_create();
+    assert(j != NULL);
+
+    uint64_t ref_cycles = 0;
+    uint64_t jit_cycles = 0;
+
+    while (jit_cycles < cycles) {
+        jit_cycles += jit_run(j, &jit_cpu, &jit_bus, 1);
+
+        while (ref_cycles < jit_cycles) {
+            ref_cycles += cpu_step_fast(&ref_cpu, &ref_bus);
+        }
+
+        assert(ref_cycles == jit_cycles);
+        assert(same_state(&ref_cpu, &jit_cpu));
+        assert(memcmp(ref.memory, jit.memory, sizeof(jit.memory)) == 0);
+    }
+
+    jit_destroy(j);
+}
+
+void test_instructions(void) {
+    uint8_t program[] = {
+        0xA2, 0x7F,         //        LDX #$7F
+        0x86, 0x50,         //        STX $50
+        0xB5, 0x10,         // loop:  LDA $10,X
+        0x69, 0x03,         //        ADC #$03
+        0x95, 0x10,         //        STA $10,X
+        0x0A,               //        ASL A
+        0x26, 0x30,         //        ROL $30
+        0x66, 0x31,         //        ROR $31
+        0x46, 0x32,         //        LSR $32
+        0xE6, 0x33,         //        INC $33
+        0xCE, 0x00, 0x05,   //        DEC $0500
+        0x24, 0x34,         //        BIT $34
+        0x2C, 0x00, 0x05,   //        BIT $0500
+        0xC9, 0x40,         //        CMP #$40
+        0xE0, 0x20,         //        CPX #$20
+        0xC4, 0x30,         //        CPY $30
+        0x48,               //        PHA
+        0x08,               //        PHP
+        0x38,               //        SEC
+        0xF8,               //        SED
+        0x28,               //        PLP
+        0x68,               //        PLA
+        0x45, 0x31,         //        EOR $31
+        0x25, 0x32,         //        AND $32
+        0x0D, 0x00, 0x05,   //        ORA $0500
+        0xA8,               //        TAY
+        0xB6, 0x10,         //        LDX $10,Y
+        0x96, 0x20,         //        STX $20,Y
+        0xAE, 0x90, 0x02,   //        LDX $0290
+        0x8C, 0x01, 0x05,   //        STY $0501
+        0xA6, 0x50,         //        LDX $50
+        0xCA,               //        DEX
+        0x86, 0x50,         //        STX $50
+        0x10, 0xC4,         //        BPL loop
+        0x4C, 0x40, 0x02,   // done:  JMP done
+    };
+
+    check(program, sizeof(program), 20000, 0);
+    check(program, sizeof(program), 20000, 1);
+}
+
+void test_branches(void) {
+    uint8_t program[] = {
+        0xA2, 0x00,         //        LDX #$00
+        0xE8,               // loop:  INX
+        0x8A,               //        TXA
+        0x29, 0x03,         //        AND #$03
+        0xF0, 0x05,         //        BEQ skip
+        0x18,               //        CLC
+        0x90, 0x02,         //        BCC skip
+        0xB8,               //        CLV
+        0xEA,               //        NOP
+        0x70, 0xF3,         // skip:  BVS loop
+        0xE0, 0xF0,         //        CPX #$F0
+        0xD0, 0x04,         //        BNE far
+        0x4C, 0x13, 0x02,   // done:  JMP done
+        0x00,               //        (padding)
+        0x4C, 0x02, 0x02,   // far:   JMP loop
+    };
+
+    check(program, sizeof(program), 20000, 0);
+    check(program, sizeof(program), 20000, 1);
+}
+
+void test_self_modifying(void) {
+    uint8_t program[] = {
+        0xA9, 0x00,         // loop:  LDA #$00
+        0x18,               //        CLC
+        0x69, 0x01,         //        ADC #$01
+        0x8D, 0x01, 0x02,   //        STA loop + 1
+        0xE6, 0x40,         //        INC $40
+        0xA6, 0x40,         //        LDX $40
+        0xE0, 0x80,         //        CPX #$80
+        0xD0, 0xF0,         //        BNE loop
+        0xA9, 0x60,         //        LDA #$60 (RTS)
+        0x9D, 0x00, 0x03,   //        STA $0300,X
+        0x20, 0x80, 0x03,   //        JSR $0380
+        0x4C, 0x18, 0x02,   // done:  JMP done
+    };
+
+    check(program, sizeof(program), 20000, 0);
+    check(program, sizeof(program), 20000, 1);
+
+    // every pass stored the new immediate before it was read again
+    assert(jit.memory[ORIGIN + 1] == 0x80);
+    assert(jit.memory[0x0380] == 0x60);
+}
+
+// I as the interrupt check sees it must come through translated CLI, SEI
+// and PLP, and the instructions after them
+void test_interrupts(void) {
+    struct bus bus = { .inst = &jit, .peek = peek, .poke = poke };
+    struct cpu cpu;
+
+    // a loop made hot with I clear, then entered through SEI and run from its
+    // translation while an IRQ is held masked
+    uint8_t masked[] = {
+        0x78,               //        SEI
+        0x4C, 0x01, 0x02,   // loop:  JMP loop
+    };
+
+    memset(jit.memory, 0, sizeof(jit.memory));
+    memcpy(jit.memory + ORIGIN, masked, sizeof(masked));
+    jit.memory[0xFFFE] = 0x00;
+    jit.memory[0xFFFF] = 0x03;
+
+    struct jit *j = jit_create();
+    assert(j != NULL);
+
+    cpu_init(&cpu, ORIGIN + 1);
+    jit_run(j, &cpu, &bus, 100);
+    cpu.pc = ORIGIN;
+    jit_run(j, &cpu, &bus, 100);
+    cpu_assert(&cpu, INTR_IRQ);
+    jit_run(j, &cpu, &bus, 100);
+    assert(cpu.pc == ORIGIN + 1 && cpu.sp == 0xFF);
+
+    // a loop that pulls I clear takes the IRQ each time round, as the
+    // handler returns with I set
+    uint8_t unmasked[] = {
+        0xA9, 0x00,         // loop:  LDA #$00
+        0x48,               //        PHA
+        0x28,               //        PLP
+        0x4C, 0x00, 0x02,   //        JMP loop
+    };
+    uint8_t handler[] = {
+        0xE6, 0x40,         //        INC $40
+        0x68,               //        PLA
+        0x09, 0x04,         //        ORA #$04
+        0x48,               //        PHA
+        0x40,               //        RTI
+    };
+
+    memcpy(jit.memory + ORIGIN, unmasked, sizeof(unmasked));
+    memcpy(jit.memory + 0x0300, handler, sizeof(handler));
+    bus_map(&bus, 0x0000, 0x10000, jit.memory);
+    jit_remap(j, 0x0000, 0x10000);
+    cpu_init(&cpu, ORIGIN);
+    cpu_set_p(&cpu, P_I);
+    cpu_assert(&cpu, INTR_IRQ);
+    jit_run(j, &cpu, &bus, 2000);
+    assert(jit.memory[0x40] > 10);
+
+    // and so does one with CLI
+    uint8_t cli[] = {
+        0x78,               // loop:  SEI
+        0xEA,               //        NOP
+        0x58,               //        CLI
+        0xEA,               //        NOP
+        0x4C, 0x00, 0x02,   //        JMP loop
+    };
+
+    memcpy(jit.memory + ORIGIN, cli, sizeof(cli));
+    jit_invalidate(j, ORIGIN);
+    cpu_init(&cpu, ORIGIN);
+    cpu_assert(&cpu, INTR_IRQ);
+    jit.memory[0x40] = 0;
+    jit_run(j, &cpu, &bus, 2000);
+    assert(jit.memory[0x40] > 10);
+
+    jit_destroy(j);
+}
+
+// A device behind $4000 that asserts the IRQ on its fifth write
+static struct cpu *device_cpu;
+static int device_writes;
+
+static void device_poke(void *inst, uint16_t addr, uint8_t data) {
+    poke(inst, addr, data);
+    if (addr == 0x4000 && ++device_writes == 5) {
+        cpu_assert(device_cpu, INTR_IRQ);
+    }
+}
+
+// An IRQ raised in the middle of a translated block is taken after the
+// instruction that raised it, not at the end of the block
+void test_latency(void) {
+    uint8_t program[] = {
+        0x58,               //        CLI
+        0xA2, 0x00,         // loop:  LDX #$00
+        0x8D, 0x00, 0x40,   //        STA $4000
+        0xE8, 0xE8, 0xE8,   //        INX, INX, INX
+        0xE8, 0xE8, 0xE8,   //        INX, INX, INX
+        0x4C, 0x01, 0x02,   //        JMP loop
+    };
+    uint8_t handler[] = {
+        0x86, 0x41,         //        STX $41
+        0x4C, 0x02, 0x03,   // done:  JMP done
+    };
+
+    memset(jit.memory, 0, sizeof(jit.memory));
+    memcpy(jit.memory + ORIGIN, program, sizeof(program));
+    memcpy(jit.memory + 0x0300, handler, sizeof(handler));
+    jit.memory[0xFFFE] = 0x00;
+    jit.memory[0xFFFF] = 0x03;
+    jit.memory[0x41] = 0xFF;
+
+    struct bus bus = { .inst = &jit, .peek = peek, .poke = device_poke };
+    bus_map(&bus, 0x0000, 0x4000, jit.memory);
+
+    struct cpu cpu;
+    cpu_init(&cpu, ORIGIN);
+    device_cpu = &cpu;
+    device_writes = 0;
+
+    struct jit *j = jit_create();
+    assert(j != NULL);
+    jit_run(j, &cpu, &bus, 2000);
+    assert(device_writes == 5 && jit.memory[0x41] == 0);
+    assert(cpu.pc == 0x0302);
+
+    jit_destroy(j);
+}
+
+// Translations follow the bus's page tables once told they changed, for
+// data and for code
+void test_remap(void) {
+    static uint8_t banks[2][0x100];
+    uint8_t program[] = {
+        0xAD, 0x00, 0x40,   // loop:  LDA $4000
+        0x85, 0x10,         //        STA $10
+        0x20, 0x00, 0x50,   //        JSR $5000
+        0x4C, 0x00, 0x02,   //        JMP loop
+    };
+
+    for (int bank = 0; bank < 2; bank++) {
+        banks[bank][0x00] = 0xA0 + bank;
+        banks[bank][0x01] = 0xA9;                       // LDA #bank
+        banks[bank][0x02] = bank;
+        banks[bank][0x03] = 0x85;                       // STA $11
+        banks[bank][0x04] = 0x11;
+        banks[bank][0x05] = 0x60;                       // RTS
+    }
+
+    memset(jit.memory, 0, sizeof(jit.memory));
+    memcpy(jit.memory + ORIGIN, program, sizeof(program));
+
+    struct bus bus = { .inst = &jit, .peek = peek, .poke = poke };
+    bus_map(&bus, 0x0000, 0x1000, jit.memory);
+    bus_map_rom(&bus, 0x4000, 0x100, banks[0]);
+    bus_map_rom(&bus, 0x5000, 0x100, banks[0] + 1);
+
+    struct jit *j = jit_create();
+    assert(j != NULL);
+
+    struct cpu cpu;
+    cpu_init(&cpu, ORIGIN);
+    jit_run(j, &cpu, &bus, 2000);
+    assert(jit.memory[0x10] == 0xA0 && jit.memory[0x11] == 0);
+
+    bus_map_rom(&bus, 0x4000, 0x100, banks[1]);
+    jit_remap(j, 0x4000, 0x100);
+    jit_run(j, &cpu, &bus, 2000);
+    assert(jit.memory[0x10] == 0xA1 && jit.memory[0x11] == 0);
+
+    bus_map_rom(&bus, 0x5000, 0x100, banks[1] + 1);
+    jit_remap(j, 0x5000, 0x100);
+    jit_run(j, &cpu, &bus, 2000);
+    assert(jit.memory[0x10] == 0xA1 && jit.memory[0x11] == 1);
+
+    jit_destroy(j);
+}
+
+// Translated code never sits in memory that is writable and executable
+void test_wx(void) {
+    uint8_t program[] = {
+        0xE6, 0x40,         // loop:  INC $40
+        0x4C, 0x00, 0x02,   //        JMP loop
+    };
+
+    memset(jit.memory, 0, sizeof(jit.memory));
+    memcpy(jit.memory + ORIGIN, program, sizeof(program));
+
+    struct bus bus = { .inst = &jit, .peek = peek, .poke = poke };
+    struct cpu cpu;
+    cpu_init(&cpu, ORIGIN);
+
+    struct jit *j = jit_create();
+    assert(j != NULL);
+    jit_run(j, &cpu, &bus, 2000);
+
+#ifdef __linux__
+    FILE *maps = fopen("/proc/self/maps", "r");
+    assert(maps != NULL);
+
+    char line[512], perms[5];
+    while (fgets(line, sizeof(line), maps) != NULL) {
+        assert(sscanf(line, "%*x-%*x %4s", perms) == 1);
+        assert(!(perms[1] == 'w' && perms[2] == 'x'));
+    }
+
+    fclose(maps);
+#endif
+
+    jit_destroy(j);
+}
+
+int main(void) {
+    TEST_INIT();
+
+    TEST(test_instructions);
+    TEST(test_branches);
+    TEST(test_self_modifying);
+    TEST(test_interrupts);
+    TEST(test_latency);
+    TEST(test_remap);
+    TEST(test_wx);
+
+    return 0;
+}
@@ -0,0 +1,154 @@
+#include "test.h"
+#include "loader.h"
+
+#define FUNCTIONAL_TEST "./test/6502_functional_test/6502_functional_test.bin"
+
+static uint8_t memory[0x10000];
+
+void test_raw(void) {
+    struct image image;
+    assert(image_open(&image, FUNCTIONAL_TEST, IMAGE_AUTO) == 0);
+    assert(image.format == IMAGE_RAW);
+    assert(image.segments_n == 1);
+    assert(image.segments[0].addr == 0x0000 && image.segments[0].size == 0x10000);
+
+    // straight from the mapping
+    assert(image.segments[0].data == image.file);
+    assert(image.has_vector);
+    assert(image.reset == (image.file[0xFFFD] << 8 | image.file[0xFFFC]));
+
+    struct bus bus = { .peek = test_zero_peek, .poke = test_ignore_poke };
+    assert(image_map(&image, &bus) == 0);
+    assert(bus.read[0x34] == image.file + 0x3400);
+    assert(bus.write[0x34] == NULL);
+    assert(bus_peek(&bus, 0x3469) == image.file[0x3469]);
+
+    image_close(&image);
+
+    // a short image ends at 0xFFFF
+    static const uint8_t rom[0x1000] = { [0xFFC] = 0x00, [0xFFD] = 0xF0 };
+    assert(image_parse(&image, rom, sizeof(rom), IMAGE_RAW) == 0);
+    assert(image.segments[0].addr == 0xF000);
+    assert(image.reset == 0xF000);
+    image_close(&image);
+
+    assert(image_open(&image, "./test/no_such_image.bin", IMAGE_AUTO) == -1);
+}
+
+void test_prg(void) {
+    static uint8_t prg[2 + 0x300];
+    prg[0] = 0x01;
+    prg[1] = 0x08;
+    for (int i = 0; i < 0x300; i++) {
+        prg[2 + i] = i;
+    }
+
+    struct image image;
+    assert(image_parse(&image, prg, sizeof(prg), IMAGE_PRG) == 0);
+    assert(image.segments_n == 1);
+    assert(image.segments[0].addr == 0x0801 && image.segments[0].size == 0x300);
+    assert(image.reset == 0x0801 && !image.has_vector);
+
+    memset(memory, 0, sizeof(memory));
+    image_copy(&image, memory);
+    assert(memory[0x0801] == 0x00 && memory[0x0B00] == 0xFF);
+    assert(memory[0xFFFC] == 0x01 && memory[0xFFFD] == 0x08);
+
+    // only 0x0900-0x0AFF are whole pages
+    struct bus bus = { .peek = test_zero_peek, .poke = test_ignore_poke };
+    assert(image_map(&image, &bus) == 0x100);
+    assert(bus.read[0x08] == NULL && bus.read[0x0B] == NULL);
+    assert(bus_peek(&bus, 0x0900) == 0xFF);
+    assert(bus_peek(&bus, 0x0A00) == 0xFF);
+    assert(bus_peek(&bus, 0x0A01) == 0x00);
+
+    image_close(&image);
+
+    assert(image_parse(&image, prg, 1, IMAGE_PRG) == -1);
+}
+
+void test_ines(void) {
+    // UxROM, 4 banks of PRG whose bytes are their bank numbers, 8K of CHR
+    static uint8_t rom[16 + 512 + 4 * 0x4000 + 0x2000];
+    memset(rom, 0, sizeof(rom));
+    memcpy(rom, "NES\x1A", 4);
+    rom[4] = 4;
+    rom[5] = 1;
+    rom[6] = 0x20 | 0x04;       // mapper 2 with a trainer
+
+    uint8_t *prg = rom + 16 + 512;
+    for (int i = 0; i < 4 * 0x4000; i++) {
+        prg[i] = i / 0x4000;
+    }
+    prg[3 * 0x4000 + 0x3FFC] = 0x00;
+    prg[3 * 0x4000 + 0x3FFD] = 0xC0;
+
+    struct image image;
+    assert(image_parse(&image, rom, sizeof(rom), IMAGE_AUTO) == 0);
+    assert(image.format == IMAGE_INES);
+    assert(image.mapper == 2);
+    assert(image.prg == prg && image.prg_size == 4 * 0x4000);
+    assert(image.chr == prg + 4 * 0x4000 && image.chr_size == 0x2000);
+    assert(image.has_vector && image.reset == 0xC000);
+
+    struct mapper mapper;
+    assert(image_mapper(&image, &mapper, NULL, test_zero_peek, test_ignore_poke) == 0);
+    assert(mapper.bus.read[0x80] == prg);
+    assert(bus_peek(&mapper.bus, 0xC000) == 3);
+    bus_poke(&mapper.bus, 0x8000, 2);
+    assert(bus_peek(&mapper.bus, 0x8000) == 2);
+
+    image_close(&image);
+
+    // MMC3 isn't there
+    rom[6] = 0x40;
+    assert(image_parse(&image, rom, sizeof(rom) - 512, IMAGE_INES) == 0);
+    assert(image_mapper(&image, &mapper, NULL, test_zero_peek, test_ignore_poke) == -1);
+    image_close(&image);
+
+    // truncated
+    assert(image_parse(&image, rom, 16 + 0x4000, IMAGE_INES) == -1);
+}
+
+void test_hex(void) {
+    const char *text =
+        ":03000000010203F7\r\n"
+        ":02000300AABB96\r\n"
+        ":01100000EE01\r\n"
+        ":0400000300001234B3\r\n"
+        ":00000001FF\r\n";
+
+    struct image image;
+    assert(image_parse(&image, (const uint8_t *)text, strlen(text), IMAGE_AUTO) == 0);
+    assert(image.format == IMAGE_HEX);
+    assert(image.segments_n == 2);
+    assert(image.segments[0].addr == 0x0000 && image.segments[0].size == 5);
+    assert(image.segments[1].addr == 0x1000 && image.segments[1].size == 1);
+    assert(image.reset == 0x1234 && !image.has_vector);
+
+    memset(memory, 0, sizeof(memory));
+    image_copy(&image, memory);
+    assert(memcmp(memory, "\x01\x02\x03\xAA\xBB", 5) == 0);
+    assert(memory[0x1000] == 0xEE);
+    assert(memory[0xFFFC] == 0x34 && memory[0xFFFD] == 0x12);
+
+    image_close(&image);
+
+    // a bad checksum, and no end record
+    const char *bad = ":03000000010203F8\n:00000001FF\n";
+    assert(image_parse(&image, (const uint8_t *)bad, strlen(bad), IMAGE_HEX) == -1);
+
+    const char *unended = ":03000000010203F7\n";
+    assert(image_parse(&image, (const uint8_t *)unended, strlen(unended), IMAGE_HEX) == -1);
+}
+
+int main(void) {
+    TEST_INIT();
+
+    TEST(test_raw);
+    TEST(test_prg);
+    TEST(test_ines);
+    TEST(test_hex);
+
+    return 0;
+}
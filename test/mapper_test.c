@@ -0,0 +1,305 @@
+#include "test.h"
+#include "mapper.h"
+
+static uint8_t io[0x10000];
+
+static uint8_t io_peek(void *inst, uint16_t addr) {
+    return ((uint8_t *)inst)[addr];
+}
+
+static void io_poke(void *inst, uint16_t addr, uint8_t data) {
+    ((uint8_t *)inst)[addr] = data;
+}
+
+static uint32_t remaps;
+
+static void count_remaps(void *ctx, uint16_t addr, uint32_t size) {
+    (void)ctx;
+    (void)addr;
+    (void)size;
+    remaps++;
+}
+
+// PRG ROM whose every byte is the number of the 16K bank it is in
+static uint8_t prg[8 * 0x4000];
+
+static void fill_prg(void) {
+    for (uint32_t i = 0; i < sizeof(prg); i++) {
+        prg[i] = i / 0x4000;
+    }
+}
+
+void test_window(void) {
+    static uint8_t banks[4 * 0x1000];
+    for (uint32_t i = 0; i < sizeof(banks); i++) {
+        banks[i] = i / 0x1000;
+    }
+
+    struct mapper mapper;
+    mapper_init(&mapper, io, io_peek, io_poke);
+    mapper.remapped = count_remaps;
+    remaps = 0;
+    memset(io, 0, sizeof(io));
+
+    int rom = mapper_window(&mapper, 0x8000, 0x1000, banks, 4, 0);
+    int ram = mapper_window(&mapper, 0x6000, 0x1000, banks, 4, 1);
+    assert(rom == 0 && ram == 1);
+
+    const struct bus *bus = &mapper.bus;
+    assert(bus_peek(bus, 0x8000) == 0);
+    assert(bus_peek(bus, 0x1234) == 0);
+
+    mapper_select(&mapper, rom, 2);
+    assert(bus_peek(bus, 0x8000) == 2);
+    assert(bus_peek(bus, 0x8FFF) == 2);
+    assert(bus_peek(bus, 0x9000) == 0);
+    assert(remaps == 1);
+
+    // banks wrap, and reselecting costs nothing
+    mapper_select(&mapper, rom, 6);
+    assert(remaps == 1);
+
+    // ROM writes go past the banks to the devices
+    bus_poke(bus, 0x8010, 0x55);
+    assert(banks[0x2010] == 2);
+    assert(io[0x8010] == 0x55);
+
+    mapper_select(&mapper, ram, 3);
+    bus_poke(bus, 0x6010, 0xAA);
+    assert(banks[0x3010] == 0xAA);
+    assert(bus_peek(bus, 0x6010) == 0xAA);
+
+    int n = 2;
+    while (mapper_window(&mapper, 0x0000, 0x100, banks, 1, 1) >= 0) {
+        n++;
+    }
+    assert(n == MAPPER_WINDOWS);
+}
+
+void test_nrom(void) {
+    fill_prg();
+
+    struct mapper mapper;
+    const struct bus *bus = &mapper.bus;
+
+    mapper_nrom(&mapper, prg, 0x4000, io, io_peek, io_poke);
+    prg[0x3FFC] = 0x34;
+    assert(bus_peek(bus, 0x8000) == 0);
+    assert(bus_peek(bus, 0xFFFC) == 0x34);
+
+    mapper_nrom(&mapper, prg, 0x8000, io, io_peek, io_poke);
+    assert(bus_peek(bus, 0xC000) == 1);
+}
+
+void test_uxrom(void) {
+    fill_prg();
+
+    struct mapper mapper;
+    mapper_uxrom(&mapper, prg, sizeof(prg), io, io_peek, io_poke);
+    const struct bus *bus = &mapper.bus;
+
+    assert(bus_peek(bus, 0x8000) == 0);
+    assert(bus_peek(bus, 0xC000) == 7);
+
+    bus_poke(bus, 0x8000, 5);
+    assert(bus_peek(bus, 0xBFFF) == 5);
+    assert(bus_peek(bus, 0xC000) == 7);
+
+    bus_poke(bus, 0xFFFF, 2);
+    assert(bus_peek(bus, 0x8000) == 2);
+    assert(prg[0xBFFF] == 2);
+}
+
+// Loads an MMC1 register through the serial port, low bit first
+static void mmc1_load(const struct bus *bus, uint16_t addr, uint8_t value) {
+    for (int i = 0; i < 5; i++) {
+        bus_poke(bus, addr, value >> i & 1);
+    }
+}
+
+void test_mmc1(void) {
+    fill_prg();
+    static uint8_t ram[0x2000];
+
+    struct mapper mapper;
+    mapper_mmc1(&mapper, prg, sizeof(prg), ram, io, io_peek, io_poke);
+    const struct bus *bus = &mapper.bus;
+
+    // mode 3: switchable at 0x8000, last bank fixed
+    assert(bus_peek(bus, 0xC000) == 7);
+    mmc1_load(bus, 0xE000, 3);
+    assert(bus_peek(bus, 0x8000) == 3);
+    assert(bus_peek(bus, 0xC000) == 7);
+
+    // mode 2: first bank fixed, switchable at 0xC000
+    mmc1_load(bus, 0x8000, 0x08);
+    assert(mapper.mmc1.control == 0x08);
+    assert(bus_peek(bus, 0x8000) == 0);
+    assert(bus_peek(bus, 0xC000) == 3);
+
+    // mode 0: 32K, ignoring the low bit of the bank
+    mmc1_load(bus, 0x9FFF, 0x00);
+    assert(bus_peek(bus, 0x8000) == 2);
+    assert(bus_peek(bus, 0xC000) == 3);
+
+    // CHR banks are only recorded
+    mmc1_load(bus, 0xA000, 0x15);
+    mmc1_load(bus, 0xC000, 0x0A);
+    assert(mapper.mmc1.chr[0] == 0x15 && mapper.mmc1.chr[1] == 0x0A);
+
+    // a write with bit 7 set empties the port and goes back to mode 3
+    bus_poke(bus, 0x8000, 1);
+    bus_poke(bus, 0x8000, 0x80);
+    assert(mapper.mmc1.shift == 0x10);
+    assert(bus_peek(bus, 0x8000) == 3);
+    assert(bus_peek(bus, 0xC000) == 7);
+
+    // PRG RAM, and bit 4 of the PRG register to disable it
+    bus_poke(bus, 0x6000, 0x42);
+    assert(ram[0] == 0x42);
+    mmc1_load(bus, 0xE000, 0x13);
+    bus_poke(bus, 0x6000, 0x24);
+    assert(ram[0] == 0x42);
+    assert(io[0x6000] == 0x24);
+}
+
+void test_c64(void) {
+    static uint8_t ram[0x10000];
+    static uint8_t basic[0x2000], kernal[0x2000], chargen[0x1000];
+    memset(ram, 0, sizeof(ram));
+    memset(basic, 0xBA, sizeof(basic));
+    memset(kernal, 0xCE, sizeof(kernal));
+    memset(chargen, 0xC6, sizeof(chargen));
+    memset(io, 0, sizeof(io));
+
+    struct mapper mapper;
+    mapper_c64(&mapper, ram, basic, kernal, chargen, io, io_peek, io_poke);
+    const struct bus *bus = &mapper.bus;
+
+    // the port powers up as inputs, which read high
+    assert(bus_peek(bus, 0xA000) == 0xBA);
+    assert(bus_peek(bus, 0xE000) == 0xCE);
+    io[0xD020] = 0x0E;
+    assert(bus_peek(bus, 0xD020) == 0x0E);
+
+    // writes under ROM land in RAM; I/O writes reach the devices
+    bus_poke(bus, 0xA000, 0x11);
+    bus_poke(bus, 0xD021, 0x06);
+    assert(ram[0xA000] == 0x11);
+    assert(io[0xD021] == 0x06);
+    assert(bus_peek(bus, 0xA000) == 0xBA);
+
+    // the zero page is RAM whose writes the mapper sees
+    assert(bus->read[0x00] == ram && bus->write[0x00] == NULL && bus->ram[0x00]);
+
+    // as the KERNAL sets it up
+    bus_poke(bus, 0x0000, 0x2F);
+    bus_poke(bus, 0x0001, 0x37);
+    assert(bus_peek(bus, 0x0001) == 0x37);
+    assert(bus_peek(bus, 0xA000) == 0xBA);
+
+    // BASIC out
+    bus_poke(bus, 0x0001, 0x36);
+    assert(bus_peek(bus, 0xA000) == 0x11);
+    assert(bus_peek(bus, 0xE000) == 0xCE);
+
+    // character ROM in place of I/O
+    bus_poke(bus, 0x0001, 0x33);
+    assert(bus_peek(bus, 0xD000) == 0xC6);
+    assert(bus_peek(bus, 0xA000) == 0xBA);
+    bus_poke(bus, 0xD000, 0x22);
+    assert(ram[0xD000] == 0x22);
+
+    // all RAM
+    bus_poke(bus, 0x0001, 0x34);
+    assert(bus_peek(bus, 0xA000) == 0x11);
+    assert(bus_peek(bus, 0xD000) == 0x22);
+    assert(bus_peek(bus, 0xE000) == 0x00);
+
+    // back to BASIC out
+    bus_poke(bus, 0x0001, 0x36);
+    assert(bus_peek(bus, 0xA000) == 0x11);
+    assert(bus_peek(bus, 0xE000) == 0xCE);
+    assert(bus_peek(bus, 0xD020) == 0x0E);
+
+    // zero page still works
+    bus_poke(bus, 0x00FB, 0x99);
+    assert(ram[0xFB] == 0x99);
+    assert(bus_peek(bus, 0x00FB) == 0x99);
+}
+
+// A program that switches UxROM banks from the CPU and reads each one
+void test_cpu_switching(void) {
+    fill_prg();
+
+    uint8_t program[] = {
+        0xA2, 0x00,         //       LDX #0
+        0x8E, 0x00, 0x80,   // loop: STX $8000
+        0xAD, 0x00, 0x80,   //       LDA $8000
+        0x9D, 0x00, 0x02,   //       STA $0200,X
+        0xE8,               //       INX
+        0xE0, 0x08,         //       CPX #8
+        0xD0, 0xF2,         //       BNE loop
+        0x4C, 0x10, 0xC0,   // done: JMP done
+    };
+
+    memcpy(prg + 7 * 0x4000, program, sizeof(program));
+
+    static uint8_t ram[0x800];
+    memset(ram, 0, sizeof(ram));
+
+    struct mapper mapper;
+    mapper_uxrom(&mapper, prg, sizeof(prg), io, io_peek, io_poke);
+    bus_map(&mapper.bus, 0x0000, 0x800, ram);
+
+    struct cpu cpu;
+    cpu_init(&cpu, 0xC000);
+    cpu_run_fast(&cpu, &mapper.bus, 500);
+
+    assert(cpu.pc == 0xC010);
+    for (int i = 0; i < 8; i++) {
+        assert(ram[0x200 + i] == (i == 7 ? program[0] : i));
+    }
+}
+
+void test_restore(void) {
+    fill_prg();
+
+    struct mapper mapper;
+    mapper_uxrom(&mapper, prg, sizeof(prg), io, io_peek, io_poke);
+    struct mapper saved = mapper;
+
+    mapper.remapped = count_remaps;
+    remaps = 0;
+
+    bus_poke(&mapper.bus, 0x8000, 3);
+    assert(bus_peek(&mapper.bus, 0x8000) == 3);
+    assert(remaps == 1);
+
+    // the bank goes back, and the callback stays
+    mapper_restore(&mapper, &saved);
+    assert(bus_peek(&mapper.bus, 0x8000) == 0);
+    assert(bus_peek(&mapper.bus, 0xC000) == 7);
+    assert(mapper.remapped == count_remaps);
+    assert(remaps == 2);
+
+    mapper_restore(&mapper, &saved);
+    assert(remaps == 2);
+
+    bus_poke(&mapper.bus, 0x8000, 5);
+    assert(bus_peek(&mapper.bus, 0x8000) == 5);
+}
+
+int main(void) {
+    TEST_INIT();
+
+    TEST(test_window);
+    TEST(test_nrom);
+    TEST(test_uxrom);
+    TEST(test_mmc1);
+    TEST(test_c64);
+    TEST(test_cpu_switching);
+    TEST(test_restore);
+
+    return 0;
+}
@@ -0,0 +1,198 @@
+#include <stdlib.h>
+
+#include "test.h"
+#include "mapper.h"
+#include "snapshot.h"
+
+#define REFS 256
+
+static uint8_t memory[0x10000];
+static struct snapshot refs[REFS];
+
+// RAM below F000 and the loop in ROM
+static void load(struct bus *bus, struct cpu *cpu) {
+    test_load_loop(memory, bus);
+    bus_map_rom(bus, 0xF000, 0x1000, memory + 0xF000);
+
+    cpu_init(cpu, 0xF000);
+}
+
+static void assert_state(const struct cpu *cpu, const struct snapshot *ref) {
+    assert(cpu->pc == ref->cpu.pc && cpu->a == ref->cpu.a && cpu->x == ref->cpu.x && cpu->y == ref->cpu.y);
+    assert(cpu->sp == ref->cpu.sp && cpu_get_p(cpu) == cpu_get_p(&ref->cpu));
+    assert(memcmp(memory, ref->pages, 0xF000) == 0);
+}
+
+// Runs a slice, with the host writing somewhere too
+static void run(struct cpu *cpu, const struct bus *bus) {
+    cpu_run_fast(cpu, bus, 1000 + rand() % 1000);
+    memory[(3 + rand() % 0xE0) << 8 | (rand() & 0xFF)] = rand();
+}
+
+void test_snapshot(void) {
+    struct bus bus;
+    struct cpu cpu;
+    load(&bus, &cpu);
+
+    run(&cpu, &bus);
+    snapshot_save(&refs[0], &cpu, &bus);
+    assert(refs[0].saved[0x00] && refs[0].saved[0xEF] && refs[0].saved[0xF0]);
+
+    run(&cpu, &bus);
+    memory[0x0300] = 0x55;
+    assert(memcmp(memory, refs[0].pages, 0xF000) != 0);
+
+    // the host's idle skipping stays
+    static struct cpu_idle idle;
+    cpu.idle = &idle;
+
+    snapshot_restore(&refs[0], &cpu, &bus);
+    assert_state(&cpu, &refs[0]);
+    assert(cpu.idle == &idle);
+    assert(memory[0xF000] == test_loop[0]);
+}
+
+// Pushes, checking each rewind against a full snapshot taken at each push
+static void check_ring(size_t budget, unsigned capacity, int pushes) {
+    struct bus bus;
+    struct cpu cpu;
+    load(&bus, &cpu);
+
+    struct snapshot_ring *ring = snapshot_ring_new(budget, capacity);
+    assert(ring != NULL);
+
+    int pushed = 0;
+    for (int round = 0; round < 4; round++) {
+        for (int i = 0; i < pushes; i++) {
+            snapshot_ring_push(ring, &cpu, &bus, pushed);
+            snapshot_save(&refs[pushed % REFS], &cpu, &bus);
+            pushed++;
+            run(&cpu, &bus);
+        }
+
+        unsigned count = snapshot_ring_count(ring);
+        assert(count > 1 && count <= capacity && count <= REFS);
+        assert(snapshot_ring_stamp(ring, 0) == (uint64_t)pushed - 1);
+
+        // the oldest, then somewhere between, then the latest
+        unsigned backs[] = { count - 1, (count - 1) / 2, 0 };
+        unsigned back = backs[round % 3];
+        int stamp = pushed - 1 - back;
+
+        assert(snapshot_ring_find(ring, stamp) == (int)back);
+        assert(snapshot_ring_rewind(ring, back, &cpu, &bus) == 0);
+        assert_state(&cpu, &refs[stamp % REFS]);
+        assert(snapshot_ring_count(ring) == count - back);
+
+        // and on from there
+        pushed = stamp + 1;
+        run(&cpu, &bus);
+    }
+
+    assert(snapshot_ring_rewind(ring, snapshot_ring_count(ring), &cpu, &bus) == -1);
+    snapshot_ring_free(ring);
+}
+
+void test_ring(void) {
+    srand(1);
+
+    // held back by the count
+    check_ring(1 << 20, 64, 200);
+
+    // held back by the budget: each push changes the stack, the loop's page
+    // and the host's page, so 64K holds about 85
+    check_ring(1 << 16, 1000, 200);
+
+    assert(snapshot_ring_new(1 << 15, 10) == NULL);
+}
+
+// The C64's zero page is only mapped for reading, and the port in it lays
+// out the banks the mapper is restored to
+void test_mapper(void) {
+    static uint8_t basic[0x2000], kernal[0x2000], chargen[0x1000];
+    memset(memory, 0, sizeof(memory));
+    memset(basic, 0xBA, sizeof(basic));
+    memset(kernal, 0x4C, sizeof(kernal));
+    memset(chargen, 0xC6, sizeof(chargen));
+
+    struct mapper mapper;
+    mapper_c64(&mapper, memory, basic, kernal, chargen, NULL, test_zero_peek, test_ignore_poke);
+    const struct bus *bus = &mapper.bus;
+    bus_poke(bus, 0x0000, 0x2F);
+    bus_poke(bus, 0x0001, 0x37);
+    bus_poke(bus, 0x0010, 0x11);
+    bus_poke(bus, 0xA000, 0x22);
+
+    struct cpu cpu;
+    cpu_init(&cpu, 0xE000);
+    struct mapper saved = mapper;
+    struct snapshot *snapshot = &refs[0];
+    snapshot_save(snapshot, &cpu, bus);
+
+    struct snapshot_ring *ring = snapshot_ring_new(0x10000, 4);
+    assert(ring != NULL);
+    snapshot_ring_push(ring, &cpu, bus, 0);
+
+    for (int round = 0; round < 2; round++) {
+        // BASIC out, and the zero page and the RAM under BASIC written
+        bus_poke(bus, 0x0010, 0x99);
+        bus_poke(bus, 0x0001, 0x36);
+        bus_poke(bus, 0xA000, 0x33);
+        assert(bus_peek(bus, 0xA000) == 0x33);
+        snapshot_ring_push(ring, &cpu, bus, 1);
+
+        mapper_restore(&mapper, &saved);
+        if (round == 0) {
+            snapshot_restore(snapshot, &cpu, bus);
+        } else {
+            assert(snapshot_ring_rewind(ring, snapshot_ring_find(ring, 0), &cpu, bus) == 0);
+        }
+
+        assert(bus_peek(bus, 0x0010) == 0x11 && bus_peek(bus, 0x0001) == 0x37);
+        assert(bus_peek(bus, 0xA000) == 0xBA && memory[0xA000] == 0x22);
+        assert(bus_peek(bus, 0xE000) == 0x4C);
+        assert(basic[0] == 0xBA && kernal[0] == 0x4C);
+
+        // and the port goes on switching from there
+        bus_poke(bus, 0x0001, 0x36);
+        assert(bus_peek(bus, 0xA000) == 0x22);
+        bus_poke(bus, 0x0001, 0x37);
+    }
+
+    snapshot_ring_free(ring);
+
+    // ROM banks switched in since are never written over
+    static uint8_t prg[4 * 0x4000];
+    for (uint32_t i = 0; i < sizeof(prg); i++) {
+        prg[i] = i / 0x4000;
+    }
+
+    mapper_uxrom(&mapper, prg, sizeof(prg), NULL, test_zero_peek, test_ignore_poke);
+    bus_map(&mapper.bus, 0x0000, 0x0800, memory);
+    ring = snapshot_ring_new(0x10000, 4);
+    assert(ring != NULL);
+    snapshot_save(snapshot, &cpu, bus);
+    snapshot_ring_push(ring, &cpu, bus, 0);
+
+    bus_poke(bus, 0x8000, 2);
+    snapshot_ring_push(ring, &cpu, bus, 1);
+    snapshot_restore(snapshot, &cpu, bus);
+    assert(snapshot_ring_rewind(ring, 1, &cpu, bus) == 0);
+
+    assert(bus_peek(bus, 0x8000) == 2);
+    for (uint32_t i = 0; i < sizeof(prg); i++) {
+        assert(prg[i] == i / 0x4000);
+    }
+
+    snapshot_ring_free(ring);
+}
+
+int main(void) {
+    TEST_INIT();
+
+    TEST(test_snapshot);
+    TEST(test_ring);
+    TEST(test_mapper);
+
+    return 0;
+}
@@ -60,3 +60,30 @@ void test_load_rom(const uint8_t *data, uint16_t data_n) {
 const struct bus * test_bus(void) {
     return &_bus;
 }
+
+const uint8_t test_loop[23] = {
+    0xA2, 0x00, 0x8A, 0x9D, 0x00, 0x02, 0x20, 0x10, 0xF0, 0xE8, 0xD0, 0xF6, 0xC8, 0x4C, 0x02, 0xF0,
+    0x48, 0x7D, 0x00, 0x02, 0x68, 0x60, 0x40,
+};
+
+void test_load_loop(uint8_t *mem, struct bus *bus) {
+    memset(mem, 0, 0x10000);
+    memcpy(mem + 0xF000, test_loop, sizeof(test_loop));
+    mem[0xFFFA] = 0x16;
+    mem[0xFFFB] = 0xF0;
+
+    *bus = (struct bus){ .peek = test_zero_peek, .poke = test_ignore_poke };
+    bus_map(bus, 0x0000, 0x10000, mem);
+}
+
+uint8_t test_zero_peek(void *inst, uint16_t addr) {
+    (void)inst;
+    (void)addr;
+    return 0;
+}
+
+void test_ignore_poke(void *inst, uint16_t addr, uint8_t data) {
+    (void)inst;
+    (void)addr;
+    (void)data;
+}
@@ -17,6 +17,32 @@ void test_load_rom(const uint8_t *data, uint16_t data_n);
 
 const struct bus * test_bus(void);
 
+// A loop that stores, calls, pushes and branches, shared by the tests of
+// the tools that record and replay a run:
+//
+//     F000 LDX #$00
+//     F002 TXA
+//     F003 STA $0200,X
+//     F006 JSR $F010
+//     F009 INX
+//     F00A BNE $F002
+//     F00C INY
+//     F00D JMP $F002
+//     F010 PHA
+//     F011 ADC $0200,X
+//     F014 PLA
+//     F015 RTS
+//     F016 RTI             (the NMI handler)
+extern const uint8_t test_loop[23];
+
+// Clears the 64K at `mem`, puts the loop at F000 and points the NMI vector
+// at its RTI, and maps all of it as RAM on a bus with the callbacks below
+void test_load_loop(uint8_t *mem, struct bus *bus);
+
+// Callbacks for a bus with nothing behind its unmapped pages
+uint8_t test_zero_peek(void *inst, uint16_t addr);
+void test_ignore_poke(void *inst, uint16_t addr, uint8_t data);
+
 #define TEST_RAM_SIZE   0x1000
 #define TEST_RAM_OFFSET 0x0000
 #define TEST_ROM_SIZE   0x1000
@@ -0,0 +1,156 @@
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "test.h"
+#include "trace.h"
+
+static uint8_t memory[0x10000];
+static uint8_t reference[0x10000];
+
+static void temp_path(char *path) {
+    strcpy(path, "/tmp/trace_test_XXXXXX");
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+}
+
+void test_records(void) {
+    char path[32];
+    temp_path(path);
+
+    struct bus bus;
+    test_load_loop(memory, &bus);
+
+    struct cpu cpu;
+    cpu_init(&cpu, 0xF000);
+
+    struct trace *trace = trace_open(path);
+    assert(trace != NULL);
+
+    // LDX, TXA, STA, JSR, PHA, then an NMI, RTI and ADC
+    assert(trace_run(trace, &cpu, &bus, 2 + 2 + 5 + 6 + 3) == 18);
+    cpu_assert(&cpu, INTR_NMI);
+    cpu_release(&cpu, INTR_NMI);
+    assert(trace_run(trace, &cpu, &bus, 7 + 6 + 4) == 17);
+    assert(trace_close(trace) == 0);
+
+    struct trace_reader *reader = trace_reader_open(path);
+    assert(reader != NULL);
+
+    struct trace_record r;
+    assert(trace_read(reader, &r) == 1);
+    assert(r.kind == TRACE_INSTRUCTION && r.cycle == 0 && r.pc == 0xF000);
+    assert(r.opcode == 0xA2 && r.length == 2 && r.operands[0] == 0x00);
+    assert(r.cycles == 2 && r.accesses_n == 0);
+
+    assert(trace_read(reader, &r) == 1);
+    assert(r.pc == 0xF002 && r.opcode == 0x8A && r.cycle == 2);
+    assert(r.accesses_n == 1 && r.accesses[0].addr == 0xF003 && !r.accesses[0].write);
+
+    assert(trace_read(reader, &r) == 1);
+    assert(r.pc == 0xF003 && r.operands[0] == 0x00 && r.operands[1] == 0x02 && r.cycles == 5);
+    assert(r.accesses_n == 2);
+    assert(r.accesses[1].addr == 0x0200 && r.accesses[1].write && r.accesses[1].data == 0);
+
+    // the operands come either side of the pushes
+    assert(trace_read(reader, &r) == 1);
+    assert(r.opcode == 0x20 && r.operands[0] == 0x10 && r.operands[1] == 0xF0);
+    assert(r.sp == 0xFD && r.accesses_n == 3);
+    assert(r.accesses[1].addr == 0x01FF && r.accesses[1].write && r.accesses[1].data == 0xF0);
+    assert(r.accesses[2].addr == 0x01FE && r.accesses[2].write && r.accesses[2].data == 0x08);
+
+    assert(trace_read(reader, &r) == 1);
+    assert(r.pc == 0xF010 && r.opcode == 0x48 && r.sp == 0xFC);
+
+    assert(trace_read(reader, &r) == 1);
+    assert(r.kind == TRACE_ENTRY && r.pc == 0xF011 && r.cycle == 18 && r.cycles == 7);
+    assert(r.sp == 0xF9 && (r.p & P_I));
+    assert(r.accesses_n == 7 && r.accesses[5].addr == 0xFFFA);
+
+    assert(trace_read(reader, &r) == 1);
+    assert(r.pc == 0xF016 && r.opcode == 0x40 && r.sp == 0xFC);
+
+    assert(trace_read(reader, &r) == 1);
+    assert(r.pc == 0xF011 && r.opcode == 0x7D && r.cycle == 31);
+
+    assert(trace_read(reader, &r) == 0);
+    trace_reader_close(reader);
+
+    unlink(path);
+}
+
+// Long enough to fill several chunks, checked against a run without a trace
+void test_replay(void) {
+    char path[32];
+    temp_path(path);
+
+    struct bus bus;
+    struct bus reference_bus;
+    test_load_loop(memory, &bus);
+    test_load_loop(reference, &reference_bus);
+
+    struct cpu cpu;
+    struct cpu ref;
+    cpu_init(&cpu, 0xF000);
+    cpu_init(&ref, 0xF000);
+
+    struct trace *trace = trace_open(path);
+    assert(trace != NULL);
+
+    // in slices, with the host changing a register between some of them
+    uint64_t ran = 0;
+    uint64_t ends[200];
+    for (int i = 0; i < 200; i++) {
+        ran += trace_run(trace, &cpu, &bus, 10000);
+        ends[i] = ran;
+        if (i % 50 == 49) {
+            cpu.y += 0x40;
+        }
+    }
+    assert(trace_close(trace) == 0);
+
+    struct trace_reader *reader = trace_reader_open(path);
+    assert(reader != NULL);
+
+    struct trace_record r;
+    uint64_t cycle = 0;
+    uint64_t records = 0;
+    int i = 0;
+
+    while (trace_read(reader, &r) == 1) {
+        assert(r.pc == ref.pc && r.cycle == cycle);
+
+        cycle += cpu_step_fast(&ref, &reference_bus);
+        assert(r.cycles == cycle - r.cycle);
+        assert(r.a == ref.a && r.x == ref.x && r.y == ref.y && r.sp == ref.sp && r.p == cpu_get_p(&ref));
+
+        // the host's change lands where it did in the traced run
+        if (i < 200 && cycle == ends[i]) {
+            if (i % 50 == 49) {
+                ref.y += 0x40;
+            }
+            i++;
+        }
+
+        records++;
+    }
+
+    assert(cycle == ran);
+    assert(records > 100000);
+    assert(memcmp(memory, reference, sizeof(memory)) == 0);
+
+    trace_reader_close(reader);
+    unlink(path);
+
+    // not a trace
+    assert(trace_reader_open("./test/6502_functional_test/6502_functional_test.bin") == NULL);
+}
+
+int main(void) {
+    TEST_INIT();
+
+    TEST(test_records);
+    TEST(test_replay);
+
+    return 0;
+}
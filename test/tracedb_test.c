@@ -0,0 +1,220 @@
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "test.h"
+#include "tracedb.h"
+
+#define CYCLES 300000
+
+static uint8_t memory[0x10000];
+static uint8_t reference[0x10000];
+static uint8_t rebuilt[0x10000];
+static uint8_t known[0x10000];
+
+static void temp_path(char *path) {
+    strcpy(path, "/tmp/tracedb_test_XXXXXX");
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+}
+
+static char trace_path[32];
+static char db_path[32];
+
+// Records the loop, with an NMI every 20000 cycles, and indexes it
+static void record(void) {
+    temp_path(trace_path);
+    temp_path(db_path);
+
+    struct bus bus;
+    test_load_loop(memory, &bus);
+
+    struct cpu cpu;
+    cpu_init(&cpu, 0xF000);
+
+    struct trace *trace = trace_open(trace_path);
+    assert(trace != NULL);
+
+    uint64_t ran = 0;
+    while (ran < CYCLES) {
+        ran += trace_run(trace, &cpu, &bus, 20000);
+        cpu_assert(&cpu, INTR_NMI);
+        cpu_release(&cpu, INTR_NMI);
+    }
+
+    assert(trace_close(trace) == 0);
+    assert(tracedb_build(trace_path, db_path) == 0);
+}
+
+static void forget(void) {
+    unlink(db_path);
+    unlink(trace_path);
+}
+
+// Checks the queries against a scan of the whole trace
+void test_queries(void) {
+    record();
+
+    struct tracedb *db = tracedb_open(db_path, trace_path);
+    assert(db != NULL);
+    assert(tracedb_cycles(db) >= CYCLES);
+
+    static const uint16_t addrs[] = { 0x0200, 0x0201, 0x02FF, 0x01FF, 0x01FC, 0xFFFA, 0x0300 };
+    static const uint64_t cycles[] = { 0, 1, 5000, 123457, 250000, UINT64_MAX };
+
+    for (size_t a = 0; a < sizeof(addrs) / sizeof(addrs[0]); a++) {
+        for (size_t c = 0; c < sizeof(cycles) / sizeof(cycles[0]); c++) {
+            struct trace_reader *reader = trace_reader_open(trace_path);
+            assert(reader != NULL);
+
+            struct trace_record r;
+            struct trace_record last;
+            int found = 0;
+            uint64_t records = 0;
+
+            while (trace_read(reader, &r) == 1) {
+                records++;
+                for (int i = 0; i < r.accesses_n; i++) {
+                    if (r.accesses[i].write && r.accesses[i].addr == addrs[a] && r.cycle < cycles[c]) {
+                        last = r;
+                        last.accesses[0] = r.accesses[i];
+                        found = 1;
+                    }
+                }
+            }
+            trace_reader_close(reader);
+            assert(records == tracedb_records(db));
+
+            struct tracedb_access access;
+            assert(tracedb_last_write(db, addrs[a], cycles[c], &access) == found);
+            if (found) {
+                assert(access.cycle == last.cycle && access.pc == last.pc && access.opcode == last.opcode);
+                assert(access.addr == addrs[a] && access.data == last.accesses[0].data && access.write);
+            }
+        }
+    }
+
+    // the stack page over a window, against a count from the trace
+    struct trace_reader *reader = trace_reader_open(trace_path);
+    struct trace_record r;
+    uint64_t reads = 0;
+    uint64_t writes = 0;
+    uint64_t entries = 0;
+
+    while (trace_read(reader, &r) == 1) {
+        entries += r.kind == TRACE_ENTRY;
+        for (int i = 0; i < r.accesses_n; i++) {
+            if (r.accesses[i].addr >> 8 == 0x01 && r.cycle >= 40000 && r.cycle < 60000) {
+                (r.accesses[i].write ? &writes : &reads)[0]++;
+            }
+        }
+    }
+    trace_reader_close(reader);
+
+    assert(reads > 0 && writes > 0);
+    assert(tracedb_accesses(db, 0x0100, 0x01FF, 40000, 60000, TRACEDB_READS, NULL, NULL) == reads);
+    assert(tracedb_accesses(db, 0x0100, 0x01FF, 40000, 60000, TRACEDB_WRITES, NULL, NULL) == writes);
+    assert(tracedb_accesses(db, 0x0100, 0x01FF, 40000, 60000, TRACEDB_READS | TRACEDB_WRITES, NULL, NULL) ==
+        reads + writes);
+
+    // each NMI entry reads the vector
+    assert(entries >= CYCLES / 20000 - 1);
+    assert(tracedb_accesses(db, 0xFFFA, 0xFFFB, 0, UINT64_MAX, TRACEDB_READS, NULL, NULL) == 2 * entries);
+
+    tracedb_close(db);
+
+    // not the trace it was built from
+    char other[32];
+    temp_path(other);
+    struct trace *trace = trace_open(other);
+    assert(trace != NULL && trace_close(trace) == 0);
+    assert(tracedb_open(db_path, other) == NULL);
+    unlink(other);
+
+    forget();
+}
+
+// Runs the same slices and NMIs without a trace, up to the instruction
+// running at `cycle`, leaving memory in `reference`
+static void run_before(uint64_t cycle, struct cpu *cpu) {
+    struct bus bus;
+    uint64_t steps = UINT64_MAX;
+
+    // once to find the instruction, and again to stop before it
+    for (int pass = 0; pass < 2; pass++) {
+        test_load_loop(reference, &bus);
+        cpu_init(cpu, 0xF000);
+
+        uint64_t ran = 0;
+        uint64_t slice_end = 20000;
+
+        for (uint64_t i = 0; i < steps; i++) {
+            if (ran >= slice_end) {
+                cpu_assert(cpu, INTR_NMI);
+                cpu_release(cpu, INTR_NMI);
+                slice_end = ran + 20000;
+            }
+
+            ran += cpu_step_fast(cpu, &bus);
+            if (pass == 0 && ran > cycle) {
+                steps = i;
+                break;
+            }
+        }
+    }
+}
+
+// Rebuilds the state at a few cycles and checks it against a run without a
+// trace
+void test_state(void) {
+    record();
+
+    struct tracedb *db = tracedb_open(db_path, trace_path);
+    assert(db != NULL);
+
+    static const uint64_t cycles[] = { 0, 3, 19999, 20000, 20003, 77777, 199999, CYCLES - 1 };
+
+    for (size_t c = 0; c < sizeof(cycles) / sizeof(cycles[0]); c++) {
+        struct cpu before;
+        run_before(cycles[c], &before);
+
+        struct cpu cpu;
+        assert(tracedb_state(db, cycles[c], &cpu, rebuilt, known) == 1);
+        assert(cpu.pc == before.pc && cpu.a == before.a && cpu.x == before.x && cpu.y == before.y && cpu.sp == before.sp);
+        assert(cpu_get_p(&cpu) == cpu_get_p(&before));
+
+        // an NMI's entry starts where the interrupted instruction would have
+        struct trace_record record;
+        assert(tracedb_record(db, cycles[c], &record) == 1);
+        assert(record.cycle <= cycles[c] && record.cycle + record.cycles > cycles[c]);
+        assert(cpu.pc == record.pc);
+
+        for (int addr = 0; addr < 0x10000; addr++) {
+            if (known[addr]) {
+                assert(rebuilt[addr] == reference[addr]);
+            }
+        }
+
+        // once the loop has been round, the page it stores to is known
+        if (cycles[c] > 20000) {
+            for (int addr = 0x0200; addr < 0x0300; addr++) {
+                assert(known[addr]);
+            }
+        }
+    }
+
+    struct cpu cpu;
+    assert(tracedb_state(db, tracedb_cycles(db), &cpu, NULL, NULL) == 0);
+
+    tracedb_close(db);
+    forget();
+}
+
+int main(void) {
+    TEST_INIT();
+
+    TEST(test_queries);
+    TEST(test_state);
+
+    return 0;
+}
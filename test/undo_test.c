@@ -0,0 +1,124 @@
+#include <stdlib.h>
+
+#include "test.h"
+#include "undo.h"
+
+#define STEPS 2000
+
+static uint8_t memory[0x10000];
+
+// RAM as it was before each step, and the CPU
+static uint8_t rams[STEPS][0x400];
+static struct cpu cpus[STEPS];
+
+static void assert_cpu(const struct cpu *cpu, const struct cpu *ref) {
+    assert(cpu->pc == ref->pc && cpu->a == ref->a && cpu->x == ref->x && cpu->y == ref->y);
+    assert(cpu->sp == ref->sp && cpu_get_p(cpu) == cpu_get_p(ref) && cpu->intr == ref->intr);
+}
+
+void test_step_back(void) {
+    struct bus bus;
+    struct cpu cpu;
+    test_load_loop(memory, &bus);
+    cpu_init(&cpu, 0xF000);
+
+    struct undo *undo = undo_new(1 << 20);
+    assert(undo != NULL);
+
+    // one instruction at a time, with an NMI now and then
+    for (int i = 0; i < STEPS; i++) {
+        memcpy(rams[i], memory, sizeof(rams[i]));
+        cpus[i] = cpu;
+
+        assert(undo_run(undo, &cpu, &bus, 1).reason == CPU_STOP_BUDGET);
+        if (i % 300 == 299) {
+            cpu_assert(&cpu, INTR_NMI);
+            cpu_release(&cpu, INTR_NMI);
+        }
+    }
+    assert(undo_depth(undo) == STEPS);
+
+    // and back, which goes through the NMI entries and RTIs
+    for (int i = STEPS - 1; i >= 0; i--) {
+        assert(undo_step_back(undo, &cpu, &bus) > 0);
+        assert_cpu(&cpu, &cpus[i]);
+        assert(memcmp(memory, rams[i], sizeof(rams[i])) == 0);
+    }
+    assert(undo_step_back(undo, &cpu, &bus) == 0);
+
+    // and forwards again the same way, up to the first NMI
+    for (int i = 0; i < 300; i++) {
+        assert_cpu(&cpu, &cpus[i]);
+        undo_run(undo, &cpu, &bus, 1);
+    }
+
+    // the host moving the CPU clears it
+    cpu.pc = 0xF000;
+    assert(undo_step_back(undo, &cpu, &bus) == 0);
+
+    undo_free(undo);
+}
+
+void test_run_back(void) {
+    struct bus bus;
+    struct cpu cpu;
+    test_load_loop(memory, &bus);
+    cpu_init(&cpu, 0xF000);
+
+    struct undo *undo = undo_new(1 << 20);
+    struct cpu_watch watch;
+    cpu_watch_init(&watch);
+    cpu.watch = &watch;
+
+    struct cpu_result result = undo_run(undo, &cpu, &bus, 100000);
+    assert(result.reason == CPU_STOP_BUDGET && result.cycles >= 100000);
+
+    // back to the last STA $0200,X that wrote $0280
+    cpu_watch_set(&watch, WATCH_WRITE, 0x0280, 1, 1);
+    result = undo_run_back(undo, &cpu, &bus, UINT64_MAX);
+    assert(result.reason == CPU_STOP_WRITE && watch.reason == CPU_STOP_WRITE);
+    assert(watch.addr == 0x0280 && watch.data == 0x80);
+    assert(cpu.pc == 0xF003 && cpu.x == 0x80);
+    uint8_t y = cpu.y;
+
+    // the write hasn't happened yet: the one before it wrote the same
+    assert(memory[0x0280] == 0x80);
+
+    // forwards, the watch stops after it
+    result = undo_run(undo, &cpu, &bus, UINT64_MAX);
+    assert(result.reason == CPU_STOP_WRITE && result.cycles == 5 && cpu.pc == 0xF006);
+    cpu_watch_set(&watch, WATCH_WRITE, 0x0280, 1, 0);
+
+    // back to the last INY, past the breakpoint at the start
+    cpu_watch_set(&watch, WATCH_EXEC, 0xF00C, 1, 1);
+    result = undo_run_back(undo, &cpu, &bus, UINT64_MAX);
+    assert(result.reason == CPU_STOP_BREAK && watch.addr == 0xF00C);
+    assert(cpu.pc == 0xF00C && cpu.x == 0x00 && cpu.y == (uint8_t)(y - 1));
+
+    // and on again, ignoring it to start
+    result = undo_run(undo, &cpu, &bus, 100);
+    assert(result.reason == CPU_STOP_BUDGET && cpu.y == y);
+
+    // a budget of a few entries
+    undo_free(undo);
+    undo = undo_new(100);
+    assert(undo != NULL);
+    undo_run(undo, &cpu, &bus, 1000);
+    assert(undo_depth(undo) > 0 && undo_depth(undo) < 10);
+
+    size_t depth = undo_depth(undo);
+    result = undo_run_back(undo, &cpu, &bus, UINT64_MAX);
+    assert(result.reason == CPU_STOP_BUDGET && undo_depth(undo) == 0 && result.cycles >= 2 * depth);
+
+    undo_free(undo);
+    assert(undo_new(4) == NULL);
+}
+
+int main(void) {
+    TEST_INIT();
+
+    TEST(test_step_back);
+    TEST(test_run_back);
+
+    return 0;
+}
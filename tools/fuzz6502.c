@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bus.h"
+#include "cpu.h"
+#include "fuzz.h"
+#include "loader.h"
+
+// Fuzzes the guest code in an image with fuzz.h. Built with
+// `clang -fsanitize=fuzzer` it is a libFuzzer target whose edge map is
+// libFuzzer's extra counters; built with afl-clang-fast it runs AFL's
+// persistent loop over AFL's map; built plainly it runs each file it is
+// given, or stdin, and says how the run ended, to replay crashes.
+//
+// It is set up from the environment:
+//   FUZZ_IMAGE   the image, loaded into 64K of RAM (required)
+//   FUZZ_READY   boot from reset until this PC and fork there; else fork at reset
+//   FUZZ_EXIT    PCs a run ends well at, separated by commas
+//   FUZZ_INPUT   addr:size to write the input to
+//   FUZZ_LENGTH  addr to write its length to, 2 bytes
+//   FUZZ_PORT    addr whose reads return the input a byte at a time
+//   FUZZ_CYCLES  cycles before a run times out, 1000000 by default
+//
+// A run that crashes aborts, so the fuzzer keeps its input. One that runs
+// out of cycles only returns: hangs are for the fuzzer's own -timeout.
+
+#ifdef FUZZ_LIBFUZZER
+__attribute__((section("__libfuzzer_extra_counters")))
+#endif
+static uint8_t counters[FUZZ_MAP];
+
+static uint8_t memory[0x10000];
+static struct fuzz *fuzz;
+
+static const char *names[] = {
+    [FUZZ_OK] = "ok",
+    [FUZZ_TIMEOUT] = "timeout",
+    [FUZZ_TRAP] = "trap",
+    [FUZZ_JAM] = "jam",
+    [FUZZ_WATCH] = "watch",
+};
+
+static void fail(const char *message) {
+    fprintf(stderr, "fuzz6502: %s\n", message);
+    exit(1);
+}
+
+// The rest of the port's page reads 0 and ignores writes
+static uint8_t open_peek(void *inst, uint16_t addr) {
+    (void)inst;
+    (void)addr;
+    return 0;
+}
+
+static void open_poke(void *inst, uint16_t addr, uint8_t data) {
+    (void)inst;
+    (void)addr;
+    (void)data;
+}
+
+// Parses the variable as a number, returns 0 if it isn't set
+static int env(const char *name, unsigned long *value) {
+    const char *s = getenv(name);
+    if (s == NULL || *s == 0) {
+        return 0;
+    }
+
+    char *end;
+    *value = strtoul(s, &end, 0);
+    if (*end != 0) {
+        fprintf(stderr, "fuzz6502: bad %s\n", name);
+        exit(1);
+    }
+    return 1;
+}
+
+int LLVMFuzzerInitialize(int *argc, char ***argv) {
+    (void)argc;
+    (void)argv;
+
+    const char *path = getenv("FUZZ_IMAGE");
+    if (path == NULL) {
+        fail("FUZZ_IMAGE isn't set");
+    }
+
+    struct image image;
+    if (image_open(&image, path, IMAGE_AUTO) != 0) {
+        fail("unable to load FUZZ_IMAGE");
+    }
+    image_copy(&image, memory);
+    uint16_t reset = image.reset;
+    image_close(&image);
+
+    struct fuzz_config config = { .max_cycles = 1000000 };
+    unsigned long value;
+
+    const char *input = getenv("FUZZ_INPUT");
+    if (input != NULL) {
+        char *end;
+        config.input_addr = strtoul(input, &end, 0);
+        if (*end != ':') {
+            fail("FUZZ_INPUT isn't addr:size");
+        }
+        config.input_size = strtoul(end + 1, NULL, 0);
+    }
+    if (env("FUZZ_LENGTH", &value)) {
+        config.length = 1;
+        config.length_addr = value;
+    }
+    if (env("FUZZ_PORT", &value)) {
+        config.port = 1;
+        config.port_addr = value;
+    }
+    if (env("FUZZ_CYCLES", &value)) {
+        config.max_cycles = value;
+    }
+
+    // RAM everywhere but the port's page
+    struct bus bus = { .peek = open_peek, .poke = open_poke };
+    bus_map(&bus, 0x0000, 0x10000, memory);
+    if (config.port) {
+        bus_unmap(&bus, config.port_addr & 0xFF00, 0x100);
+    }
+
+    struct cpu cpu;
+    cpu_init(&cpu, reset);
+
+    if (env("FUZZ_READY", &value)) {
+        static struct cpu_watch ready;
+        cpu_watch_init(&ready);
+        cpu_watch_set(&ready, WATCH_EXEC, value, 1, 1);
+        cpu.watch = &ready;
+
+        struct cpu_result result = cpu_run(&cpu, &bus, 1000000000);
+        if (result.reason != CPU_STOP_BREAK) {
+            fail("the image didn't reach FUZZ_READY");
+        }
+        cpu.watch = NULL;
+    }
+
+    fuzz = fuzz_new(&cpu, &bus, &config);
+    if (fuzz == NULL) {
+        fail("unable to fork the machine");
+    }
+    fuzz->map = counters;
+
+    const char *exits = getenv("FUZZ_EXIT");
+    while (exits != NULL && *exits != 0) {
+        char *end;
+        fuzz_exit(fuzz, strtoul(exits, &end, 0), 1);
+        exits = *end == ',' ? end + 1 : end;
+        if (*end != ',' && *end != 0) {
+            fail("bad FUZZ_EXIT");
+        }
+    }
+
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    enum fuzz_result result = fuzz_run(fuzz, data, size);
+
+    if (FUZZ_CRASHED(result)) {
+        fprintf(stderr, "fuzz6502: %s at $%04X after %llu cycles\n", names[result],
+            fuzz->child->cpu.pc, (unsigned long long)fuzz->cycles);
+        abort();
+    }
+
+    return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+
+#ifdef __AFL_HAVE_MANUAL_CONTROL
+__AFL_FUZZ_INIT();
+extern uint8_t *__afl_area_ptr;
+#endif
+
+static uint8_t buffer[0x10000];
+
+// Runs one input without aborting, for replaying
+static void replay(const char *name, FILE *file) {
+    size_t size = fread(buffer, 1, sizeof(buffer), file);
+    enum fuzz_result result = fuzz_run(fuzz, buffer, size);
+
+    printf("%s: %s at $%04X after %llu cycles\n", name, names[result],
+        fuzz->child->cpu.pc, (unsigned long long)fuzz->cycles);
+}
+
+int main(int argc, char *argv[]) {
+    LLVMFuzzerInitialize(&argc, &argv);
+
+#ifdef __AFL_HAVE_MANUAL_CONTROL
+    __AFL_INIT();
+    const uint8_t *data = __AFL_FUZZ_TESTCASE_BUF;
+    while (__AFL_LOOP(100000)) {
+        fuzz->map = __afl_area_ptr;
+        LLVMFuzzerTestOneInput(data, __AFL_FUZZ_TESTCASE_LEN);
+    }
+    return 0;
+#endif
+
+    if (argc < 2) {
+        replay("stdin", stdin);
+    }
+
+    for (int i = 1; i < argc; i++) {
+        FILE *file = fopen(argv[i], "rb");
+        if (file == NULL) {
+            fprintf(stderr, "fuzz6502: unable to open %s\n", argv[i]);
+            return 1;
+        }
+        replay(argv[i], file);
+        fclose(file);
+    }
+
+    return 0;
+}
+
+#endif
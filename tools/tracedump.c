@@ -0,0 +1,164 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "trace.h"
+
+// Prints a trace written by trace_run() as one line per record: the cycle,
+// PC, bytes, disassembly, registers after it and its bus accesses. Build it
+// with the same CPU_* defines as the core that wrote the trace.
+
+static const struct {
+    const char *proc;
+    const char *action;
+} ops[256] = {
+#define OP(opc, p, a, t) [opc] = { #p, #a },
+#include "opcodes.def"
+#undef OP
+};
+
+// The procedure or action name up to any '_', in upper case
+static void mnemonic(uint8_t opc, char *out) {
+    const char *proc = ops[opc].proc;
+    const char *action = ops[opc].action;
+    const char *name;
+
+    if (strcmp(proc, "illegal") == 0) {
+        name = "???";
+    } else if (strcmp(proc, "nop1") == 0) {
+        name = "nop";
+    } else if (strcmp(proc, "phr") == 0 || strcmp(proc, "plr") == 0) {
+        // PHX, PHY, PLX and PLY take the register from their STx or LDx action
+        out[0] = 'P';
+        out[1] = toupper((unsigned char)proc[1]);
+        out[2] = toupper((unsigned char)action[2]);
+        out[3] = 0;
+        return;
+    } else if (strcmp(action, "NULL") != 0) {
+        name = action;
+    } else {
+        name = proc;
+    }
+
+    int i = 0;
+    for (; name[i] && name[i] != '_'; i++) {
+        out[i] = toupper((unsigned char)name[i]);
+    }
+    out[i] = 0;
+}
+
+static void disassemble(const struct trace_record *r, char *out, size_t size) {
+    char name[8];
+    mnemonic(r->opcode, name);
+
+    const char *proc = ops[r->opcode].proc;
+    uint8_t lo = r->operands[0];
+    uint16_t word = r->operands[0] | r->operands[1] << 8;
+
+    if (strcmp(proc, "imm") == 0) {
+        snprintf(out, size, "%s #$%02X", name, lo);
+    } else if (strcmp(proc, "zpg") == 0) {
+        snprintf(out, size, "%s $%02X", name, lo);
+    } else if (strcmp(proc, "zpx") == 0) {
+        snprintf(out, size, "%s $%02X,X", name, lo);
+    } else if (strcmp(proc, "zpy") == 0) {
+        snprintf(out, size, "%s $%02X,Y", name, lo);
+    } else if (strcmp(proc, "idx") == 0) {
+        snprintf(out, size, "%s ($%02X,X)", name, lo);
+    } else if (strcmp(proc, "idy") == 0) {
+        snprintf(out, size, "%s ($%02X),Y", name, lo);
+    } else if (strcmp(proc, "zpi") == 0) {
+        snprintf(out, size, "%s ($%02X)", name, lo);
+    } else if (strcmp(proc, "abl") == 0 || strcmp(proc, "jsr") == 0 || strcmp(proc, "jmp_abl") == 0) {
+        snprintf(out, size, "%s $%04X", name, word);
+    } else if (strcmp(proc, "abx") == 0 || strcmp(proc, "abx_shift") == 0) {
+        snprintf(out, size, "%s $%04X,X", name, word);
+    } else if (strcmp(proc, "aby") == 0) {
+        snprintf(out, size, "%s $%04X,Y", name, word);
+    } else if (strcmp(proc, "jmp_ind") == 0) {
+        snprintf(out, size, "%s ($%04X)", name, word);
+    } else if (strcmp(proc, "jmp_iax") == 0) {
+        snprintf(out, size, "%s ($%04X,X)", name, word);
+    } else if (strcmp(proc, "rel") == 0) {
+        snprintf(out, size, "%s $%04X", name, (uint16_t)(r->pc + 2 + (int8_t)lo));
+    } else if (strcmp(proc, "acc") == 0) {
+        snprintf(out, size, "%s A", name);
+    } else {
+        snprintf(out, size, "%s", name);
+    }
+}
+
+// Which entry it was, from the vector it read
+static const char *entry_name(const struct trace_record *r) {
+    for (int i = 0; i < r->accesses_n; i++) {
+        switch (r->accesses[i].addr) {
+        case 0xFFFA:
+            return "<nmi>";
+        case 0xFFFC:
+            return "<reset>";
+        case 0xFFFE:
+            return "<irq>";
+        }
+    }
+
+    return "<entry>";
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argc > 4) {
+        printf("Usage: tracedump <trace> [first cycle [records]]\n");
+        return 1;
+    }
+
+    uint64_t first = argc > 2 ? strtoull(argv[2], NULL, 0) : 0;
+    uint64_t count = argc > 3 ? strtoull(argv[3], NULL, 0) : UINT64_MAX;
+
+    struct trace_reader *reader = trace_reader_open(argv[1]);
+    if (reader == NULL) {
+        printf("ERROR: %s is not a trace from this CPU\n", argv[1]);
+        return 1;
+    }
+
+    struct trace_record r;
+    int result = 0;
+
+    while (count > 0 && (result = trace_read(reader, &r)) == 1) {
+        if (r.cycle < first) {
+            continue;
+        }
+
+        char bytes[12] = "";
+        char text[24];
+
+        if (r.kind == TRACE_ENTRY) {
+            snprintf(text, sizeof(text), "%s", entry_name(&r));
+        } else {
+            int n = snprintf(bytes, sizeof(bytes), "%02X", r.opcode);
+            for (int i = 0; i < r.length - 1; i++) {
+                n += snprintf(bytes + n, sizeof(bytes) - n, " %02X", r.operands[i]);
+            }
+            disassemble(&r, text, sizeof(text));
+        }
+
+        printf("%12llu  %04X  %-8s  %-14s  A:%02X X:%02X Y:%02X P:%02X SP:%02X  %u",
+            (unsigned long long)r.cycle, r.pc, bytes, text, r.a, r.x, r.y, r.p, r.sp, r.cycles);
+
+        for (int i = 0; i < r.accesses_n; i++) {
+            printf(" %c:%04X=%02X", r.accesses[i].write ? 'W' : 'R', r.accesses[i].addr, r.accesses[i].data);
+        }
+        printf("\n");
+
+        count--;
+    }
+
+    trace_reader_close(reader);
+
+    if (count > 0 && result < 0) {
+        printf("ERROR: %s is corrupt\n", argv[1]);
+        return 1;
+    }
+
+    return 0;
+}